@@ -13,9 +13,11 @@
 */
 
 #include "ById.h"
+#include "EpochReclaimer.h"
 
 #include <unordered_map>
 #include <typeinfo>
+#include <atomic>
 
 //#define DEBUG_BY_ID 1
 
@@ -42,9 +44,27 @@ int IdAlloc::getNextId()
 #pragma clang diagnostic ignored "-Wpotentially-evaluated-expression"
 #endif
 
+// Items are owned by a map that is only touched with the mutex
+// held. Lookups don't take the mutex: they go to a read-only snapshot
+// of the id table, which maps ids to weak pointers and is replaced
+// wholesale (copy-on-write) whenever an item is added or released.
+//
+// A reader holds a read scope of m_reclaimer while it uses the
+// snapshot. A writer publishes its new snapshot and retires the old
+// one to m_reclaimer, which deletes it once no reader can still hold
+// it (see EpochReclaimer) - a write or two later, even if lookups
+// never stop. Retired snapshots that remain are deleted with the
+// reclaimer.
+
 class AnyById::Impl
 {
-public:    
+public:
+    typedef std::unordered_map<int, std::weak_ptr<WithId>> Snapshot;
+
+    Impl() :
+        m_snapshot(new Snapshot),
+        m_contention(0) { }
+    
     ~Impl() {
         QMutexLocker locker(&m_mutex);
         bool empty = true;
@@ -71,6 +91,9 @@ public:
                 }
             }
         }
+        SVDEBUG << "ById: contention count at close is " << m_contention
+                << endl;
+        delete m_snapshot.load();
     }
         
     int add(std::shared_ptr<WithId> item) {
@@ -82,6 +105,7 @@ public:
         SVCERR << "ById::add(#" << id << ") of type "
                << typeid(*item.get()).name() << endl;
 #endif
+        noteContention();
         QMutexLocker locker(&m_mutex);
         if (m_items.find(id) != m_items.end()) {
             SVCERR << "ById::add: item with id " << id
@@ -92,6 +116,9 @@ public:
             throw std::logic_error("item id is already recorded in add");
         }
         m_items[id] = item;
+        Snapshot *snapshot = new Snapshot(*m_snapshot.load());
+        (*snapshot)[id] = item;
+        publish(snapshot);
         return id;
     }
 
@@ -102,11 +129,15 @@ public:
 #ifdef DEBUG_BY_ID
         SVCERR << "ById::release(#" << id << ")" << endl;
 #endif
+        noteContention();
         QMutexLocker locker(&m_mutex);
         if (m_items.find(id) == m_items.end()) {
             SVCERR << "ById::release: unknown item id " << id << endl;
             throw std::logic_error("unknown item id in release");
         }
+        Snapshot *snapshot = new Snapshot(*m_snapshot.load());
+        snapshot->erase(id);
+        publish(snapshot);
         m_items.erase(id);
     }
     
@@ -114,18 +145,40 @@ public:
         if (id == IdAlloc::NO_ID) {
             return {}; // this id cannot be added: avoid locking
         }
-        QMutexLocker locker(&m_mutex);
-        const auto &itr = m_items.find(id);
-        if (itr != m_items.end()) {
-            return itr->second;
-        } else {
-            return {};
+        EpochReclaimer<Snapshot>::ReadScope scope(m_reclaimer);
+        const Snapshot *snapshot = m_snapshot.load();
+        std::shared_ptr<WithId> result;
+        const auto &itr = snapshot->find(id);
+        if (itr != snapshot->end()) {
+            result = itr->second.lock();
         }
+        return result;
+    }
+
+    int getContentionCount() const {
+        return m_contention;
     }
 
 private:
     mutable QMutex m_mutex;
     std::unordered_map<int, std::shared_ptr<WithId>> m_items;
+
+    std::atomic<Snapshot *> m_snapshot;
+    EpochReclaimer<Snapshot> m_reclaimer; // retire only with m_mutex held
+    std::atomic<int> m_contention;
+
+    void noteContention() {
+        if (m_mutex.tryLock()) {
+            m_mutex.unlock();
+        } else {
+            ++m_contention;
+        }
+    }
+
+    // Call with m_mutex held
+    void publish(Snapshot *snapshot) {
+        m_reclaimer.retire(m_snapshot.exchange(snapshot));
+    }
 };
 
 int
@@ -146,6 +199,12 @@ AnyById::get(int id)
     return impl().get(id);
 }
 
+int
+AnyById::getContentionCount()
+{
+    return impl().getContentionCount();
+}
+
 AnyById::Impl &
 AnyById::impl()
 {
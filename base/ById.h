@@ -204,6 +204,13 @@ public:
     static void release(int);
     static std::shared_ptr<WithId> get(int); 
 
+    /**
+     * Return the number of times a call to add() or release() has had
+     * to wait for another add() or release() to finish. Lookups via
+     * get() never wait, so this is for diagnostic purposes only.
+     */
+    static int getContentionCount();
+
     template <typename Derived>
     static bool isa(int id) {
         std::shared_ptr<WithId> p = get(id);
@@ -0,0 +1,162 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_EPOCH_RECLAIMER_H
+#define SV_EPOCH_RECLAIMER_H
+
+#include <atomic>
+#include <vector>
+
+/**
+ * The epoch and per-epoch reader counts of an EpochReclaimer, which
+ * are all an EpochReadScope needs to know about.
+ */
+class EpochReaders
+{
+protected:
+    EpochReaders() : m_epoch(0) {
+        m_readers[0] = 0;
+        m_readers[1] = 0;
+    }
+
+    std::atomic<unsigned int> m_epoch;
+    mutable std::atomic<int> m_readers[2];
+
+    friend class EpochReadScope;
+};
+
+/**
+ * A reader's hold on an EpochReclaimer, for as long as it exists. A
+ * default-constructed scope holds nothing. Scopes can be moved, so
+ * that an object giving access to reclaimable data can carry one.
+ */
+class EpochReadScope
+{
+public:
+    EpochReadScope() : m_count(nullptr) { }
+    EpochReadScope(const EpochReaders &readers) :
+        m_count(&readers.m_readers[readers.m_epoch.load() & 1]) {
+        ++*m_count;
+    }
+    EpochReadScope(EpochReadScope &&other) : m_count(other.m_count) {
+        other.m_count = nullptr;
+    }
+    ~EpochReadScope() {
+        if (m_count) --*m_count;
+    }
+
+private:
+    std::atomic<int> *m_count;
+
+    EpochReadScope(const EpochReadScope &) =delete;
+    EpochReadScope &operator=(const EpochReadScope &) =delete;
+    EpochReadScope &operator=(EpochReadScope &&) =delete;
+};
+
+/**
+ * Deferred deletion of objects that readers may still be using
+ * without a lock, after a writer has replaced them with new ones
+ * (e.g. a copy-on-write table published through an atomic pointer).
+ *
+ * A reader holds a ReadScope for as long as it uses anything it
+ * obtained from the published pointer. The scope counts the reader
+ * against the parity of the current epoch. A writer publishes its
+ * replacement and then retires the old object. Whenever the count
+ * for the other parity -- that of the previous epoch -- is found to
+ * be zero, every object retired before the current epoch is deleted
+ * and the epoch advances. New readers count against the new epoch,
+ * so the old count drains even while reading never stops, and
+ * objects are freed within a couple of writes rather than only when
+ * there happen to be no readers at all.
+ *
+ * Writers must be serialised by the caller (retire and reclaim are
+ * not thread-safe with respect to each other). ReadScopes may be
+ * taken from any thread at any time, and may be nested.
+ */
+template <typename T>
+class EpochReclaimer : public EpochReaders
+{
+public:
+    typedef EpochReadScope ReadScope;
+
+    EpochReclaimer() { }
+
+    ~EpochReclaimer() {
+        // No readers may remain by now
+        for (const auto &r: m_retired) delete r.object;
+    }
+
+    /**
+     * Take ownership of an object that has been replaced, and that
+     * no reader starting from now can obtain, deleting it once no
+     * reader can still be using it. Call from a writer, after the
+     * replacement has been published.
+     */
+    void retire(T *object) {
+        m_retired.push_back({ object, m_epoch.load() });
+        reclaim();
+    }
+
+    /**
+     * Delete whatever retired objects no reader can still be using.
+     * This is done by retire() as well, and only needs calling
+     * separately to free objects sooner after reads have finished.
+     */
+    void reclaim() {
+
+        // Every object retired before the current epoch was replaced
+        // before the epoch last advanced, which happened only once
+        // the count for the epoch before that had been seen to be
+        // zero. So any reader still holding one of them counts
+        // against the previous epoch: once that count is zero, none
+        // is held
+
+        unsigned int epoch = m_epoch.load();
+        if (m_readers[(epoch + 1) & 1].load() != 0) {
+            return;
+        }
+
+        auto keep = m_retired.begin();
+        for (auto i = m_retired.begin(); i != m_retired.end(); ++i) {
+            if (i->epoch == epoch) {
+                *keep++ = *i;
+            } else {
+                delete i->object;
+            }
+        }
+        m_retired.erase(keep, m_retired.end());
+
+        m_epoch.store(epoch + 1);
+    }
+
+    /**
+     * Return the number of objects retired but not yet deleted.
+     */
+    int getRetiredCount() const {
+        return int(m_retired.size());
+    }
+
+private:
+    struct Retired {
+        T *object;
+        unsigned int epoch;
+    };
+
+    std::vector<Retired> m_retired;
+
+    EpochReclaimer(const EpochReclaimer &) =delete;
+    EpochReclaimer &operator=(const EpochReclaimer &) =delete;
+};
+
+#endif
@@ -20,6 +20,7 @@
 #include "NoteData.h"
 #include "XmlExportable.h"
 #include "DataExportOptions.h"
+#include "NumberFormat.h"
 
 #include <vector>
 #include <stdexcept>
@@ -296,34 +297,54 @@ public:
                QString extraAttributes = "",
                ExportNameOptions opts = ExportNameOptions()) const {
 
-        // For I/O purposes these are points, not events
-        stream << indent << QString("<point frame=\"%1\" ").arg(m_frame);
+        // For I/O purposes these are points, not events. The point
+        // is built up as a single string and written in one go, as
+        // models may have very many of them
+        QString line;
+        line.reserve(indent.size() + extraAttributes.size() +
+                     m_label.size() + m_uri.size() + 120);
+
+        line += indent;
+        line += QLatin1String("<point frame=\"");
+        NumberFormat::appendInteger(line, m_frame);
+        line += QLatin1String("\" ");
         if (m_haveValue) {
-            stream << QString("%1=\"%2\" ")
-                .arg(opts.valueAttributeName).arg(m_value);
+            line += opts.valueAttributeName;
+            line += QLatin1String("=\"");
+            NumberFormat::appendFloat(line, m_value);
+            line += QLatin1String("\" ");
         }
         if (m_haveDuration) {
-            stream << QString("duration=\"%1\" ").arg(m_duration);
+            line += QLatin1String("duration=\"");
+            NumberFormat::appendInteger(line, m_duration);
+            line += QLatin1String("\" ");
         }
         if (m_haveLevel) {
-            stream << QString("%1=\"%2\" ")
-                .arg(opts.levelAttributeName)
-                .arg(m_level);
+            line += opts.levelAttributeName;
+            line += QLatin1String("=\"");
+            NumberFormat::appendFloat(line, m_level);
+            line += QLatin1String("\" ");
         }
         if (m_haveReferenceFrame) {
-            stream << QString("referenceFrame=\"%1\" ")
-                .arg(m_referenceFrame);
+            line += QLatin1String("referenceFrame=\"");
+            NumberFormat::appendInteger(line, m_referenceFrame);
+            line += QLatin1String("\" ");
         }
 
-        stream << QString("label=\"%1\" ")
-            .arg(XmlExportable::encodeEntities(m_label));
+        line += QLatin1String("label=\"");
+        line += XmlExportable::encodeEntities(m_label);
+        line += QLatin1String("\" ");
         
         if (m_uri != QString()) {
-            stream << QString("%1=\"%2\" ")
-                .arg(opts.uriAttributeName)
-                .arg(XmlExportable::encodeEntities(m_uri));
+            line += opts.uriAttributeName;
+            line += QLatin1String("=\"");
+            line += XmlExportable::encodeEntities(m_uri);
+            line += QLatin1String("\" ");
         }
-        stream << extraAttributes << "/>\n";
+        line += extraAttributes;
+        line += QLatin1String("/>\n");
+
+        stream << line;
     }
 
     QString toXmlString(QString indent = "",
@@ -421,22 +442,23 @@ public:
     toStringExportRow(DataExportOptions opts,
                       sv_samplerate_t sampleRate) const {
         
-        QStringList list;
+        QVector<QString> list;
+        list.reserve(6);
 
         if (opts & DataExportWriteTimeInFrames) {
-            list << QString("%1").arg(m_frame);
+            list << NumberFormat::fromInteger(m_frame);
         } else {
             list << RealTime::frame2RealTime(m_frame, sampleRate)
                 .toString().c_str();
         }
         
         if (m_haveValue) {
-            list << QString("%1").arg(m_value);
+            list << NumberFormat::fromFloat(m_value);
         }
         
         if (m_haveDuration) {
             if (opts & DataExportWriteTimeInFrames) {
-                list << QString("%1").arg(m_duration);
+                list << NumberFormat::fromInteger(m_duration);
             } else {
                 list << RealTime::frame2RealTime(m_duration, sampleRate)
                     .toString().c_str();
@@ -445,7 +467,7 @@ public:
         
         if (m_haveLevel) {
             if (!(opts & DataExportOmitLevel)) {
-                list << QString("%1").arg(m_level);
+                list << NumberFormat::fromFloat(m_level);
             }
         }
 
@@ -456,7 +478,7 @@ public:
         if (m_uri != "") list << m_uri;
         if (m_label != "") list << m_label;
 
-        return list.toVector();
+        return list;
     }
     
     uint hash(uint seed = 0) const {
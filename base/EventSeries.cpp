@@ -16,9 +16,13 @@
 
 #include <QMutexLocker>
 
+#include <algorithm>
+
 using std::vector;
 using std::string;
 
+constexpr sv_frame_t EventSeries::noEnd;
+
 EventSeries::EventSeries(const EventSeries &other) :
     EventSeries(other, QMutexLocker(&other.m_mutex))
 {
@@ -26,7 +30,8 @@ EventSeries::EventSeries(const EventSeries &other) :
 
 EventSeries::EventSeries(const EventSeries &other, const QMutexLocker &) :
     m_events(other.m_events),
-    m_seams(other.m_seams),
+    m_endIndex(other.m_endIndex),
+    m_endIndexCapacity(other.m_endIndexCapacity),
     m_finalDurationlessEventFrame(other.m_finalDurationlessEventFrame)
 {
 }
@@ -36,7 +41,8 @@ EventSeries::operator=(const EventSeries &other)
 {
     QMutexLocker locker(&m_mutex), otherLocker(&other.m_mutex);
     m_events = other.m_events;
-    m_seams = other.m_seams;
+    m_endIndex = other.m_endIndex;
+    m_endIndexCapacity = other.m_endIndexCapacity;
     m_finalDurationlessEventFrame = other.m_finalDurationlessEventFrame;
     return *this;
 }
@@ -46,7 +52,9 @@ EventSeries::operator=(EventSeries &&other)
 {
     QMutexLocker locker(&m_mutex), otherLocker(&other.m_mutex);
     m_events = std::move(other.m_events);
-    m_seams = std::move(other.m_seams);
+    m_endIndex = std::move(other.m_endIndex);
+    m_endIndexCapacity = other.m_endIndexCapacity;
+    other.m_endIndexCapacity = 0;
     m_finalDurationlessEventFrame = std::move(other.m_finalDurationlessEventFrame);
     return *this;
 }
@@ -62,9 +70,7 @@ EventSeries
 EventSeries::fromEvents(const EventVector &v)
 {
     EventSeries s;
-    for (const auto &e: v) {
-        s.add(e);
-    }
+    s.addEvents(v);
     return s;
 }
 
@@ -90,45 +96,19 @@ EventSeries::add(const Event &p)
 {
     QMutexLocker locker(&m_mutex);
 
-    bool isUnique = true;
-
     auto pitr = lower_bound(m_events.begin(), m_events.end(), p);
-    if (pitr != m_events.end() && *pitr == p) {
-        isUnique = false;
-    }
+    size_t index = size_t(distance(m_events.begin(), pitr));
     m_events.insert(pitr, p);
 
     if (!p.hasDuration() && p.getFrame() > m_finalDurationlessEventFrame) {
         m_finalDurationlessEventFrame = p.getFrame();
     }
-    
-    if (p.hasDuration() && isUnique) {
-
-        const sv_frame_t frame = p.getFrame();
-        const sv_frame_t endFrame = p.getFrame() + p.getDuration();
 
-        createSeam(frame);
-        createSeam(endFrame);
-
-        // These calls must both succeed after calling createSeam above
-        const auto i0 = m_seams.find(frame);
-        const auto i1 = m_seams.find(endFrame);
-
-        for (auto i = i0; i != i1; ++i) {
-            if (i == m_seams.end()) {
-                SVCERR << "ERROR: EventSeries::add: "
-                       << "reached end of seam map"
-                       << endl;
-                break;
-            }
-            i->second.push_back(p);
-        }
-    }
+    updateEndIndex(index, m_events.size() - 1);
 
 #ifdef DEBUG_EVENT_SERIES
     std::cerr << "after add:" << std::endl;
     dumpEvents();
-    dumpSeams();
 #endif
 }
 
@@ -137,9 +117,6 @@ EventSeries::remove(const Event &p)
 {
     QMutexLocker locker(&m_mutex);
 
-    // If we are removing the last (unique) example of an event,
-    // then we also need to remove it from the seam map. If this
-    // is only one of multiple identical events, then we don't.
     bool isUnique = true;
         
     auto pitr = lower_bound(m_events.begin(), m_events.end(), p);
@@ -154,6 +131,8 @@ EventSeries::remove(const Event &p)
         }
     }
 
+    size_t index = size_t(distance(m_events.begin(), pitr));
+    size_t formerLast = m_events.size() - 1;
     m_events.erase(pitr);
 
     if (!p.hasDuration() && isUnique &&
@@ -166,85 +145,219 @@ EventSeries::remove(const Event &p)
             }
         }
     }
-    
-    if (p.hasDuration() && isUnique) {
-            
-        const sv_frame_t frame = p.getFrame();
-        const sv_frame_t endFrame = p.getFrame() + p.getDuration();
 
-        const auto i0 = m_seams.find(frame);
-        const auto i1 = m_seams.find(endFrame);
+    updateEndIndex(index, formerLast);
 
 #ifdef DEBUG_EVENT_SERIES
-        // This should be impossible if we found p in m_events above
-        if (i0 == m_seams.end() || i1 == m_seams.end()) {
-            SVCERR << "ERROR: EventSeries::remove: either frame " << frame
-                   << " or endFrame " << endFrame
-                   << " for event not found in seam map: event is "
-                   << p.toXmlString() << endl;
-        }
+    std::cerr << "after remove:" << std::endl;
+    dumpEvents();
 #endif
+}
 
-        // Remove any and all instances of p from the seam map; we
-        // are only supposed to get here if we are removing the
-        // last instance of p from the series anyway
-            
-        for (auto i = i0; i != i1; ++i) {
-            if (i == m_seams.end()) {
-                // This can happen only if we have a negative
-                // duration, which Event forbids
-                throw std::logic_error("unexpectedly reached end of map");
-            }
-            for (size_t j = 0; j < i->second.size(); ) {
-                if (i->second[j] == p) {
-                    i->second.erase(i->second.begin() + j);
-                } else {
-                    ++j;
-                }
-            }
-        }
+void
+EventSeries::addEvents(const EventVector &ee)
+{
+    if (ee.empty()) {
+        return;
+    }
+    
+    EventVector sorted(ee);
+    std::sort(sorted.begin(), sorted.end());
 
-        // Tidy up by removing any entries that are now identical
-        // to their predecessors
-            
-        std::vector<sv_frame_t> redundant;
+    QMutexLocker locker(&m_mutex);
+
+    // Everything before the position of the first new event is
+    // unchanged by the merge
+    
+    auto pitr = upper_bound(m_events.begin(), m_events.end(), sorted[0]);
+    size_t firstChanged = size_t(distance(m_events.begin(), pitr));
+    size_t formerSize = m_events.size();
+
+    m_events.insert(m_events.end(), sorted.begin(), sorted.end());
+
+    if (firstChanged < formerSize) {
+        std::inplace_merge(m_events.begin() + firstChanged,
+                           m_events.begin() + formerSize,
+                           m_events.end());
+    }
 
-        auto pitr = m_seams.end();
-        if (i0 != m_seams.begin()) {
-            pitr = i0;
-            --pitr;
+    for (const auto &p: sorted) {
+        if (!p.hasDuration() && p.getFrame() > m_finalDurationlessEventFrame) {
+            m_finalDurationlessEventFrame = p.getFrame();
         }
+    }
+
+    updateEndIndex(firstChanged, m_events.size() - 1);
+
+#ifdef DEBUG_EVENT_SERIES
+    std::cerr << "after addEvents:" << std::endl;
+    dumpEvents();
+#endif
+}
+
+void
+EventSeries::removeEvents(const EventVector &ee)
+{
+    if (ee.empty()) {
+        return;
+    }
+    
+    EventVector sorted(ee);
+    std::sort(sorted.begin(), sorted.end());
+
+    QMutexLocker locker(&m_mutex);
+
+    // Walk through both sorted sequences together, dropping one
+    // event from m_events for each matching event in sorted
 
-        for (auto i = i0; i != m_seams.end(); ++i) {
-            if (pitr != m_seams.end() &&
-                seamsEqual(i->second, pitr->second)) {
-                redundant.push_back(i->first);
+    auto pitr = lower_bound(m_events.begin(), m_events.end(), sorted[0]);
+    size_t firstChanged = size_t(distance(m_events.begin(), pitr));
+    size_t formerLast = m_events.size() - 1;
+
+    auto out = pitr;
+    auto ritr = sorted.begin();
+    bool lostFinalDurationless = false;
+
+    while (pitr != m_events.end()) {
+        while (ritr != sorted.end() && *ritr < *pitr) {
+            ++ritr;
+        }
+        if (ritr != sorted.end() && *ritr == *pitr) {
+            if (!pitr->hasDuration() &&
+                pitr->getFrame() == m_finalDurationlessEventFrame) {
+                lostFinalDurationless = true;
             }
-            pitr = i;
-            if (i == i1) {
-                break;
+            ++ritr;
+        } else {
+            if (out != pitr) {
+                *out = std::move(*pitr);
             }
+            ++out;
         }
+        ++pitr;
+    }
 
-        for (sv_frame_t f: redundant) {
-            m_seams.erase(f);
-        }
+    if (out == m_events.end()) {
+        // we didn't know any of these events
+        return;
+    }
+    
+    m_events.erase(out, m_events.end());
 
-        // And remove any empty seams from the start of the map
-            
-        while (m_seams.begin() != m_seams.end() &&
-               m_seams.begin()->second.empty()) {
-            m_seams.erase(m_seams.begin());
+    if (lostFinalDurationless) {
+        m_finalDurationlessEventFrame = 0;
+        for (auto ritr = m_events.rbegin(); ritr != m_events.rend(); ++ritr) {
+            if (!ritr->hasDuration()) {
+                m_finalDurationlessEventFrame = ritr->getFrame();
+                break;
+            }
         }
     }
 
+    updateEndIndex(firstChanged, formerLast);
+
 #ifdef DEBUG_EVENT_SERIES
-    std::cerr << "after remove:" << std::endl;
+    std::cerr << "after removeEvents:" << std::endl;
     dumpEvents();
-    dumpSeams();
 #endif
 }
 
+void
+EventSeries::updateEndIndex(size_t from, size_t to)
+{
+    size_t n = m_events.size();
+
+    if (n > m_endIndexCapacity) {
+
+        // Reallocate and rebuild the whole thing
+        
+        size_t capacity = (m_endIndexCapacity > 0 ? m_endIndexCapacity : 16);
+        while (capacity < n) {
+            capacity *= 2;
+        }
+        m_endIndexCapacity = capacity;
+        m_endIndex = vector<sv_frame_t>(capacity * 2, noEnd);
+        
+        from = 0;
+        to = n - 1;
+    }
+
+    if (n == 0 && m_endIndexCapacity == 0) {
+        return;
+    }
+
+    if (to >= m_endIndexCapacity) {
+        to = m_endIndexCapacity - 1;
+    }
+    if (from > to) {
+        return;
+    }
+
+    size_t lo = m_endIndexCapacity + from;
+    size_t hi = m_endIndexCapacity + to;
+
+    for (size_t i = from; i <= to; ++i) {
+        m_endIndex[m_endIndexCapacity + i] =
+            (i < n ? endIndexValueFor(m_events[i]) : noEnd);
+    }
+
+    while (lo > 1) {
+        lo /= 2;
+        hi /= 2;
+        for (size_t i = lo; i <= hi; ++i) {
+            m_endIndex[i] = std::max(m_endIndex[i*2], m_endIndex[i*2 + 1]);
+        }
+    }
+}
+
+void
+EventSeries::findEventsEndingAfter(size_t node, size_t lo, size_t hi,
+                                   size_t limit, sv_frame_t after,
+                                   vector<size_t> &found) const
+{
+    if (lo >= limit || m_endIndex[node] <= after) {
+        return;
+    }
+    if (node >= m_endIndexCapacity) {
+        found.push_back(lo);
+        return;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    findEventsEndingAfter(node * 2, lo, mid, limit, after, found);
+    findEventsEndingAfter(node * 2 + 1, mid, hi, limit, after, found);
+}
+
+EventVector
+EventSeries::getDurationEventsActive(sv_frame_t lastStart,
+                                     sv_frame_t after) const
+{
+    EventVector active;
+    
+    if (m_events.empty() || m_endIndexCapacity == 0) {
+        return active;
+    }
+
+    auto limitItr = upper_bound(m_events.begin(), m_events.end(), lastStart,
+                                [](sv_frame_t f, const Event &e) {
+                                    return f < e.getFrame();
+                                });
+    size_t limit = size_t(distance(m_events.begin(), limitItr));
+
+    vector<size_t> found;
+    findEventsEndingAfter(1, 0, m_endIndexCapacity, limit, after, found);
+
+    for (size_t i: found) {
+        const Event &e = m_events[i];
+        // Events with duration zero were never considered to be
+        // active anywhere, so we continue not to return them
+        if (e.getDuration() > 0) {
+            active.push_back(e);
+        }
+    }
+
+    return active;
+}
+
 bool
 EventSeries::contains(const Event &p) const
 {
@@ -257,7 +370,8 @@ EventSeries::clear()
 {
     QMutexLocker locker(&m_mutex);
     m_events.clear();
-    m_seams.clear();
+    m_endIndex.clear();
+    m_endIndexCapacity = 0;
     m_finalDurationlessEventFrame = 0;
 }
 
@@ -280,11 +394,11 @@ EventSeries::getEndFrame() const
     
     latest = m_finalDurationlessEventFrame;
 
-    if (m_seams.empty()) return latest;
+    if (m_endIndexCapacity == 0) return latest;
     
-    sv_frame_t lastSeam = m_seams.rbegin()->first;
-    if (lastSeam > latest) {
-        latest = lastSeam;
+    sv_frame_t lastEnd = m_endIndex[1];
+    if (lastEnd > latest) {
+        latest = lastEnd;
     }
 
     return latest;
@@ -312,28 +426,11 @@ EventSeries::getEventsSpanning(sv_frame_t frame,
         ++pitr;
     }
 
-    // now any non-zero-duration ones from the seam map
+    // now any non-zero-duration ones, i.e. those starting before
+    // the end of the span and ending after its start
 
-    std::set<Event> found;
-    auto sitr = m_seams.lower_bound(start);
-    if (sitr == m_seams.end() || sitr->first > start) {
-        if (sitr != m_seams.begin()) {
-            --sitr;
-        }                
-    }
-    while (sitr != m_seams.end() && sitr->first < end) {
-        for (const auto &p: sitr->second) {
-            found.insert(p);
-        }
-        ++sitr;
-    }
-    for (const auto &p: found) {
-        auto pitr = lower_bound(m_events.begin(), m_events.end(), p);
-        while (pitr != m_events.end() && *pitr == p) {
-            span.push_back(p);
-            ++pitr;
-        }
-    }
+    EventVector active = getDurationEventsActive(end - 1, start);
+    span.insert(span.end(), active.begin(), active.end());
             
     return span;
 }
@@ -434,28 +531,11 @@ EventSeries::getEventsCovering(sv_frame_t frame) const
         ++pitr;
     }
         
-    // now any non-zero-duration ones from the seam map
-        
-    std::set<Event> found;
-    auto sitr = m_seams.lower_bound(frame);
-    if (sitr == m_seams.end() || sitr->first > frame) {
-        if (sitr != m_seams.begin()) {
-            --sitr;
-        }                
-    }
-    if (sitr != m_seams.end() && sitr->first <= frame) {
-        for (const auto &p: sitr->second) {
-            found.insert(p);
-        }
-        ++sitr;
-    }
-    for (const auto &p: found) {
-        auto pitr = lower_bound(m_events.begin(), m_events.end(), p);
-        while (pitr != m_events.end() && *pitr == p) {
-            cover.push_back(p);
-            ++pitr;
-        }
-    }
+    // now any non-zero-duration ones, i.e. those starting at or
+    // before the frame and ending after it
+
+    EventVector active = getDurationEventsActive(frame, frame);
+    cover.insert(cover.end(), active.begin(), active.end());
         
     return cover;
 }
@@ -22,6 +22,7 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <limits>
 
 #include <QMutex>
 
@@ -32,24 +33,25 @@
  * and supporting the ability to query which events are active at a
  * given frame or within a span of frames.
  *
- * To that end, in addition to the series of events, it stores a
- * series of "seams", which are frame positions at which the set of
- * simultaneous events changes (i.e. an event of non-zero duration
- * starts or ends) associated with a set of the events that are active
- * at or from that position. These are updated when an event is added
- * or removed.
+ * To that end, in addition to the series of events, it stores an
+ * index of the end frames of the events, arranged so that the events
+ * that are still active at a given frame can be found without
+ * scanning everything that started before it. This is updated when
+ * an event is added or removed, and takes space linear in the number
+ * of events however much they overlap.
  *
  * This class is highly optimised for inserting events in increasing
  * order of start frame. Inserting (or deleting) events in the middle
  * does work, and should be acceptable in interactive use, but it is
- * very slow in bulk.
+ * very slow in bulk; use addEvents and removeEvents instead when
+ * there are many events to add or remove at once.
  *
  * EventSeries is thread-safe.
  */
 class EventSeries : public XmlExportable
 {
 public:
-    EventSeries() : m_finalDurationlessEventFrame(0) { }
+    EventSeries() : m_endIndexCapacity(0), m_finalDurationlessEventFrame(0) { }
     ~EventSeries() =default;
 
     EventSeries(const EventSeries &);
@@ -64,6 +66,22 @@ public:
     void clear();
     void add(const Event &e);
     void remove(const Event &e);
+
+    /**
+     * Add all of the given events, which may be in any order. This
+     * has the same effect as calling add() for each of them, but
+     * sorts, merges, and updates the index of end frames only once.
+     */
+    void addEvents(const EventVector &ee);
+
+    /**
+     * Remove all of the given events. This has the same effect as
+     * calling remove() for each of them: events that are not in the
+     * series are ignored, and where the series holds several
+     * identical events, each instance given removes one of them. But
+     * the series is rebuilt only once.
+     */
+    void removeEvents(const EventVector &ee);
     bool contains(const Event &e) const;
     bool isEmpty() const;
     int count() const;
@@ -264,96 +282,83 @@ private:
     Events m_events;
     
     /**
-     * The FrameEventMap maps from frame number to a set of events. In
-     * the seam map this is used to represent the events that are
-     * active at that frame, either because they begin at that frame
-     * or because they are continuing from an earlier frame. There is
-     * an entry here for each frame at which an event starts or ends,
-     * with the event appearing in all entries from its start time
-     * onward and disappearing again at its end frame.
+     * The end index is an implicit binary tree laid over m_events,
+     * stored in the usual heap layout: node 1 is the root, the
+     * children of node n are 2n and 2n+1, and the leaves start at
+     * m_endIndexCapacity, one per element of m_events (with any
+     * spare leaves at the end unused). Each leaf holds the end frame
+     * (start + duration) of the corresponding event, or noEnd for an
+     * event without duration; each internal node holds the greatest
+     * end frame found in its subtree.
      *
-     * Only events with duration appear in this map; point events
-     * appear only in m_events. Note that unlike m_events, we only
-     * store one instance of each event here, even if we hold many -
-     * we refer back to m_events when we need to know how many
-     * identical copies of a given event we have.
+     * Because m_events is sorted by start frame, the events active at
+     * a frame f are those in the prefix of m_events starting at or
+     * before f whose end frames exceed f, and the tree lets us find
+     * those without visiting any subtree that ends too early. Unlike
+     * a map from frame to active events, this holds one value per
+     * event regardless of how many other events it overlaps.
+     *
+     * The capacity is always a power of two, and at least the number
+     * of events.
      */
-    typedef std::map<sv_frame_t, std::vector<Event>> FrameEventMap;
-    FrameEventMap m_seams;
+    std::vector<sv_frame_t> m_endIndex;
+    size_t m_endIndexCapacity;
+
+    static constexpr sv_frame_t noEnd = std::numeric_limits<sv_frame_t>::min();
 
     /**
-     * The frame of the last durationless event we have in the series.
-     * This is to support a fast-ish getEndFrame(): we can easily keep
-     * this up-to-date when events are added or removed, and we can
-     * easily find the end frame of the last with-duration event from
-     * the seam map, but it's not so easy to continuously update an
-     * overall end frame or to find the last frame of all events
-     * without this.
+     * Return the value for the end index leaf of the given event.
      */
-    sv_frame_t m_finalDurationlessEventFrame;
-    
-    /** 
-     * Create a seam at the given frame, copying from the prior seam
-     * if there is one. If a seam already exists at the given frame,
-     * leave it untouched.
+    static sv_frame_t endIndexValueFor(const Event &e) {
+        return e.hasDuration() ? e.getFrame() + e.getDuration() : noEnd;
+    }
+
+    /**
+     * Update the end index after events have been inserted into or
+     * removed from m_events, changing the events at indices from
+     * "from" to "to" inclusive. Leaves at or beyond the current end
+     * of m_events are reset to noEnd. Reallocates and rebuilds the
+     * whole index if m_events has outgrown it.
      *
      * Call with m_mutex locked.
      */
-    void createSeam(sv_frame_t frame) {
-        auto itr = m_seams.lower_bound(frame);
-        if (itr == m_seams.end() || itr->first > frame) {
-            if (itr != m_seams.begin()) {
-                --itr;
-            }
-        }
-        if (itr == m_seams.end()) {
-            m_seams[frame] = {};
-        } else if (itr->first < frame) {
-            m_seams[frame] = itr->second;
-        } else if (itr->first > frame) { // itr must be begin()
-            m_seams[frame] = {};
-        }
-    }
+    void updateEndIndex(size_t from, size_t to);
 
-    /** 
-     * Return true if the two seam map entries contain the same set of
-     * events.
-     *
-     * Precondition: no duplicates, i.e. no event appears more than
-     * once in s1 or more than once in s2.
+    /**
+     * Push to found the indices, in ascending order, of all events
+     * with index less than limit whose end frames are greater than
+     * after, searching the subtree of the end index rooted at the
+     * given node, whose leaves cover m_events indices from lo to hi
+     * exclusive.
      *
      * Call with m_mutex locked.
      */
-    bool seamsEqual(const std::vector<Event> &s1,
-                    const std::vector<Event> &s2) const {
-        
-        if (s1.size() != s2.size()) {
-            return false;
-        }
+    void findEventsEndingAfter(size_t node, size_t lo, size_t hi,
+                               size_t limit, sv_frame_t after,
+                               std::vector<size_t> &found) const;
 
-#ifdef DEBUG_EVENT_SERIES
-        for (int i = 0; in_range_for(s1, i); ++i) {
-            for (int j = i + 1; in_range_for(s1, j); ++j) {
-                if (s1[i] == s1[j] || s2[i] == s2[j]) {
-                    throw std::runtime_error
-                        ("debug error: duplicate event in s1 or s2");
-                }
-            }
-        }
-#endif
-
-        std::set<Event> ee;
-        for (const auto &e: s1) {
-            ee.insert(e);
-        }
-        for (const auto &e: s2) {
-            if (ee.find(e) == ee.end()) {
-                return false;
-            }
-        }
-        return true;
-    }
+    /**
+     * Return the events with duration, in their natural order, whose
+     * start frames are less than or equal to lastStart and whose end
+     * frames are greater than after. Events with a zero duration are
+     * never returned.
+     *
+     * Call with m_mutex locked.
+     */
+    EventVector getDurationEventsActive(sv_frame_t lastStart,
+                                        sv_frame_t after) const;
 
+    /**
+     * The frame of the last durationless event we have in the series.
+     * This is to support a fast-ish getEndFrame(): we can easily keep
+     * this up-to-date when events are added or removed, and we can
+     * easily find the end frame of the last with-duration event from
+     * the root of the end index, but it's not so easy to continuously
+     * update an overall end frame or to find the last frame of all
+     * events without this.
+     */
+    sv_frame_t m_finalDurationlessEventFrame;
+    
 #ifdef DEBUG_EVENT_SERIES
     void dumpEvents() const {
         std::cerr << "EVENTS (" << m_events.size() << ") [" << std::endl;
@@ -362,18 +367,6 @@ private:
         }
         std::cerr << "]" << std::endl;
     }
-    
-    void dumpSeams() const {
-        std::cerr << "SEAMS (" << m_seams.size() << ") [" << std::endl;
-        for (const auto &s: m_seams) {
-            std::cerr << "  " << s.first << " -> {" << std::endl;
-            for (const auto &p: s.second) {
-                std::cerr << p.toXmlString("    ");
-            }
-            std::cerr << "  }" << std::endl;
-        }
-        std::cerr << "]" << std::endl;
-    }
 #endif
 };
 
@@ -0,0 +1,393 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "NumberFormat.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+static const int maxSignificantDigits = 100;
+static const int bufferSize = maxSignificantDigits + 32;
+
+// Significant digits used for %g-style layout of the shortest form,
+// where fewer are needed
+static const int shortestMinPrecision = 6;
+
+// Powers of ten from 1e-64 to 1e64. Only those from 1e0 to 1e22 are
+// exact
+static const int minPower = -64;
+static const int maxPower = 64;
+static const double powersOfTen[] = {
+    1e-64, 1e-63, 1e-62, 1e-61, 1e-60, 1e-59,
+    1e-58, 1e-57, 1e-56, 1e-55, 1e-54, 1e-53,
+    1e-52, 1e-51, 1e-50, 1e-49, 1e-48, 1e-47,
+    1e-46, 1e-45, 1e-44, 1e-43, 1e-42, 1e-41,
+    1e-40, 1e-39, 1e-38, 1e-37, 1e-36, 1e-35,
+    1e-34, 1e-33, 1e-32, 1e-31, 1e-30, 1e-29,
+    1e-28, 1e-27, 1e-26, 1e-25, 1e-24, 1e-23,
+    1e-22, 1e-21, 1e-20, 1e-19, 1e-18, 1e-17,
+    1e-16, 1e-15, 1e-14, 1e-13, 1e-12, 1e-11,
+    1e-10, 1e-9, 1e-8, 1e-7, 1e-6, 1e-5,
+    1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1,
+    1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+    1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+    1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+    1e20, 1e21, 1e22, 1e23, 1e24, 1e25,
+    1e26, 1e27, 1e28, 1e29, 1e30, 1e31,
+    1e32, 1e33, 1e34, 1e35, 1e36, 1e37,
+    1e38, 1e39, 1e40, 1e41, 1e42, 1e43,
+    1e44, 1e45, 1e46, 1e47, 1e48, 1e49,
+    1e50, 1e51, 1e52, 1e53, 1e54, 1e55,
+    1e56, 1e57, 1e58, 1e59, 1e60, 1e61,
+    1e62, 1e63, 1e64
+};
+
+static inline double
+powerOfTen(int k)
+{
+    return powersOfTen[k - minPower];
+}
+
+static int
+formatInteger(char *out, int64_t value)
+{
+    char reversed[24];
+    int n = 0;
+    uint64_t u = (value < 0 ? 0 - uint64_t(value) : uint64_t(value));
+    do {
+        reversed[n++] = char('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+
+    int m = 0;
+    if (value < 0) out[m++] = '-';
+    while (n > 0) out[m++] = reversed[--n];
+    return m;
+}
+
+static int
+formatDigits(char *digits, uint64_t mantissa, int precision)
+{
+    // Write the precision-digit mantissa, returning the number of
+    // digits without trailing zeros
+
+    for (int i = precision - 1; i >= 0; --i) {
+        digits[i] = char('0' + mantissa % 10);
+        mantissa /= 10;
+    }
+    int n = precision;
+    while (n > 1 && digits[n-1] == '0') --n;
+    return n;
+}
+
+static int
+getDigitsFromPrintf(double magnitude, int precision,
+                    char *digits, int &exponent)
+{
+    // Get the leading digits of a finite, non-zero magnitude,
+    // correctly rounded, from printf's %e. The decimal point in that
+    // depends on the C locale, so we just take the digits that come
+    // before the 'e'
+
+    char buf[bufferSize];
+    snprintf(buf, sizeof(buf), "%.*e", precision - 1, magnitude);
+
+    const char *p = buf;
+    int n = 0;
+    while (*p && *p != 'e' && *p != 'E') {
+        if (*p >= '0' && *p <= '9' && n < precision) {
+            digits[n++] = *p;
+        }
+        ++p;
+    }
+    exponent = (*p ? atoi(p + 1) : 0);
+
+    while (n > 1 && digits[n-1] == '0') --n;
+    return n;
+}
+
+static bool
+getScaledMantissa(double magnitude, int precision, int &exponent,
+                  double &scaled)
+{
+    // Find the decimal exponent of a finite, non-zero magnitude, and
+    // the magnitude scaled so as to have precision digits before the
+    // point. This is approximate (the scaling may be inexact) and
+    // fails if the magnitude is out of range of the table
+
+    exponent = int(floor(log10(magnitude)));
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int k = precision - 1 - exponent;
+        if (k < minPower || k > maxPower) return false;
+        scaled = magnitude * powerOfTen(k);
+        if (scaled < powerOfTen(precision - 1)) {
+            --exponent;
+        } else if (scaled >= powerOfTen(precision)) {
+            ++exponent;
+        } else {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+readsAs(float value, double lower, double upper,
+        double mantissa, int scale)
+{
+    // True if mantissa * 10^scale (an integer mantissa of no more
+    // than nine digits) is certain to read back as value, whose
+    // rounding interval is (lower, upper).
+    //
+    // If the decimal is exactly representable as a double, reading
+    // it as one and then converting that to float is exact too.
+    // Otherwise it is converted in one or more steps, each rounding
+    // to within half a double ulp, and is accepted only if it lies
+    // further than that inside the interval
+
+    if (scale >= 0 && scale <= 22 &&
+        mantissa * powerOfTen(scale) <= 9007199254740992.0) { // 2^53
+        return float(mantissa * powerOfTen(scale)) == value;
+    }
+
+    double d = mantissa;
+    int steps = 0;
+    while (scale > 22) {
+        d *= powerOfTen(22);
+        scale -= 22;
+        ++steps;
+    }
+    while (scale < -22) {
+        d /= powerOfTen(22);
+        scale += 22;
+        ++steps;
+    }
+    d = (scale >= 0 ? d * powerOfTen(scale) : d / powerOfTen(-scale));
+    ++steps;
+
+    if (float(d) != value) return false;
+
+    double margin = d * steps * 2.3e-16; // > steps * DBL_EPSILON / 2
+    return d - lower > margin && upper - d > margin;
+}
+
+static int
+layout(char *out, bool negative, const char *digits, int n,
+       int exponent, int precision)
+{
+    // As %g with the given precision, where digits are the n
+    // significant digits without trailing zeros
+
+    int m = 0;
+    if (negative) out[m++] = '-';
+
+    if (exponent < -4 || exponent >= precision) {
+        out[m++] = digits[0];
+        if (n > 1) {
+            out[m++] = '.';
+            memcpy(out + m, digits + 1, n - 1);
+            m += n - 1;
+        }
+        out[m++] = 'e';
+        out[m++] = (exponent < 0 ? '-' : '+');
+        m += formatInteger(out + m, exponent < 0 ? -exponent : exponent);
+
+    } else if (exponent >= 0) {
+        for (int i = 0; i <= exponent; ++i) {
+            out[m++] = (i < n ? digits[i] : '0');
+        }
+        if (n > exponent + 1) {
+            out[m++] = '.';
+            memcpy(out + m, digits + exponent + 1, n - exponent - 1);
+            m += n - exponent - 1;
+        }
+
+    } else {
+        out[m++] = '0';
+        out[m++] = '.';
+        for (int i = -1; i > exponent; --i) {
+            out[m++] = '0';
+        }
+        memcpy(out + m, digits, n);
+        m += n;
+    }
+
+    return m;
+}
+
+static int
+formatNonFinite(char *out, double value)
+{
+    const char *s = (std::isnan(value) ? "nan" : value < 0 ? "-inf" : "inf");
+    int n = int(strlen(s));
+    memcpy(out, s, n);
+    return n;
+}
+
+static int
+formatShortest(char *out, float value)
+{
+    if (!std::isfinite(value)) {
+        return formatNonFinite(out, value);
+    }
+
+    bool negative = std::signbit(value);
+    float magnitude = fabsf(value);
+    char digits[maxSignificantDigits];
+
+    if (magnitude == 0.f) {
+        return layout(out, negative, "0", 1, 0, 1);
+    }
+
+    // Nine significant digits always suffice to identify a float.
+    // Scale the value to have nine digits before the point, and try
+    // rounding it to fewer: any rounding that lands within the
+    // (similarly scaled) interval of values that read as our float is
+    // a candidate, to be checked exactly with readsAs
+
+    double lower = (double(magnitude) + nextafterf(magnitude, 0.f)) / 2.0;
+    double upper = (double(magnitude) + nextafterf(magnitude, HUGE_VALF)) / 2.0;
+
+    int exponent = 0;
+    double scaled = 0.0;
+
+    if (getScaledMantissa(magnitude, 9, exponent, scaled)) {
+
+        double factor = powerOfTen(8 - exponent);
+        double scaledLower = lower * factor;
+        double scaledUpper = upper * factor;
+
+        for (int precision = 1; precision <= 9; ++precision) {
+
+            double unit = powerOfTen(9 - precision);
+            double mantissa = floor(scaled / unit + 0.5);
+            double candidate = mantissa * unit;
+            if (candidate < scaledLower || candidate > scaledUpper) {
+                continue;
+            }
+
+            int e = exponent;
+            if (mantissa >= powerOfTen(precision)) {
+                mantissa /= 10.0;
+                ++e;
+            }
+            if (readsAs(magnitude, lower, upper,
+                        mantissa, e - (precision - 1))) {
+                int n = formatDigits(digits, uint64_t(mantissa), precision);
+                return layout(out, negative, digits, n, e,
+                              n > shortestMinPrecision ?
+                              n : shortestMinPrecision);
+            }
+        }
+    }
+
+    int n = getDigitsFromPrintf(magnitude, 9, digits, exponent);
+    return layout(out, negative, digits, n, exponent, n);
+}
+
+static int
+formatPrecision(char *out, double value, int precision)
+{
+    if (!std::isfinite(value)) {
+        return formatNonFinite(out, value);
+    }
+
+    if (precision < 1) precision = 1;
+    if (precision > maxSignificantDigits) precision = maxSignificantDigits;
+
+    bool negative = std::signbit(value);
+    double magnitude = fabs(value);
+    char digits[maxSignificantDigits];
+
+    if (magnitude == 0.0) {
+        return layout(out, negative, "0", 1, 0, precision);
+    }
+
+    // Scale and round in double arithmetic where that gives the
+    // correctly rounded result, i.e. where there are few enough
+    // digits and the scaled value is not too close to a tie
+
+    int exponent = 0;
+    double scaled = 0.0;
+    if (precision <= 9 &&
+        getScaledMantissa(magnitude, precision, exponent, scaled)) {
+        double fraction = scaled - floor(scaled);
+        if (fabs(fraction - 0.5) > 1e-6) {
+            double mantissa = floor(scaled + 0.5);
+            if (mantissa >= powerOfTen(precision)) {
+                mantissa /= 10.0;
+                ++exponent;
+            }
+            int n = formatDigits(digits, uint64_t(mantissa), precision);
+            return layout(out, negative, digits, n, exponent, precision);
+        }
+    }
+
+    int n = getDigitsFromPrintf(magnitude, precision, digits, exponent);
+    return layout(out, negative, digits, n, exponent, precision);
+}
+
+void
+NumberFormat::appendInteger(QString &out, int64_t value)
+{
+    char buf[24];
+    int n = formatInteger(buf, value);
+    out.append(QLatin1String(buf, n));
+}
+
+void
+NumberFormat::appendFloat(QString &out, float value)
+{
+    char buf[bufferSize];
+    int n = formatShortest(buf, value);
+    out.append(QLatin1String(buf, n));
+}
+
+void
+NumberFormat::appendFloat(QString &out, double value, int significantDigits)
+{
+    char buf[bufferSize];
+    int n = formatPrecision(buf, value, significantDigits);
+    out.append(QLatin1String(buf, n));
+}
+
+QString
+NumberFormat::fromInteger(int64_t value)
+{
+    QString s;
+    appendInteger(s, value);
+    return s;
+}
+
+QString
+NumberFormat::fromFloat(float value)
+{
+    QString s;
+    appendFloat(s, value);
+    return s;
+}
+
+QString
+NumberFormat::fromFloat(double value, int significantDigits)
+{
+    QString s;
+    appendFloat(s, value, significantDigits);
+    return s;
+}
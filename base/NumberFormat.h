@@ -0,0 +1,61 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_NUMBER_FORMAT_H
+#define SV_NUMBER_FORMAT_H
+
+#include <QString>
+
+#include <cstdint>
+
+/**
+ * Formatting of numbers for text export (CSV, session XML and the
+ * like), independent of locale and of Qt version.
+ *
+ * Numbers are appended to an existing string, so that a caller
+ * building a line or a block of output can reserve space for it once
+ * rather than making a temporary string for every value.
+ *
+ * Floating-point values are written in the style of printf's %g,
+ * except that the exponent is not zero-padded ("1e-5" rather than
+ * "1e-05"). By default a float is written with the fewest
+ * significant digits that read back as the same float, so that
+ * exports lose nothing but are no longer than they need to be;
+ * alternatively a fixed number of significant digits may be given.
+ * Infinities and NaNs are written as "inf", "-inf" and "nan".
+ */
+class NumberFormat
+{
+public:
+    static void appendInteger(QString &out, int64_t value);
+
+    /**
+     * Append the shortest representation that reads back as the
+     * same float.
+     */
+    static void appendFloat(QString &out, float value);
+
+    /**
+     * Append with the given number of significant digits (at least
+     * 1, at most 100), as %g with that precision would.
+     */
+    static void appendFloat(QString &out, double value,
+                            int significantDigits);
+
+    static QString fromInteger(int64_t value);
+    static QString fromFloat(float value);
+    static QString fromFloat(double value, int significantDigits);
+};
+
+#endif
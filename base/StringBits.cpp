@@ -172,17 +172,30 @@ QString
 StringBits::joinDelimited(QVector<QString> row, QString delimiter)
 {
     QString s;
-    for (auto col: row) {
-        if (s != "") {
-            s += delimiter;
+    appendDelimited(s, row, delimiter);
+    return s;
+}
+
+void
+StringBits::appendDelimited(QString &out,
+                            const QVector<QString> &row,
+                            QString delimiter)
+{
+    int start = out.size();
+    for (const auto &col: row) {
+        if (out.size() > start) {
+            out += delimiter;
         }
         if (col.contains(delimiter)) {
-            col.replace("\"", "\"\"");
-            col = "\"" + col + "\"";
+            QString quoted(col);
+            quoted.replace("\"", "\"\"");
+            out += '"';
+            out += quoted;
+            out += '"';
+        } else {
+            out += col;
         }
-        s += col;
     }
-    return s;    
 }
 
 bool
@@ -77,6 +77,15 @@ public:
      */
     static QString joinDelimited(QVector<QString> row, QString delimiter);
 
+    /**
+     * As joinDelimited, but appending the result to an existing
+     * string, so as to avoid a temporary string per row when
+     * building up a larger block of text.
+     */
+    static void appendDelimited(QString &out,
+                                const QVector<QString> &row,
+                                QString delimiter);
+
     /**
      * Return true if the given byte array contains a valid UTF-8
      * sequence, false if not. If isTruncated is true, the byte array
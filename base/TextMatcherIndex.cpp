@@ -0,0 +1,127 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "TextMatcherIndex.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+static const int maxGramLength = 3;
+
+TextMatcherIndex::TextMatcherIndex()
+{
+}
+
+void
+TextMatcherIndex::clear()
+{
+    m_keys.clear();
+    m_keyIndices.clear();
+    m_grams.clear();
+}
+
+void
+TextMatcherIndex::add(QString key, QString text)
+{
+    int ix = 0;
+    auto ki = m_keyIndices.find(key);
+    if (ki != m_keyIndices.end()) {
+        ix = ki->second;
+    } else {
+        ix = int(m_keys.size());
+        m_keys.push_back(key);
+        m_keyIndices[key] = ix;
+    }
+
+    // TextMatcher compares case-insensitively, i.e. by folded case
+    QString folded = text.toCaseFolded();
+    int len = folded.length();
+
+    for (int n = 1; n <= maxGramLength; ++n) {
+        for (int i = 0; i + n <= len; ++i) {
+            Postings &p = m_grams[folded.mid(i, n)];
+            if (p.empty() || p.back() < ix) {
+                p.push_back(ix);
+            } else {
+                // a later text for an earlier key
+                auto pi = lower_bound(p.begin(), p.end(), ix);
+                if (pi == p.end() || *pi != ix) {
+                    p.insert(pi, ix);
+                }
+            }
+        }
+    }
+}
+
+vector<int>
+TextMatcherIndex::getCandidatesFor(QString keyword) const
+{
+    QString folded = keyword.toCaseFolded();
+    int len = folded.length();
+
+    if (len == 0) {
+        // matches anything
+        vector<int> all(m_keys.size());
+        for (size_t i = 0; i < all.size(); ++i) all[i] = int(i);
+        return all;
+    }
+
+    if (len <= maxGramLength) {
+        return m_grams.value(folded);
+    }
+
+    // Every text containing the keyword contains all of its
+    // trigrams. Start from the rarest, to keep the intersection small
+
+    vector<const Postings *> lists;
+    for (int i = 0; i + maxGramLength <= len; ++i) {
+        auto gi = m_grams.constFind(folded.mid(i, maxGramLength));
+        if (gi == m_grams.constEnd()) {
+            return {};
+        }
+        lists.push_back(&gi.value());
+    }
+
+    sort(lists.begin(), lists.end(),
+         [](const Postings *a, const Postings *b) {
+             return a->size() < b->size();
+         });
+
+    vector<int> result(*lists[0]);
+    for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+        vector<int> narrowed;
+        set_intersection(result.begin(), result.end(),
+                         lists[i]->begin(), lists[i]->end(),
+                         back_inserter(narrowed));
+        result.swap(narrowed);
+    }
+
+    return result;
+}
+
+set<QString>
+TextMatcherIndex::getCandidates(QStringList keywords) const
+{
+    set<QString> candidates;
+
+    for (const auto &keyword: keywords) {
+        for (int ix: getCandidatesFor(keyword)) {
+            candidates.insert(m_keys[ix]);
+        }
+    }
+
+    return candidates;
+}
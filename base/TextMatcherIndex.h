@@ -0,0 +1,71 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_TEXT_MATCHER_INDEX_H
+#define SV_TEXT_MATCHER_INDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+#include <vector>
+#include <set>
+#include <map>
+
+/**
+ * An index of texts, each belonging to a key, used to find which of
+ * the keys might have a hit when their texts are tested by
+ * TextMatcher, without having to test all of them.
+ *
+ * TextMatcher finds keywords anywhere within a text, ignoring case,
+ * so the index records every substring of up to three characters of
+ * each (case-folded) text. A keyword of up to three characters is
+ * looked up directly; a longer one is looked up by all of its
+ * three-character substrings, which gives a small superset of the
+ * keys that actually contain it.
+ */
+class TextMatcherIndex
+{
+public:
+    TextMatcherIndex();
+
+    void clear();
+
+    /**
+     * Add a text for the given key. A key may have any number of
+     * texts.
+     */
+    void add(QString key, QString text);
+
+    /**
+     * Return the keys of all texts that might contain any of the
+     * given keywords. Every key with a text that does contain one is
+     * included, but some whose texts don't may be as well, so the
+     * texts should still be tested with TextMatcher.
+     */
+    std::set<QString> getCandidates(QStringList keywords) const;
+
+    int getKeyCount() const { return int(m_keys.size()); }
+
+private:
+    typedef std::vector<int> Postings; // key indices, ascending
+
+    std::vector<int> getCandidatesFor(QString keyword) const;
+
+    std::vector<QString> m_keys;
+    std::map<QString, int> m_keyIndices;
+    QHash<QString, Postings> m_grams;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef STRESS_NUMBER_FORMAT_H
+#define STRESS_NUMBER_FORMAT_H
+
+#include "../BaseTypes.h"
+#include "../NumberFormat.h"
+#include "../StringBits.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QVector>
+
+#include <iostream>
+
+using namespace std;
+
+/**
+ * Compare the cost of exporting rows of a frame and some float
+ * values as CSV text, the old way (a QString::arg per value and a
+ * joined string per row) and through NumberFormat appending to a
+ * single buffer.
+ */
+class StressNumberFormat : public QObject
+{
+    Q_OBJECT
+
+private:
+    static const int rowCount = 2000000;
+    static const int columnCount = 4;
+
+    void report(QString sort, clock_t start, clock_t end, int size) {
+        QString message = QString("Time for %1 rows (%2) = ")
+            .arg(rowCount).arg(sort);
+        cerr << "                 " << message;
+        for (int i = 0; i < 44 - message.size(); ++i) cerr << " ";
+        cerr << double(end - start) * 1000.0 / double(CLOCKS_PER_SEC)
+             << "ms (" << size << " chars)" << std::endl;
+    }
+
+    float valueFor(int row, int col) {
+        return float(row % 1000) / float(col + 3) - 100.f;
+    }
+
+private slots:
+    void viaArg() {
+        clock_t start = clock();
+        int size = 0;
+        for (int i = 0; i < rowCount; ++i) {
+            QVector<QString> row;
+            row.push_back(QString("%1").arg(sv_frame_t(i) * 512));
+            for (int j = 0; j < columnCount; ++j) {
+                row.push_back(QString("%1").arg(valueFor(i, j)));
+            }
+            size += StringBits::joinDelimited(row, ",").size() + 1;
+        }
+        clock_t end = clock();
+        report("QString::arg", start, end, size);
+    }
+
+    void viaNumberFormat() {
+        clock_t start = clock();
+        int size = 0;
+        QString block;
+        for (int i = 0; i < rowCount; ++i) {
+            if (i % 16384 == 0) {
+                size += block.size();
+                block.clear();
+                block.reserve(16384 * 48);
+            }
+            NumberFormat::appendInteger(block, sv_frame_t(i) * 512);
+            for (int j = 0; j < columnCount; ++j) {
+                block += ',';
+                NumberFormat::appendFloat(block, valueFor(i, j));
+            }
+            block += '\n';
+        }
+        size += block.size();
+        clock_t end = clock();
+        report("NumberFormat", start, end, size);
+    }
+};
+
+#endif
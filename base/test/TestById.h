@@ -16,8 +16,11 @@
 
 #include <QObject>
 #include <QtTest>
+#include <QThread>
+#include <QSemaphore>
 
 #include <iostream>
+#include <atomic>
 
 using namespace std;
 
@@ -34,6 +37,42 @@ struct M {};
 
 typedef TypedById<A, A::Id> AById;
 
+// An item whose destructor blocks until told to proceed. The store
+// drops its reference to an item within release() while holding its
+// write lock, so this holds the lock for as long as we like
+struct BlockingA : public A {
+    static QSemaphore entered;
+    static QSemaphore proceed;
+    static std::atomic<bool> blocking;
+    ~BlockingA() {
+        blocking = true;
+        entered.release();
+        proceed.tryAcquire(1, 10000);
+        blocking = false;
+    }
+};
+QSemaphore BlockingA::entered;
+QSemaphore BlockingA::proceed;
+std::atomic<bool> BlockingA::blocking(false);
+
+class ReleaseThread : public QThread
+{
+public:
+    ReleaseThread(A::Id id) : m_id(id) { }
+    void run() override { AById::release(m_id); }
+private:
+    A::Id m_id;
+};
+
+class AddThread : public QThread
+{
+public:
+    AddThread(std::shared_ptr<A> item) : m_item(item) { }
+    void run() override { AById::add(m_item); }
+private:
+    std::shared_ptr<A> m_item;
+};
+
 struct X : virtual public WithId { public: using WithId::getUntypedId; };
 struct Y : public X, public B2, public M {};
 
@@ -206,5 +245,74 @@ private slots:
         }
         AById::release(a);
     }
+
+    void manyAddRelease() {
+        // Each add and release publishes a new snapshot of the id
+        // table; check that lookups see exactly the current items
+        // throughout
+        vector<shared_ptr<A>> items;
+        vector<A::Id> ids;
+        for (int i = 0; i < 100; ++i) {
+            items.push_back(std::make_shared<A>());
+            ids.push_back(AById::add(items[i]));
+        }
+        for (int i = 0; i < 100; i += 2) {
+            AById::release(ids[i]);
+        }
+        for (int i = 0; i < 100; ++i) {
+            auto p = AById::get(ids[i]);
+            if (i % 2 == 0) {
+                QVERIFY(!p);
+            } else {
+                QCOMPARE(p, items[i]);
+            }
+        }
+        for (int i = 1; i < 100; i += 2) {
+            AById::release(ids[i]);
+        }
+        for (int i = 0; i < 100; ++i) {
+            QVERIFY(!AById::get(ids[i]));
+        }
+    }
+
+    void lookupWhileWriting() {
+        auto a = std::make_shared<A>();
+        A::Id aid = AById::add(a);
+
+        auto blocker = std::make_shared<BlockingA>();
+        A::Id bid = AById::add(blocker);
+        blocker.reset();
+
+        // Release the blocker from another thread, which then holds
+        // the write lock until we let it go
+        ReleaseThread releaser(bid);
+        releaser.start();
+        QVERIFY(BlockingA::entered.tryAcquire(1, 10000));
+
+        // Lookups don't wait for the lock
+        QCOMPARE(AById::get(aid), a);
+        QVERIFY(!AById::get(bid));
+        QVERIFY(BlockingA::blocking);
+
+        // An add does, and is counted as having had to
+        int before = AnyById::getContentionCount();
+        auto c = std::make_shared<A>();
+        AddThread adder(c);
+        adder.start();
+        for (int i = 0; i < 1000; ++i) {
+            if (AnyById::getContentionCount() > before) break;
+            QThread::msleep(10);
+        }
+        QVERIFY(AnyById::getContentionCount() > before);
+        QVERIFY(BlockingA::blocking);
+
+        BlockingA::proceed.release();
+        QVERIFY(releaser.wait(10000));
+        QVERIFY(adder.wait(10000));
+        QCOMPARE(AById::get(c->getId()), c);
+
+        AById::release(c);
+        AById::release(a);
+    }
 };
 
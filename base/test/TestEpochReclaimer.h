@@ -0,0 +1,141 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_EPOCH_RECLAIMER_H
+#define TEST_EPOCH_RECLAIMER_H
+
+#include "../EpochReclaimer.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QThread>
+
+#include <atomic>
+#include <memory>
+
+class TestEpochReclaimer : public QObject
+{
+    Q_OBJECT
+
+    struct Counted {
+        static std::atomic<int> deleted;
+        std::atomic<int> value;
+        Counted(int v) : value(v) { }
+        ~Counted() { value = -1; ++deleted; }
+    };
+
+    typedef EpochReclaimer<Counted> Reclaimer;
+
+    // Reads the published object continually, always taking a new
+    // read scope before letting go of the last one, so that there is
+    // never a moment with no reader at all
+    class ChainedReader : public QThread
+    {
+    public:
+        ChainedReader(const Reclaimer &reclaimer,
+                      const std::atomic<Counted *> &current,
+                      const std::atomic<bool> &done) :
+            m_reclaimer(reclaimer), m_current(current), m_done(done),
+            m_bad(0) { }
+
+        int getBad() const { return m_bad; }
+
+        void run() override {
+            std::unique_ptr<Reclaimer::ReadScope> held
+                (new Reclaimer::ReadScope(m_reclaimer));
+            while (!m_done) {
+                std::unique_ptr<Reclaimer::ReadScope> next
+                    (new Reclaimer::ReadScope(m_reclaimer));
+                if (m_current.load()->value < 0) {
+                    ++m_bad;
+                }
+                held = std::move(next);
+            }
+        }
+
+    private:
+        const Reclaimer &m_reclaimer;
+        const std::atomic<Counted *> &m_current;
+        const std::atomic<bool> &m_done;
+        int m_bad;
+    };
+
+private slots:
+    void init() {
+        Counted::deleted = 0;
+    }
+    
+    void heldScopeDefersDeletion() {
+        Reclaimer reclaimer;
+        {
+            Reclaimer::ReadScope scope(reclaimer);
+            reclaimer.retire(new Counted(1));
+            reclaimer.reclaim();
+            reclaimer.reclaim();
+            QCOMPARE(Counted::deleted.load(), 0);
+            QCOMPARE(reclaimer.getRetiredCount(), 1);
+        }
+        reclaimer.reclaim();
+        reclaimer.reclaim();
+        QCOMPARE(Counted::deleted.load(), 1);
+        QCOMPARE(reclaimer.getRetiredCount(), 0);
+    }
+
+    void deletedWithReclaimer() {
+        {
+            Reclaimer reclaimer;
+            Reclaimer::ReadScope *scope = new Reclaimer::ReadScope(reclaimer);
+            reclaimer.retire(new Counted(1));
+            reclaimer.retire(new Counted(2));
+            QCOMPARE(Counted::deleted.load(), 0);
+            delete scope;
+        }
+        QCOMPARE(Counted::deleted.load(), 2);
+    }
+
+    void reclaimDuringContinuousReads() {
+        Reclaimer reclaimer;
+        std::atomic<Counted *> current(new Counted(0));
+        std::atomic<bool> done(false);
+
+        ChainedReader reader(reclaimer, current, done);
+        reader.start();
+
+        // Objects are freed while reading goes on, and none that the
+        // reader might still see
+        int written = 0;
+        for (int i = 0; i < 100000 && Counted::deleted < 1000; ++i) {
+            reclaimer.retire(current.exchange(new Counted(i + 1)));
+            ++written;
+            if (i % 100 == 0) {
+                QThread::usleep(100);
+            }
+        }
+        QVERIFY(Counted::deleted >= 1000);
+        QVERIFY(reclaimer.getRetiredCount() < written);
+
+        done = true;
+        QVERIFY(reader.wait(10000));
+        QCOMPARE(reader.getBad(), 0);
+
+        reclaimer.reclaim();
+        reclaimer.reclaim();
+        QCOMPARE(reclaimer.getRetiredCount(), 0);
+        delete current.load();
+    }
+};
+
+std::atomic<int> TestEpochReclaimer::Counted::deleted(0);
+
+#endif
@@ -601,6 +601,75 @@ private slots:
         QCOMPARE(s.getEndFrame(), sv_frame_t(0));
     }
 
+    void manyOverlappingEvents() {
+
+        // Every event is still active when all of the later ones
+        // start
+        
+        EventSeries s;
+        int n = 2000;
+        for (int i = 0; i < n; ++i) {
+            s.add(Event(i, float(i), n * 2 - i, QString()));
+        }
+        QCOMPARE(s.count(), n);
+        QCOMPARE(s.getEndFrame(), sv_frame_t(n * 2));
+        QCOMPARE(int(s.getEventsCovering(n - 1).size()), n);
+        QCOMPARE(int(s.getEventsCovering(n / 2).size()), n / 2 + 1);
+        QCOMPARE(int(s.getEventsSpanning(n * 2 - 1, 10).size()), n);
+        QCOMPARE(int(s.getEventsSpanning(n * 2, 10).size()), 0);
+        for (int i = 0; i < n; i += 2) {
+            s.remove(Event(i, float(i), n * 2 - i, QString()));
+        }
+        QCOMPARE(s.count(), n / 2);
+        QCOMPARE(int(s.getEventsCovering(n - 1).size()), n / 2);
+        QCOMPARE(s.getEventsCovering(1), EventVector({ Event(1, 1.f, n * 2 - 1, QString()) }));
+    }
+
+    void bulkAddRemove() {
+
+        EventVector ee;
+        for (int i = 0; i < 300; ++i) {
+            int frame = (i * 37) % 101;
+            if (i % 3 == 0) {
+                ee.push_back(Event(frame, float(i % 7), QString()));
+            } else {
+                ee.push_back(Event(frame, float(i % 7), i % 13, QString()));
+            }
+        }
+        ee.push_back(ee[4]); // a duplicate
+
+        EventSeries one, bulk;
+        for (const auto &e: ee) one.add(e);
+        bulk.addEvents(EventVector(ee.begin(), ee.begin() + 150));
+        bulk.addEvents(EventVector(ee.begin() + 150, ee.end()));
+        QCOMPARE(bulk.getAllEvents(), one.getAllEvents());
+        QCOMPARE(bulk.getEndFrame(), one.getEndFrame());
+        for (int f = 0; f < 120; f += 5) {
+            QCOMPARE(bulk.getEventsCovering(f), one.getEventsCovering(f));
+            QCOMPARE(bulk.getEventsSpanning(f, 7), one.getEventsSpanning(f, 7));
+        }
+
+        EventVector toRemove;
+        for (int i = 0; i < int(ee.size()); i += 2) {
+            toRemove.push_back(ee[i]);
+        }
+        toRemove.push_back(ee[4]); // remove both instances of the duplicate
+        toRemove.push_back(Event(1000, QString())); // never added
+        for (const auto &e: toRemove) one.remove(e);
+        bulk.removeEvents(toRemove);
+        QCOMPARE(bulk.count(), one.count());
+        QCOMPARE(bulk.getAllEvents(), one.getAllEvents());
+        QCOMPARE(bulk.getEndFrame(), one.getEndFrame());
+        for (int f = 0; f < 120; f += 5) {
+            QCOMPARE(bulk.getEventsCovering(f), one.getEventsCovering(f));
+            QCOMPARE(bulk.getEventsSpanning(f, 7), one.getEventsSpanning(f, 7));
+        }
+
+        bulk.removeEvents(bulk.getAllEvents());
+        QVERIFY(bulk.isEmpty());
+        QCOMPARE(bulk.getEndFrame(), sv_frame_t(0));
+    }
+
     void preceding() {
         
         EventSeries s;
@@ -0,0 +1,170 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_NUMBER_FORMAT_H
+#define TEST_NUMBER_FORMAT_H
+
+#include "../NumberFormat.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QRegExp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+class TestNumberFormat : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QString printfG(double value, int precision) {
+        // %g, with the exponent zero-padding removed
+        char buf[200];
+        snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        QString s(buf);
+        s.replace("e-0", "e-");
+        s.replace("e+0", "e+");
+        return s;
+    }
+
+private slots:
+    void integers() {
+        QCOMPARE(NumberFormat::fromInteger(0), QString("0"));
+        QCOMPARE(NumberFormat::fromInteger(7), QString("7"));
+        QCOMPARE(NumberFormat::fromInteger(-7), QString("-7"));
+        QCOMPARE(NumberFormat::fromInteger(1234567890123LL),
+                 QString("1234567890123"));
+        QCOMPARE(NumberFormat::fromInteger
+                 (std::numeric_limits<int64_t>::max()),
+                 QString("9223372036854775807"));
+        QCOMPARE(NumberFormat::fromInteger
+                 (std::numeric_limits<int64_t>::min()),
+                 QString("-9223372036854775808"));
+    }
+
+    void appending() {
+        QString s("frame=");
+        NumberFormat::appendInteger(s, 100);
+        s += ",";
+        NumberFormat::appendFloat(s, 0.5f);
+        s += ",";
+        NumberFormat::appendFloat(s, 0.333333333, 3);
+        QCOMPARE(s, QString("frame=100,0.5,0.333"));
+    }
+
+    void shortest() {
+        QCOMPARE(NumberFormat::fromFloat(0.f), QString("0"));
+        QCOMPARE(NumberFormat::fromFloat(-0.f), QString("-0"));
+        QCOMPARE(NumberFormat::fromFloat(1.f), QString("1"));
+        QCOMPARE(NumberFormat::fromFloat(-2.5f), QString("-2.5"));
+        QCOMPARE(NumberFormat::fromFloat(0.1f), QString("0.1"));
+        QCOMPARE(NumberFormat::fromFloat(0.3f), QString("0.3"));
+        QCOMPARE(NumberFormat::fromFloat(123.4f), QString("123.4"));
+        QCOMPARE(NumberFormat::fromFloat(100000.f), QString("100000"));
+        QCOMPARE(NumberFormat::fromFloat(1000000.f), QString("1e+6"));
+        QCOMPARE(NumberFormat::fromFloat(16777216.f), QString("16777216"));
+        QCOMPARE(NumberFormat::fromFloat(0.0001f), QString("0.0001"));
+        QCOMPARE(NumberFormat::fromFloat(0.00001f), QString("1e-5"));
+        QCOMPARE(NumberFormat::fromFloat(1.0f/3.0f), QString("0.33333334"));
+        QCOMPARE(NumberFormat::fromFloat(std::numeric_limits<float>::max()),
+                 QString("3.4028235e+38"));
+        QCOMPARE(NumberFormat::fromFloat(std::numeric_limits<float>::min()),
+                 QString("1.1754944e-38"));
+        QCOMPARE(NumberFormat::fromFloat
+                 (std::numeric_limits<float>::denorm_min()),
+                 QString("1e-45"));
+    }
+
+    void nonFinite() {
+        QCOMPARE(NumberFormat::fromFloat(NAN), QString("nan"));
+        QCOMPARE(NumberFormat::fromFloat(INFINITY), QString("inf"));
+        QCOMPARE(NumberFormat::fromFloat(-INFINITY), QString("-inf"));
+        QCOMPARE(NumberFormat::fromFloat(double(NAN), 6), QString("nan"));
+        QCOMPARE(NumberFormat::fromFloat(-double(INFINITY), 6),
+                 QString("-inf"));
+    }
+
+    void shortestRoundTrips() {
+        // Pseudo-random floats across the whole range, each of which
+        // must read back exactly and must need no fewer digits
+        uint32_t bits = 1;
+        for (int i = 0; i < 200000; ++i) {
+            bits = bits * 1664525u + 1013904223u;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            if (!std::isfinite(f)) continue;
+            QString s = NumberFormat::fromFloat(f);
+            bool ok = false;
+            float back = s.toFloat(&ok);
+            QVERIFY(ok);
+            if (back != f) {
+                std::cerr << "Float " << f << " written as \""
+                          << s.toStdString() << "\" reads back as "
+                          << back << std::endl;
+            }
+            QCOMPARE(back, f);
+            QString mantissa = s.section('e', 0, 0);
+            mantissa.remove('-');
+            mantissa.remove('.');
+            mantissa.remove(QRegExp("^0+"));
+            mantissa.remove(QRegExp("0+$"));
+            int digits = mantissa.size();
+            if (digits > 1) {
+                QVERIFY(float(printfG(f, digits - 1).toDouble()) != f);
+            }
+        }
+    }
+
+    void precision() {
+        QCOMPARE(NumberFormat::fromFloat(M_PI, 1), QString("3"));
+        QCOMPARE(NumberFormat::fromFloat(M_PI, 6), QString("3.14159"));
+        QCOMPARE(NumberFormat::fromFloat(M_PI, 12), QString("3.14159265359"));
+        QCOMPARE(NumberFormat::fromFloat(0.5, 6), QString("0.5"));
+        QCOMPARE(NumberFormat::fromFloat(1e-5, 6), QString("1e-5"));
+        QCOMPARE(NumberFormat::fromFloat(123456789.0, 6), QString("1.23457e+8"));
+        QCOMPARE(NumberFormat::fromFloat(-0.000123456, 3), QString("-0.000123"));
+        QCOMPARE(NumberFormat::fromFloat(2.5, 1), QString("2"));
+        QCOMPARE(NumberFormat::fromFloat(999999.5, 6), QString("1e+6"));
+        QCOMPARE(NumberFormat::fromFloat(0.0, 6), QString("0"));
+        // out-of-range precision is clamped
+        QCOMPARE(NumberFormat::fromFloat(M_PI, 0), QString("3"));
+    }
+
+    void precisionMatchesPrintf() {
+        uint64_t bits = 1;
+        for (int i = 0; i < 100000; ++i) {
+            bits = bits * 6364136223846793005ull + 1442695040888963407ull;
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            if (!std::isfinite(d)) continue;
+            for (int precision: { 1, 3, 6, 9, 17 }) {
+                QCOMPARE(NumberFormat::fromFloat(d, precision),
+                         printfG(d, precision));
+            }
+            float f = float(d);
+            if (!std::isfinite(f)) continue;
+            for (int precision: { 2, 6, 8 }) {
+                QCOMPARE(NumberFormat::fromFloat(f, precision),
+                         printfG(f, precision));
+            }
+        }
+    }
+};
+
+#endif
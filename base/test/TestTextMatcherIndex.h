@@ -0,0 +1,103 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_TEXT_MATCHER_INDEX_H
+#define TEST_TEXT_MATCHER_INDEX_H
+
+#include "../TextMatcherIndex.h"
+#include "../TextMatcher.h"
+
+#include <QObject>
+#include <QStringList>
+#include <QtTest>
+
+#include <random>
+
+using namespace std;
+
+class TestTextMatcherIndex : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString randomText(mt19937 &rng, int maxLength) {
+        // a small alphabet, so that there are plenty of partial hits
+        static const QString alphabet("abcdABCD -");
+        QString s;
+        int n = int(rng() % (maxLength + 1));
+        for (int i = 0; i < n; ++i) {
+            s += alphabet[int(rng() % alphabet.length())];
+        }
+        return s;
+    }
+
+private slots:
+    void empty() {
+        TextMatcherIndex index;
+        QVERIFY(index.getCandidates(QStringList() << "a").empty());
+        QVERIFY(index.getCandidates(QStringList() << "abcd").empty());
+    }
+
+    void caseInsensitive() {
+        TextMatcherIndex index;
+        index.add("x", "Spectral Centroid");
+        index.add("y", "Onset Detector");
+        set<QString> expected { "x" };
+        QCOMPARE(index.getCandidates(QStringList() << "SPECTRAL"), expected);
+        QCOMPARE(index.getCandidates(QStringList() << "troi"), expected);
+        QCOMPARE(index.getCandidates(QStringList() << "cen"), expected);
+        expected.insert("y");
+        QCOMPARE(index.getCandidates(QStringList() << "centroid" << "onset"),
+                 expected);
+        QVERIFY(index.getCandidates(QStringList() << "chroma").empty());
+    }
+
+    void sameAsTextMatcher() {
+        // Every key that TextMatcher would score must be a candidate,
+        // including where a key's texts were added out of order
+        mt19937 rng(0);
+        map<QString, QStringList> texts;
+        TextMatcherIndex index;
+        for (int i = 0; i < 1000; ++i) {
+            QString key = QString("key%1").arg(rng() % 300);
+            QString text = randomText(rng, 30);
+            texts[key] << text;
+            index.add(key, text);
+        }
+        QCOMPARE(index.getKeyCount(), int(texts.size()));
+
+        TextMatcher matcher;
+        for (int i = 0; i < 500; ++i) {
+            QStringList keywords;
+            int nk = 1 + int(rng() % 3);
+            for (int k = 0; k < nk; ++k) {
+                QString keyword;
+                while (keyword == "") keyword = randomText(rng, 6);
+                keywords << keyword;
+            }
+            set<QString> candidates = index.getCandidates(keywords);
+            for (const auto &t: texts) {
+                TextMatcher::Match match;
+                for (const auto &text: t.second) {
+                    matcher.test(match, keywords, text, "text", 10);
+                }
+                if (match.score > 0) {
+                    QVERIFY(candidates.find(t.first) != candidates.end());
+                }
+            }
+        }
+    }
+};
+
+#endif
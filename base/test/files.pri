@@ -1,16 +1,20 @@
 TEST_HEADERS = \
 	     TestById.h \
 	     TestColumnOp.h \
+	     TestEpochReclaimer.h \
 	     TestLogRange.h \
 	     TestMovingMedian.h \
+	     TestNumberFormat.h \
 	     TestOurRealTime.h \
 	     TestPitch.h \
 	     TestEventSeries.h \
 	     TestRangeMapper.h \
 	     TestScaleTickIntervals.h \
 	     TestStringBits.h \
+	     TestTextMatcherIndex.h \
 	     TestVampRealTime.h \
-	     StressEventSeries.h
+	     StressEventSeries.h \
+	     StressNumberFormat.h
 	     
 TEST_SOURCES += \
 	     svcore-base-test.cpp
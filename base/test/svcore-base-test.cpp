@@ -16,13 +16,17 @@
 #include "TestPitch.h"
 #include "TestScaleTickIntervals.h"
 #include "TestStringBits.h"
+#include "TestNumberFormat.h"
+#include "TestTextMatcherIndex.h"
 #include "TestOurRealTime.h"
 #include "TestVampRealTime.h"
 #include "TestColumnOp.h"
 #include "TestMovingMedian.h"
 #include "TestById.h"
+#include "TestEpochReclaimer.h"
 #include "TestEventSeries.h"
 #include "StressEventSeries.h"
+#include "StressNumberFormat.h"
 
 #include "system/Init.h"
 
@@ -67,6 +71,16 @@ int main(int argc, char *argv[])
         if (QTest::qExec(&t, argc, argv) == 0) ++good;
         else ++bad;
     }
+    {
+        TestNumberFormat t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+    {
+        TestTextMatcherIndex t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
     {
         TestColumnOp t;
         if (QTest::qExec(&t, argc, argv) == 0) ++good;
@@ -98,12 +112,23 @@ int main(int argc, char *argv[])
         else ++bad;
     }
 
+    {
+        TestEpochReclaimer t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
 #ifdef NOT_DEFINED
     {
         StressEventSeries t;
         if (QTest::qExec(&t, argc, argv) == 0) ++good;
         else ++bad;
     }
+    {
+        StressNumberFormat t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
 #endif
     
     if (bad > 0) {
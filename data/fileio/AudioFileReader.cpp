@@ -15,8 +15,25 @@
 
 #include "AudioFileReader.h"
 
+#include <algorithm>
+
 using std::vector;
 
+sv_frame_t
+AudioFileReader::getInterleavedFrames(sv_frame_t start,
+                                      sv_frame_t count,
+                                      float *buffer) const
+{
+    floatvec_t interleaved = getInterleavedFrames(start, count);
+
+    int channels = getChannelCount();
+    if (channels < 1) return 0;
+
+    sv_frame_t rc = std::min(sv_frame_t(interleaved.size()) / channels, count);
+    std::copy(interleaved.begin(), interleaved.begin() + rc * channels, buffer);
+    return rc;
+}
+
 vector<floatvec_t>
 AudioFileReader::getDeInterleavedFrames(sv_frame_t start, sv_frame_t count) const
 {
@@ -140,6 +140,26 @@ public:
      */
     virtual bool isUpdating() const { return false; }
 
+    /**
+     * Return true if reads from this reader go to storage or to a
+     * decoder, rather than to samples already held in memory, so that
+     * a caller working through the file may gain by reading ahead of
+     * itself. This may change from true to false over the lifetime
+     * of the reader, for example once a file is fully available and
+     * can be mapped. The default is false.
+     */
+    virtual bool isReadAheadUseful() const { return false; }
+
+    /**
+     * Set the priority with which this file should be decoded,
+     * relative to any others waiting to be decoded at the same
+     * time. Higher values go first; the default is 0. This may be
+     * raised, for example, for the file the user is looking at. Has
+     * no effect for readers that do not decode, or that have already
+     * started decoding.
+     */
+    virtual void setDecodePriority(int) { }
+
     /** 
      * Return interleaved samples for count frames from index start.
      * The resulting vector will contain count * getChannelCount()
@@ -152,6 +172,23 @@ public:
     virtual floatvec_t getInterleavedFrames(sv_frame_t start,
                                             sv_frame_t count) const = 0;
 
+    /**
+     * Write interleaved samples for count frames from index start
+     * into the given buffer, which must have room for count *
+     * getChannelCount() samples. Return the number of frames
+     * actually written, which will be fewer than count if end of
+     * file is reached.
+     *
+     * The default implementation calls the vector-returning
+     * getInterleavedFrames and copies the result. Subclasses that
+     * can read directly into the caller's buffer should override
+     * this, as it is the cheaper of the two for block-by-block
+     * reading. The same thread-safety requirement applies.
+     */
+    virtual sv_frame_t getInterleavedFrames(sv_frame_t start,
+                                            sv_frame_t count,
+                                            float *buffer) const;
+
     /**
      * Return de-interleaved samples for count frames from index
      * start.  Implemented in this class (it calls
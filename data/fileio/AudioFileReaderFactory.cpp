@@ -26,6 +26,7 @@
 #include <QString>
 #include <QFileInfo>
 #include <iostream>
+#include <cstdint>
 
 using namespace std;
 
@@ -92,14 +93,21 @@ AudioFileReaderFactory::createReader(FileSource source,
     sv_samplerate_t targetRate = params.targetRate;
     bool normalised = (params.normalisation == Normalisation::Peak);
   
+    int bitDepth = 0;
     sv_frame_t estimatedSamples = 
-        AudioFileSizeEstimator::estimate(source, targetRate);
+        AudioFileSizeEstimator::estimate(source, targetRate, &bitDepth);
     
     CodedAudioFileReader::CacheMode cacheMode =
         CodedAudioFileReader::CacheInTemporaryFile;
 
     if (estimatedSamples > 0) {
-        size_t kb = (estimatedSamples * sizeof(float)) / 1024;
+        // The in-memory cache stores samples from sources of up to
+        // 16 bits in 16 bits (see CompactSampleBuffer)
+        size_t bytesPerSample = sizeof(float);
+        if (bitDepth > 0 && bitDepth <= 16) {
+            bytesPerSample = sizeof(int16_t);
+        }
+        size_t kb = (estimatedSamples * bytesPerSample) / 1024;
         SVDEBUG << "AudioFileReaderFactory: checking where to potentially cache "
                 << kb << "K of sample data" << endl;
         StorageAdviser::Recommendation rec =
@@ -153,12 +161,23 @@ AudioFileReaderFactory::createReader(FileSource source,
                     MP3FileReader::GaplessMode::Gapless :
                     MP3FileReader::GaplessMode::Gappy;
             
+                // If the decoded audio would be too large to cache
+                // in memory, index the file and decode from it on
+                // demand rather than decoding it all to disc first
+                CodedAudioFileReader::DecodeMode mp3DecodeMode = decodeMode;
+                if (decodeMode == CodedAudioFileReader::DecodeThreaded &&
+                    cacheMode == CodedAudioFileReader::CacheInTemporaryFile &&
+                    !normalised) {
+                    mp3DecodeMode = CodedAudioFileReader::DecodeOnDemand;
+                }
+                
                 reader = new MP3FileReader
-                    (source, decodeMode, cacheMode, gapless,
+                    (source, mp3DecodeMode, cacheMode, gapless,
                      targetRate, normalised, reporter);
 
                 if (reader->isOK()) {
                     SVDEBUG << "AudioFileReaderFactory: MP3 file reader is OK, returning it" << endl;
+                    reader->setDecodePriority(params.decodePriority);
                     return reader;
                 } else {
                     delete reader;
@@ -192,6 +211,7 @@ AudioFileReaderFactory::createReader(FileSource source,
 
             if (reader->isOK()) {
                 SVDEBUG << "AudioFileReaderFactory: WAV file reader is OK, returning it" << endl;
+                reader->setDecodePriority(params.decodePriority);
                 return reader;
             } else {
                 delete reader;
@@ -206,6 +226,7 @@ AudioFileReaderFactory::createReader(FileSource source,
 
             if (reader->isOK()) {
                 SVDEBUG << "AudioFileReaderFactory: BQA reader is OK, returning it" << endl;
+                reader->setDecodePriority(params.decodePriority);
                 return reader;
             } else {
                 delete reader;
@@ -114,12 +114,21 @@ public:
          * Threading mode. The default is ThreadingMode::NotThreaded.
          */
         ThreadingMode threadingMode;
+
+        /**
+         * Priority of the file's decode relative to others waiting
+         * to be decoded at the same time (see
+         * AudioFileReader::setDecodePriority). Higher values go
+         * first. The default is 0.
+         */
+        int decodePriority;
         
         Parameters() :
             targetRate(0),
             normalisation(Normalisation::None),
             gaplessMode(GaplessMode::Gapless),
-            threadingMode(ThreadingMode::NotThreaded)
+            threadingMode(ThreadingMode::NotThreaded),
+            decodePriority(0)
         { }
     };
     
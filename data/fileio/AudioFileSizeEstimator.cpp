@@ -22,9 +22,14 @@
 
 sv_frame_t
 AudioFileSizeEstimator::estimate(FileSource source,
-                                 sv_samplerate_t targetRate)
+                                 sv_samplerate_t targetRate,
+                                 int *bitDepth)
 {
     sv_frame_t estimate = 0;
+
+    if (bitDepth) {
+        *bitDepth = 0;
+    }
     
     SVDEBUG << "AudioFileSizeEstimator: Sample count estimate requested for file \""
             << source.getLocalFilename() << "\"" << endl;
@@ -41,6 +46,8 @@ AudioFileSizeEstimator::estimate(FileSource source,
         sv_samplerate_t rate = reader->getSampleRate();
         if (targetRate != 0.0 && targetRate != rate) {
             samples = sv_frame_t(double(samples) * targetRate / rate);
+        } else if (bitDepth) {
+            *bitDepth = reader->getBitDepth();
         }
         SVDEBUG << "AudioFileSizeEstimator: WAV file reader accepts this file, reports "
                 << samples << " samples" << endl;
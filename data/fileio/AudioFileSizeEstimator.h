@@ -41,9 +41,15 @@ public:
      * The returned value is an estimate, and is deliberately usually
      * on the high side. If the estimator has no idea at all, this
      * will return 0.
+     *
+     * If bitDepth is non-null, it will be set to the bit depth of
+     * the decoded samples if they are known to be integer PCM that
+     * will not be resampled (so that they could be stored at that
+     * depth without loss), or to 0 otherwise.
      */
     static sv_frame_t estimate(FileSource source,
-                               sv_samplerate_t targetRate = 0);
+                               sv_samplerate_t targetRate = 0,
+                               int *bitDepth = nullptr);
 };
 
 #endif
@@ -0,0 +1,420 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "AudioReadScheduler.h"
+
+#include "AudioFileReader.h"
+#include "FileReadThread.h"
+
+#include "base/Profiler.h"
+#include "base/Debug.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+
+//#define DEBUG_AUDIO_READ_SCHEDULER 1
+
+using namespace std;
+
+static const sv_frame_t blockFrames = 16384;
+
+// Limit on the memory used for retained blocks, in samples
+static const sv_frame_t maxRetainedSamples = 1024 * 1024;
+
+// Limit on the number of blocks queued ahead of a sequential reader
+static const int maxReadAheadBlocks = 8;
+
+// Number of separate sequential readers we keep track of
+static const int maxStreams = 4;
+
+AudioReadScheduler::AudioReadScheduler(const AudioFileReader *reader) :
+    m_reader(reader),
+    m_thread(new FileReadThread),
+    m_channels(reader ? reader->getChannelCount() : 0),
+    m_blockFrames(blockFrames),
+    m_maxBlocks(0),
+    m_useCount(0),
+    m_nextStreamId(0)
+{
+    m_maxBlocks = int(maxRetainedSamples / (m_blockFrames * max(m_channels, 1)));
+    if (m_maxBlocks < 2 * maxReadAheadBlocks) {
+        m_maxBlocks = 2 * maxReadAheadBlocks;
+    }
+
+    m_thread->start();
+}
+
+AudioReadScheduler::~AudioReadScheduler()
+{
+    // This cancels any outstanding requests; the thread won't write
+    // to their buffers after that
+    m_thread->finish();
+    m_thread->wait();
+    delete m_thread;
+}
+
+sv_frame_t
+AudioReadScheduler::getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                         float *buffer)
+{
+    Profiler profiler("AudioReadScheduler::getInterleavedFrames");
+    
+    if (start < 0 || count <= 0 || m_channels == 0) {
+        return 0;
+    }
+
+    if (!m_reader->isUpdating()) {
+        sv_frame_t available = m_reader->getFrameCount() - start;
+        if (available <= 0) {
+            return 0;
+        }
+        if (count > available) {
+            count = available;
+        }
+    }
+
+    sv_frame_t first = start / m_blockFrames;
+    sv_frame_t last = (start + count - 1) / m_blockFrames;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        collectCompleted();
+
+        // Queue all the blocks we need before waiting for any of
+        // them, so that the read thread can coalesce them
+        requestRange(first, last, DemandPriority);
+
+        Stream &stream = findStream(start);
+        stream.lastStart = start;
+        stream.lastEnd = start + count;
+        stream.lastUsed = ++m_useCount;
+
+        if (stream.sequentialReads >= 2) {
+            // Read further ahead the longer the run goes on
+            int n = min(stream.sequentialReads - 1, maxReadAheadBlocks);
+#ifdef DEBUG_AUDIO_READ_SCHEDULER
+            SVDEBUG << "AudioReadScheduler: sequential read at " << start
+                    << " in stream " << stream.id << ", reading " << n
+                    << " block(s) ahead" << endl;
+#endif
+            requestRange(last + 1, last + n, ReadAheadPriority,
+                         stream.id);
+        }
+    }
+
+    sv_frame_t obtained = 0;
+
+    for (sv_frame_t b = first; b <= last; ++b) {
+
+        shared_ptr<floatvec_t> data;
+        sv_frame_t frames = 0;
+        if (!acquireBlock(b, data, frames)) {
+            break;
+        }
+
+        sv_frame_t offset = start + obtained - b * m_blockFrames;
+        sv_frame_t n = min(frames - offset, count - obtained);
+        if (n <= 0) {
+            break;
+        }
+
+        copy(data->begin() + offset * m_channels,
+             data->begin() + (offset + n) * m_channels,
+             buffer + obtained * m_channels);
+        obtained += n;
+
+        if (frames < m_blockFrames) {
+            break;
+        }
+    }
+
+    return obtained;
+}
+
+void
+AudioReadScheduler::prefetch(sv_frame_t start, sv_frame_t count, int priority)
+{
+    if (start < 0) {
+        count += start;
+        start = 0;
+    }
+    if (count <= 0 || m_channels == 0) {
+        return;
+    }
+
+    sv_frame_t first = start / m_blockFrames;
+    sv_frame_t last = (start + count - 1) / m_blockFrames;
+
+    // Don't let a prefetch push out more than half of what we have
+    if (last - first >= m_maxBlocks / 2) {
+        last = first + m_maxBlocks / 2 - 1;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    collectCompleted();
+    requestRange(first, last, priority);
+}
+
+AudioReadScheduler::BlockMap::iterator
+AudioReadScheduler::request(sv_frame_t index, int priority, int stream)
+{
+    Block block;
+    block.data = make_shared<floatvec_t>(m_blockFrames * m_channels, 0.f);
+    block.frames = 0;
+    block.priority = priority;
+    block.lastUsed = ++m_useCount;
+    block.stream = stream;
+
+    // If the reader is still decoding when we ask, a short read may
+    // just mean that it hasn't got that far yet. (If it has finished
+    // by now, it has everything, and a short read is the true end.)
+    block.incomplete = m_reader->isUpdating();
+
+    FileReadThread::Request request;
+    request.reader = m_reader;
+    request.start = index * m_blockFrames;
+    request.count = m_blockFrames;
+    request.data = block.data->data();
+    request.priority = priority;
+    request.got = 0;
+    request.successful = false;
+
+    block.token = m_thread->request(request);
+    
+    return m_blocks.insert(BlockMap::value_type(index, block)).first;
+}
+
+void
+AudioReadScheduler::requestRange(sv_frame_t first, sv_frame_t last,
+                                 int priority, int stream)
+{
+    for (sv_frame_t b = first; b <= last; ++b) {
+
+        // Only a demand read goes past the end of what the reader
+        // has now: it may be about to have more
+        if (priority < DemandPriority &&
+            b * m_blockFrames >= m_reader->getFrameCount()) {
+            break;
+        }
+
+        auto i = m_blocks.find(b);
+        if (i == m_blocks.end()) {
+            request(b, priority, stream);
+        } else if (i->second.token >= 0 && i->second.priority < priority) {
+            m_thread->setPriority(i->second.token, priority);
+            i->second.priority = priority;
+            i->second.stream = -1;
+        }
+    }
+}
+
+bool
+AudioReadScheduler::complete(BlockMap::iterator i)
+{
+    // The request must be ready or cancelled
+
+    FileReadThread::Request request;
+    bool successful = (m_thread->getRequest(i->second.token, request) &&
+                       request.successful);
+    m_thread->done(i->second.token);
+
+    if (!successful) {
+        m_blocks.erase(i);
+        return false;
+    }
+
+    i->second.token = -1;
+    i->second.frames = request.got;
+    if (request.got >= m_blockFrames) {
+        i->second.incomplete = false;
+    }
+    return true;
+}
+
+void
+AudioReadScheduler::collectCompleted()
+{
+    for (auto i = m_blocks.begin(); i != m_blocks.end(); ) {
+        auto j = i++;
+        if (j->second.token >= 0 && m_thread->isReady(j->second.token)) {
+            complete(j);
+        }
+    }
+    evict();
+}
+
+AudioReadScheduler::Stream &
+AudioReadScheduler::findStream(sv_frame_t start)
+{
+    // A read continues a stream if it starts no earlier than the last
+    // read in that stream did and not far past where that one ended
+    // -- this includes the overlapping reads made by windowed
+    // analysis
+    
+    for (auto &s: m_streams) {
+        if (start >= s.lastStart && start <= s.lastEnd + m_blockFrames) {
+            if (s.sequentialReads <= maxReadAheadBlocks) {
+                ++s.sequentialReads;
+            }
+            return s;
+        }
+    }
+
+    // Otherwise it starts a new one, in place of whichever has gone
+    // longest without a read
+    
+    Stream stream;
+    stream.id = m_nextStreamId++;
+    stream.lastStart = start;
+    stream.lastEnd = start;
+    stream.sequentialReads = 0;
+    stream.lastUsed = 0;
+    
+    if (int(m_streams.size()) < maxStreams) {
+        m_streams.push_back(stream);
+        return m_streams.back();
+    }
+
+    auto lru = min_element(m_streams.begin(), m_streams.end(),
+                           [](const Stream &a, const Stream &b) {
+                               return a.lastUsed < b.lastUsed;
+                           });
+    if (lru->sequentialReads > 0) {
+        cancelReadAhead(lru->id);
+    }
+    *lru = stream;
+    return *lru;
+}
+
+void
+AudioReadScheduler::cancelReadAhead(int stream)
+{
+    // Anything queued purely as read-ahead for a stream we have
+    // stopped following is now probably not going to be
+    // wanted. (Blocks anyone is waiting for have been raised to
+    // demand priority.)
+    
+    for (auto i = m_blocks.begin(); i != m_blocks.end(); ) {
+        auto j = i++;
+        if (j->second.token >= 0 &&
+            j->second.priority == ReadAheadPriority &&
+            j->second.stream == stream) {
+            m_thread->cancel(j->second.token);
+            m_thread->done(j->second.token);
+            m_blocks.erase(j);
+        }
+    }
+}
+
+void
+AudioReadScheduler::evict()
+{
+    int retained = 0;
+    for (const auto &b: m_blocks) {
+        if (b.second.token < 0) ++retained;
+    }
+
+    while (retained > m_maxBlocks) {
+        auto lru = m_blocks.end();
+        for (auto i = m_blocks.begin(); i != m_blocks.end(); ++i) {
+            if (i->second.token >= 0) continue;
+            if (lru == m_blocks.end() ||
+                i->second.lastUsed < lru->second.lastUsed) {
+                lru = i;
+            }
+        }
+        m_blocks.erase(lru);
+        --retained;
+    }
+}
+
+void
+AudioReadScheduler::use(BlockMap::iterator i,
+                        shared_ptr<floatvec_t> &data,
+                        sv_frame_t &frames)
+{
+    data = i->second.data;
+    frames = i->second.frames;
+    i->second.lastUsed = ++m_useCount;
+
+    if (i->second.incomplete) {
+        // This was the end of the audio decoded so far when it was
+        // read, and there may have been more since, so it can't be
+        // reused
+        m_blocks.erase(i);
+    }
+}
+
+bool
+AudioReadScheduler::acquireBlock(sv_frame_t index,
+                                 shared_ptr<floatvec_t> &data,
+                                 sv_frame_t &frames)
+{
+    while (true) {
+
+        int token = -1;
+
+        {
+            QMutexLocker locker(&m_mutex);
+
+            auto i = m_blocks.find(index);
+            if (i != m_blocks.end() &&
+                i->second.token < 0 && i->second.incomplete) {
+                // Read (in advance) before decoding had got to the
+                // end of it: there may be more now, so read it again
+                m_blocks.erase(i);
+                i = m_blocks.end();
+            }
+            if (i == m_blocks.end()) {
+                i = request(index, DemandPriority);
+            } else if (i->second.token >= 0 &&
+                       i->second.priority < DemandPriority) {
+                m_thread->setPriority(i->second.token, DemandPriority);
+                i->second.priority = DemandPriority;
+                i->second.stream = -1;
+            }
+
+            if (i->second.token < 0) {
+                use(i, data, frames);
+                return true;
+            }
+
+            token = i->second.token;
+        }
+
+        m_thread->waitFor(token);
+
+        {
+            QMutexLocker locker(&m_mutex);
+
+            auto i = m_blocks.find(index);
+            if (i != m_blocks.end() && i->second.token == token) {
+                if (!complete(i)) {
+                    return false;
+                }
+            }
+            
+            if (i != m_blocks.end() && i->second.token < 0) {
+                use(i, data, frames);
+                evict();
+                return true;
+            }
+
+            // Otherwise another reader got to it first, and it has
+            // since been dropped again: go round and ask for it anew
+        }
+    }
+}
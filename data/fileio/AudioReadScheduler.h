@@ -0,0 +1,128 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_AUDIO_READ_SCHEDULER_H
+#define SV_AUDIO_READ_SCHEDULER_H
+
+#include "base/BaseTypes.h"
+
+#include <QMutex>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+class AudioFileReader;
+class FileReadThread;
+
+/**
+ * Reads audio from an AudioFileReader in fixed-size blocks through a
+ * FileReadThread of its own, and keeps the most recently used blocks.
+ *
+ * Reads requested through getInterleavedFrames are queued ahead of
+ * anything else. When successive reads are found to be moving
+ * forward through the file, the blocks following them are queued
+ * for reading in the background, at low priority, so that the
+ * reader is not kept waiting for the storage when it gets there.
+ * A few such forward runs are tracked at once, so that callers
+ * working through different parts of the file in turn (a player
+ * and an analysis, say) do not cancel one another's read-ahead.
+ * Other users may ask for a region to be read in advance with
+ * prefetch.
+ *
+ * The reader must outlive the scheduler. All functions are
+ * thread-safe.
+ */
+class AudioReadScheduler
+{
+public:
+    enum Priority {
+        ReadAheadPriority = 0,
+        PrefetchPriority = 1,
+        DemandPriority = 2
+    };
+    
+    AudioReadScheduler(const AudioFileReader *reader);
+    ~AudioReadScheduler();
+
+    /**
+     * Write interleaved samples for count frames from index start
+     * into the given buffer, as for
+     * AudioFileReader::getInterleavedFrames, waiting for any of them
+     * that are not yet available to be read.
+     */
+    sv_frame_t getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer);
+
+    /**
+     * Queue the given region for reading in the background, if it is
+     * not already available, without waiting for it.
+     */
+    void prefetch(sv_frame_t start, sv_frame_t count,
+                  int priority = PrefetchPriority);
+
+    AudioReadScheduler(const AudioReadScheduler &) =delete;
+    AudioReadScheduler &operator=(const AudioReadScheduler &) =delete;
+    
+private:
+    struct Block {
+        std::shared_ptr<floatvec_t> data;
+        sv_frame_t frames;
+        int token;     // of the request outstanding, or -1 once read
+        int priority;  // of the request outstanding
+        long lastUsed;
+        bool incomplete; // may be short only because decoding was not done
+        int stream;    // id of the stream it was read ahead for, or -1
+    };
+    typedef std::map<sv_frame_t, Block> BlockMap; // by block index
+
+    struct Stream {
+        int id;
+        sv_frame_t lastStart;
+        sv_frame_t lastEnd;
+        int sequentialReads;
+        long lastUsed;
+    };
+
+    // These are called with m_mutex held
+    BlockMap::iterator request(sv_frame_t index, int priority,
+                               int stream = -1);
+    void requestRange(sv_frame_t first, sv_frame_t last, int priority,
+                      int stream = -1);
+    bool complete(BlockMap::iterator i);
+    void collectCompleted();
+    Stream &findStream(sv_frame_t start);
+    void cancelReadAhead(int stream);
+    void evict();
+    void use(BlockMap::iterator i,
+             std::shared_ptr<floatvec_t> &data,
+             sv_frame_t &frames);
+
+    bool acquireBlock(sv_frame_t index,
+                      std::shared_ptr<floatvec_t> &data,
+                      sv_frame_t &frames);
+    
+    const AudioFileReader *m_reader;
+    FileReadThread *m_thread;
+    int m_channels;
+    sv_frame_t m_blockFrames;
+    int m_maxBlocks;
+    BlockMap m_blocks;
+    long m_useCount;
+    std::vector<Stream> m_streams;
+    int m_nextStreamId;
+    QMutex m_mutex;
+};
+
+#endif
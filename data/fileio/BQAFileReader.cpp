@@ -97,7 +97,7 @@ BQAFileReader::BQAFileReader(FileSource source,
         }
 
         if (isDecodeCacheInitialised()) finishDecodeCache();
-        endSerialised();
+        releaseDecodeSlot();
 
         if (m_reporter) m_reporter->setProgress(100);
 
@@ -136,9 +136,8 @@ void
 BQAFileReader::DecodeThread::run()
 {
     if (m_reader->m_cacheMode == CacheInTemporaryFile) {
-        m_reader->startSerialised("BQAFileReader::Decode",
-                                  &m_reader->m_cancelled);
-        if (m_reader->m_cancelled) {
+        // We don't know the length of the decoded data in advance
+        if (!m_reader->acquireDecodeSlot(&m_reader->m_cancelled, 0)) {
             return;
         }
     }
@@ -169,7 +168,7 @@ BQAFileReader::DecodeThread::run()
     if (m_reader->isDecodeCacheInitialised()) m_reader->finishDecodeCache();
     m_reader->m_completion = 100;
 
-    m_reader->endSerialised();
+    m_reader->releaseDecodeSlot();
 
     delete m_reader->m_stream;
     m_reader->m_stream = 0;
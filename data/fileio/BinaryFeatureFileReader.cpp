@@ -0,0 +1,286 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "BinaryFeatureFileReader.h"
+#include "BinaryFeatureFormat.h"
+
+#include "model/Model.h"
+#include "model/SparseOneDimensionalModel.h"
+#include "model/SparseTimeValueModel.h"
+#include "model/RegionModel.h"
+#include "model/EditableDenseThreeDimensionalModel.h"
+#include "base/RealTime.h"
+#include "base/Debug.h"
+
+#include <QFile>
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+static sv_frame_t
+toFrame(int64_t ns, sv_samplerate_t rate)
+{
+    return RealTime::realTime2Frame
+        (RealTime(int(ns / 1000000000), int(ns % 1000000000)), rate);
+}
+
+BinaryFeatureFileReader::BinaryFeatureFileReader(QString path,
+                                                 sv_samplerate_t mainModelSampleRate) :
+    m_path(path),
+    m_mainModelSampleRate(mainModelSampleRate),
+    m_ok(false)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QByteArray header = file.read(BinaryFeatureFormat::getFileHeaderSize());
+    m_ok = BinaryFeatureFormat::isFeatureFile
+        (reinterpret_cast<const unsigned char *>(header.constData()),
+         header.size());
+}
+
+BinaryFeatureFileReader::~BinaryFeatureFileReader()
+{
+}
+
+bool
+BinaryFeatureFileReader::isOK() const
+{
+    return m_ok;
+}
+
+QString
+BinaryFeatureFileReader::getError() const
+{
+    return m_error;
+}
+
+Model *
+BinaryFeatureFileReader::load() const
+{
+    if (!m_ok) return nullptr;
+
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        SVCERR << "BinaryFeatureFileReader: Failed to open \"" << m_path
+               << "\"" << endl;
+        return nullptr;
+    }
+
+    int64_t size = file.size();
+    const unsigned char *data = file.map(0, size);
+    if (!data || !BinaryFeatureFormat::isFeatureFile(data, size)) {
+        SVCERR << "BinaryFeatureFileReader: Failed to map \"" << m_path
+               << "\": " << file.errorString() << endl;
+        return nullptr;
+    }
+
+    // Find the first output and all of its data records. The views
+    // refer to the mapping, which lasts as long as the file is open
+
+    BinaryFeatureFormat::OutputHeader output;
+    bool haveOutput = false;
+    vector<BinaryFeatureFormat::RowsView> runs;
+    bool haveDurations = false;
+    bool haveLabels = false;
+
+    int64_t offset = BinaryFeatureFormat::getFileHeaderSize();
+    int type = 0;
+    int64_t payloadOffset = 0, payloadLength = 0;
+
+    while (BinaryFeatureFormat::readRecord(data, size, offset, type,
+                                           payloadOffset, payloadLength)) {
+
+        const unsigned char *payload = data + payloadOffset;
+        offset = payloadOffset + payloadLength;
+
+        if (type == BinaryFeatureFormat::OutputRecord && !haveOutput) {
+            // The output's bin count has no values of its own to be
+            // checked against, but no row can have more bins than the
+            // file has room for
+            if (!BinaryFeatureFormat::decodeOutputRecord
+                (payload, payloadLength, output) ||
+                output.binCount > size / 4) {
+                SVCERR << "BinaryFeatureFileReader: Malformed output record in \""
+                       << m_path << "\"" << endl;
+                return nullptr;
+            }
+            haveOutput = true;
+
+        } else if (type == BinaryFeatureFormat::OutputRecord) {
+            // Only one output becomes a model, but the rest shouldn't
+            // vanish without a word
+            BinaryFeatureFormat::OutputHeader other;
+            QString id = "(malformed)";
+            if (BinaryFeatureFormat::decodeOutputRecord
+                (payload, payloadLength, other)) {
+                id = other.outputId;
+            }
+            SVCERR << "BinaryFeatureFileReader: Skipping output \"" << id
+                   << "\" in \"" << m_path << "\": only the first output, \""
+                   << output.outputId << "\", is loaded" << endl;
+
+        } else if (type == BinaryFeatureFormat::DataRecord && haveOutput) {
+            BinaryFeatureFormat::RowsView v;
+            if (!BinaryFeatureFormat::decodeDataRecord
+                (payload, payloadLength, v)) {
+                SVCERR << "BinaryFeatureFileReader: Malformed data record in \""
+                       << m_path << "\", ignoring the rest of the file" << endl;
+                break;
+            }
+            if (v.outputIndex != output.index ||
+                v.binCount != output.binCount) {
+                continue;
+            }
+            for (int i = 0; i < v.rowCount && !haveDurations; ++i) {
+                if (v.getDurationNs(i) >= 0) haveDurations = true;
+            }
+            if (v.hasLabels()) haveLabels = true;
+            runs.push_back(v);
+        }
+    }
+
+    if (!haveOutput) {
+        SVCERR << "BinaryFeatureFileReader: No outputs in \"" << m_path
+               << "\"" << endl;
+        return nullptr;
+    }
+
+    sv_samplerate_t rate = m_mainModelSampleRate;
+    if (rate <= 0) rate = output.sampleRate;
+    if (rate <= 0) rate = 44100;
+
+    QString name = output.name;
+    if (name == "") name = output.transformId;
+    if (output.summaryType != "") {
+        name = QString("%1 (%2)").arg(name).arg(output.summaryType);
+    }
+
+    int resolution = output.stepSize > 0 ? output.stepSize : 1;
+
+    if (output.binCount > 1) {
+
+        // Dense: each feature goes in the column for its own
+        // timestamp, so that a gap or an irregular step in the data
+        // doesn't shift everything after it. The columns are as far
+        // apart as the output says its features are, or failing that
+        // as the closest pair of features
+
+        sv_frame_t spacing = 0;
+        if (output.sampleType == BinaryFeatureFormat::FixedSampleRate) {
+            if (output.outputSampleRate > 0) {
+                spacing = sv_frame_t(round(rate / output.outputSampleRate));
+            }
+        } else if (output.stepSize > 0 && output.sampleRate > 0) {
+            spacing = sv_frame_t(round(output.stepSize * rate /
+                                       output.sampleRate));
+        }
+
+        sv_frame_t start = 0, prev = 0, closest = 0;
+        bool haveFrame = false;
+        for (const auto &v: runs) {
+            for (int i = 0; i < v.rowCount; ++i) {
+                sv_frame_t frame = toFrame(v.getTimeNs(i), rate);
+                if (!haveFrame || frame < start) start = frame;
+                if (haveFrame && frame > prev &&
+                    (closest == 0 || frame - prev < closest)) {
+                    closest = frame - prev;
+                }
+                prev = frame;
+                haveFrame = true;
+            }
+        }
+        if (spacing <= 0) spacing = closest;
+        if (spacing > 0) resolution = int(spacing);
+
+        auto model = new EditableDenseThreeDimensionalModel
+            (rate, resolution, output.binCount, false);
+        model->setStartFrame(start);
+        model->setBinNames(output.binNames);
+        model->setBinValueUnit(output.unit);
+
+        float min = 0.f, max = 0.f;
+        bool first = true;
+
+        EditableDenseThreeDimensionalModel::Column values(output.binCount);
+
+        for (const auto &v: runs) {
+            for (int i = 0; i < v.rowCount; ++i) {
+                for (int b = 0; b < v.binCount; ++b) {
+                    float value = v.getValue(i, b);
+                    values[b] = value;
+                    if (std::isnan(value)) continue;
+                    if (first || value < min) min = value;
+                    if (first || value > max) max = value;
+                    first = false;
+                }
+                sv_frame_t frame = toFrame(v.getTimeNs(i), rate);
+                model->setColumn(int((frame - start + resolution / 2)
+                                     / resolution), values);
+            }
+        }
+
+        model->setMinimumLevel(min);
+        model->setMaximumLevel(max);
+        model->setObjectName(name);
+        return model;
+    }
+
+    EventVector events;
+    for (const auto &v: runs) {
+        for (int i = 0; i < v.rowCount; ++i) {
+            sv_frame_t frame = toFrame(v.getTimeNs(i), rate);
+            QString label = v.getLabel(i);
+            if (output.binCount == 0) {
+                events.push_back(Event(frame, label));
+            } else if (haveDurations) {
+                int64_t d = v.getDurationNs(i);
+                events.push_back(Event(frame, v.getValue(i, 0),
+                                       d > 0 ? toFrame(d, rate) : 0,
+                                       label));
+            } else {
+                events.push_back(Event(frame, v.getValue(i, 0), label));
+            }
+        }
+    }
+
+    Model *model = nullptr;
+
+    if (output.binCount == 0) {
+        auto m = new SparseOneDimensionalModel(rate, resolution, false);
+        m->addEvents(events);
+        model = m;
+    } else if (haveDurations) {
+        auto m = new RegionModel(rate, resolution, false);
+        m->setScaleUnits(output.unit);
+        m->addEvents(events);
+        model = m;
+    } else {
+        auto m = new SparseTimeValueModel(rate, resolution, false);
+        m->setScaleUnits(output.unit);
+        m->addEvents(events);
+        model = m;
+    }
+
+    SVDEBUG << "BinaryFeatureFileReader: Loaded " << events.size()
+            << " features of output \"" << output.outputId << "\" from \""
+            << m_path << "\"" << (haveLabels ? " with labels" : "") << endl;
+
+    model->setObjectName(name);
+    return model;
+}
@@ -0,0 +1,53 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_BINARY_FEATURE_FILE_READER_H
+#define SV_BINARY_FEATURE_FILE_READER_H
+
+#include "DataFileReader.h"
+
+#include "base/BaseTypes.h"
+
+#include <QString>
+
+/**
+ * Reader for files in the binary feature format described in
+ * BinaryFeatureFormat, as written by BinaryFeatureWriter.
+ *
+ * The file is memory-mapped and the features of its first output
+ * are read from the mapping directly into a model: an output with
+ * no bins becomes a SparseOneDimensionalModel, one with a single
+ * bin a SparseTimeValueModel (or a RegionModel if its features have
+ * durations), and one with more bins an
+ * EditableDenseThreeDimensionalModel.
+ */
+class BinaryFeatureFileReader : public DataFileReader
+{
+public:
+    BinaryFeatureFileReader(QString path,
+                            sv_samplerate_t mainModelSampleRate);
+    virtual ~BinaryFeatureFileReader();
+
+    bool isOK() const override;
+    QString getError() const override;
+    Model *load() const override;
+
+private:
+    QString m_path;
+    sv_samplerate_t m_mainModelSampleRate;
+    bool m_ok;
+    QString m_error;
+};
+
+#endif
@@ -0,0 +1,356 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "BinaryFeatureFormat.h"
+
+#include <QFile>
+
+#include <cstring>
+#include <climits>
+
+using namespace std;
+
+static const char magic[8] = { 'S', 'V', 'F', 'E', 'A', 'T', 'B', 'N' };
+static const uint32_t formatVersion = 1;
+static const int recordHeaderSize = 16;
+static const int dataHeaderSize = 16;
+static const int outputFixedSize = 40;
+static const uint32_t hasLabelsFlag = 1;
+
+static inline uint32_t
+load32(const unsigned char *p)
+{
+    return p[0] | (uint32_t(p[1]) << 8) |
+        (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static inline uint64_t
+load64(const unsigned char *p)
+{
+    return load32(p) | (uint64_t(load32(p + 4)) << 32);
+}
+
+static inline double
+loadDouble(const unsigned char *p)
+{
+    uint64_t bits = load64(p);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static inline void
+append32(QByteArray &b, uint32_t v)
+{
+    char c[4] = { char(v & 0xff), char((v >> 8) & 0xff),
+                  char((v >> 16) & 0xff), char((v >> 24) & 0xff) };
+    b.append(c, 4);
+}
+
+static inline void
+append64(QByteArray &b, uint64_t v)
+{
+    append32(b, uint32_t(v & 0xffffffffu));
+    append32(b, uint32_t(v >> 32));
+}
+
+static inline void
+appendDouble(QByteArray &b, double d)
+{
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    append64(b, bits);
+}
+
+static void
+appendString(QByteArray &b, QString s)
+{
+    QByteArray utf8 = s.toUtf8();
+    append32(b, uint32_t(utf8.size()));
+    b.append(utf8);
+}
+
+static void
+pad(QByteArray &b)
+{
+    while (b.size() % 8 != 0) b.append('\0');
+}
+
+static QByteArray
+makeRecord(BinaryFeatureFormat::RecordType type, QByteArray payload)
+{
+    pad(payload);
+    QByteArray record;
+    record.reserve(recordHeaderSize + payload.size());
+    append32(record, uint32_t(type));
+    append32(record, 0);
+    append64(record, uint64_t(payload.size()));
+    record.append(payload);
+    return record;
+}
+
+static bool
+readString(const unsigned char *payload, int64_t length,
+           int64_t &pos, QString &s)
+{
+    if (pos + 4 > length) return false;
+    int64_t n = load32(payload + pos);
+    pos += 4;
+    if (pos + n > length) return false;
+    s = QString::fromUtf8(reinterpret_cast<const char *>(payload + pos),
+                          int(n));
+    pos += n;
+    return true;
+}
+
+QByteArray
+BinaryFeatureFormat::encodeFileHeader()
+{
+    QByteArray b(magic, sizeof(magic));
+    append32(b, formatVersion);
+    append32(b, 0);
+    return b;
+}
+
+QByteArray
+BinaryFeatureFormat::encodeOutputRecord(const OutputHeader &h)
+{
+    QByteArray b;
+    append32(b, uint32_t(h.index));
+    append32(b, uint32_t(h.binCount));
+    appendDouble(b, h.sampleRate);
+    append32(b, uint32_t(h.sampleType));
+    append32(b, h.hasDuration ? 1 : 0);
+    appendDouble(b, h.outputSampleRate);
+    append32(b, uint32_t(h.stepSize));
+    append32(b, uint32_t(h.blockSize));
+
+    appendString(b, h.trackId);
+    appendString(b, h.transformId);
+    appendString(b, h.outputId);
+    appendString(b, h.name);
+    appendString(b, h.unit);
+    appendString(b, h.summaryType);
+
+    append32(b, uint32_t(h.binNames.size()));
+    for (const auto &n: h.binNames) {
+        appendString(b, n);
+    }
+
+    return makeRecord(OutputRecord, b);
+}
+
+QByteArray
+BinaryFeatureFormat::encodeDataRecord(const Rows &rows)
+{
+    int n = rows.getRowCount();
+    bool labels = !rows.labels.empty();
+
+    QByteArray b;
+    b.reserve(dataHeaderSize + n * 16 + (n * rows.binCount + 1) * 4);
+
+    append32(b, uint32_t(rows.outputIndex));
+    append32(b, uint32_t(n));
+    append32(b, uint32_t(rows.binCount));
+    append32(b, labels ? hasLabelsFlag : 0);
+
+    for (int i = 0; i < n; ++i) {
+        append64(b, uint64_t(rows.timesNs[i]));
+    }
+    for (int i = 0; i < n; ++i) {
+        append64(b, uint64_t(rows.durationsNs[i]));
+    }
+
+    size_t values = size_t(n) * rows.binCount;
+    for (size_t i = 0; i < values; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &rows.values[i], sizeof(bits));
+        append32(b, bits);
+    }
+    pad(b);
+
+    if (labels) {
+        for (int i = 0; i < n; ++i) {
+            appendString(b, rows.labels[i]);
+        }
+    }
+
+    return makeRecord(DataRecord, b);
+}
+
+bool
+BinaryFeatureFormat::isFeatureFile(const unsigned char *data, int64_t size)
+{
+    return size >= getFileHeaderSize() &&
+        memcmp(data, magic, sizeof(magic)) == 0 &&
+        load32(data + 8) == formatVersion;
+}
+
+bool
+BinaryFeatureFormat::readRecord(const unsigned char *data, int64_t size,
+                                int64_t offset, int &type,
+                                int64_t &payloadOffset,
+                                int64_t &payloadLength)
+{
+    if (offset + recordHeaderSize > size) return false;
+    uint64_t length = load64(data + offset + 8);
+    if (length > uint64_t(size - offset - recordHeaderSize)) return false;
+    type = int(load32(data + offset));
+    payloadOffset = offset + recordHeaderSize;
+    payloadLength = int64_t(length);
+    return true;
+}
+
+bool
+BinaryFeatureFormat::decodeOutputRecord(const unsigned char *payload,
+                                        int64_t length, OutputHeader &h)
+{
+    if (length < outputFixedSize) return false;
+
+    h.index = int(load32(payload));
+    int64_t bins = load32(payload + 4);
+    if (bins > INT_MAX) return false;
+    h.binCount = int(bins);
+    h.sampleRate = loadDouble(payload + 8);
+    h.sampleType = int(load32(payload + 16));
+    h.hasDuration = (load32(payload + 20) != 0);
+    h.outputSampleRate = loadDouble(payload + 24);
+    h.stepSize = int(load32(payload + 32));
+    h.blockSize = int(load32(payload + 36));
+
+    int64_t pos = outputFixedSize;
+    if (!readString(payload, length, pos, h.trackId) ||
+        !readString(payload, length, pos, h.transformId) ||
+        !readString(payload, length, pos, h.outputId) ||
+        !readString(payload, length, pos, h.name) ||
+        !readString(payload, length, pos, h.unit) ||
+        !readString(payload, length, pos, h.summaryType)) {
+        return false;
+    }
+
+    if (pos + 4 > length) return false;
+    int64_t names = load32(payload + pos);
+    pos += 4;
+    h.binNames.clear();
+    for (int64_t i = 0; i < names; ++i) {
+        QString name;
+        if (!readString(payload, length, pos, name)) return false;
+        h.binNames.push_back(name);
+    }
+
+    return true;
+}
+
+bool
+BinaryFeatureFormat::decodeDataRecord(const unsigned char *payload,
+                                      int64_t length, RowsView &v)
+{
+    if (length < dataHeaderSize) return false;
+
+    v.outputIndex = int(load32(payload));
+    int64_t rows = load32(payload + 4);
+    int64_t bins = load32(payload + 8);
+    bool labels = (load32(payload + 12) & hasLabelsFlag);
+
+    if (rows > INT_MAX || bins > INT_MAX) return false;
+
+    // Check the counts against the space remaining before using
+    // them, dividing rather than multiplying so that the counts in a
+    // malformed record can't overflow
+    int64_t pos = dataHeaderSize;
+    int64_t remaining = length - pos;
+    if (rows > remaining / 16) return false;
+    remaining -= rows * 16;
+    if (bins > 0 && rows > remaining / 4 / bins) return false;
+    int64_t valueBytes = rows * bins * 4;
+
+    v.rowCount = int(rows);
+    v.binCount = int(bins);
+    v.times = payload + pos;
+    v.durations = v.times + rows * 8;
+    v.values = v.durations + rows * 8;
+    v.labels = nullptr;
+    v.labelOffsets.clear();
+
+    pos += rows * 16 + valueBytes;
+    pos = (pos + 7) & ~int64_t(7);
+
+    if (labels) {
+        v.labels = payload;
+        v.labelOffsets.reserve(size_t(rows));
+        for (int64_t i = 0; i < rows; ++i) {
+            if (pos + 4 > length) return false;
+            v.labelOffsets.push_back(pos);
+            pos += 4 + load32(payload + pos);
+            if (pos > length) return false;
+        }
+    }
+
+    return true;
+}
+
+int64_t
+BinaryFeatureFormat::RowsView::getTimeNs(int row) const
+{
+    return int64_t(load64(times + size_t(row) * 8));
+}
+
+int64_t
+BinaryFeatureFormat::RowsView::getDurationNs(int row) const
+{
+    return int64_t(load64(durations + size_t(row) * 8));
+}
+
+float
+BinaryFeatureFormat::RowsView::getValue(int row, int bin) const
+{
+    uint32_t bits = load32(values + (size_t(row) * binCount + bin) * 4);
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+QString
+BinaryFeatureFormat::RowsView::getLabel(int row) const
+{
+    if (!labels) return {};
+    const unsigned char *p = labels + labelOffsets[row];
+    return QString::fromUtf8(reinterpret_cast<const char *>(p + 4),
+                             int(load32(p)));
+}
+
+int
+BinaryFeatureFormat::countOutputs(QString path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return -1;
+
+    int64_t size = file.size();
+    const unsigned char *data = (size > 0 ? file.map(0, size) : nullptr);
+    if (!data || !isFeatureFile(data, size)) return -1;
+
+    int count = 0;
+    int64_t offset = getFileHeaderSize();
+    int type = 0;
+    int64_t payloadOffset = 0, payloadLength = 0;
+
+    while (readRecord(data, size, offset, type,
+                      payloadOffset, payloadLength)) {
+        if (type == OutputRecord) ++count;
+        offset = payloadOffset + payloadLength;
+    }
+
+    // the mapping is released when the file is closed
+    return count;
+}
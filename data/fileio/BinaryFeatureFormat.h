@@ -0,0 +1,162 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_BINARY_FEATURE_FORMAT_H
+#define SV_BINARY_FEATURE_FORMAT_H
+
+#include <QString>
+#include <QByteArray>
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * Encoding and decoding of the binary feature file format, written
+ * by BinaryFeatureWriter and read by BinaryFeatureFileReader.
+ *
+ * A feature file holds the features of one or more plugin outputs,
+ * in a form that can be used in place through a memory map. All
+ * values are little-endian, and every record starts on an 8-byte
+ * boundary, so the value arrays are aligned within a mapped file.
+ *
+ * The file starts with the 8 bytes "SVFEATBN" and a 32-bit version
+ * and a 32-bit reserved word. Records follow, each with a 32-bit
+ * type, a 32-bit reserved word, and a 64-bit payload length (a
+ * multiple of 8) before the payload. There are two types of record:
+ *
+ * An output record describes an output, giving it an index that is
+ * unique within the file. It holds the track and transform IDs, the
+ * output's identifier, name, unit and sample type, the sample rate,
+ * step and block size of the transform, and the bin count and bin
+ * names.
+ *
+ * A data record holds a run of features for an output that has
+ * already been described. It has a column of 64-bit timestamps and
+ * one of 64-bit durations (both in nanoseconds, with duration -1 for
+ * a feature without one), then a block of 32-bit float values with a
+ * fixed stride of the output's bin count, and optionally a label for
+ * each feature.
+ */
+class BinaryFeatureFormat
+{
+public:
+    enum RecordType {
+        OutputRecord = 1,
+        DataRecord = 2
+    };
+
+    // The values of Vamp::Plugin::OutputDescriptor::SampleType
+    enum SampleType {
+        OneSamplePerStep = 0,
+        FixedSampleRate = 1,
+        VariableSampleRate = 2
+    };
+
+    struct OutputHeader {
+        OutputHeader() :
+            index(0), sampleRate(0.0), stepSize(0), blockSize(0),
+            sampleType(0), outputSampleRate(0.0), hasDuration(false),
+            binCount(0) { }
+        int index;
+        QString trackId;
+        QString transformId;
+        QString outputId;
+        QString name;
+        QString unit;
+        QString summaryType;
+        double sampleRate;         // of the transform input
+        int stepSize;
+        int blockSize;
+        int sampleType;            // Vamp::Plugin::OutputDescriptor::SampleType
+        double outputSampleRate;   // as in the output descriptor
+        bool hasDuration;
+        int binCount;
+        std::vector<QString> binNames;
+    };
+
+    /**
+     * A run of features for writing.
+     */
+    struct Rows {
+        Rows() : outputIndex(0), binCount(0) { }
+        int outputIndex;
+        int binCount;
+        std::vector<int64_t> timesNs;
+        std::vector<int64_t> durationsNs;  // -1 where none
+        std::vector<float> values;         // binCount per row
+        std::vector<QString> labels;       // empty, or one per row
+        int getRowCount() const { return int(timesNs.size()); }
+    };
+
+    /**
+     * A run of features as found in a data record, referring to the
+     * record's memory rather than copying it.
+     */
+    struct RowsView {
+        RowsView() : outputIndex(0), rowCount(0), binCount(0),
+                     times(nullptr), durations(nullptr),
+                     values(nullptr), labels(nullptr) { }
+        int outputIndex;
+        int rowCount;
+        int binCount;
+        int64_t getTimeNs(int row) const;
+        int64_t getDurationNs(int row) const;
+        float getValue(int row, int bin) const;
+        bool hasLabels() const { return labels != nullptr; }
+        QString getLabel(int row) const;
+
+        const unsigned char *times;
+        const unsigned char *durations;
+        const unsigned char *values;
+        const unsigned char *labels;
+        std::vector<int64_t> labelOffsets;  // into labels, per row
+    };
+
+    static QByteArray encodeFileHeader();
+    static QByteArray encodeOutputRecord(const OutputHeader &);
+    static QByteArray encodeDataRecord(const Rows &);
+
+    static int getFileHeaderSize() { return 16; }
+
+    /**
+     * Return true if the data starts with a feature file header.
+     */
+    static bool isFeatureFile(const unsigned char *data, int64_t size);
+
+    /**
+     * Read the header of the record at the given offset of a mapped
+     * file, setting the type and the offset and length of its
+     * payload. Return false at the end of the data or if the record
+     * is truncated.
+     */
+    static bool readRecord(const unsigned char *data, int64_t size,
+                           int64_t offset, int &type,
+                           int64_t &payloadOffset, int64_t &payloadLength);
+
+    static bool decodeOutputRecord(const unsigned char *payload,
+                                   int64_t length, OutputHeader &);
+
+    static bool decodeDataRecord(const unsigned char *payload,
+                                 int64_t length, RowsView &);
+
+    /**
+     * Return the number of output records in an existing feature
+     * file, or -1 if the file is not a feature file or cannot be
+     * read. Used to choose the index of the next output when
+     * appending.
+     */
+    static int countOutputs(QString path);
+};
+
+#endif
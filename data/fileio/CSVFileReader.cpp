@@ -20,6 +20,7 @@
 #include "base/StringBits.h"
 #include "base/ProgressReporter.h"
 #include "base/RecordDirectory.h"
+#include "base/Thread.h"
 #include "model/SparseOneDimensionalModel.h"
 #include "model/SparseTimeValueModel.h"
 #include "model/EditableDenseThreeDimensionalModel.h"
@@ -35,15 +36,391 @@
 #include <QString>
 #include <QRegExp>
 #include <QStringList>
-#include <QTextStream>
 #include <QDateTime>
+#include <QTextCodec>
 
 #include <iostream>
 #include <map>
 #include <string>
+#include <atomic>
+#include <algorithm>
 
 using namespace std;
 
+// The input is read and parsed a block at a time. Each block of
+// about blockBytes (extended to the end of a line) is divided into
+// slices of about sliceBytes, also ending at line ends, which are
+// split into fields and converted by a pool of threads. The lines of
+// the block are then added to the model in order on the loading
+// thread.
+static const qint64 blockBytes = 4 * 1024 * 1024;
+static const qint64 sliceBytes = 256 * 1024;
+
+static bool
+isLineEnd(char c)
+{
+    return c == '\n' || c == '\r';
+}
+
+static qint64
+findLineEnd(const char *data, qint64 from, qint64 size)
+{
+    // Return the offset just past the first line ending at or after
+    // from, or size if there is none. CR, LF and CR/LF endings are
+    // all accepted
+    for (qint64 i = from; i < size; ++i) {
+        if (isLineEnd(data[i])) {
+            if (data[i] == '\r' && i + 1 < size && data[i+1] == '\n') {
+                return i + 2;
+            }
+            return i + 1;
+        }
+    }
+    return size;
+}
+
+static qint64
+findLastLineEnd(const QByteArray &data)
+{
+    // Return the offset just past the last line ending, or 0 if there
+    // is none
+    for (int i = data.size(); i > 0; --i) {
+        if (isLineEnd(data[i-1])) return i;
+    }
+    return 0;
+}
+
+/**
+ * Supplies the input for CSVFileReader::load a block at a time, each
+ * block ending at the end of a line. A file is mapped; any other
+ * device is read. Text in the locale encoding (usually UTF-8) is
+ * left as it is, to be decoded line by line by the parsing threads,
+ * but UTF-16 or UTF-32 input (identified by its byte-order mark) is
+ * converted to UTF-8 up front so that lines can be found by looking
+ * for line-ending bytes.
+ */
+class CSVBlockReader
+{
+public:
+    CSVBlockReader(QIODevice *device) :
+        m_device(device),
+        m_file(nullptr),
+        m_mapped(nullptr),
+        m_data(nullptr),
+        m_size(0),
+        m_offset(0),
+        m_codec(nullptr)
+    {
+        QTextCodec *codec = QTextCodec::codecForUtfText(device->peek(4),
+                                                        nullptr);
+        if (codec && codec->mibEnum() != 106) { // not UTF-8
+            QString text = codec->toUnicode(device->readAll());
+            if (text.startsWith(QChar(0xfeff))) text.remove(0, 1);
+            m_converted = text.toUtf8();
+            m_data = m_converted.constData();
+            m_size = m_converted.size();
+            return;
+        }
+
+        qint64 skip = 0;
+        if (codec) {
+            skip = 3; // UTF-8 byte-order mark
+        } else {
+            codec = QTextCodec::codecForLocale();
+            if (codec && codec->mibEnum() != 106) {
+                m_codec = codec;
+            }
+        }
+
+        m_file = qobject_cast<QFile *>(device);
+        if (m_file && m_file->size() > 0) {
+            m_mapped = m_file->map(0, m_file->size());
+        }
+        if (m_mapped) {
+            m_data = reinterpret_cast<const char *>(m_mapped);
+            m_size = m_file->size();
+            m_offset = skip;
+        } else if (skip > 0) {
+            device->read(skip);
+        }
+    }
+
+    ~CSVBlockReader() {
+        if (m_mapped) {
+            m_file->unmap(m_mapped);
+        }
+    }
+
+    /**
+     * Return the codec to decode lines with, or nullptr for UTF-8.
+     */
+    QTextCodec *getCodec() const { return m_codec; }
+
+    /**
+     * Retrieve the next block, returning false if there is no more
+     * input. The block remains valid until the next call.
+     */
+    bool next(const char *&data, qint64 &size) {
+
+        if (m_data) {
+            if (m_offset >= m_size) return false;
+            qint64 end = findLineEnd
+                (m_data, std::min(m_offset + blockBytes, m_size) - 1, m_size);
+            data = m_data + m_offset;
+            size = end - m_offset;
+            m_offset = end;
+            return true;
+        }
+
+        m_buffer = m_carry;
+        m_carry.clear();
+        
+        while (true) {
+            QByteArray more = m_device->read(blockBytes);
+            if (more.isEmpty()) break; // end of input
+            m_buffer.append(more);
+            qint64 end = findLastLineEnd(m_buffer);
+            if (end > 0) {
+                m_carry = m_buffer.mid(int(end));
+                m_buffer.truncate(int(end));
+                break;
+            }
+        }
+        
+        if (m_buffer.isEmpty()) return false;
+        data = m_buffer.constData();
+        size = m_buffer.size();
+        return true;
+    }
+        
+private:
+    QIODevice *m_device;
+    QFile *m_file;
+    uchar *m_mapped;
+    const char *m_data;
+    qint64 m_size;
+    qint64 m_offset;
+    QTextCodec *m_codec;
+    QByteArray m_converted;
+    QByteArray m_buffer;
+    QByteArray m_carry;
+
+    CSVBlockReader(const CSVBlockReader &) =delete;
+    CSVBlockReader &operator=(const CSVBlockReader &) =delete;
+};
+
+/**
+ * Everything the parsing threads need to know about the format. None
+ * of it changes during a load.
+ */
+struct CSVParseContext
+{
+    const CSVFormat *format;
+    QChar separator;
+    bool allowQuoting;
+    sv_samplerate_t sampleRate;
+    int increment;
+    QTextCodec *codec;
+};
+
+/**
+ * A block of input divided into slices, with the parsed lines of
+ * each slice. Slices are taken in turn by the threads parsing the
+ * block.
+ */
+struct CSVBlockParse
+{
+    const CSVParseContext *context;
+    const char *data;
+    std::vector<std::pair<qint64, qint64>> slices;
+    std::vector<std::vector<CSVFileReader::ParsedLine>> results;
+    std::atomic<int> next;
+};
+
+static bool
+parseTimeValue(QString s, CSVFormat::TimeUnits timeUnits,
+               sv_samplerate_t sampleRate, int increment,
+               sv_frame_t &calculatedFrame)
+{
+    calculatedFrame = 0;
+
+    // Remove anything that can't be part of a number
+    QString numeric;
+    numeric.reserve(s.size());
+    for (QChar c: s) {
+        ushort u = c.unicode();
+        if ((u >= '0' && u <= '9') ||
+            u == 'e' || u == 'E' || u == '.' || u == ',' ||
+            u == '+' || u == '-') {
+            numeric += c;
+        }
+    }
+
+    bool ok = false;
+    
+    if (timeUnits == CSVFormat::TimeSeconds) {
+
+        double time = numeric.toDouble(&ok);
+        if (!ok) time = StringBits::stringToDoubleLocaleFree(numeric, &ok);
+        calculatedFrame = sv_frame_t(time * sampleRate + 0.5);
+    
+    } else if (timeUnits == CSVFormat::TimeMilliseconds) {
+
+        double time = numeric.toDouble(&ok);
+        if (!ok) time = StringBits::stringToDoubleLocaleFree(numeric, &ok);
+        calculatedFrame = sv_frame_t((time / 1000.0) * sampleRate + 0.5);
+        
+    } else {
+        
+        long n = numeric.toLong(&ok);
+        if (n >= 0) calculatedFrame = n;
+        
+        if (timeUnits == CSVFormat::TimeWindows) {
+            calculatedFrame *= increment;
+        }
+    }
+
+    return ok;
+}
+
+static void
+parseSlice(const CSVParseContext &context, const char *data, qint64 size,
+           std::vector<CSVFileReader::ParsedLine> &lines)
+{
+    CSVFormat::TimeUnits timeUnits = context.format->getTimeUnits();
+    
+    qint64 i = 0;
+    while (i < size) {
+
+        qint64 j = i;
+        while (j < size && !isLineEnd(data[j])) ++j;
+
+        // Empty lines are skipped, as are comments
+        if (j > i) {
+            
+            CSVFileReader::ParsedLine pl;
+            if (context.codec) {
+                pl.line = context.codec->toUnicode(data + i, int(j - i));
+            } else {
+                pl.line = QString::fromUtf8(data + i, int(j - i));
+            }
+
+            if (!pl.line.startsWith("#")) {
+
+                pl.fields = StringBits::split(pl.line, context.separator,
+                                              context.allowQuoting);
+                pl.parsed.resize(pl.fields.size());
+
+                for (int k = 0; k < pl.fields.size(); ++k) {
+
+                    const QString &s = pl.fields[k];
+                    CSVFileReader::ParsedField &field = pl.parsed[k];
+                
+                    switch (context.format->getColumnPurpose(k)) {
+
+                    case CSVFormat::ColumnStartTime:
+                    case CSVFormat::ColumnEndTime:
+                    case CSVFormat::ColumnDuration:
+                        field.frameOk = parseTimeValue(s, timeUnits,
+                                                       context.sampleRate,
+                                                       context.increment,
+                                                       field.frame);
+                        break;
+
+                    case CSVFormat::ColumnValue:
+                    case CSVFormat::ColumnPitch:
+                        field.value = s.toFloat(&field.valueOk);
+                        break;
+
+                    case CSVFormat::ColumnUnknown:
+                    case CSVFormat::ColumnLabel:
+                        break;
+                    }
+                }
+            
+                lines.push_back(std::move(pl));
+            }
+        }
+
+        i = j + 1;
+    }
+}
+
+static void
+parseSlices(CSVBlockParse &block)
+{
+    while (true) {
+        int slice = block.next++;
+        if (slice >= int(block.slices.size())) break;
+        const auto &extent = block.slices[slice];
+        parseSlice(*block.context,
+                   block.data + extent.first,
+                   extent.second - extent.first,
+                   block.results[slice]);
+    }
+}
+
+/**
+ * Helper thread for parsing a block. Each worker takes slices of the
+ * block in turn until there are none left.
+ */
+class CSVParseWorker : public Thread
+{
+public:
+    CSVParseWorker(CSVBlockParse &block) : m_block(block) { }
+    void run() override { parseSlices(m_block); }
+private:
+    CSVBlockParse &m_block;
+};
+
+static void
+parseBlock(CSVBlockParse &block, const char *data, qint64 size,
+           std::vector<CSVFileReader::ParsedLine> &lines)
+{
+    block.data = data;
+    block.slices.clear();
+
+    qint64 start = 0;
+    while (start < size) {
+        qint64 end = size;
+        if (start + sliceBytes < size) {
+            end = findLineEnd(data, start + sliceBytes - 1, size);
+        }
+        block.slices.push_back({ start, end });
+        start = end;
+    }
+
+    block.results.clear();
+    block.results.resize(block.slices.size());
+    block.next = 0;
+    
+    int threadCount = std::min(QThread::idealThreadCount(),
+                               int(block.slices.size()));
+
+    std::vector<CSVParseWorker *> workers;
+    for (int i = 1; i < threadCount; ++i) {
+        CSVParseWorker *worker = new CSVParseWorker(block);
+        worker->start();
+        workers.push_back(worker);
+    }
+
+    // This thread works too
+    parseSlices(block);
+
+    for (auto worker: workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    lines.clear();
+    for (auto &result: block.results) {
+        for (auto &line: result) {
+            lines.push_back(std::move(line));
+        }
+    }
+}
+
+
 CSVFileReader::CSVFileReader(QString path, CSVFormat format,
                              sv_samplerate_t mainModelSampleRate,
                              ProgressReporter *reporter) :
@@ -118,45 +495,18 @@ CSVFileReader::getError() const
 }
 
 bool
-CSVFileReader::convertTimeValue(QString s, int lineno,
-                                sv_samplerate_t sampleRate,
-                                int increment,
+CSVFileReader::convertTimeValue(QString s, const ParsedField &field,
+                                int lineno,
                                 sv_frame_t &calculatedFrame) const
 {
-    QRegExp nonNumericRx("[^0-9eE.,+-]");
-    int warnLimit = 10;
-
-    CSVFormat::TimeUnits timeUnits = m_format.getTimeUnits();
-
-    calculatedFrame = 0;
-
-    bool ok = false;
-    QString numeric = s;
-    numeric.remove(nonNumericRx);
+    // The conversion itself was made when the line was parsed; this
+    // returns its result, warning if it failed
     
-    if (timeUnits == CSVFormat::TimeSeconds) {
+    int warnLimit = 10;
 
-        double time = numeric.toDouble(&ok);
-        if (!ok) time = StringBits::stringToDoubleLocaleFree(numeric, &ok);
-        calculatedFrame = sv_frame_t(time * sampleRate + 0.5);
-    
-    } else if (timeUnits == CSVFormat::TimeMilliseconds) {
+    calculatedFrame = field.frame;
 
-        double time = numeric.toDouble(&ok);
-        if (!ok) time = StringBits::stringToDoubleLocaleFree(numeric, &ok);
-        calculatedFrame = sv_frame_t((time / 1000.0) * sampleRate + 0.5);
-        
-    } else {
-        
-        long n = numeric.toLong(&ok);
-        if (n >= 0) calculatedFrame = n;
-        
-        if (timeUnits == CSVFormat::TimeWindows) {
-            calculatedFrame *= increment;
-        }
-    }
-    
-    if (!ok) {
+    if (!field.frameOk) {
         if (m_warnings < warnLimit) {
             SVCERR << "WARNING: CSVFileReader::load: "
                       << "Bad time format (\"" << s
@@ -168,7 +518,7 @@ CSVFileReader::convertTimeValue(QString s, int lineno,
         ++m_warnings;
     }
 
-    return calculatedFrame;
+    return field.frameOk;
 }
 
 Model *
@@ -208,8 +558,6 @@ CSVFileReader::load() const
     WritableWaveFileModel *modelW = nullptr;
     Model *model = nullptr;
 
-    QTextStream in(m_device);
-
     unsigned int warnings = 0, warnLimit = 10;
     unsigned int lineno = 0;
 
@@ -234,17 +582,12 @@ CSVFileReader::load() const
     }
 
     int audioChannels = 0;
-    float **audioSamples = nullptr;
     float sampleShift = 0.f;
     float sampleScale = 1.f;
 
     if (modelType == CSVFormat::WaveFileModel) {
 
         audioChannels = valueColumns;
-                
-        audioSamples =
-            breakfastquay::allocate_and_zero_channels<float>
-            (audioChannels, 1);
 
         switch (m_format.getAudioSampleRange()) {
         case CSVFormat::SampleRangeSigned1:
@@ -265,26 +608,39 @@ CSVFileReader::load() const
 
     map<QString, int> labelCountMap;
 
+    // Events for the sparse models are gathered here and added in a
+    // single batch once the whole file has been read
+    EventVector pending;
+
+    // Columns for the dense model, and samples for the wave-file
+    // model, are gathered here and added at the end of each block
+    vector<DenseThreeDimensionalModel::Column> pendingColumns;
+    int pendingColumnsStart = 0;
+    vector<floatvec_t> pendingSamples(audioChannels);
+
+    CSVBlockReader reader(m_device);
+
+    CSVParseContext context;
+    context.format = &m_format;
+    context.separator = separator;
+    context.allowQuoting = allowQuoting;
+    context.sampleRate = sampleRate;
+    context.increment = increment;
+    context.codec = reader.getCodec();
+
+    CSVBlockParse block;
+    block.context = &context;
+    vector<ParsedLine> lines;
+    
+    const char *data = nullptr;
+    qint64 size = 0;
+
     bool atStart = true;
     bool abandoned = false;
     
-    while (!in.atEnd() && !abandoned) {
+    while (!abandoned && reader.next(data, size)) {
 
-        // QTextStream's readLine doesn't cope with old-style Mac
-        // CR-only line endings.  Why did they bother making the class
-        // cope with more than one sort of line ending, if it still
-        // can't be configured to cope with all the common sorts?
-
-        // For the time being we'll deal with this case (which is
-        // relatively uncommon for us, but still necessary to handle)
-        // by reading the entire file using a single readLine, and
-        // splitting it.  For CR and CR/LF line endings this will just
-        // read a line at a time, and that's obviously OK.
-
-        QString chunk = in.readLine();
-        QStringList lines = chunk.split('\r', QString::SkipEmptyParts);
-
-        m_readCount += chunk.size() + 1;
+        m_readCount += size;
 
         if (m_reporter) {
             if (m_reporter->wasCancelled()) {
@@ -303,11 +659,12 @@ CSVFileReader::load() const
                 m_progress = progress;
             }
         }
-        
-        for (int li = 0; li < lines.size(); ++li) {
+
+        parseBlock(block, data, size, lines);
+
+        for (const ParsedLine &parsed: lines) {
             
-            QString line = lines[li];
-            if (line.startsWith("#")) continue;
+            const QString &line = parsed.line;
 
             if (atStart) {
                 atStart = false;
@@ -316,7 +673,7 @@ CSVFileReader::load() const
                 }
             }
 
-            QStringList list = StringBits::split(line, separator, allowQuoting);
+            const QStringList &list = parsed.fields;
             if (!model) {
 
                 QString modelName = m_filename;
@@ -414,7 +771,8 @@ CSVFileReader::load() const
             
             for (int i = 0; i < list.size(); ++i) {
 
-                QString s = list[i];
+                const QString &s = list[i];
+                const ParsedField &field = parsed.parsed[i];
 
                 CSVFormat::ColumnPurpose purpose = m_format.getColumnPurpose(i);
 
@@ -424,19 +782,19 @@ CSVFileReader::load() const
                     break;
 
                 case CSVFormat::ColumnStartTime:
-                    if (!convertTimeValue(s, lineno, sampleRate, increment, frameNo)) {
+                    if (!convertTimeValue(s, field, lineno, frameNo)) {
                         ok = false;
                     }
                     break;
                 
                 case CSVFormat::ColumnEndTime:
-                    if (convertTimeValue(s, lineno, sampleRate, increment, endFrame)) {
+                    if (convertTimeValue(s, field, lineno, endFrame)) {
                         haveEndTime = true;
                     }
                     break;
 
                 case CSVFormat::ColumnDuration:
-                    if (!convertTimeValue(s, lineno, sampleRate, increment, duration)) {
+                    if (!convertTimeValue(s, field, lineno, duration)) {
                         ok = false;
                     }
                     break;
@@ -445,12 +803,12 @@ CSVFileReader::load() const
                     if (haveAnyValue) {
                         otherValue = value;
                     }
-                    value = s.toFloat();
+                    value = field.value;
                     haveAnyValue = true;
                     break;
 
                 case CSVFormat::ColumnPitch:
-                    pitch = s.toFloat();
+                    pitch = field.value;
                     if (pitch < 0.f || pitch > 127.f) {
                         pitchLooksLikeMIDI = false;
                     }
@@ -477,23 +835,23 @@ CSVFileReader::load() const
             if (modelType == CSVFormat::OneDimensionalModel) {
             
                 Event point(frameNo, label);
-                model1->add(point);
+                pending.push_back(point);
 
             } else if (modelType == CSVFormat::TwoDimensionalModel) {
 
                 Event point(frameNo, value, label);
-                model2->add(point);
+                pending.push_back(point);
 
             } else if (modelType == CSVFormat::TwoDimensionalModelWithDuration) {
 
                 Event region(frameNo, value, duration, label);
-                model2a->add(region);
+                pending.push_back(region);
 
             } else if (modelType == CSVFormat::TwoDimensionalModelWithDurationAndPitch) {
 
                 float level = ((value >= 0.f && value <= 1.f) ? value : 1.f);
                 Event note(frameNo, pitch, duration, level, label);
-                model2b->add(note);
+                pending.push_back(note);
 
             } else if (modelType == CSVFormat::TwoDimensionalModelWithDurationAndExtent) {
 
@@ -505,7 +863,7 @@ CSVFileReader::load() const
                     level = otherValue - value;
                 }
                 Event box(frameNo, value, duration, level, label);
-                model2c->add(box);
+                pending.push_back(box);
 
             } else if (modelType == CSVFormat::ThreeDimensionalModel) {
 
@@ -517,8 +875,8 @@ CSVFileReader::load() const
                         continue;
                     }
 
-                    bool ok = false;
-                    float value = list[i].toFloat(&ok);
+                    bool ok = parsed.parsed[i].valueOk;
+                    float value = parsed.parsed[i].value;
 
                     values.push_back(value);
             
@@ -553,7 +911,10 @@ CSVFileReader::load() const
 //                SVDEBUG << "Setting bin values for count " << lineno << ", frame "
 //                          << frameNo << ", time " << RealTime::frame2RealTime(frameNo, sampleRate) << endl;
 
-                model3->setColumn(lineno, values);
+                if (pendingColumns.empty()) {
+                    pendingColumnsStart = lineno;
+                }
+                pendingColumns.push_back(std::move(values));
 
             } else if (modelType == CSVFormat::WaveFileModel) {
 
@@ -568,36 +929,23 @@ CSVFileReader::load() const
                         continue;
                     }
 
-                    bool ok = false;
-                    float value = list[i].toFloat(&ok);
-                    if (!ok) {
+                    float value = parsed.parsed[i].value;
+                    if (!parsed.parsed[i].valueOk) {
                         value = 0.f;
                     }
 
                     value += sampleShift;
                     value *= sampleScale;
                     
-                    audioSamples[channel][0] = value;
+                    pendingSamples[channel].push_back(value);
 
                     ++channel;
                 }
 
                 while (channel < audioChannels) {
-                    audioSamples[channel][0] = 0.f;
+                    pendingSamples[channel].push_back(0.f);
                     ++channel;
                 }
-
-                bool ok = modelW->addSamples(audioSamples, 1);
-                
-                if (!ok) {
-                    if (warnings < warnLimit) {
-                        SVCERR << "WARNING: CSVFileReader::load: "
-                               << "Unable to add sample to wave-file model"
-                               << endl;
-                        SVCERR << line << endl;
-                        ++warnings;
-                    }
-                }
             }
             
             ++lineno;
@@ -606,6 +954,38 @@ CSVFileReader::load() const
                 frameNo += increment;
             }
         }
+
+        if (model3 && !pendingColumns.empty()) {
+            model3->setColumns(pendingColumnsStart, pendingColumns);
+            pendingColumns.clear();
+        }
+
+        if (modelW && audioChannels > 0 && !pendingSamples[0].empty()) {
+            vector<const float *> channels;
+            for (const auto &samples: pendingSamples) {
+                channels.push_back(samples.data());
+            }
+            sv_frame_t count = sv_frame_t(pendingSamples[0].size());
+            if (!modelW->addSamples(channels.data(), count)) {
+                if (warnings < warnLimit) {
+                    SVCERR << "WARNING: CSVFileReader::load: "
+                           << "Unable to add " << count
+                           << " samples to wave-file model" << endl;
+                    ++warnings;
+                }
+            }
+            for (auto &samples: pendingSamples) {
+                samples.clear();
+            }
+        }
+    }
+
+    if (!pending.empty()) {
+        if (model1) model1->addEvents(pending);
+        else if (model2) model2->addEvents(pending);
+        else if (model2a) model2a->addEvents(pending);
+        else if (model2b) model2b->addEvents(pending);
+        else if (model2c) model2c->addEvents(pending);
     }
 
     if (!haveAnyValue) {
@@ -632,7 +1012,7 @@ CSVFileReader::load() const
                 }
             }
 
-            map<Event, Event> eventMap;
+            EventVector toRemove, toAdd;
 
             EventVector allEvents = model2a->getAllEvents();
             for (const Event &e: allEvents) {
@@ -641,23 +1021,18 @@ CSVFileReader::load() const
                 // SVCERR << "mapping from label \"" << p.label
                 //       << "\" (count " << count
                 //       << ") to value " << v << endl;
-                eventMap[e] = Event(e.getFrame(), v,
-                                    e.getDuration(), e.getLabel());
-            }
-
-            for (const auto &i: eventMap) {
-                // There could be duplicate regions; if so replace
-                // them all -- but we need to check we're not
-                // replacing a region by itself (or else this will
-                // never terminate)
-                if (i.first.getValue() == i.second.getValue()) {
+                // There could be duplicate regions; if so they all
+                // appear in allEvents and are all replaced
+                if (e.getValue() == v) {
                     continue;
                 }
-                while (model2a->containsEvent(i.first)) {
-                    model2a->remove(i.first);
-                    model2a->add(i.second);
-                }
+                toRemove.push_back(e);
+                toAdd.push_back(Event(e.getFrame(), v,
+                                      e.getDuration(), e.getLabel()));
             }
+
+            model2a->removeEvents(toRemove);
+            model2a->addEvents(toAdd);
         }
     }
                 
@@ -675,7 +1050,6 @@ CSVFileReader::load() const
     }
 
     if (modelW) {
-        breakfastquay::deallocate_channels(audioSamples, audioChannels);
         modelW->updateModel();
         modelW->writeComplete();
     }
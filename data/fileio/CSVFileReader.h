@@ -26,6 +26,8 @@
 #include <QStringList>
 #include <QIODevice>
 
+#include <vector>
+
 class QFile;
 class ProgressReporter;
 
@@ -57,6 +59,31 @@ public:
 
     Model *load() const override;
 
+    /**
+     * A field of a line of the file, with the conversion appropriate
+     * to its column already made: to a float for value and pitch
+     * columns, and to a frame for time columns.
+     */
+    struct ParsedField {
+        ParsedField() : value(0.f), valueOk(false),
+                        frame(0), frameOk(false) { }
+        float value;
+        bool valueOk;
+        sv_frame_t frame;
+        bool frameOk;
+    };
+
+    /**
+     * A non-empty, non-comment line of the file, split into fields.
+     * Lines are parsed in parallel a block of the file at a time,
+     * and then added to the model in order by load().
+     */
+    struct ParsedLine {
+        QString line;
+        QStringList fields;
+        std::vector<ParsedField> parsed;
+    };
+
 protected:
     CSVFormat m_format;
     QIODevice *m_device;
@@ -70,8 +97,8 @@ protected:
     mutable int m_progress;
     ProgressReporter *m_reporter;
 
-    bool convertTimeValue(QString, int lineno, sv_samplerate_t sampleRate,
-                          int increment, sv_frame_t &calculatedFrame) const;
+    bool convertTimeValue(QString, const ParsedField &, int lineno,
+                          sv_frame_t &calculatedFrame) const;
 
     QString getConvertedAudioFilePath() const;
 };
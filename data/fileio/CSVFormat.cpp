@@ -30,6 +30,9 @@
 
 //#define DEBUG_COLUMN_QUALITIES 1
 
+// Upper limit on the amount of a file read when guessing its format
+static const qint64 maxGuessBytes = 1024 * 1024;
+
 CSVFormat::CSVFormat(QString path) :
     m_separator(""),
     m_sampleRate(44100),
@@ -70,14 +73,30 @@ CSVFormat::guessFormatFor(QString path)
     }
     SVDEBUG << "CSVFormat::guessFormatFor(" << path << ")" << endl;
 
-    QTextStream in(&file);
-    in.seek(0);
+    // Only a limited prefix of the file is examined, so that the cost
+    // of guessing doesn't depend on the size of the file, nor on its
+    // line endings. A line that crosses the end of the prefix is
+    // dropped, unless it is the only one
+    
+    QByteArray prefix = file.read(maxGuessBytes);
+    if (!file.atEnd()) {
+        int end = prefix.size();
+        while (end > 0 && prefix[end-1] != '\n' && prefix[end-1] != '\r') {
+            --end;
+        }
+        if (end > 0) {
+            prefix.truncate(end);
+        }
+    }
+    
+    QTextStream in(&prefix, QIODevice::ReadOnly);
 
     int lineno = 0;
 
     while (!in.atEnd()) {
 
-        // See comment about line endings in CSVFileReader::load() 
+        // QTextStream's readLine doesn't cope with old-style Mac
+        // CR-only line endings, so we split on CR as well
 
         QString chunk = in.readLine();
         QStringList lines = chunk.split('\r', QString::SkipEmptyParts);
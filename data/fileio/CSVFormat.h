@@ -115,6 +115,10 @@ public:
      * Note also that this function will never guess WaveFileModel for
      * the model type.
      *
+     * Only a sample from the start of the file is examined: the
+     * first 150 non-empty lines, or as many as are found in the
+     * first megabyte.
+     *
      * Return false if there is some fundamental error, e.g. the file
      * could not be opened at all. Return true otherwise. Note that
      * this function returns true even if the file doesn't appear to
@@ -77,14 +77,23 @@ writeInChunks(OutStream& oss,
             );
 
             if (!data.empty()) {
+                // Format the whole block into one string and write
+                // that, rather than a string per row
+                QString chunk;
+                int estimate = 0;
+                for (const auto &col: data[0]) {
+                    estimate += col.size() + delimiter.size();
+                }
+                chunk.reserve(data.size() * (estimate + 1) + 1);
                 for (const auto &row: data) {
                     if (started) {
-                        oss << "\n";
+                        chunk += '\n';
                     } else {
                         started = true;
                     }
-                    oss << StringBits::joinDelimited(row, delimiter);
+                    StringBits::appendDelimited(chunk, row, delimiter);
                 }
+                oss << chunk;
             }
 
             nFramesWritten += end - start;
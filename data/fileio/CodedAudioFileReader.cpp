@@ -16,16 +16,18 @@
 #include "CodedAudioFileReader.h"
 
 #include "WavFileReader.h"
+#include "DecodeScheduler.h"
+#include "CompactSampleBuffer.h"
 #include "base/TempDirectory.h"
 #include "base/Exceptions.h"
 #include "base/Profiler.h"
-#include "base/Serialiser.h"
 #include "base/StorageAdviser.h"
 
 #include <bqresample/Resampler.h>
 
 #include <stdint.h>
 #include <iostream>
+#include <algorithm>
 #include <QDir>
 #include <QMutexLocker>
 
@@ -35,9 +37,13 @@ CodedAudioFileReader::CodedAudioFileReader(CacheMode cacheMode,
                                            sv_samplerate_t targetRate,
                                            bool normalised) :
     m_cacheMode(cacheMode),
+    m_data(nullptr),
     m_initialised(false),
-    m_serialiser(nullptr),
+    m_haveDecodeSlot(false),
+    m_decodePriority(0),
     m_fileRate(0),
+    m_sourceBitDepth(0),
+    m_cacheBitDepth(0),
     m_cacheFileWritePtr(nullptr),
     m_cacheFileReader(nullptr),
     m_cacheWriteBuffer(nullptr),
@@ -71,7 +77,7 @@ CodedAudioFileReader::~CodedAudioFileReader()
 {
     QMutexLocker locker(&m_cacheMutex);
 
-    if (m_serialiser) endSerialised();
+    releaseDecodeSlot();
     
     if (m_cacheFileWritePtr) sf_close(m_cacheFileWritePtr);
 
@@ -90,10 +96,13 @@ CodedAudioFileReader::~CodedAudioFileReader()
     delete m_resampler;
     delete[] m_resampleBuffer;
 
-    if (!m_data.empty()) {
-        StorageAdviser::notifyDoneAllocation
-            (StorageAdviser::MemoryAllocation,
-             (m_data.size() * sizeof(float)) / 1024);
+    if (m_data) {
+        if (m_data->getFrameCount() > 0) {
+            StorageAdviser::notifyDoneAllocation
+                (StorageAdviser::MemoryAllocation,
+                 m_data->getSizeInBytes() / 1024);
+        }
+        delete m_data;
     }
 }
 
@@ -105,22 +114,42 @@ CodedAudioFileReader::setFramesToTrim(sv_frame_t fromStart, sv_frame_t fromEnd)
 }
 
 void
-CodedAudioFileReader::startSerialised(QString id,
-                                      const std::atomic<bool> *cancelled)
+CodedAudioFileReader::setSourceBitDepth(int bits)
+{
+    m_sourceBitDepth = bits;
+}
+
+void
+CodedAudioFileReader::setDecodePriority(int priority)
+{
+    if (m_decodePriority.exchange(priority) != priority) {
+        DecodeScheduler::getInstance()->priorityChanged();
+    }
+}
+
+bool
+CodedAudioFileReader::acquireDecodeSlot(const std::atomic<bool> *cancelled,
+                                        size_t estimatedKB)
 {
-//    SVCERR << "CodedAudioFileReader(" << this << ")::startSerialised: id = " << id << endl;
+    if (m_haveDecodeSlot) return true;
     
-    delete m_serialiser;
-    m_serialiser = new Serialiser(id, cancelled);
+//    SVCERR << "CodedAudioFileReader(" << this << ")::acquireDecodeSlot: estimated size " << estimatedKB << "K" << endl;
+
+    m_haveDecodeSlot = DecodeScheduler::getInstance()->acquire
+        (&m_decodePriority, estimatedKB, cancelled);
+
+    return m_haveDecodeSlot;
 }
 
 void
-CodedAudioFileReader::endSerialised()
+CodedAudioFileReader::releaseDecodeSlot()
 {
-//    SVCERR << "CodedAudioFileReader(" << this << ")::endSerialised: id = " << (m_serialiser ? m_serialiser->getId() : "(none)") << endl;
+    if (!m_haveDecodeSlot) return;
 
-    delete m_serialiser;
-    m_serialiser = nullptr;
+//    SVCERR << "CodedAudioFileReader(" << this << ")::releaseDecodeSlot" << endl;
+    
+    DecodeScheduler::getInstance()->release();
+    m_haveDecodeSlot = false;
 }
 
 void
@@ -197,7 +226,25 @@ CodedAudioFileReader::initialiseDecodeCache()
             // tests.)
             //
             // So: now we write floats.
-            fileInfo.format = SF_FORMAT_W64 | SF_FORMAT_FLOAT;
+            //
+            // Unless the subclass has told us that its source was
+            // integer PCM at no more than 24 bits and we are not
+            // resampling, in which case every value is exactly
+            // representable at that depth and we can write half (or
+            // three quarters) as much. We then scale the values
+            // ourselves on writing, to match the scaling libsndfile
+            // uses on reading, rather than relying on its own
+            // float-to-int conversion.
+            m_cacheBitDepth = 0;
+            if (!m_resampler &&
+                m_sourceBitDepth > 0 && m_sourceBitDepth <= 24) {
+                m_cacheBitDepth = (m_sourceBitDepth <= 16 ? 16 : 24);
+            }
+            
+            fileInfo.format = SF_FORMAT_W64 |
+                (m_cacheBitDepth == 16 ? SF_FORMAT_PCM_16 :
+                 m_cacheBitDepth == 24 ? SF_FORMAT_PCM_24 :
+                 SF_FORMAT_FLOAT);
 
 #ifdef Q_OS_WIN
             m_cacheFileWritePtr = sf_wchar_open
@@ -209,6 +256,13 @@ CodedAudioFileReader::initialiseDecodeCache()
 
             if (m_cacheFileWritePtr) {
 
+                if (m_cacheBitDepth > 0) {
+                    sf_command(m_cacheFileWritePtr, SFC_SET_NORM_FLOAT,
+                               nullptr, SF_FALSE);
+                    sf_command(m_cacheFileWritePtr, SFC_SET_CLIPPING,
+                               nullptr, SF_TRUE);
+                }
+
                 // Ideally we would do this now only if we were in a
                 // threaded mode -- creating the reader later if we're
                 // not threaded -- but we don't have access to that
@@ -236,7 +290,9 @@ CodedAudioFileReader::initialiseDecodeCache()
     }
 
     if (m_cacheMode == CacheInMemory) {
-        m_data.clear();
+        m_cacheBitDepth = 0;
+        delete m_data;
+        m_data = new CompactSampleBuffer(m_channelCount);
     }
 
     if (m_trimFromEnd >= (m_cacheWriteBufferFrames * m_channelCount)) {
@@ -350,7 +406,10 @@ CodedAudioFileReader::finishDecodeCache()
         // I know, I know, we already allocated it...
         StorageAdviser::notifyPlannedAllocation
             (StorageAdviser::MemoryAllocation,
-             (m_data.size() * sizeof(float)) / 1024);
+             m_data->getSizeInBytes() / 1024);
+        SVDEBUG << "CodedAudioFileReader: In-memory cache takes "
+                << m_data->getSizeInBytes() / 1024 << "K (as floats it would take "
+                << m_data->getUncompactedSizeInBytes() / 1024 << "K)" << endl;
     }
 
     SVDEBUG << "CodedAudioFileReader: File decodes to " << m_fileFrameCount
@@ -470,6 +529,13 @@ CodedAudioFileReader::pushBufferNonResampling(float *buffer, sv_frame_t sz)
     switch (m_cacheMode) {
 
     case CacheInTemporaryFile:
+        if (m_cacheBitDepth > 0) {
+            // Scale to integer range in place, see initialiseDecodeCache
+            float scale = float(1 << (m_cacheBitDepth - 1));
+            for (sv_frame_t i = 0; i < count; ++i) {
+                buffer[i] *= scale;
+            }
+        }
         if (sf_writef_float(m_cacheFileWritePtr, buffer, sz) < sz) {
             sf_close(m_cacheFileWritePtr);
             m_cacheFileWritePtr = nullptr;
@@ -480,9 +546,9 @@ CodedAudioFileReader::pushBufferNonResampling(float *buffer, sv_frame_t sz)
     case CacheInMemory:
         m_dataLock.lock();
         try {
-            m_data.insert(m_data.end(), buffer, buffer + count);
+            m_data->append(buffer, sz);
         } catch (const std::bad_alloc &e) {
-            m_data.clear();
+            m_data->clear();
             SVCERR << "CodedAudioFileReader: Caught bad_alloc when trying to add " << count << " elements to buffer" << endl;
             m_dataLock.unlock();
             throw e;
@@ -573,20 +639,19 @@ CodedAudioFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) c
     case CacheInMemory:
     {
         if (!isOK()) return {};
-        if (count == 0) return {};
-
-        sv_frame_t ix0 = start * m_channelCount;
-        sv_frame_t ix1 = ix0 + (count * m_channelCount);
+        if (count <= 0 || start < 0) return {};
 
         // This lock used to be a QReadWriteLock, but it appears that
         // its lock mechanism is significantly slower than QMutex so
         // it's not a good idea in cases like this where we don't
         // really have threads taking a long time to read concurrently
         m_dataLock.lock();
-        sv_frame_t n = sv_frame_t(m_data.size());
-        if (ix0 > n) ix0 = n;
-        if (ix1 > n) ix1 = n;
-        frames = floatvec_t(m_data.begin() + ix0, m_data.begin() + ix1);
+        sv_frame_t available = m_data->getFrameCount() - start;
+        if (count > available) count = available;
+        if (count > 0) {
+            frames.resize(count * m_channelCount);
+            m_data->getInterleavedFrames(start, count, frames.data());
+        }
         m_dataLock.unlock();
         break;
     }
@@ -599,3 +664,47 @@ CodedAudioFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) c
     return frames;
 }
 
+sv_frame_t
+CodedAudioFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                           float *buffer) const
+{
+    Profiler profiler("CodedAudioFileReader::getInterleavedFrames");
+    
+    if (!m_initialised) {
+        SVDEBUG << "CodedAudioFileReader::getInterleavedFrames: not initialised" << endl;
+        return 0;
+    }
+
+    sv_frame_t obtained = 0;
+    
+    switch (m_cacheMode) {
+
+    case CacheInTemporaryFile:
+        if (m_cacheFileReader) {
+            obtained = m_cacheFileReader->getInterleavedFrames
+                (start, count, buffer);
+        }
+        break;
+
+    case CacheInMemory:
+    {
+        if (!isOK()) return 0;
+        if (count <= 0 || start < 0) return 0;
+
+        m_dataLock.lock();
+        obtained = m_data->getInterleavedFrames(start, count, buffer);
+        m_dataLock.unlock();
+        break;
+    }
+    }
+
+    if (m_normalised) {
+        sv_frame_t n = obtained * m_channelCount;
+        for (sv_frame_t i = 0; i < n; ++i) {
+            buffer[i] *= m_gain;
+        }
+    }
+
+    return obtained;
+}
+
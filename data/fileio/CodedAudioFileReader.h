@@ -31,7 +31,7 @@
 #include <atomic>
 
 class WavFileReader;
-class Serialiser;
+class CompactSampleBuffer;
 
 namespace breakfastquay {
     class Resampler;
@@ -51,10 +51,15 @@ public:
 
     enum DecodeMode {
         DecodeAtOnce, // decode the file on construction, with progress 
-        DecodeThreaded // decode in a background thread after construction
+        DecodeThreaded, // decode in a background thread after construction
+        DecodeOnDemand  // index the file on construction and decode
+                        // only the regions requested, with no cache;
+                        // readers that can't do this decode threaded
     };
 
     floatvec_t getInterleavedFrames(sv_frame_t start, sv_frame_t count) const override;
+    sv_frame_t getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer) const override;
 
     sv_samplerate_t getNativeRate() const override { return m_fileRate; }
 
@@ -63,6 +68,13 @@ public:
     /// Intermediate cache means all CodedAudioFileReaders are quickly seekable
     bool isQuicklySeekable() const override { return true; }
 
+    /// Reading ahead helps only when the cache is on disc
+    bool isReadAheadUseful() const override {
+        return m_cacheMode == CacheInTemporaryFile;
+    }
+
+    void setDecodePriority(int priority) override;
+
 signals:
     void progress(int);
 
@@ -75,6 +87,15 @@ protected:
 
     // compensation for encoder delays:
     void setFramesToTrim(sv_frame_t fromStart, sv_frame_t fromEnd);
+
+    /**
+     * Declare that every decoded sample will be an exact multiple of
+     * 2^-(bits-1), as for audio decoded from integer PCM at the given
+     * bit depth. Must be called before initialiseDecodeCache. If the
+     * audio is not to be resampled, this allows a file cache to be
+     * written as 16- or 24-bit PCM rather than float, without loss.
+     */
+    void setSourceBitDepth(int bits);
     
     // may throw InsufficientDiscSpace:
     void addSamplesToDecodeCache(float **samples, sv_frame_t nframes);
@@ -86,8 +107,19 @@ protected:
 
     bool isDecodeCacheInitialised() const { return m_initialised; }
 
-    void startSerialised(QString id, const std::atomic<bool> *cancelled);
-    void endSerialised();
+    /**
+     * Wait for the DecodeScheduler to allow this decode to go ahead,
+     * returning true when it does, or false if the cancelled flag
+     * was set first. The estimated size of the decoded data in
+     * kilobytes may be passed if known, otherwise 0.
+     */
+    bool acquireDecodeSlot(const std::atomic<bool> *cancelled,
+                           size_t estimatedKB);
+
+    /**
+     * Release the decode slot, if we have one.
+     */
+    void releaseDecodeSlot();
 
 private:
     void pushCacheWriteBufferMaybe(bool final);
@@ -103,11 +135,14 @@ private:
 protected:
     QMutex m_cacheMutex;
     CacheMode m_cacheMode;
-    floatvec_t m_data;
+    CompactSampleBuffer *m_data;
     mutable QMutex m_dataLock;
     bool m_initialised;
-    Serialiser *m_serialiser;
+    bool m_haveDecodeSlot;
+    std::atomic<int> m_decodePriority;
     sv_samplerate_t m_fileRate;
+    int m_sourceBitDepth;
+    int m_cacheBitDepth; // of file cache, or 0 for float
 
     QString m_cacheFileName;
     SNDFILE *m_cacheFileWritePtr;
@@ -0,0 +1,212 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "CompactSampleBuffer.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+static const sv_frame_t blockFrames = 4096;
+
+CompactSampleBuffer::CompactSampleBuffer(int channels) :
+    m_channels(channels > 0 ? channels : 1),
+    m_frameCount(0),
+    m_packedBytes(0),
+    m_floatBytes(0)
+{
+}
+
+void
+CompactSampleBuffer::clear()
+{
+    m_blocks.clear();
+    m_pending.clear();
+    m_frameCount = 0;
+    m_packedBytes = 0;
+    m_floatBytes = 0;
+}
+
+size_t
+CompactSampleBuffer::getSizeInBytes() const
+{
+    return m_packedBytes + m_floatBytes + m_pending.size() * sizeof(float);
+}
+
+void
+CompactSampleBuffer::append(const float *interleaved, sv_frame_t frames)
+{
+    const sv_frame_t blockSamples = blockFrames * m_channels;
+    sv_frame_t samples = frames * m_channels;
+    sv_frame_t ix = 0;
+
+    // Top up any incomplete block first, then take whole blocks
+    // straight from the input
+
+    if (!m_pending.empty()) {
+        sv_frame_t n = min(samples, blockSamples - sv_frame_t(m_pending.size()));
+        m_pending.insert(m_pending.end(), interleaved, interleaved + n);
+        ix = n;
+        if (sv_frame_t(m_pending.size()) == blockSamples) {
+            pushBlock(m_pending.data(), blockFrames);
+            m_pending.clear();
+        }
+    }
+
+    while (samples - ix >= blockSamples) {
+        pushBlock(interleaved + ix, blockFrames);
+        ix += blockSamples;
+    }
+
+    if (ix < samples) {
+        m_pending.insert(m_pending.end(),
+                         interleaved + ix, interleaved + samples);
+    }
+
+    m_frameCount += frames;
+}
+
+void
+CompactSampleBuffer::pushBlock(const float *interleaved, sv_frame_t frames)
+{
+    sv_frame_t n = frames * m_channels;
+
+    float maxValue = 0.f, minValue = 0.f;
+    bool finite = true;
+    for (sv_frame_t i = 0; i < n; ++i) {
+        float v = interleaved[i];
+        if (!std::isfinite(v)) {
+            finite = false;
+            break;
+        }
+        if (v > maxValue) maxValue = v;
+        if (v < minValue) minValue = v;
+    }
+
+    // Choose the largest power-of-two scale factor that keeps the
+    // values within 16 bits, i.e. -32768 to 32767, so that a block
+    // of 16-bit audio reaching -1.0 still packs at 2^15. If the
+    // block is exactly representable at that scale, it is
+    // representable at no coarser one
+
+    bool packable = finite;
+    int shift = 0;
+    if (packable && (maxValue > 0.f || minValue < 0.f)) {
+        int exponent = 0;
+        frexpf(max(maxValue, -minValue), &exponent);
+        // keep the scale and its reciprocal comfortably within range
+        if (exponent < -100 || exponent > 100) {
+            packable = false;
+        } else {
+            // peak * 2^shift is now in [32768, 65536), which fits
+            // only for a negative peak of exactly 32768 after scaling
+            shift = 16 - exponent;
+            if (maxValue * ldexpf(1.f, shift) > 32767.f ||
+                minValue * ldexpf(1.f, shift) < -32768.f) {
+                --shift;
+            }
+        }
+    }
+
+    Block block;
+    block.packed = false;
+    block.gain = 1.f;
+
+    if (packable) {
+
+        float scale = ldexpf(1.f, shift);
+        block.values.resize(n);
+
+        for (sv_frame_t i = 0; i < n; ++i) {
+            // Multiplying by a power of two is exact, so the value
+            // round-trips only if this is already an integer. The
+            // range is checked above, but it is cheap to be sure
+            float s = interleaved[i] * scale;
+            if (s < -32768.f || s > 32767.f) {
+                packable = false;
+                break;
+            }
+            int16_t q = int16_t(s);
+            if (float(q) != s) {
+                packable = false;
+                break;
+            }
+            block.values[i] = q;
+        }
+    }
+
+    if (packable) {
+        block.packed = true;
+        block.gain = ldexpf(1.f, -shift);
+        m_packedBytes += n * sizeof(int16_t);
+    } else {
+        block.values.clear();
+        block.values.shrink_to_fit();
+        block.floats = floatvec_t(interleaved, interleaved + n);
+        m_floatBytes += n * sizeof(float);
+    }
+
+    m_blocks.push_back(std::move(block));
+}
+
+sv_frame_t
+CompactSampleBuffer::getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                          float *buffer) const
+{
+    if (start < 0 || count <= 0 || start >= m_frameCount) {
+        return 0;
+    }
+    if (count > m_frameCount - start) {
+        count = m_frameCount - start;
+    }
+
+    sv_frame_t blocked = sv_frame_t(m_blocks.size()) * blockFrames;
+    sv_frame_t got = 0;
+
+    while (got < count) {
+
+        sv_frame_t frame = start + got;
+        float *out = buffer + got * m_channels;
+
+        if (frame >= blocked) {
+            sv_frame_t ix = (frame - blocked) * m_channels;
+            sv_frame_t n = (count - got) * m_channels;
+            copy(m_pending.begin() + ix, m_pending.begin() + ix + n, out);
+            got = count;
+            break;
+        }
+
+        const Block &block = m_blocks[frame / blockFrames];
+        sv_frame_t offset = frame % blockFrames;
+        sv_frame_t frames = min(blockFrames - offset, count - got);
+        sv_frame_t ix = offset * m_channels;
+        sv_frame_t n = frames * m_channels;
+
+        if (block.packed) {
+            const int16_t *values = block.values.data() + ix;
+            float gain = block.gain;
+            for (sv_frame_t i = 0; i < n; ++i) {
+                out[i] = float(values[i]) * gain;
+            }
+        } else {
+            copy(block.floats.begin() + ix, block.floats.begin() + ix + n,
+                 out);
+        }
+
+        got += frames;
+    }
+
+    return got;
+}
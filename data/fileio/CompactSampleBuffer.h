@@ -0,0 +1,91 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_COMPACT_SAMPLE_BUFFER_H
+#define SV_COMPACT_SAMPLE_BUFFER_H
+
+#include "base/BaseTypes.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * An append-only store of interleaved float samples, used as the
+ * in-memory decode cache of CodedAudioFileReader, that takes less
+ * space than a plain float vector when the samples allow it without
+ * losing anything.
+ *
+ * Samples are held in blocks of a few thousand frames. A block whose
+ * values can all be written exactly as 16-bit integers times a
+ * power-of-two gain, as is the case for audio decoded from 8- or
+ * 16-bit sources (and for quiet passages of 24-bit ones, or for
+ * silence), is stored that way, in half the space. Any other block
+ * is stored as floats. Either way, the values read back are exactly
+ * those appended.
+ *
+ * Not thread-safe: the caller must serialise access.
+ */
+class CompactSampleBuffer
+{
+public:
+    CompactSampleBuffer(int channels);
+
+    void append(const float *interleaved, sv_frame_t frames);
+    void clear();
+
+    int getChannelCount() const { return m_channels; }
+    sv_frame_t getFrameCount() const { return m_frameCount; }
+
+    /**
+     * Return the number of bytes used for sample storage.
+     */
+    size_t getSizeInBytes() const;
+
+    /**
+     * Return the number of bytes that the same samples would take up
+     * as plain floats.
+     */
+    size_t getUncompactedSizeInBytes() const {
+        return size_t(m_frameCount) * m_channels * sizeof(float);
+    }
+
+    /**
+     * Copy up to count interleaved frames starting at frame start
+     * into the buffer, which must have room for count * channels
+     * values. Return the number of frames copied, which will be fewer
+     * than count if the end of the buffer is reached.
+     */
+    sv_frame_t getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer) const;
+
+private:
+    struct Block {
+        bool packed;
+        float gain;                 // of packed values
+        std::vector<int16_t> values;
+        floatvec_t floats;          // if not packed
+    };
+
+    void pushBlock(const float *interleaved, sv_frame_t frames);
+
+    int m_channels;
+    std::vector<Block> m_blocks;
+    floatvec_t m_pending;  // incomplete final block
+    sv_frame_t m_frameCount;
+    size_t m_packedBytes;
+    size_t m_floatBytes;
+};
+
+#endif
@@ -16,6 +16,7 @@
 #include "DataFileReaderFactory.h"
 #include "MIDIFileReader.h"
 #include "CSVFileReader.h"
+#include "BinaryFeatureFileReader.h"
 
 #include "model/Model.h"
 
@@ -24,7 +25,7 @@
 QString
 DataFileReaderFactory::getKnownExtensions()
 {
-    return "*.svl *.csv *.lab *.mid *.txt";
+    return "*.svl *.csv *.lab *.mid *.txt *.svfb";
 }
 
 DataFileReader *
@@ -39,6 +40,13 @@ DataFileReaderFactory::createReader(QString path,
 
     DataFileReader *reader = nullptr;
 
+    if (!csv) {
+        reader = new BinaryFeatureFileReader(path, mainModelSampleRate);
+        if (reader->isOK()) return reader;
+        if (reader->getError() != "") err = reader->getError();
+        delete reader;
+    }
+
     if (!csv) {
         reader = new MIDIFileReader(path,
                                     acquirer,
@@ -0,0 +1,205 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "DecodeScheduler.h"
+
+#include "base/StorageAdviser.h"
+#include "base/Exceptions.h"
+#include "base/Debug.h"
+
+#include <QMutexLocker>
+#include <QSettings>
+#include <QThread>
+
+#include <algorithm>
+
+//#define DEBUG_DECODE_SCHEDULER 1
+
+using namespace std;
+
+DecodeScheduler *
+DecodeScheduler::getInstance()
+{
+    static DecodeScheduler instance;
+    return &instance;
+}
+
+DecodeScheduler::DecodeScheduler() :
+    m_running(0),
+    m_maxConcurrent(0),
+    m_nextSequence(0)
+{
+    QSettings settings;
+    settings.beginGroup("DecodeScheduler");
+    m_maxConcurrent = settings.value("max-concurrent-decodes", 0).toInt();
+    settings.endGroup();
+
+    if (m_maxConcurrent < 0) {
+        m_maxConcurrent = 0;
+    }
+}
+
+bool
+DecodeScheduler::acquire(const std::atomic<int> *priority,
+                         size_t estimatedKB,
+                         const std::atomic<bool> *cancelled)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Waiter waiter;
+    waiter.priority = priority;
+    waiter.estimatedKB = estimatedKB;
+    waiter.sequence = m_nextSequence++;
+
+    m_waiting.push_back(&waiter);
+
+    while (true) {
+
+        if (cancelled && *cancelled) {
+            m_waiting.erase(find(m_waiting.begin(), m_waiting.end(), &waiter));
+            // someone behind us may now be first in line
+            m_condition.wakeAll();
+#ifdef DEBUG_DECODE_SCHEDULER
+            SVCERR << "DecodeScheduler::acquire: cancelled while waiting"
+                   << endl;
+#endif
+            return false;
+        }
+
+        if (isFirstInLine(&waiter) && m_running < getLimitFor(&waiter)) {
+            m_waiting.erase(find(m_waiting.begin(), m_waiting.end(), &waiter));
+            ++m_running;
+            // and the next in line may be able to start too
+            m_condition.wakeAll();
+#ifdef DEBUG_DECODE_SCHEDULER
+            SVCERR << "DecodeScheduler::acquire: starting decode with priority "
+                   << (priority ? int(*priority) : 0) << ", now "
+                   << m_running << " running and " << m_waiting.size()
+                   << " waiting" << endl;
+#endif
+            return true;
+        }
+
+        // Wake occasionally to poll the cancelled flag, which is
+        // set without notifying us
+        m_condition.wait(&m_mutex, 500);
+    }
+}
+
+void
+DecodeScheduler::release()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_running > 0) {
+        --m_running;
+    } else {
+        SVCERR << "WARNING: DecodeScheduler::release: no decode is running"
+               << endl;
+    }
+
+    m_condition.wakeAll();
+}
+
+void
+DecodeScheduler::priorityChanged()
+{
+    QMutexLocker locker(&m_mutex);
+    m_condition.wakeAll();
+}
+
+void
+DecodeScheduler::setMaxConcurrentDecodes(int n)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxConcurrent = max(n, 0);
+    m_condition.wakeAll();
+}
+
+int
+DecodeScheduler::getMaxConcurrentDecodes() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_maxConcurrent > 0) {
+        return m_maxConcurrent;
+    }
+    // Leave room for the threads that will be summarising, rendering
+    // and analysing the decoded audio
+    return max(1, QThread::idealThreadCount() / 2);
+}
+
+int
+DecodeScheduler::getRunningDecodeCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running;
+}
+
+int
+DecodeScheduler::getWaitingDecodeCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_waiting.size());
+}
+
+bool
+DecodeScheduler::isFirstInLine(const Waiter *w) const
+{
+    // called with m_mutex held
+
+    int p = (w->priority ? int(*w->priority) : 0);
+
+    for (const Waiter *other: m_waiting) {
+        if (other == w) continue;
+        int op = (other->priority ? int(*other->priority) : 0);
+        if (op > p || (op == p && other->sequence < w->sequence)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int
+DecodeScheduler::getLimitFor(const Waiter *w) const
+{
+    // called with m_mutex held
+
+    int limit = m_maxConcurrent;
+    if (limit == 0) {
+        limit = max(1, QThread::idealThreadCount() / 2);
+    }
+
+    if (limit == 1 || m_running == 0 || w->estimatedKB == 0) {
+        return limit;
+    }
+
+    // If the decode caches are going to be tight for space, don't
+    // start so many at once. We always allow at least one decode to
+    // run, as it would have done without any scheduling at all
+
+    try {
+        StorageAdviser::Recommendation rec =
+            StorageAdviser::recommend(StorageAdviser::NoCriteria,
+                                      w->estimatedKB,
+                                      w->estimatedKB);
+        if (rec & StorageAdviser::ConserveSpace) {
+            limit = max(1, limit / 2);
+        }
+    } catch (const InsufficientDiscSpace &) {
+        limit = 1;
+    }
+
+    return limit;
+}
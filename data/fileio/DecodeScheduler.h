@@ -0,0 +1,103 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_DECODE_SCHEDULER_H
+#define SV_DECODE_SCHEDULER_H
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Process-wide limit on the number of coded audio files being
+ * decoded at once. A CodedAudioFileReader acquires a slot before it
+ * starts decoding into its cache and releases it when done.
+ *
+ * The number of slots is derived from the number of processor cores,
+ * unless set explicitly (either through setMaxConcurrentDecodes or
+ * with the "max-concurrent-decodes" value in the "DecodeScheduler"
+ * settings group). Fewer decodes are started alongside others when
+ * the StorageAdviser reports that space for their caches is short.
+ *
+ * Waiting decodes are started in order of priority, highest first,
+ * and in order of arrival among those of equal priority. A waiting
+ * decode's priority may be changed while it waits.
+ */
+class DecodeScheduler
+{
+public:
+    static DecodeScheduler *getInstance();
+
+    /**
+     * Wait until a decode slot is available and this caller is the
+     * first in line for it, then take the slot and return true. The
+     * priority is read afresh whenever the queue is reconsidered, so
+     * the caller may change it while waiting (see
+     * priorityChanged). The estimated size, in kilobytes, of the
+     * decoded data is used to check storage headroom; pass 0 if it
+     * is unknown.
+     *
+     * If cancelled is non-null and is found to have become true while
+     * waiting, return false without taking a slot.
+     */
+    bool acquire(const std::atomic<int> *priority,
+                 size_t estimatedKB,
+                 const std::atomic<bool> *cancelled);
+
+    /**
+     * Release a slot previously taken with acquire.
+     */
+    void release();
+
+    /**
+     * Notify the scheduler that the priority of a waiting decode has
+     * changed, so that the queue should be reconsidered.
+     */
+    void priorityChanged();
+
+    /**
+     * Set the maximum number of decodes to run at once. Pass 0 to
+     * revert to the default, derived from the processor core count.
+     */
+    void setMaxConcurrentDecodes(int n);
+
+    int getMaxConcurrentDecodes() const;
+
+    int getRunningDecodeCount() const;
+    int getWaitingDecodeCount() const;
+
+private:
+    DecodeScheduler();
+
+    struct Waiter {
+        const std::atomic<int> *priority;
+        size_t estimatedKB;
+        long sequence;
+    };
+
+    bool isFirstInLine(const Waiter *w) const;
+    int getLimitFor(const Waiter *w) const;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_condition;
+    std::vector<Waiter *> m_waiting;
+    int m_running;
+    int m_maxConcurrent;
+    long m_nextSequence;
+};
+
+#endif
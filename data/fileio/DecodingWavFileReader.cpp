@@ -61,6 +61,8 @@ DecodingWavFileReader::DecodingWavFileReader(FileSource source,
     m_title = m_original->getTitle();
     m_maker = m_original->getMaker();
 
+    setSourceBitDepth(m_original->getBitDepth());
+    
     initialiseDecodeCache();
 
     if (decodeMode == DecodeAtOnce) {
@@ -88,7 +90,7 @@ DecodingWavFileReader::DecodingWavFileReader(FileSource source,
         }
 
         if (isDecodeCacheInitialised()) finishDecodeCache();
-        endSerialised();
+        releaseDecodeSlot();
 
         if (m_reporter) m_reporter->setProgress(100);
 
@@ -125,9 +127,12 @@ void
 DecodingWavFileReader::DecodeThread::run()
 {
     if (m_reader->m_cacheMode == CacheInTemporaryFile) {
-        m_reader->startSerialised("DecodingWavFileReader::Decode",
-                                  &m_reader->m_cancelled);
-        if (m_reader->m_cancelled) {
+        double ratio = m_reader->m_sampleRate / m_reader->m_fileRate;
+        size_t estimatedKB = size_t
+            (double(m_reader->m_original->getFrameCount()) * ratio
+             * m_reader->m_channelCount * sizeof(float) / 1024.0);
+        if (!m_reader->acquireDecodeSlot(&m_reader->m_cancelled,
+                                         estimatedKB)) {
             return;
         }
     }
@@ -151,7 +156,7 @@ DecodingWavFileReader::DecodeThread::run()
     if (m_reader->isDecodeCacheInitialised()) m_reader->finishDecodeCache();
     m_reader->m_completion = 100;
 
-    m_reader->endSerialised();
+    m_reader->releaseDecodeSlot();
 
     delete m_reader->m_original;
     m_reader->m_original = nullptr;
@@ -15,21 +15,20 @@
 
 #include "FileReadThread.h"
 
+#include "AudioFileReader.h"
+
 #include "base/Profiler.h"
-#include "base/Thread.h"
+#include "base/Debug.h"
 
-#include <iostream>
+#include <algorithm>
 
-#ifdef _MSC_VER
-#include <io.h>
-#define _lseek lseek
-#else
-#include <unistd.h>
-#endif
+//#define DEBUG_FILE_READ_THREAD 1
 
-#include <cstdio>
+using namespace std;
 
-//#define DEBUG_FILE_READ_THREAD 1
+// Upper limit on the size of a read made by coalescing several
+// requests, in samples
+static const sv_frame_t maxCoalescedSamples = 1024 * 1024;
 
 FileReadThread::FileReadThread() :
     m_nextToken(0),
@@ -48,11 +47,8 @@ FileReadThread::run()
         } else {
             process();
         }
-        notifyCancelled();
     }
 
-    notifyCancelled();
-
 #ifdef DEBUG_FILE_READ_THREAD
     SVDEBUG << "FileReadThread::run() exiting" << endl;
 #endif
@@ -70,7 +66,6 @@ FileReadThread::finish()
 
         while (!m_queue.empty()) {
             m_cancelledRequests[m_queue.begin()->first] = m_queue.begin()->second;
-            m_newlyCancelled.insert(m_queue.begin()->first);
             m_queue.erase(m_queue.begin());
         }
         
@@ -78,6 +73,7 @@ FileReadThread::finish()
     }
 
     m_condition.wakeAll();
+    m_readyCondition.wakeAll();
 
 #ifdef DEBUG_FILE_READ_THREAD
     SVDEBUG << "FileReadThread::finish() exiting" << endl;
@@ -94,6 +90,8 @@ FileReadThread::request(const Request &request)
     
         token = m_nextToken++;
         m_queue[token] = request;
+        m_queue[token].got = 0;
+        m_queue[token].successful = false;
     }
 
     m_condition.wakeAll();
@@ -107,15 +105,19 @@ FileReadThread::cancel(int token)
     {
         MutexLocker locker(&m_mutex, "FileReadThread::cancel::m_mutex");
 
+        // A request that is being read is left in m_queue until the
+        // read completes, and its data buffer is written only if it
+        // is still there then -- so once it has been moved out here,
+        // the caller may delete the buffer straight away
+
         if (m_queue.find(token) != m_queue.end()) {
             m_cancelledRequests[token] = m_queue[token];
             m_queue.erase(token);
-            m_newlyCancelled.insert(token);
         } else if (m_readyRequests.find(token) != m_readyRequests.end()) {
             m_cancelledRequests[token] = m_readyRequests[token];
             m_readyRequests.erase(token);
         } else {
-            cerr << "WARNING: FileReadThread::cancel: token " << token << " not found" << endl;
+            SVCERR << "WARNING: FileReadThread::cancel: token " << token << " not found" << endl;
         }
     }
 
@@ -123,7 +125,17 @@ FileReadThread::cancel(int token)
     SVDEBUG << "FileReadThread::cancel(" << token << ") waking condition" << endl;
 #endif
 
-    m_condition.wakeAll();
+    m_readyCondition.wakeAll();
+}
+
+void
+FileReadThread::setPriority(int token, int priority)
+{
+    MutexLocker locker(&m_mutex, "FileReadThread::setPriority::m_mutex");
+
+    if (m_queue.find(token) != m_queue.end()) {
+        m_queue[token].priority = priority;
+    }
 }
 
 bool
@@ -142,8 +154,7 @@ FileReadThread::isCancelled(int token)
     MutexLocker locker(&m_mutex, "FileReadThread::isCancelled::m_mutex");
 
     bool cancelled = 
-        m_cancelledRequests.find(token) != m_cancelledRequests.end() &&
-        m_newlyCancelled.find(token) == m_newlyCancelled.end();
+        m_cancelledRequests.find(token) != m_cancelledRequests.end();
 
     return cancelled;
 }
@@ -187,6 +198,18 @@ FileReadThread::getRequest(int token, Request &request)
     return found;
 }
 
+bool
+FileReadThread::waitFor(int token)
+{
+    MutexLocker locker(&m_mutex, "FileReadThread::waitFor::m_mutex");
+
+    while (!m_exiting && m_queue.find(token) != m_queue.end()) {
+        m_readyCondition.wait(&m_mutex);
+    }
+
+    return m_readyRequests.find(token) != m_readyRequests.end();
+}
+
 void
 FileReadThread::done(int token)
 {
@@ -196,20 +219,61 @@ FileReadThread::done(int token)
 
     if (m_cancelledRequests.find(token) != m_cancelledRequests.end()) {
         m_cancelledRequests.erase(token);
-        m_newlyCancelled.erase(token);
         found = true;
     } else if (m_readyRequests.find(token) != m_readyRequests.end()) {
         m_readyRequests.erase(token);
         found = true;
     } else if (m_queue.find(token) != m_queue.end()) {
-        cerr << "WARNING: FileReadThread::done(" << token << "): request is still in queue (wait or cancel it)" << endl;
+        SVCERR << "WARNING: FileReadThread::done(" << token << "): request is still in queue (wait or cancel it)" << endl;
     }
 
     if (!found) {
-        cerr << "WARNING: FileReadThread::done(" << token << "): request not found" << endl;
+        SVCERR << "WARNING: FileReadThread::done(" << token << "): request not found" << endl;
     }
 }
 
+std::set<int>
+FileReadThread::coalesce(int token, sv_frame_t &start, sv_frame_t &end)
+{
+    // called with m_mutex held
+
+    std::set<int> tokens;
+    tokens.insert(token);
+
+    const Request &first = m_queue[token];
+    int channels = std::max(first.reader->getChannelCount(), 1);
+    sv_frame_t limit = std::max(end - start, maxCoalescedSamples / channels);
+
+    // Keep absorbing requests on the same reader that overlap or abut
+    // the range so far, as each one may bring others into reach
+
+    bool added = true;
+    while (added) {
+        added = false;
+        for (const auto &q: m_queue) {
+            const Request &r = q.second;
+            if (r.reader != first.reader || tokens.find(q.first) != tokens.end()) {
+                continue;
+            }
+            sv_frame_t rend = r.start + r.count;
+            if (r.start > end || rend < start) {
+                continue;
+            }
+            sv_frame_t s = std::min(start, r.start);
+            sv_frame_t e = std::max(end, rend);
+            if (e - s > limit) {
+                continue;
+            }
+            start = s;
+            end = e;
+            tokens.insert(q.first);
+            added = true;
+        }
+    }
+
+    return tokens;
+}
+
 void
 FileReadThread::process()
 {
@@ -217,113 +281,72 @@ FileReadThread::process()
 
     Profiler profiler("FileReadThread::process", true);
 
-    int token = m_queue.begin()->first;
-    Request request = m_queue.begin()->second;
+    // The queue is in token order, i.e. order of arrival, so the
+    // first of the highest priority is the one to serve
+    
+    auto best = m_queue.begin();
+    for (auto i = m_queue.begin(); i != m_queue.end(); ++i) {
+        if (i->second.priority > best->second.priority) {
+            best = i;
+        }
+    }
+
+    const AudioFileReader *reader = best->second.reader;
+    sv_frame_t start = best->second.start;
+    sv_frame_t end = start + best->second.count;
+    std::set<int> tokens = coalesce(best->first, start, end);
 
     m_mutex.unlock();
 
 #ifdef DEBUG_FILE_READ_THREAD
-    SVDEBUG << "FileReadThread::process: reading " << request.start << ", " << request.size << " on " << request.fd << endl;
+    SVDEBUG << "FileReadThread::process: reading " << start << " to " << end
+            << " for " << tokens.size() << " request(s)" << endl;
 #endif
 
-    bool successful = false;
-    bool seekFailed = false;
-    ssize_t r = 0;
-
-    { 
-        MutexLocker rlocker(request.mutex, "FileReadThread::process::request.mutex");
-
-        if (::lseek(request.fd, request.start, SEEK_SET) == (off_t)-1) {
-            seekFailed = true;
-        } else {
-        
-            // if request.size is large, we want to avoid making a single
-            // system call to read it all as it may block too much
-            
-            static const size_t blockSize = 256 * 1024;
-            
-            size_t size = request.size;
-            char *destination = request.data;
-            
-            while (size > 0) {
-                size_t readSize = size;
-                if (readSize > blockSize) readSize = blockSize;
-                ssize_t br = ::read(request.fd, destination, readSize);
-                if (br < 0) { 
-                    r = br;
-                    break;
-                } else {
-                    r += br;
-                    if (br < ssize_t(readSize)) break;
-                }
-                destination += readSize;
-                size -= readSize;
-            }
-        }
-    }
+    bool successful = (reader && reader->isOK() && start >= 0);
+    sv_frame_t got = 0;
+    int channels = 0;
 
-    if (seekFailed) {
-        ::perror("Seek failed");
-        cerr << "ERROR: FileReadThread::process: seek to "
-                  << request.start << " failed" << endl;
-        request.size = 0;
-    } else {
-        if (r < 0) {
-            ::perror("ERROR: FileReadThread::process: Read failed");
-            cerr << "ERROR: FileReadThread::process: read of "
-                      << request.size << " at "
-                      << request.start << " failed" << endl;
-            request.size = 0;
-        } else if (r < ssize_t(request.size)) {
-            cerr << "WARNING: FileReadThread::process: read "
-                      << request.size << " returned only " << r << " bytes"
-                      << endl;
-            request.size = r;
-            usleep(100000);
-        } else {
-            successful = true;
-        }
+    if (successful) {
+        channels = reader->getChannelCount();
+        m_buffer.resize((end - start) * channels);
+        got = reader->getInterleavedFrames(start, end - start, m_buffer.data());
     }
         
-    // Check that the token hasn't been cancelled and the thread
-    // hasn't been asked to finish
+    // Deliver to those requests that haven't been cancelled in the
+    // meantime, unless the thread has been asked to finish
     
     m_mutex.lock();
 
-    request.successful = successful;
-        
-    if (m_queue.find(token) != m_queue.end() && !m_exiting) {
-        m_queue.erase(token);
-        m_readyRequests[token] = request;
+    if (!m_exiting) {
+        for (int token: tokens) {
+            auto i = m_queue.find(token);
+            if (i == m_queue.end()) {
 #ifdef DEBUG_FILE_READ_THREAD
-        SVDEBUG << "FileReadThread::process: done, marking as ready (success = " << m_readyRequests[token].successful << ")" << endl;
+                SVDEBUG << "FileReadThread::process: request " << token
+                        << " disappeared" << endl;
 #endif
-    } else {
-#ifdef DEBUG_FILE_READ_THREAD
-        if (m_exiting) {
-            SVDEBUG << "FileReadThread::process: exiting" << endl;
-        } else {
-            SVDEBUG << "FileReadThread::process: request disappeared" << endl;
+                continue;
+            }
+            Request request = i->second;
+            request.successful = successful;
+            if (successful) {
+                sv_frame_t offset = request.start - start;
+                request.got = std::max(sv_frame_t(0),
+                                       std::min(request.count, got - offset));
+                std::copy(m_buffer.begin() + offset * channels,
+                          m_buffer.begin() + (offset + request.got) * channels,
+                          request.data);
+            }
+            m_queue.erase(i);
+            m_readyRequests[token] = request;
         }
-#endif
     }
-}
-
-void
-FileReadThread::notifyCancelled()
-{
-    // entered with m_mutex locked
 
-    while (!m_newlyCancelled.empty()) {
-
-        int token = *m_newlyCancelled.begin();
-
-#ifdef DEBUG_FILE_READ_THREAD
-        SVDEBUG << "FileReadThread::notifyCancelled: token " << token << endl;
-#endif
-
-        m_newlyCancelled.erase(token);
+    // Don't hang on to the memory for an unusually large read
+    if (m_buffer.size() > size_t(maxCoalescedSamples)) {
+        floatvec_t().swap(m_buffer);
     }
+
+    m_readyCondition.wakeAll();
 }
-        
-    
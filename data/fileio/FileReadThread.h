@@ -17,6 +17,7 @@
 #define SV_FILE_READ_THREAD_H
 
 #include "base/Thread.h"
+#include "base/BaseTypes.h"
 
 #include <QMutex>
 #include <QWaitCondition>
@@ -24,8 +25,19 @@
 #include <map>
 #include <set>
 
-#include <stdint.h>
+class AudioFileReader;
 
+/**
+ * A thread that reads audio frames from AudioFileReaders on behalf of
+ * other threads. A caller queues a request and gets back a token
+ * with which to check on it, wait for it, change its priority or
+ * cancel it.
+ *
+ * Requests are served in order of priority, highest first, and in
+ * order of arrival among those of equal priority. Queued requests on
+ * the same reader whose frame ranges overlap or abut the one being
+ * served are coalesced into a single read.
+ */
 class FileReadThread : public Thread
 {
     Q_OBJECT
@@ -37,21 +49,31 @@ public:
     virtual void finish();
 
     struct Request {
-        int fd;
-        QMutex *mutex; // used to synchronise access to fd; may be null
-        off_t start;
-        size_t size;
-        char *data; // caller is responsible for allocating and deallocating
+        const AudioFileReader *reader;
+        sv_frame_t start;
+        sv_frame_t count;
+        float *data; // count * channels; caller allocates and deallocates
+        int priority; // higher is served sooner
+        sv_frame_t got; // set by FileReadThread: number of frames read
         bool successful; // set by FileReadThread after processing request
     };
     
     virtual int request(const Request &request);
     virtual void cancel(int token);
+    virtual void setPriority(int token, int priority);
 
     virtual bool isReady(int token);
     virtual bool isCancelled(int token); // and safe to delete
     virtual bool haveRequest(int token);
     virtual bool getRequest(int token, Request &request);
+
+    /**
+     * Block until the request with the given token is no longer
+     * queued. Return true if it is then ready, false if it was
+     * cancelled (or is unknown).
+     */
+    virtual bool waitFor(int token);
+
     virtual void done(int token);
     
 protected:
@@ -62,13 +84,15 @@ protected:
     RequestQueue m_queue;
     RequestQueue m_cancelledRequests;
     RequestQueue m_readyRequests;
-    std::set<int> m_newlyCancelled;
+
+    floatvec_t m_buffer; // used only by the read thread
 
     QMutex m_mutex;
     QWaitCondition m_condition;
+    QWaitCondition m_readyCondition;
 
     void process();
-    void notifyCancelled();
+    std::set<int> coalesce(int token, sv_frame_t &start, sv_frame_t &end);
 };
 
 #endif
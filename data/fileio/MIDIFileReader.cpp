@@ -951,6 +951,9 @@ MIDIFileReader::loadTrack(unsigned int trackToLoad,
 
     bool sharpKey = true;
 
+    EventVector notes;
+    notes.reserve(totalEvents);
+
     for (MIDITrack::const_iterator i = track.begin(); i != track.end(); ++i) {
 
         RealTime rt;
@@ -1037,7 +1040,7 @@ MIDIFileReader::loadTrack(unsigned int trackToLoad,
 
 //                    SVDEBUG << "Adding note " << startFrame << "," << (endFrame-startFrame) << " : " << int((*i)->getPitch()) << endl;
 
-                    model->add(note);
+                    notes.push_back(note);
                     break;
                 }
 
@@ -1063,6 +1066,8 @@ MIDIFileReader::loadTrack(unsigned int trackToLoad,
         ++count;
     }
 
+    model->addEvents(notes);
+
     return model;
 }
 
@@ -28,6 +28,7 @@
 #include <iostream>
 
 #include <cstdlib>
+#include <algorithm>
 
 #ifdef HAVE_ID3TAG
 #include <id3tag.h>
@@ -41,6 +42,7 @@
 #include <unistd.h>
 #endif
 
+#include <QFile>
 #include <QFileInfo>
 
 #include <QTextCodec>
@@ -59,11 +61,16 @@ MP3FileReader::MP3FileReader(FileSource source, DecodeMode decodeMode,
     m_path(source.getLocalFilename()),
     m_gaplessMode(gaplessMode),
     m_decodeErrorShown(false),
-    m_decodeThread(nullptr)
+    m_decodeThread(nullptr),
+    m_onDemand(false),
+    m_samplesPerFrame(0),
+    m_chunkUseCount(0)
 {
     SVDEBUG << "MP3FileReader: local path: \"" << m_path
             << "\", decode mode: " << decodeMode << " ("
-            << (decodeMode == DecodeAtOnce ? "DecodeAtOnce" : "DecodeThreaded")
+            << (decodeMode == DecodeAtOnce ? "DecodeAtOnce" :
+                decodeMode == DecodeOnDemand ? "DecodeOnDemand" :
+                "DecodeThreaded")
             << ")" << endl;
     
     m_channelCount = 0;
@@ -83,48 +90,40 @@ MP3FileReader::MP3FileReader(FileSource source, DecodeMode decodeMode,
     
     m_fileSize = 0;
 
-    m_fileBuffer = nullptr;
-    m_fileBufferSize = 0;
+    m_file = nullptr;
+    m_mappedFile = nullptr;
 
     m_sampleBuffer = nullptr;
     m_sampleBufferSize = 0;
 
-    QFile qfile(m_path);
-    if (!qfile.open(QIODevice::ReadOnly)) {
+    if (!openFile()) {
         m_error = QString("Failed to open file %1 for reading.").arg(m_path);
         SVDEBUG << "MP3FileReader: " << m_error << endl;
         return;
     }   
 
-    m_fileSize = qfile.size();
-    
-    try {
-        // We need a mysterious MAD_BUFFER_GUARD (== 8) zero bytes at
-        // end of input, to ensure libmad decodes the last frame
-        // correctly. Otherwise the decoded audio is truncated.
-        SVDEBUG << "file size = " << m_fileSize << ", buffer guard = " << MAD_BUFFER_GUARD << endl;
-        m_fileBufferSize = m_fileSize + MAD_BUFFER_GUARD;
-        m_fileBuffer = new unsigned char[m_fileBufferSize];
-        memset(m_fileBuffer + m_fileSize, 0, MAD_BUFFER_GUARD);
-    } catch (...) {
-        m_error = QString("Out of memory");
-        SVDEBUG << "MP3FileReader: " << m_error << endl;
-        return;
-    }
+    loadTags(m_file->handle());
 
-    auto amountRead = qfile.read(reinterpret_cast<char *>(m_fileBuffer),
-                                 m_fileSize);
+    if (decodeMode == DecodeOnDemand) {
 
-    if (amountRead < m_fileSize) {
-        SVCERR << QString("MP3FileReader::MP3FileReader: Warning: reached EOF after only %1 of %2 bytes")
-            .arg(amountRead).arg(m_fileSize) << endl;
-        memset(m_fileBuffer + amountRead, 0, m_fileSize - amountRead);
-        m_fileSize = amountRead;
-    }
+        // We can only decode on demand if we can map the file for
+        // random access, and if the audio is needed as it is in the
+        // file: resampling and normalisation both require a full
+        // decode
         
-    loadTags(qfile.handle());
+        if (!normalised && m_mappedFile && buildFrameIndex()) {
+            SVDEBUG << "MP3FileReader: indexed " << m_frameOffsets.size() - 1
+                    << " mp3 frames, will decode on demand" << endl;
+            m_onDemand = true;
+            m_completion = 100;
+            m_done = true;
+            return;
+        }
 
-    qfile.close();
+        SVDEBUG << "MP3FileReader: can't decode on demand, decoding in full"
+                << endl;
+        decodeMode = DecodeThreaded;
+    }
 
     if (decodeMode == DecodeAtOnce) {
 
@@ -134,7 +133,7 @@ MP3FileReader::MP3FileReader(FileSource source, DecodeMode decodeMode,
                 (tr("Decoding %1...").arg(QFileInfo(m_path).fileName()));
         }
 
-        if (!decode(m_fileBuffer, m_fileBufferSize)) {
+        if (!decode()) {
             m_error = QString("Failed to decode file %1.").arg(m_path);
         }
 
@@ -146,11 +145,10 @@ MP3FileReader::MP3FileReader(FileSource source, DecodeMode decodeMode,
             m_sampleBuffer = nullptr;
         }
         
-        delete[] m_fileBuffer;
-        m_fileBuffer = nullptr;
+        closeFile();
 
         if (isDecodeCacheInitialised()) finishDecodeCache();
-        endSerialised();
+        releaseDecodeSlot();
 
     } else {
 
@@ -181,6 +179,45 @@ MP3FileReader::~MP3FileReader()
         m_decodeThread->wait();
         delete m_decodeThread;
     }
+
+    closeFile();
+}
+
+bool
+MP3FileReader::openFile()
+{
+    m_file = new QFile(m_path);
+    if (!m_file->open(QIODevice::ReadOnly)) {
+        delete m_file;
+        m_file = nullptr;
+        return false;
+    }
+
+    m_fileSize = m_file->size();
+
+    // Decode straight from a read-only mapping of the file if we
+    // can, so that we neither hold a copy of the whole file in memory
+    // nor wait for it all to be read before decoding starts. If the
+    // file can't be mapped (for example if it is larger than the
+    // available address space) we read it in chunks instead.
+    
+    if (m_fileSize > 0) {
+        m_mappedFile = m_file->map(0, m_fileSize);
+    }
+
+    SVDEBUG << "MP3FileReader: file size = " << m_fileSize << ", "
+            << (m_mappedFile ? "mapped" : "not mapped, will stream") << endl;
+
+    return true;
+}
+
+void
+MP3FileReader::closeFile()
+{
+    // QFile unmaps on close
+    delete m_file;
+    m_file = nullptr;
+    m_mappedFile = nullptr;
 }
 
 void
@@ -290,12 +327,11 @@ MP3FileReader::loadTag(void *vtag, const char *name)
 void
 MP3FileReader::DecodeThread::run()
 {
-    if (!m_reader->decode(m_reader->m_fileBuffer, m_reader->m_fileBufferSize)) {
+    if (!m_reader->decode()) {
         m_reader->m_error = QString("Failed to decode file %1.").arg(m_reader->m_path);
     }
 
-    delete[] m_reader->m_fileBuffer;
-    m_reader->m_fileBuffer = nullptr;
+    m_reader->closeFile();
 
     if (m_reader->m_sampleBuffer) {
         for (int c = 0; c < m_reader->m_channelCount; ++c) {
@@ -312,23 +348,71 @@ MP3FileReader::DecodeThread::run()
     m_reader->m_done = true;
     m_reader->m_completion = 100;
 
-    m_reader->endSerialised();
+    m_reader->releaseDecodeSlot();
 } 
 
+static sv_frame_t
+findAudioStart(const unsigned char *mapped, QFile *file, sv_frame_t length)
+{
+    sv_frame_t start = 0;
+
+#ifdef HAVE_ID3TAG
+    while (length - start > ID3_TAG_QUERYSIZE) {
+        id3_byte_t header[ID3_TAG_QUERYSIZE];
+        const id3_byte_t *query = header;
+        if (mapped) {
+            query = mapped + start;
+        } else if (!file->seek(start) ||
+                   file->read(reinterpret_cast<char *>(header),
+                              ID3_TAG_QUERYSIZE) != ID3_TAG_QUERYSIZE) {
+            break;
+        }
+        long taglen = id3_tag_query(query, ID3_TAG_QUERYSIZE);
+        if (taglen <= 0) {
+            break;
+        }
+        SVDEBUG << "MP3FileReader: ID3 tag length to skip: " << taglen << endl;
+        start += taglen;
+    }
+    if (start > length) {
+        start = length;
+    }
+#else
+    (void)mapped;
+    (void)file;
+    (void)length;
+#endif
+
+    return start;
+}
+
 bool
-MP3FileReader::decode(void *mm, sv_frame_t sz)
+MP3FileReader::decode()
 {
+    if (!m_file) {
+        m_done = true;
+        return false;
+    }
+    
     DecoderData data;
     struct mad_decoder decoder;
 
-    data.start = (unsigned char const *)mm;
-    data.length = sz;
+    data.mapped = m_mappedFile;
+    data.file = m_file;
+    data.length = m_fileSize;
+    data.position = findAudioStart(m_mappedFile, m_file, m_fileSize);
+    data.bufferOffset = data.position;
     data.finished = false;
     data.reader = this;
 
+    if (!m_mappedFile && !m_file->seek(data.position)) {
+        m_done = true;
+        return false;
+    }
+
     mad_decoder_init(&decoder,          // decoder to initialise
                      &data,             // our own data block for callbacks
-                     input_callback,    // provides (entire) input to mad
+                     input_callback,    // provides input to mad
                      nullptr,                 // checks header
                      filter_callback,   // filters frame before decoding
                      output_callback,   // receives decoded output
@@ -345,33 +429,99 @@ MP3FileReader::decode(void *mm, sv_frame_t sz)
     return true;
 }
 
+// Size of the chunks read from the file when it can't be mapped
+static const sv_frame_t streamingChunkSize = 256 * 1024;
+
 enum mad_flow
 MP3FileReader::input_callback(void *dp, struct mad_stream *stream)
 {
     DecoderData *data = (DecoderData *)dp;
 
-    if (!data->length) {
+    if (data->finished) {
+        return MAD_FLOW_STOP;
+    }
+
+    // Bytes that mad was given last time but has not consumed,
+    // because they don't make up a whole frame
+    sv_frame_t remaining = 0;
+    if (stream->next_frame) {
+        remaining = stream->bufend - stream->next_frame;
+    }
+
+    // We need a mysterious MAD_BUFFER_GUARD (== 8) zero bytes at end
+    // of input, to ensure libmad decodes the last frame
+    // correctly. Otherwise the decoded audio is truncated.
+    
+    if (data->mapped) {
+
+        if (data->position < data->length) {
+            // First call: hand over the whole mapping
+            mad_stream_buffer(stream,
+                              data->mapped + data->position,
+                              data->length - data->position);
+            data->bufferOffset = data->position;
+            data->position = data->length;
+            return MAD_FLOW_CONTINUE;
+        }
+
+        // Second call: mad has stopped short of the last frame,
+        // because there are no guard bytes after it. We can't write
+        // those into the mapping, so copy the remainder into a
+        // buffer that has them
+        data->finished = true;
+        if (remaining == 0) {
+            return MAD_FLOW_STOP;
+        }
+        data->buffer.assign(stream->next_frame, stream->bufend);
+        data->buffer.resize(remaining + MAD_BUFFER_GUARD, 0);
+        mad_stream_buffer(stream, data->buffer.data(), data->buffer.size());
+        data->bufferOffset = data->length - remaining;
+        return MAD_FLOW_CONTINUE;
+    }
+
+    // Not mapped: keep the unconsumed bytes and fill up the rest of
+    // the buffer from the file
+
+    if (data->buffer.empty()) {
+        data->buffer.resize(streamingChunkSize + MAD_BUFFER_GUARD, 0);
+    }
+    
+    sv_frame_t wanted = streamingChunkSize - remaining;
+    if (wanted <= 0) {
+        // mad can't make anything of a whole chunk
         data->finished = true;
         return MAD_FLOW_STOP;
     }
 
-    unsigned char const *start = data->start;
-    sv_frame_t length = data->length;
+    unsigned char *buffer = data->buffer.data();
+    if (remaining > 0) {
+        memmove(buffer, stream->next_frame, remaining);
+    }
 
-#ifdef HAVE_ID3TAG
-    while (length > ID3_TAG_QUERYSIZE) {
-        ssize_t taglen = id3_tag_query(start, ID3_TAG_QUERYSIZE);
-        if (taglen <= 0) {
-            break;
+    qint64 obtained = data->file->read
+        (reinterpret_cast<char *>(buffer + remaining), wanted);
+    if (obtained < 0) {
+        SVCERR << "MP3FileReader: Failed to read from file: "
+               << data->file->errorString() << endl;
+        obtained = 0;
+    }
+
+    data->bufferOffset = data->position - remaining;
+    data->position += obtained;
+
+    sv_frame_t available = remaining + obtained;
+
+    if (obtained < wanted) {
+        // End of file
+        data->finished = true;
+        if (available == 0) {
+            return MAD_FLOW_STOP;
         }
-        SVDEBUG << "MP3FileReader: ID3 tag length to skip: " << taglen << endl;
-        start += taglen;
-        length -= taglen;
+        memset(buffer + available, 0, MAD_BUFFER_GUARD);
+        available += MAD_BUFFER_GUARD;
     }
-#endif
 
-    mad_stream_buffer(stream, start, length);
-    data->length = 0;
+    mad_stream_buffer(stream, buffer, available);
 
     return MAD_FLOW_CONTINUE;
 }
@@ -509,9 +659,15 @@ MP3FileReader::accept(struct mad_header const *header,
         initialiseDecodeCache();
 
         if (m_cacheMode == CacheInTemporaryFile) {
-//            SVDEBUG << "MP3FileReader::accept: channel count " << m_channelCount << ", file rate " << m_fileRate << ", about to start serialised section" << endl;
-            startSerialised("MP3FileReader::Decode", &m_cancelled);
-            if (m_cancelled) {
+//            SVDEBUG << "MP3FileReader::accept: channel count " << m_channelCount << ", file rate " << m_fileRate << ", about to wait for decode slot" << endl;
+            size_t estimatedKB = 0;
+            if (m_bitrateDenom > 0 && m_bitrateNum > 0) {
+                double bitrate = m_bitrateNum / m_bitrateDenom;
+                double duration = double(m_fileSize * 8) / bitrate;
+                estimatedKB = size_t(duration * m_sampleRate * m_channelCount
+                                     * sizeof(float) / 1024.0);
+            }
+            if (!acquireDecodeSlot(&m_cancelled, estimatedKB)) {
                 return MAD_FLOW_STOP;
             }
         }
@@ -588,7 +744,7 @@ MP3FileReader::error_callback(void *dp,
 {
     DecoderData *data = (DecoderData *)dp;
 
-    sv_frame_t ix = stream->this_frame - data->start;
+    sv_frame_t ix = data->bufferOffset + (stream->this_frame - stream->buffer);
     
     if (stream->error == MAD_ERROR_LOSTSYNC &&
         (data->finished || ix >= data->length)) {
@@ -610,6 +766,349 @@ MP3FileReader::error_callback(void *dp,
     return MAD_FLOW_CONTINUE;
 }
 
+// Number of mp3 frames decoded together on demand and cached as one
+// chunk, and the number of chunks to keep
+static const sv_frame_t framesPerChunk = 64;
+static const int maxDecodedChunks = 32;
+
+// Number of mp3 frames to decode and discard before the first frame
+// we want, when decoding on demand. A layer III frame may take data
+// from up to 511 bytes of preceding frames (the bit reservoir), which
+// at the lowest bit rates spans six frames, and its output overlaps
+// with that of the frame before
+static const sv_frame_t prerollFrames = 8;
+
+bool
+MP3FileReader::buildFrameIndex()
+{
+    Profiler profiler("MP3FileReader::buildFrameIndex");
+
+    qint64 audioStart = findAudioStart(m_mappedFile, m_file, m_fileSize);
+    if (m_fileSize - audioStart <= MAD_BUFFER_GUARD) {
+        return false;
+    }
+    
+    // Decode the first frame in full, to see whether it is a
+    // Xing/LAME metadata frame that tells us how much to trim (in
+    // filter) and that should not itself be decoded
+
+    qint64 metadataFrame = -1;
+    
+    struct mad_stream stream;
+    struct mad_frame frame;
+    mad_stream_init(&stream);
+    mad_frame_init(&frame);
+    mad_stream_buffer(&stream, m_mappedFile + audioStart,
+                      m_fileSize - audioStart);
+
+    bool found = false;
+    while (!found) {
+        if (mad_frame_decode(&frame, &stream) == 0) {
+            found = true;
+        } else if (!MAD_RECOVERABLE(stream.error)) {
+            break;
+        }
+    }
+    if (found && filter(&stream, &frame) == MAD_FLOW_IGNORE) {
+        metadataFrame = stream.this_frame - m_mappedFile;
+    }
+
+    mad_frame_finish(&frame);
+    mad_stream_finish(&stream);
+
+    if (!found) {
+        return false;
+    }
+
+    // Now scan the headers only. Every frame must have the same
+    // layer, rate and channel count as the first; anything else is
+    // taken to be junk that happens to look like a frame header
+    
+    struct mad_header header;
+    mad_stream_init(&stream);
+    mad_header_init(&header);
+    mad_stream_buffer(&stream, m_mappedFile + audioStart,
+                      m_fileSize - audioStart);
+
+    const unsigned char *buffer = m_mappedFile + audioStart;
+    qint64 bufferOffset = audioStart;
+    std::vector<unsigned char> tail;
+    
+    std::vector<qint64> offsets;
+    qint64 end = 0;
+    enum mad_layer layer = MAD_LAYER_III;
+    unsigned int rate = 0;
+    int channels = 0;
+    int samplesPerFrame = 0;
+    
+    while (true) {
+
+        if (mad_header_decode(&header, &stream) == -1) {
+            if (stream.error == MAD_ERROR_BUFLEN) {
+                if (!tail.empty()) {
+                    break;
+                }
+                // As in input_callback, copy the last few frames to a
+                // buffer with the guard bytes libmad needs after them
+                qint64 remaining = stream.bufend - stream.next_frame;
+                tail.assign(stream.next_frame, stream.bufend);
+                tail.resize(remaining + MAD_BUFFER_GUARD, 0);
+                buffer = tail.data();
+                bufferOffset = m_fileSize - remaining;
+                mad_stream_buffer(&stream, tail.data(), tail.size());
+                continue;
+            }
+            if (MAD_RECOVERABLE(stream.error)) {
+                continue;
+            }
+            break;
+        }
+
+        qint64 offset = bufferOffset + (stream.this_frame - buffer);
+        if (offset == metadataFrame) {
+            continue;
+        }
+
+        int frameChannels = MAD_NCHANNELS(&header);
+        int frameSamples = 32 * MAD_NSBSAMPLES(&header);
+
+        if (offsets.empty()) {
+            layer = header.layer;
+            rate = header.samplerate;
+            channels = frameChannels;
+            samplesPerFrame = frameSamples;
+        } else if (header.layer != layer ||
+                   header.samplerate != rate ||
+                   frameChannels != channels ||
+                   frameSamples != samplesPerFrame) {
+            continue;
+        }
+
+        offsets.push_back(offset);
+        end = bufferOffset + (stream.next_frame - buffer);
+    }
+
+    mad_header_finish(&header);
+    mad_stream_finish(&stream);
+
+    if (offsets.empty() || rate == 0 || channels == 0) {
+        return false;
+    }
+
+    if (m_sampleRate != 0 && m_sampleRate != sv_samplerate_t(rate)) {
+        // Resampling needs a full decode
+        return false;
+    }
+    
+    offsets.push_back(end);
+
+    m_frameOffsets = offsets;
+    m_samplesPerFrame = samplesPerFrame;
+    m_fileRate = rate;
+    m_sampleRate = rate;
+    m_channelCount = channels;
+
+    sv_frame_t decoded = sv_frame_t(m_frameOffsets.size() - 1) * samplesPerFrame;
+    m_frameCount = decoded - m_trimFromStart - m_trimFromEnd;
+    if (m_frameCount < 0) {
+        m_frameCount = 0;
+    }
+
+    return true;
+}
+
+std::shared_ptr<const floatvec_t>
+MP3FileReader::decodeChunk(sv_frame_t chunk) const
+{
+    Profiler profiler("MP3FileReader::decodeChunk");
+    
+    sv_frame_t frameCount = sv_frame_t(m_frameOffsets.size()) - 1;
+    sv_frame_t first = chunk * framesPerChunk;
+    sv_frame_t last = std::min(first + framesPerChunk, frameCount);
+    sv_frame_t from = std::max(first - prerollFrames, sv_frame_t(0));
+
+    auto data = std::make_shared<floatvec_t>
+        ((last - first) * m_samplesPerFrame * m_channelCount, 0.f);
+    if (last <= first) {
+        return data;
+    }
+
+    // Copy the frames so as to add the guard bytes after the last one
+    
+    qint64 start = m_frameOffsets[from];
+    qint64 length = m_frameOffsets[last] - start;
+    std::vector<unsigned char> input(length + MAD_BUFFER_GUARD, 0);
+    memcpy(input.data(), m_mappedFile + start, length);
+
+    struct mad_stream stream;
+    struct mad_frame frame;
+    struct mad_synth synth;
+    mad_stream_init(&stream);
+    mad_frame_init(&frame);
+    mad_synth_init(&synth);
+    mad_stream_buffer(&stream, input.data(), input.size());
+
+    auto frameBegin = m_frameOffsets.begin() + from;
+    auto frameEnd = m_frameOffsets.begin() + last;
+    
+    while (true) {
+
+        bool ok = (mad_frame_decode(&frame, &stream) == 0);
+        if (!ok && !MAD_RECOVERABLE(stream.error)) {
+            break;
+        }
+
+        // Find which of our frames this was, if any. If a frame
+        // fails to decode, we leave its output as silence so that the
+        // frames after it remain where the index says they are
+        
+        qint64 offset = start + (stream.this_frame - input.data());
+        auto itr = std::lower_bound(frameBegin, frameEnd, offset);
+        if (itr == frameEnd) {
+            break;
+        }
+        if (!ok || *itr != offset) {
+            continue;
+        }
+        sv_frame_t index = itr - m_frameOffsets.begin();
+
+        // Preroll frames are synthesised too, to prime the filterbank
+        mad_synth_frame(&synth, &frame);
+        
+        if (index < first) {
+            continue;
+        }
+        
+        const struct mad_pcm &pcm = synth.pcm;
+        int n = std::min(int(pcm.length), m_samplesPerFrame);
+        float *out = data->data() +
+            (index - first) * m_samplesPerFrame * m_channelCount;
+        
+        for (int i = 0; i < n; ++i) {
+            for (int c = 0; c < m_channelCount; ++c) {
+                out[i * m_channelCount + c] =
+                    float(pcm.samples[c][i]) / float(MAD_F_ONE);
+            }
+        }
+    }
+
+    mad_synth_finish(&synth);
+    mad_frame_finish(&frame);
+    mad_stream_finish(&stream);
+
+    return data;
+}
+
+floatvec_t
+MP3FileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) const
+{
+    if (!m_onDemand) {
+        return CodedAudioFileReader::getInterleavedFrames(start, count);
+    }
+
+    if (start < 0 || start >= m_frameCount) {
+        return {};
+    }
+    if (count > m_frameCount - start) {
+        count = m_frameCount - start;
+    }
+
+    floatvec_t frames(count * m_channelCount, 0.f);
+    count = getInterleavedFrames(start, count, frames.data());
+    frames.resize(count * m_channelCount);
+    return frames;
+}
+
+std::shared_ptr<const floatvec_t>
+MP3FileReader::findDecodedChunk(sv_frame_t chunk) const
+{
+    for (auto &c: m_chunks) {
+        if (c.index == chunk) {
+            c.lastUsed = ++m_chunkUseCount;
+            return c.data;
+        }
+    }
+    return {};
+}
+
+sv_frame_t
+MP3FileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer) const
+{
+    if (!m_onDemand) {
+        return CodedAudioFileReader::getInterleavedFrames
+            (start, count, buffer);
+    }
+
+    if (start < 0 || count <= 0 || start >= m_frameCount) {
+        return 0;
+    }
+    if (count > m_frameCount - start) {
+        count = m_frameCount - start;
+    }
+
+    const sv_frame_t chunkSize = framesPerChunk * m_samplesPerFrame;
+    
+    sv_frame_t got = 0;
+    
+    while (got < count) {
+
+        sv_frame_t decoded = start + got + m_trimFromStart;
+        sv_frame_t chunk = decoded / chunkSize;
+        sv_frame_t offset = decoded - chunk * chunkSize;
+        
+        std::shared_ptr<const floatvec_t> data;
+
+        {
+            QMutexLocker locker(&m_chunkMutex);
+            data = findDecodedChunk(chunk);
+        }
+
+        if (!data) {
+
+            // Decode without holding the lock, so that other threads
+            // can read from other chunks meanwhile
+            std::shared_ptr<const floatvec_t> decoded = decodeChunk(chunk);
+
+            QMutexLocker locker(&m_chunkMutex);
+
+            // Another thread may have stored the same chunk while we
+            // were decoding it. Use theirs if so, as storing a second
+            // copy would push out a chunk that is still wanted
+            data = findDecodedChunk(chunk);
+
+            if (data) {
+                // nothing to store
+            } else if (int(m_chunks.size()) < maxDecodedChunks) {
+                data = decoded;
+                m_chunks.push_back({ chunk, ++m_chunkUseCount, data });
+            } else {
+                data = decoded;
+                auto oldest = m_chunks.begin();
+                for (auto i = m_chunks.begin(); i != m_chunks.end(); ++i) {
+                    if (i->lastUsed < oldest->lastUsed) oldest = i;
+                }
+                *oldest = { chunk, ++m_chunkUseCount, data };
+            }
+        }
+
+        sv_frame_t available =
+            sv_frame_t(data->size()) / m_channelCount - offset;
+        if (available <= 0) {
+            break;
+        }
+        sv_frame_t n = std::min(available, count - got);
+        
+        std::copy(data->begin() + offset * m_channelCount,
+                  data->begin() + (offset + n) * m_channelCount,
+                  buffer + got * m_channelCount);
+        
+        got += n;
+    }
+
+    return got;
+}
+
 void
 MP3FileReader::getSupportedExtensions(std::set<QString> &extensions)
 {
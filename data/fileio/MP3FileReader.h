@@ -25,8 +25,11 @@
 
 #include <set>
 #include <atomic>
+#include <vector>
+#include <memory>
 
 class ProgressReporter;
+class QFile;
 
 class MP3FileReader : public CodedAudioFileReader
 {
@@ -93,6 +96,15 @@ public:
         return m_decodeThread && m_decodeThread->isRunning();
     }
 
+    bool isReadAheadUseful() const override {
+        return m_onDemand || CodedAudioFileReader::isReadAheadUseful();
+    }
+
+    floatvec_t getInterleavedFrames(sv_frame_t start,
+                                    sv_frame_t count) const override;
+    sv_frame_t getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer) const override;
+
 public slots:
     void cancelled();
 
@@ -111,8 +123,8 @@ protected:
     int m_completion;
     bool m_done;
 
-    unsigned char *m_fileBuffer;
-    size_t m_fileBufferSize;
+    QFile *m_file;
+    const unsigned char *m_mappedFile;
     
     float **m_sampleBuffer;
     size_t m_sampleBufferSize;
@@ -123,13 +135,20 @@ protected:
     bool m_decodeErrorShown;
 
     struct DecoderData {
-        unsigned char const *start;
-        sv_frame_t length;
+        unsigned char const *mapped; // whole file, or null if streaming
+        QFile *file;                 // used if not mapped
+        sv_frame_t length;           // of whole file
+        sv_frame_t position;         // of next byte not yet given to mad
+        sv_frame_t bufferOffset;     // file offset of current mad buffer
+        std::vector<unsigned char> buffer;
         bool finished;
         MP3FileReader *reader;
     };
 
-    bool decode(void *mm, sv_frame_t sz);
+    bool openFile();
+    void closeFile();
+    
+    bool decode();
     enum mad_flow filter(struct mad_stream const *, struct mad_frame *);
     enum mad_flow accept(struct mad_header const *, struct mad_pcm *);
 
@@ -153,6 +172,28 @@ protected:
 
     DecodeThread *m_decodeThread;
 
+    // Used in DecodeOnDemand mode, where we index the mp3 frames
+    // and decode chunks of them as they are asked for
+    bool m_onDemand;
+    std::vector<qint64> m_frameOffsets; // of each frame, plus end of last
+    int m_samplesPerFrame;
+
+    struct DecodedChunk {
+        sv_frame_t index;
+        long lastUsed;
+        std::shared_ptr<const floatvec_t> data;
+    };
+
+    mutable QMutex m_chunkMutex;
+    mutable std::vector<DecodedChunk> m_chunks;
+    mutable long m_chunkUseCount;
+
+    bool buildFrameIndex();
+    std::shared_ptr<const floatvec_t> decodeChunk(sv_frame_t chunk) const;
+
+    // Caller must hold m_chunkMutex. Marks the chunk as used, if found
+    std::shared_ptr<const floatvec_t> findDecodedChunk(sv_frame_t chunk) const;
+
     void loadTags(int fd);
     QString loadTag(void *vtag, const char *name);
 };
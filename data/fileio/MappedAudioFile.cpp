@@ -0,0 +1,405 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "MappedAudioFile.h"
+
+#include "base/Debug.h"
+
+#include <QFile>
+
+#include <sndfile.h>
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+//#define DEBUG_MAPPED_AUDIO_FILE 1
+
+using namespace std;
+
+static const unsigned char w64RiffGuid[16] = {
+    'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11,
+    0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00
+};
+static const unsigned char w64WaveGuid[16] = {
+    'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11,
+    0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A
+};
+static const unsigned char w64FmtGuid[16] = {
+    'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11,
+    0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A
+};
+static const unsigned char w64DataGuid[16] = {
+    'd', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11,
+    0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A
+};
+
+template <bool BigEndian>
+static inline uint16_t
+load16(const unsigned char *p)
+{
+    return BigEndian ?
+        uint16_t((uint16_t(p[0]) << 8) | p[1]) :
+        uint16_t(p[0] | (uint16_t(p[1]) << 8));
+}
+
+template <bool BigEndian>
+static inline uint32_t
+load24(const unsigned char *p)
+{
+    return BigEndian ?
+        (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2] :
+        p[0] | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+}
+
+template <bool BigEndian>
+static inline uint32_t
+load32(const unsigned char *p)
+{
+    return BigEndian ?
+        (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+        (uint32_t(p[2]) << 8) | p[3] :
+        p[0] | (uint32_t(p[1]) << 8) |
+        (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+template <bool BigEndian>
+static inline uint64_t
+load64(const unsigned char *p)
+{
+    return BigEndian ?
+        (uint64_t(load32<true>(p)) << 32) | load32<true>(p + 4) :
+        load32<false>(p) | (uint64_t(load32<false>(p + 4)) << 32);
+}
+
+static uint32_t
+loadChunkSize(const unsigned char *p, bool bigEndian)
+{
+    return bigEndian ? load32<true>(p) : load32<false>(p);
+}
+
+template <bool BigEndian>
+static void
+convert(const unsigned char *p, sv_frame_t n, int type, float *buffer)
+{
+    // type is the libsndfile subtype; scale factors are as used by
+    // libsndfile when reading to float with normalisation on
+
+    switch (type) {
+
+    case SF_FORMAT_PCM_U8:
+        for (sv_frame_t i = 0; i < n; ++i) {
+            buffer[i] = float(int(p[i]) - 128) * (1.f / 128.f);
+        }
+        break;
+
+    case SF_FORMAT_PCM_S8:
+        for (sv_frame_t i = 0; i < n; ++i) {
+            buffer[i] = float(int8_t(p[i])) * (1.f / 128.f);
+        }
+        break;
+
+    case SF_FORMAT_PCM_16:
+        for (sv_frame_t i = 0; i < n; ++i) {
+            buffer[i] = float(int16_t(load16<BigEndian>(p + i * 2)))
+                * (1.f / 32768.f);
+        }
+        break;
+
+    case SF_FORMAT_PCM_24:
+        for (sv_frame_t i = 0; i < n; ++i) {
+            int32_t v = int32_t(load24<BigEndian>(p + i * 3) << 8);
+            buffer[i] = float(v) * (1.f / 2147483648.f);
+        }
+        break;
+
+    case SF_FORMAT_PCM_32:
+        for (sv_frame_t i = 0; i < n; ++i) {
+            buffer[i] = float(int32_t(load32<BigEndian>(p + i * 4)))
+                * (1.f / 2147483648.f);
+        }
+        break;
+
+    case SF_FORMAT_FLOAT:
+        for (sv_frame_t i = 0; i < n; ++i) {
+            uint32_t v = load32<BigEndian>(p + i * 4);
+            memcpy(buffer + i, &v, 4);
+        }
+        break;
+
+    case SF_FORMAT_DOUBLE:
+        for (sv_frame_t i = 0; i < n; ++i) {
+            uint64_t v = load64<BigEndian>(p + i * 8);
+            double d;
+            memcpy(&d, &v, 8);
+            buffer[i] = float(d);
+        }
+        break;
+    }
+}
+
+static int
+getSampleBytes(int subtype)
+{
+    switch (subtype) {
+    case SF_FORMAT_PCM_U8: return 1;
+    case SF_FORMAT_PCM_S8: return 1;
+    case SF_FORMAT_PCM_16: return 2;
+    case SF_FORMAT_PCM_24: return 3;
+    case SF_FORMAT_PCM_32: return 4;
+    case SF_FORMAT_FLOAT: return 4;
+    case SF_FORMAT_DOUBLE: return 8;
+    default: return 0;
+    }
+}
+
+bool
+MappedAudioFile::isMappableFormat(int sfFormat)
+{
+    int type = sfFormat & SF_FORMAT_TYPEMASK;
+    int subtype = sfFormat & SF_FORMAT_SUBMASK;
+
+    if (type != SF_FORMAT_WAV &&
+        type != SF_FORMAT_WAVEX &&
+        type != SF_FORMAT_W64 &&
+        type != SF_FORMAT_AIFF) {
+        return false;
+    }
+
+    return getSampleBytes(subtype) > 0;
+}
+
+MappedAudioFile::MappedAudioFile(QString path, int sfFormat,
+                                 int channels, sv_frame_t frames) :
+    m_file(nullptr),
+    m_base(nullptr),
+    m_data(nullptr),
+    m_channels(channels),
+    m_frames(frames),
+    m_subtype(sfFormat & SF_FORMAT_SUBMASK),
+    m_sampleBytes(getSampleBytes(m_subtype)),
+    m_bigEndian(false)
+{
+    if (!isMappableFormat(sfFormat) || channels <= 0 || frames <= 0) {
+        return;
+    }
+
+    QFile *file = new QFile(path);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        return;
+    }
+
+    qint64 size = file->size();
+    uchar *mapped = (size > 0 ? file->map(0, size) : nullptr);
+    if (!mapped) {
+        SVDEBUG << "MappedAudioFile: failed to map \"" << path << "\": "
+                << file->errorString() << endl;
+        delete file;
+        return;
+    }
+
+    qint64 offset = 0, length = 0;
+    if (!findSampleData(mapped, size, sfFormat, offset, length)) {
+        SVDEBUG << "MappedAudioFile: unsupported or unexpected layout in \""
+                << path << "\", not mapping" << endl;
+        file->unmap(mapped);
+        delete file;
+        return;
+    }
+
+    qint64 frameBytes = qint64(m_channels) * m_sampleBytes;
+    qint64 available = std::min(length, size - offset) / frameBytes;
+
+    if (available != frames) {
+        SVDEBUG << "MappedAudioFile: file \"" << path << "\" has "
+                << available << " frames of sample data where libsndfile "
+                << "reports " << frames << ", not mapping" << endl;
+        file->unmap(mapped);
+        delete file;
+        return;
+    }
+
+    m_file = file;
+    m_base = mapped;
+    m_data = mapped + offset;
+
+#ifdef DEBUG_MAPPED_AUDIO_FILE
+    SVCERR << "MappedAudioFile: mapped \"" << path << "\": "
+           << frames << " frames of " << m_channels << " channels at offset "
+           << offset << ", " << m_sampleBytes << " bytes per sample, "
+           << (m_bigEndian ? "big" : "little") << "-endian" << endl;
+#endif
+}
+
+MappedAudioFile::~MappedAudioFile()
+{
+    if (m_file) {
+        m_file->unmap(m_base);
+        delete m_file;
+    }
+}
+
+bool
+MappedAudioFile::findSampleData(const unsigned char *base, qint64 size,
+                                int sfFormat, qint64 &offset, qint64 &length)
+{
+    int type = sfFormat & SF_FORMAT_TYPEMASK;
+
+    int channels = 0;
+    int blockAlign = 0;
+    bool haveFormat = false;
+
+    if (type == SF_FORMAT_WAV || type == SF_FORMAT_WAVEX) {
+
+        if (size < 12) return false;
+
+        if (!memcmp(base, "RIFF", 4)) m_bigEndian = false;
+        else if (!memcmp(base, "RIFX", 4)) m_bigEndian = true;
+        else return false;
+
+        if (memcmp(base + 8, "WAVE", 4)) return false;
+
+        qint64 pos = 12;
+        while (pos + 8 <= size) {
+            const unsigned char *chunk = base + pos;
+            qint64 chunkSize = loadChunkSize(chunk + 4, m_bigEndian);
+            qint64 body = pos + 8;
+            if (!memcmp(chunk, "fmt ", 4)) {
+                if (chunkSize < 16 || body + 16 > size) return false;
+                channels = m_bigEndian ?
+                    load16<true>(base + body + 2) :
+                    load16<false>(base + body + 2);
+                blockAlign = m_bigEndian ?
+                    load16<true>(base + body + 12) :
+                    load16<false>(base + body + 12);
+                haveFormat = true;
+            } else if (!memcmp(chunk, "data", 4)) {
+                if (!haveFormat) return false;
+                offset = body;
+                length = chunkSize;
+                break;
+            }
+            pos = body + chunkSize + (chunkSize & 1);
+        }
+
+    } else if (type == SF_FORMAT_W64) {
+
+        if (size < 40 ||
+            memcmp(base, w64RiffGuid, 16) ||
+            memcmp(base + 24, w64WaveGuid, 16)) {
+            return false;
+        }
+
+        m_bigEndian = false;
+
+        qint64 pos = 40;
+        while (pos + 24 <= size) {
+            const unsigned char *chunk = base + pos;
+            uint64_t chunkSize = load64<false>(chunk + 16);
+            if (chunkSize < 24 || chunkSize > uint64_t(size)) return false;
+            qint64 body = pos + 24;
+            if (!memcmp(chunk, w64FmtGuid, 16)) {
+                if (chunkSize < 24 + 16 || body + 16 > size) return false;
+                channels = load16<false>(base + body + 2);
+                blockAlign = load16<false>(base + body + 12);
+                haveFormat = true;
+            } else if (!memcmp(chunk, w64DataGuid, 16)) {
+                if (!haveFormat) return false;
+                offset = body;
+                length = qint64(chunkSize) - 24;
+                break;
+            }
+            pos += qint64((chunkSize + 7) & ~uint64_t(7));
+        }
+
+    } else if (type == SF_FORMAT_AIFF) {
+
+        if (size < 12 || memcmp(base, "FORM", 4)) return false;
+
+        bool aifc = false;
+        if (!memcmp(base + 8, "AIFC", 4)) aifc = true;
+        else if (memcmp(base + 8, "AIFF", 4)) return false;
+
+        m_bigEndian = true;
+
+        qint64 pos = 12;
+        while (pos + 8 <= size) {
+            const unsigned char *chunk = base + pos;
+            qint64 chunkSize = load32<true>(chunk + 4);
+            qint64 body = pos + 8;
+            if (!memcmp(chunk, "COMM", 4)) {
+                if (chunkSize < 18 || body + 18 > size) return false;
+                channels = load16<true>(base + body);
+                int bits = load16<true>(base + body + 6);
+                if ((bits + 7) / 8 != m_sampleBytes) return false;
+                blockAlign = channels * m_sampleBytes;
+                if (aifc) {
+                    if (chunkSize < 22 || body + 22 > size) return false;
+                    const unsigned char *comp = base + body + 18;
+                    if (!memcmp(comp, "sowt", 4)) {
+                        m_bigEndian = false;
+                    } else if (memcmp(comp, "NONE", 4) &&
+                               memcmp(comp, "twos", 4) &&
+                               memcmp(comp, "fl32", 4) &&
+                               memcmp(comp, "FL32", 4) &&
+                               memcmp(comp, "fl64", 4) &&
+                               memcmp(comp, "FL64", 4)) {
+                        return false;
+                    }
+                }
+                haveFormat = true;
+            } else if (!memcmp(chunk, "SSND", 4)) {
+                if (!haveFormat || chunkSize < 8 || body + 8 > size) {
+                    return false;
+                }
+                qint64 dataOffset = load32<true>(base + body);
+                offset = body + 8 + dataOffset;
+                length = chunkSize - 8 - dataOffset;
+                break;
+            }
+            pos = body + chunkSize + (chunkSize & 1);
+        }
+
+    } else {
+        return false;
+    }
+
+    if (!haveFormat || offset <= 0 || offset >= size || length <= 0) {
+        return false;
+    }
+
+    if (channels != m_channels ||
+        blockAlign != m_channels * m_sampleBytes) {
+        return false;
+    }
+
+    return true;
+}
+
+void
+MappedAudioFile::readFrames(sv_frame_t start, sv_frame_t count,
+                            float *buffer) const
+{
+    if (!m_data || count <= 0) return;
+
+    const unsigned char *p = m_data + start * m_channels * m_sampleBytes;
+    sv_frame_t n = count * m_channels;
+
+    if (m_bigEndian) {
+        convert<true>(p, n, m_subtype, buffer);
+    } else {
+        convert<false>(p, n, m_subtype, buffer);
+    }
+}
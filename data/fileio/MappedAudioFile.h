@@ -0,0 +1,87 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_MAPPED_AUDIO_FILE_H
+#define SV_MAPPED_AUDIO_FILE_H
+
+#include "base/BaseTypes.h"
+
+#include <QString>
+
+class QFile;
+
+/**
+ * Read-only memory mapping of the sample data in an uncompressed
+ * WAV, W64 or AIFF file, used by WavFileReader to read without going
+ * through libsndfile.
+ *
+ * The file header is parsed here only to find the sample data and
+ * its layout, and the result is checked against the format, channel
+ * count and frame count that libsndfile reported when it opened the
+ * same file. If anything is unfamiliar or inconsistent, the mapping
+ * is simply not valid and the caller should read through libsndfile
+ * as usual.
+ *
+ * Once constructed, a MappedAudioFile is immutable and readFrames
+ * may be called from any number of threads at once without locking.
+ */
+class MappedAudioFile
+{
+public:
+    /**
+     * Map the given file, whose libsndfile format (as in
+     * SF_INFO::format), channel count and frame count are already
+     * known.
+     */
+    MappedAudioFile(QString path, int sfFormat,
+                    int channels, sv_frame_t frames);
+    ~MappedAudioFile();
+
+    bool isValid() const { return m_data != nullptr; }
+
+    sv_frame_t getFrameCount() const { return m_frames; }
+    int getChannelCount() const { return m_channels; }
+
+    /**
+     * Convert count interleaved frames starting at frame start into
+     * the buffer, which must have room for count * channels
+     * values. The range must lie within the file. Uses the same
+     * scaling as libsndfile's sf_readf_float.
+     */
+    void readFrames(sv_frame_t start, sv_frame_t count, float *buffer) const;
+
+    /**
+     * Return true if the given libsndfile format is one that
+     * MappedAudioFile may be able to read.
+     */
+    static bool isMappableFormat(int sfFormat);
+
+private:
+    QFile *m_file;
+    unsigned char *m_base;
+    const unsigned char *m_data;
+    int m_channels;
+    sv_frame_t m_frames;
+    int m_subtype;
+    int m_sampleBytes;
+    bool m_bigEndian;
+
+    bool findSampleData(const unsigned char *base, qint64 size,
+                        int sfFormat, qint64 &offset, qint64 &length);
+
+    MappedAudioFile(const MappedAudioFile &) =delete;
+    MappedAudioFile &operator=(const MappedAudioFile &) =delete;
+};
+
+#endif
@@ -0,0 +1,213 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "QueuedFileDevice.h"
+
+#include "base/Debug.h"
+
+#include <QFile>
+
+//#define DEBUG_QUEUED_FILE_DEVICE 1
+
+QueuedFileDevice::QueuedFileDevice(QFile *file,
+                                   int bufferSize,
+                                   int maxQueuedBuffers) :
+    m_file(file),
+    m_bufferSize(bufferSize > 0 ? bufferSize : 1),
+    m_maxQueued(maxQueuedBuffers > 0 ? maxQueuedBuffers : 1),
+    m_writing(false),
+    m_exiting(false),
+    m_failed(false),
+    m_thread(nullptr)
+{
+    m_current.reserve(m_bufferSize);
+
+    QIODevice::open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+
+    m_thread = new WriterThread(*this);
+    m_thread->start();
+}
+
+QueuedFileDevice::~QueuedFileDevice()
+{
+    if (m_thread) close();
+}
+
+bool
+QueuedFileDevice::isOK() const
+{
+    QMutexLocker locker(&m_mutex);
+    return !m_failed;
+}
+
+bool
+QueuedFileDevice::checkFailed()
+{
+    // Caller thread only, with m_mutex unlocked
+
+    QString error;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_failed) return false;
+        error = m_error;
+    }
+    setErrorString(error);
+    return true;
+}
+
+qint64
+QueuedFileDevice::readData(char *, qint64)
+{
+    return -1;
+}
+
+qint64
+QueuedFileDevice::writeData(const char *data, qint64 size)
+{
+    if (checkFailed()) return -1;
+
+    m_current.append(data, int(size));
+
+    if (m_current.size() >= m_bufferSize) {
+        if (!enqueue()) return -1;
+    }
+
+    return size;
+}
+
+bool
+QueuedFileDevice::enqueue()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+
+        // Block while the writer thread is too far behind
+        while (int(m_queue.size()) >= m_maxQueued && !m_failed) {
+            m_condition.wait(&m_mutex);
+        }
+
+        if (!m_failed) {
+            m_queue.push_back(m_current);
+            m_condition.wakeAll();
+        }
+    }
+
+    m_current = QByteArray();
+    m_current.reserve(m_bufferSize);
+
+    return !checkFailed();
+}
+
+bool
+QueuedFileDevice::flush()
+{
+    if (!m_thread) {
+        return !checkFailed();
+    }
+
+    if (!m_current.isEmpty()) {
+        if (!enqueue()) return false;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        while ((!m_queue.empty() || m_writing) && !m_failed) {
+            m_condition.wait(&m_mutex);
+        }
+    }
+
+    if (checkFailed()) return false;
+
+    // The writer thread is idle with nothing queued, so we can use
+    // the file from here
+    if (!m_file->flush()) {
+        QMutexLocker locker(&m_mutex);
+        m_failed = true;
+        m_error = m_file->errorString();
+    }
+
+    return !checkFailed();
+}
+
+void
+QueuedFileDevice::close()
+{
+    if (!m_thread) return;
+
+    if (!flush()) {
+        SVCERR << "QueuedFileDevice: ERROR: Failed to write to \""
+               << m_file->fileName() << "\": " << errorString() << endl;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_exiting = true;
+        m_condition.wakeAll();
+    }
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+
+    QIODevice::close();
+}
+
+void
+QueuedFileDevice::writeQueued()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (true) {
+
+        while (m_queue.empty() && !m_exiting) {
+            m_condition.wait(&m_mutex);
+        }
+
+        if (m_queue.empty()) {
+            break; // exiting, and everything has been written
+        }
+
+        QByteArray buffer = m_queue.front();
+        m_queue.pop_front();
+        m_writing = true;
+        m_condition.wakeAll(); // there is room in the queue again
+
+        locker.unlock();
+
+#ifdef DEBUG_QUEUED_FILE_DEVICE
+        SVCERR << "QueuedFileDevice: writing " << buffer.size()
+               << " bytes to \"" << m_file->fileName() << "\"" << endl;
+#endif
+
+        qint64 written = 0;
+        while (written < buffer.size()) {
+            qint64 n = m_file->write(buffer.constData() + written,
+                                     buffer.size() - written);
+            if (n <= 0) break;
+            written += n;
+        }
+
+        locker.relock();
+
+        m_writing = false;
+
+        if (written < buffer.size()) {
+            m_failed = true;
+            m_error = m_file->errorString();
+            m_queue.clear();
+        }
+
+        m_condition.wakeAll();
+    }
+}
@@ -0,0 +1,111 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_QUEUED_FILE_DEVICE_H
+#define SV_QUEUED_FILE_DEVICE_H
+
+#include "base/Thread.h"
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <deque>
+
+class QFile;
+
+/**
+ * Write-only device that passes data on to a file from a thread of
+ * its own, so that the caller does not wait for the file system on
+ * every write.
+ *
+ * Data written to the device is gathered into a buffer, which is
+ * handed to the writer thread when full while the caller goes on to
+ * fill the next one. At most a fixed number of full buffers may be
+ * waiting to be written: once that many are, a write that fills
+ * another blocks until the writer thread has caught up.
+ *
+ * If writing to the file fails, the error is reported by the
+ * device's errorString() and any further write returns -1. Data
+ * still waiting at the time is discarded.
+ */
+class QueuedFileDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Write to the given file, which must already be open for
+     * writing and must outlast the device. The file should not be
+     * written to other than through the device until it is closed.
+     */
+    QueuedFileDevice(QFile *file,
+                     int bufferSize = 256 * 1024,
+                     int maxQueuedBuffers = 4);
+    virtual ~QueuedFileDevice();
+
+    /**
+     * Write out everything written to the device so far, waiting
+     * until it has all been passed to the file, and flush the
+     * file. Return false if anything could not be written.
+     */
+    bool flush();
+
+    /**
+     * Flush and stop the writer thread. The file itself is left open.
+     */
+    void close() override;
+
+    bool isOK() const;
+
+    bool isSequential() const override { return true; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+    class WriterThread : public Thread
+    {
+    public:
+        WriterThread(QueuedFileDevice &d) : m_d(d) { }
+        void run() override { m_d.writeQueued(); }
+    private:
+        QueuedFileDevice &m_d;
+    };
+
+    bool enqueue();
+    void writeQueued();
+    bool checkFailed();
+
+    QFile *m_file;
+    int m_bufferSize;
+    int m_maxQueued;
+    QByteArray m_current; // filled by the caller, not yet queued
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_condition;
+    std::deque<QByteArray> m_queue;
+    bool m_writing;
+    bool m_exiting;
+    bool m_failed;
+    QString m_error;
+
+    WriterThread *m_thread;
+
+    QueuedFileDevice(const QueuedFileDevice &) =delete;
+    QueuedFileDevice &operator=(const QueuedFileDevice &) =delete;
+};
+
+#endif
@@ -14,11 +14,13 @@
 */
 
 #include "WavFileReader.h"
+#include "MappedAudioFile.h"
 
 #include "base/HitCount.h"
 #include "base/Profiler.h"
 
 #include <iostream>
+#include <algorithm>
 
 #include <QMutexLocker>
 #include <QFileInfo>
@@ -34,6 +36,7 @@ WavFileReader::WavFileReader(FileSource source,
     m_seekable(false),
     m_lastStart(0),
     m_lastCount(0),
+    m_mapped(nullptr),
     m_normalisation(normalisation),
     m_max(0.f),
     m_updating(fileUpdating)
@@ -92,6 +95,10 @@ WavFileReader::WavFileReader(FileSource source,
             m_seekable = true;
         }
 
+        if (!m_updating) {
+            mapFile();
+        }
+
         if (m_normalisation != Normalisation::None && !m_updating) {
             m_max = getMax();
         }
@@ -114,6 +121,28 @@ WavFileReader::~WavFileReader()
     Profiler profiler("WavFileReader::~WavFileReader");
     
     if (m_file) sf_close(m_file);
+
+    delete m_mapped.load();
+}
+
+void
+WavFileReader::mapFile()
+{
+    if (m_mapped.load() ||
+        !MappedAudioFile::isMappableFormat(m_fileInfo.format)) {
+        return;
+    }
+
+    MappedAudioFile *mapped = new MappedAudioFile
+        (m_path, m_fileInfo.format, m_channelCount, m_frameCount);
+
+    if (!mapped->isValid()) {
+        delete mapped;
+        return;
+    }
+
+    m_seekable = true;
+    m_mapped.store(mapped, std::memory_order_release);
 }
 
 void
@@ -155,6 +184,9 @@ WavFileReader::updateDone()
 {
     updateFrameCount();
     m_updating = false;
+    if (m_file && m_fileInfo.channels > 0) {
+        mapFile();
+    }
     if (m_normalisation != Normalisation::None) {
         m_max = getMax();
     }
@@ -163,51 +195,93 @@ WavFileReader::updateDone()
 floatvec_t
 WavFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count) const
 {
-    floatvec_t frames = getInterleavedFramesUnnormalised(start, count);
+    if (count <= 0 || start < 0 || start >= m_frameCount || !m_channelCount) {
+        return {};
+    }
+
+    if (count > m_frameCount - start) {
+        count = m_frameCount - start;
+    }
+    
+    floatvec_t frames(count * m_channelCount);
+    sv_frame_t obtained = getInterleavedFrames(start, count, frames.data());
+    frames.resize(obtained * m_channelCount);
+    return frames;
+}
+
+sv_frame_t
+WavFileReader::getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer) const
+{
+    sv_frame_t obtained = getInterleavedFramesUnnormalised(start, count, buffer);
 
     if (m_normalisation == Normalisation::None || m_max == 0.f) {
-        return frames;
+        return obtained;
     }
 
-    for (int i = 0; in_range_for(frames, i); ++i) {
-        frames[i] /= m_max;
+    sv_frame_t n = obtained * m_channelCount;
+    for (sv_frame_t i = 0; i < n; ++i) {
+        buffer[i] /= m_max;
     }
     
-    return frames;
+    return obtained;
 }
 
-floatvec_t
+sv_frame_t
 WavFileReader::getInterleavedFramesUnnormalised(sv_frame_t start,
-                                                sv_frame_t count) const
+                                                sv_frame_t count,
+                                                float *buffer) const
 {
     static HitCount lastRead("WavFileReader: last read");
 
-    if (count == 0) return {};
+    if (count <= 0) return 0;
+
+    // The mapped file never changes once it has been set, so we can
+    // read from it without locking
+    
+    if (const MappedAudioFile *mapped =
+        m_mapped.load(std::memory_order_acquire)) {
+
+        sv_frame_t frames = mapped->getFrameCount();
+        if (start < 0 || start >= frames) {
+            return 0;
+        }
+        if (count > frames - start) {
+            count = frames - start;
+        }
+        
+        mapped->readFrames(start, count, buffer);
+        return count;
+    }
 
     QMutexLocker locker(&m_mutex);
 
     Profiler profiler("WavFileReader::getInterleavedFrames");
     
     if (!m_file || !m_channelCount) {
-        return {};
+        return 0;
     }
 
     if (start >= m_fileInfo.frames) {
 //        SVDEBUG << "WavFileReader::getInterleavedFrames: " << start
 //                  << " > " << m_fileInfo.frames << endl;
-        return {};
+        return 0;
     }
 
     if (start + count > m_fileInfo.frames) {
         count = m_fileInfo.frames - start;
     }
 
+    sv_frame_t n = count * m_fileInfo.channels;
+    
     // Because WaveFileModel::getSummaries() is called separately for
     // individual channels, it's quite common for us to be called
     // repeatedly for the same data. So this is worth cacheing.
-    if (start == m_lastStart && count == m_lastCount) {
+    if (start == m_lastStart && count == m_lastCount &&
+        sv_frame_t(m_buffer.size()) == n) {
         lastRead.hit();
-        return m_buffer;
+        std::copy(m_buffer.begin(), m_buffer.end(), buffer);
+        return count;
     }
 
     // We don't actually support partial cache reads, but let's use
@@ -220,23 +294,26 @@ WavFileReader::getInterleavedFramesUnnormalised(sv_frame_t start,
     }
     
     if (sf_seek(m_file, start, SEEK_SET) < 0) {
-        return {};
+        return 0;
     }
 
-    floatvec_t data;
-    sv_frame_t n = count * m_fileInfo.channels;
-    data.resize(n);
-
     m_lastStart = start;
     m_lastCount = count;
     
     sf_count_t readCount = 0;
-    if ((readCount = sf_readf_float(m_file, data.data(), count)) < 0) {
-        return {};
+    if ((readCount = sf_readf_float(m_file, buffer, count)) < 0) {
+        m_buffer.clear();
+        return 0;
     }
 
-    m_buffer = data;
-    return data;
+    // A short read leaves the rest of the block silent, as if the
+    // whole block had been read
+    for (sv_frame_t i = readCount * m_fileInfo.channels; i < n; ++i) {
+        buffer[i] = 0.f;
+    }
+
+    m_buffer.assign(buffer, buffer + n);
+    return count;
 }
 
 float
@@ -305,6 +382,28 @@ WavFileReader::getSupportedExtensions(set<QString> &extensions)
     }
 }
 
+int
+WavFileReader::getBitDepth() const
+{
+    if (m_normalisation != Normalisation::None) {
+        return 0;
+    }
+    
+    switch (m_fileInfo.format & SF_FORMAT_SUBMASK) {
+    case SF_FORMAT_PCM_S8:
+    case SF_FORMAT_PCM_U8:
+        return 8;
+    case SF_FORMAT_PCM_16:
+        return 16;
+    case SF_FORMAT_PCM_24:
+        return 24;
+    case SF_FORMAT_PCM_32:
+        return 32;
+    default:
+        return 0;
+    }
+}
+
 bool
 WavFileReader::supportsExtension(QString extension)
 {
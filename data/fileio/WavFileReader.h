@@ -27,6 +27,9 @@
 #include <QMutex>
 
 #include <set>
+#include <atomic>
+
+class MappedAudioFile;
 
 /**
  * Reader for audio files using libsndfile.
@@ -34,6 +37,12 @@
  * This is typically intended for seekable file types that can be read
  * directly (e.g. WAV, AIFF etc).
  *
+ * Uncompressed PCM and float WAV, W64 and AIFF files are also
+ * memory-mapped once they are complete, and read from the mapping
+ * without taking any lock, so that many threads can read from the
+ * same file at once. Other files, and files that are still being
+ * written, are read through libsndfile under a mutex.
+ *
  * Compressed files supported by libsndfile (e.g. Ogg, FLAC) should
  * normally be read using DecodingWavFileReader instead (which decodes
  * to an intermediate cached file).
@@ -57,12 +66,27 @@ public:
     QString getLocalFilename() const override { return m_path; }
     
     bool isQuicklySeekable() const override { return m_seekable; }
+
+    bool isReadAheadUseful() const override {
+        // A mapped file is read straight from the page cache
+        return m_mapped.load(std::memory_order_acquire) == nullptr;
+    }
+
+    /**
+     * Return the bit depth of the file's sample data if it is integer
+     * PCM at 32 bits or fewer and is being returned without
+     * normalisation, so that every sample we return is an exact
+     * multiple of 2^-(depth-1). Otherwise return 0.
+     */
+    int getBitDepth() const;
     
     /** 
      * Must be safe to call from multiple threads with different
      * arguments on the same object at the same time.
      */
     floatvec_t getInterleavedFrames(sv_frame_t start, sv_frame_t count) const override;
+    sv_frame_t getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer) const override;
     
     static void getSupportedExtensions(std::set<QString> &extensions);
     static bool supportsExtension(QString ext);
@@ -93,14 +117,18 @@ protected:
     mutable sv_frame_t m_lastStart;
     mutable sv_frame_t m_lastCount;
 
+    std::atomic<MappedAudioFile *> m_mapped;
+
     Normalisation m_normalisation;
     float m_max;
 
     bool m_updating;
 
-    floatvec_t getInterleavedFramesUnnormalised(sv_frame_t start,
-                                                sv_frame_t count) const;
+    sv_frame_t getInterleavedFramesUnnormalised(sv_frame_t start,
+                                                sv_frame_t count,
+                                                float *buffer) const;
     float getMax() const;
+    void mapFile();
 };
 
 #endif
@@ -20,10 +20,15 @@
 #include "../AudioFileReader.h"
 #include "../WavFileWriter.h"
 
+#ifdef HAVE_MAD
+#include "../MP3FileReader.h"
+#endif
+
 #include "AudioTestData.h"
 #include "UnsupportedFormat.h"
 
 #include <cmath>
+#include <algorithm>
 
 #include <QObject>
 #include <QtTest>
@@ -339,6 +344,23 @@ private slots:
         // into account silence at beginning and end (if it is).
         floatvec_t test = reader->getInterleavedFrames(0, refFrames + 5000);
 
+        // Reading the same data block-by-block into a buffer of our
+        // own should give exactly the same samples
+        sv_frame_t testFrames = test.size() / channels;
+        floatvec_t buffered(testFrames * channels + 1, -99.f);
+        sv_frame_t bufferedFrames = 0;
+        while (bufferedFrames < testFrames) {
+            sv_frame_t n = std::min(sv_frame_t(1001),
+                                    testFrames - bufferedFrames);
+            sv_frame_t got = reader->getInterleavedFrames
+                (bufferedFrames, n, buffered.data() + bufferedFrames * channels);
+            QCOMPARE(got, n);
+            bufferedFrames += got;
+        }
+        QCOMPARE(buffered[testFrames * channels], -99.f);
+        buffered.resize(testFrames * channels);
+        QVERIFY(buffered == test);
+
         delete reader;
         reader = 0;
         
@@ -541,6 +563,85 @@ private slots:
             }
         }
     }
+
+    void readOnDemand_data()
+    {
+        QTest::addColumn<QString>("audiofile");
+        QTest::addColumn<bool>("gapless");
+        QStringList files = QDir(QDir(audioDir).filePath("mp3"))
+            .entryList(QDir::Files);
+        bool gaplesses[] = { true, false };
+        foreach (QString filename, files) {
+            for (bool gapless: gaplesses) {
+                QString desc = testName("mp3", filename, 0, false, gapless);
+                QTest::newRow(strOf(desc)) << filename << gapless;
+            }
+        }
+    }
+
+    void readOnDemand()
+    {
+        // An mp3 file indexed and decoded on demand should read the
+        // same as one decoded in full, wherever we read from it
+        
+#ifdef HAVE_MAD
+        QFETCH(QString, audiofile);
+        QFETCH(bool, gapless);
+
+        QString path = audioDir + "/mp3/" + audiofile;
+        MP3FileReader::GaplessMode gaplessMode =
+            (gapless ?
+             MP3FileReader::GaplessMode::Gapless :
+             MP3FileReader::GaplessMode::Gappy);
+
+        MP3FileReader full(path, CodedAudioFileReader::DecodeAtOnce,
+                           CodedAudioFileReader::CacheInMemory,
+                           gaplessMode);
+        MP3FileReader onDemand(path, CodedAudioFileReader::DecodeOnDemand,
+                               CodedAudioFileReader::CacheInMemory,
+                               gaplessMode);
+
+        QVERIFY(full.isOK());
+        QVERIFY(onDemand.isOK());
+        QVERIFY(!onDemand.isUpdating());
+        QCOMPARE(onDemand.getChannelCount(), full.getChannelCount());
+        QCOMPARE(onDemand.getSampleRate(), full.getSampleRate());
+        QCOMPARE(onDemand.getFrameCount(), full.getFrameCount());
+
+        int channels = full.getChannelCount();
+        sv_frame_t frames = full.getFrameCount();
+        floatvec_t expected = full.getInterleavedFrames(0, frames);
+        QCOMPARE(sv_frame_t(expected.size()), frames * channels);
+
+        // Read backwards in blocks of awkward size, so that chunks
+        // are decoded out of order and most reads start somewhere
+        // other than at a chunk boundary
+        sv_frame_t blockSize = 10007;
+        floatvec_t block(blockSize * channels);
+        for (sv_frame_t start = (frames / blockSize) * blockSize;
+             start >= 0; start -= blockSize) {
+            sv_frame_t got = onDemand.getInterleavedFrames
+                (start, blockSize, block.data());
+            QCOMPARE(got, std::min(blockSize, frames - start));
+            for (sv_frame_t i = 0; i < got * channels; ++i) {
+                float diff = fabsf(block[i] - expected[start * channels + i]);
+                if (diff > 1e-4f) {
+                    SVCERR << "ERROR: for audiofile " << audiofile
+                           << ": on-demand sample " << i / channels
+                           << " of block at " << start << " differs by "
+                           << diff << endl;
+                    QVERIFY(diff <= 1e-4f);
+                }
+            }
+        }
+#else
+#if ( QT_VERSION >= 0x050000 )
+        QSKIP("No mp3 support, skipping");
+#else
+        QSKIP("No mp3 support, skipping", SkipSingle);
+#endif
+#endif
+    }
 };
 
 #endif
@@ -0,0 +1,325 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_AUDIO_READ_SCHEDULER_H
+#define TEST_AUDIO_READ_SCHEDULER_H
+
+#include "../AudioReadScheduler.h"
+#include "../FileReadThread.h"
+#include "../AudioFileReader.h"
+
+#include "base/Thread.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <random>
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+// A reader whose every sample is distinct and predictable, and which
+// keeps a log of the reads made from it. It can also pretend to be
+// still decoding, with only some of its frames available so far
+class CountingAudioFileReader : public AudioFileReader
+{
+public:
+    CountingAudioFileReader(sv_frame_t frames, int channels) :
+        m_updating(false),
+        m_completedReads(0) {
+        m_frameCount = frames;
+        m_channelCount = channels;
+        m_sampleRate = 44100;
+    }
+
+    // Call only when no read is in progress
+    void setDecoding(sv_frame_t decodedFrames, bool updating) {
+        m_frameCount = decodedFrames;
+        m_updating = updating;
+    }
+
+    bool isUpdating() const override { return m_updating; }
+
+    int getCompletedReadCount() const { return m_completedReads; }
+
+    static float sampleAt(sv_frame_t frame, int channel, int channels) {
+        return float(frame * channels + channel);
+    }
+    
+    QString getLocation() const override { return ""; }
+    QString getLocalFilename() const override { return ""; }
+    QString getTitle() const override { return ""; }
+    QString getMaker() const override { return ""; }
+    bool isQuicklySeekable() const override { return true; }
+
+    floatvec_t getInterleavedFrames(sv_frame_t start,
+                                    sv_frame_t count) const override {
+        floatvec_t data(count * m_channelCount);
+        data.resize(getInterleavedFrames(start, count, data.data())
+                    * m_channelCount);
+        return data;
+    }
+
+    sv_frame_t getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer) const override {
+        {
+            QMutexLocker locker(&m_logMutex);
+            m_log.push_back({ start, count });
+        }
+        if (start >= m_frameCount) {
+            ++m_completedReads;
+            return 0;
+        }
+        count = min(count, m_frameCount - start);
+        for (sv_frame_t i = 0; i < count; ++i) {
+            for (int c = 0; c < m_channelCount; ++c) {
+                buffer[i * m_channelCount + c] =
+                    sampleAt(start + i, c, m_channelCount);
+            }
+        }
+        ++m_completedReads;
+        return count;
+    }
+
+    vector<pair<sv_frame_t, sv_frame_t>> getLog() const {
+        QMutexLocker locker(&m_logMutex);
+        return m_log;
+    }
+
+private:
+    std::atomic<bool> m_updating;
+    mutable std::atomic<int> m_completedReads;
+    mutable QMutex m_logMutex;
+    mutable vector<pair<sv_frame_t, sv_frame_t>> m_log;
+};
+
+class AudioReadSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    class RandomReadThread : public Thread
+    {
+    public:
+        RandomReadThread(AudioReadScheduler &scheduler,
+                         sv_frame_t frames, int channels, int seed) :
+            m_scheduler(scheduler), m_frames(frames), m_channels(channels),
+            m_seed(seed), m_errors(0) { }
+
+        void run() override {
+            mt19937 rng(m_seed);
+            for (int i = 0; i < 200; ++i) {
+                sv_frame_t start = rng() % m_frames;
+                sv_frame_t count = rng() % 50000 + 1;
+                floatvec_t buffer(count * m_channels);
+                sv_frame_t got = m_scheduler.getInterleavedFrames
+                    (start, count, buffer.data());
+                if (got != min(count, m_frames - start)) ++m_errors;
+                for (sv_frame_t j = 0; j < got; ++j) {
+                    for (int c = 0; c < m_channels; ++c) {
+                        if (buffer[j * m_channels + c] !=
+                            CountingAudioFileReader::sampleAt
+                            (start + j, c, m_channels)) {
+                            ++m_errors;
+                        }
+                    }
+                }
+            }
+        }
+
+        int getErrorCount() const { return m_errors; }
+
+    private:
+        AudioReadScheduler &m_scheduler;
+        sv_frame_t m_frames;
+        int m_channels;
+        int m_seed;
+        int m_errors;
+    };
+        
+    void checkRead(AudioReadScheduler &scheduler, sv_frame_t frames,
+                   int channels, sv_frame_t start, sv_frame_t count) {
+        floatvec_t buffer(count * channels);
+        sv_frame_t got = scheduler.getInterleavedFrames
+            (start, count, buffer.data());
+        QCOMPARE(got, max(sv_frame_t(0), min(count, frames - start)));
+        for (sv_frame_t i = 0; i < got; ++i) {
+            for (int c = 0; c < channels; ++c) {
+                QCOMPARE(buffer[i * channels + c],
+                         CountingAudioFileReader::sampleAt
+                         (start + i, c, channels));
+            }
+        }
+    }
+    
+private slots:
+    void priorityAndCoalescing() {
+
+        CountingAudioFileReader reader(100000, 2);
+        FileReadThread thread;
+
+        // Queue before starting the thread, so that all requests are
+        // present when it first looks
+        
+        floatvec_t a(1000 * 2), b(1000 * 2), c(500 * 2);
+        FileReadThread::Request r { &reader, 0, 1000, a.data(), 0, 0, false };
+        int ta = thread.request(r);
+        r = { &reader, 50000, 500, c.data(), 0, 0, false };
+        int tc = thread.request(r);
+        r = { &reader, 1000, 1000, b.data(), 1, 0, false };
+        int tb = thread.request(r);
+        thread.setPriority(tc, 2);
+
+        thread.start();
+
+        QVERIFY(thread.waitFor(ta));
+        QVERIFY(thread.waitFor(tb));
+        QVERIFY(thread.waitFor(tc));
+
+        QVERIFY(thread.getRequest(tb, r));
+        QVERIFY(r.successful);
+        QCOMPARE(r.got, sv_frame_t(1000));
+        QCOMPARE(b[0], CountingAudioFileReader::sampleAt(1000, 0, 2));
+        QCOMPARE(b[1999], CountingAudioFileReader::sampleAt(1999, 1, 2));
+        QCOMPARE(a[0], CountingAudioFileReader::sampleAt(0, 0, 2));
+        QCOMPARE(c[0], CountingAudioFileReader::sampleAt(50000, 0, 2));
+
+        thread.done(ta);
+        thread.done(tb);
+        thread.done(tc);
+        thread.finish();
+        thread.wait();
+
+        // The raised request first, then the other two in one read
+        auto log = reader.getLog();
+        QCOMPARE(int(log.size()), 2);
+        QCOMPARE(log[0].first, sv_frame_t(50000));
+        QCOMPARE(log[1].first, sv_frame_t(0));
+        QCOMPARE(log[1].second, sv_frame_t(2000));
+    }
+
+    void cancel() {
+        CountingAudioFileReader reader(100000, 1);
+        FileReadThread thread;
+        floatvec_t a(1000);
+        FileReadThread::Request r { &reader, 0, 1000, a.data(), 0, 0, false };
+        int token = thread.request(r);
+        thread.cancel(token);
+        QVERIFY(thread.isCancelled(token));
+        QVERIFY(!thread.waitFor(token));
+        thread.done(token);
+        QVERIFY(!thread.haveRequest(token));
+        thread.start();
+        thread.finish();
+        thread.wait();
+        QCOMPARE(int(reader.getLog().size()), 0);
+    }
+    
+    void sequential() {
+        sv_frame_t frames = 1000000;
+        CountingAudioFileReader reader(frames, 2);
+        AudioReadScheduler scheduler(&reader);
+        for (sv_frame_t start = 0; start < frames + 5000; start += 3000) {
+            checkRead(scheduler, frames, 2, start, 4096);
+        }
+        // There should have been far fewer reads from the file than
+        // from the scheduler, as reads were coalesced into blocks and
+        // made ahead of time
+        QVERIFY(reader.getLog().size() < frames / 3000 / 2);
+    }
+
+    void interleavedStreams() {
+        // Two callers working forward through different parts of the
+        // file in turn should each get read ahead of, rather than
+        // cancelling one another's read-ahead
+        sv_frame_t frames = 1000000;
+        sv_frame_t blockFrames = 16384;
+        CountingAudioFileReader reader(frames, 2);
+        AudioReadScheduler scheduler(&reader);
+        sv_frame_t a = 0, b = 500000;
+        for (int i = 0; i < 10; ++i, a += 3000, b += 3000) {
+            checkRead(scheduler, frames, 2, a, 4096);
+            checkRead(scheduler, frames, 2, b, 4096);
+        }
+
+        // Blocks beyond the last one actually read, for each stream
+        sv_frame_t aheadA = ((a + 4096) / blockFrames + 2) * blockFrames;
+        sv_frame_t aheadB = ((b + 4096) / blockFrames + 2) * blockFrames;
+        
+        auto haveRead = [&](sv_frame_t frame) {
+            for (auto r: reader.getLog()) {
+                if (r.first <= frame && frame < r.first + r.second) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        for (int i = 0; i < 1000; ++i) {
+            if (haveRead(aheadA) && haveRead(aheadB)) break;
+            QThread::msleep(1);
+        }
+        QVERIFY(haveRead(aheadA));
+        QVERIFY(haveRead(aheadB));
+    }
+
+    void random() {
+        sv_frame_t frames = 300000;
+        CountingAudioFileReader reader(frames, 3);
+        AudioReadScheduler scheduler(&reader);
+        mt19937 rng(0);
+        for (int i = 0; i < 300; ++i) {
+            sv_frame_t start = rng() % (frames + 1000);
+            sv_frame_t count = rng() % 40000 + 1;
+            checkRead(scheduler, frames, 3, start, count);
+        }
+    }
+
+    void shortBlockReadWhileDecoding() {
+        // A block read in advance while the reader was still
+        // decoding, and found short, must not be kept as if it were
+        // the end of the file once decoding has finished
+        sv_frame_t frames = 100000;
+        CountingAudioFileReader reader(frames, 2);
+        reader.setDecoding(20000, true);
+        AudioReadScheduler scheduler(&reader);
+        scheduler.prefetch(16384, 8000);
+        while (reader.getCompletedReadCount() < 1) {
+            QThread::msleep(1);
+        }
+        reader.setDecoding(frames, false);
+        checkRead(scheduler, frames, 2, 16384, 8000);
+        checkRead(scheduler, frames, 2, 20000, 8000);
+    }
+
+    void concurrent() {
+        sv_frame_t frames = 500000;
+        CountingAudioFileReader reader(frames, 2);
+        AudioReadScheduler scheduler(&reader);
+        vector<RandomReadThread *> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.push_back(new RandomReadThread(scheduler, frames, 2, i));
+        }
+        for (auto t: threads) t->start();
+        for (auto t: threads) t->wait();
+        for (auto t: threads) {
+            QCOMPARE(t->getErrorCount(), 0);
+            delete t;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,296 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_BINARY_FEATURE_FILE_READER_H
+#define TEST_BINARY_FEATURE_FILE_READER_H
+
+#include "../BinaryFeatureFileReader.h"
+#include "../BinaryFeatureFormat.h"
+
+#include "data/model/SparseOneDimensionalModel.h"
+#include "data/model/SparseTimeValueModel.h"
+#include "data/model/RegionModel.h"
+#include "data/model/EditableDenseThreeDimensionalModel.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+
+#include <cmath>
+
+using namespace std;
+
+class BinaryFeatureFileReaderTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir tempDir;
+
+    typedef BinaryFeatureFormat::OutputHeader OutputHeader;
+    typedef BinaryFeatureFormat::Rows Rows;
+
+    QString writeFile(QString name, const OutputHeader &h,
+                      vector<Rows> runs) {
+        QString path = tempDir.filePath(name);
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) return {};
+        file.write(BinaryFeatureFormat::encodeFileHeader());
+        file.write(BinaryFeatureFormat::encodeOutputRecord(h));
+        for (const auto &r: runs) {
+            file.write(BinaryFeatureFormat::encodeDataRecord(r));
+        }
+        return path;
+    }
+
+    OutputHeader makeHeader(int binCount) {
+        OutputHeader h;
+        h.index = 0;
+        h.trackId = "track.wav";
+        h.transformId = "vamp:test:test:output";
+        h.outputId = "output";
+        h.name = "Output";
+        h.unit = "dB";
+        h.sampleRate = 1000;
+        h.stepSize = 10;
+        h.blockSize = 20;
+        h.binCount = binCount;
+        for (int b = 0; b < binCount; ++b) {
+            h.binNames.push_back(QString("bin %1").arg(b));
+        }
+        return h;
+    }
+
+    // Rows at every 10ms from the given row, with value row * 10 + bin
+    Rows makeRows(int binCount, int from, int count) {
+        Rows r;
+        r.binCount = binCount;
+        for (int i = from; i < from + count; ++i) {
+            r.timesNs.push_back(int64_t(i) * 10000000);
+            r.durationsNs.push_back(-1);
+            for (int b = 0; b < binCount; ++b) {
+                r.values.push_back(float(i * 10 + b));
+            }
+        }
+        return r;
+    }
+
+private slots:
+    void init() {
+        QVERIFY(tempDir.isValid());
+    }
+
+    void notAFeatureFile() {
+        QString path = tempDir.filePath("not.svfb");
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("1.0,2.0,3.0\n");
+        file.close();
+        BinaryFeatureFileReader reader(path, 1000);
+        QVERIFY(!reader.isOK());
+        QCOMPARE(BinaryFeatureFormat::countOutputs(path), -1);
+    }
+
+    void dense() {
+        QString path = writeFile("dense.svfb", makeHeader(3),
+                                 { makeRows(3, 0, 4), makeRows(3, 4, 2) });
+        QCOMPARE(BinaryFeatureFormat::countOutputs(path), 1);
+
+        BinaryFeatureFileReader reader(path, 1000);
+        QVERIFY(reader.isOK());
+        Model *model = reader.load();
+        auto actual = qobject_cast<EditableDenseThreeDimensionalModel *>(model);
+        QVERIFY(actual);
+        QCOMPARE(actual->getWidth(), 6);
+        QCOMPARE(actual->getHeight(), 3);
+        QCOMPARE(actual->getResolution(), 10);
+        QCOMPARE(actual->getBinName(2), QString("bin 2"));
+        QCOMPARE(actual->getBinValueUnit(), QString("dB"));
+        for (int i = 0; i < 6; ++i) {
+            auto column = actual->getColumn(i);
+            QCOMPARE(int(column.size()), 3);
+            for (int b = 0; b < 3; ++b) {
+                QCOMPARE(column[b], float(i * 10 + b));
+            }
+        }
+        QCOMPARE(actual->getMinimumLevel(), 0.f);
+        QCOMPARE(actual->getMaximumLevel(), 52.f);
+        delete model;
+    }
+
+    void denseWithGap() {
+        // Rows 4 and 5 are missing: the rows after them should still
+        // go in the columns for their own times
+        QString path = writeFile("gap.svfb", makeHeader(2),
+                                 { makeRows(2, 0, 4), makeRows(2, 6, 2) });
+
+        BinaryFeatureFileReader reader(path, 1000);
+        Model *model = reader.load();
+        auto actual = qobject_cast<EditableDenseThreeDimensionalModel *>(model);
+        QVERIFY(actual);
+        QCOMPARE(actual->getWidth(), 8);
+        QCOMPARE(actual->getResolution(), 10);
+        for (int i = 0; i < 8; ++i) {
+            auto column = actual->getColumn(i);
+            for (int b = 0; b < 2; ++b) {
+                QCOMPARE(column[b], (i == 4 || i == 5) ?
+                         0.f : float(i * 10 + b));
+            }
+        }
+        delete model;
+    }
+
+    void denseAtLowerRate() {
+        // Features at every 10ms of a 1000Hz input, loaded against a
+        // 500Hz main model, are 5 frames apart
+        QString path = writeFile("lowrate.svfb", makeHeader(2),
+                                 { makeRows(2, 0, 4) });
+
+        BinaryFeatureFileReader reader(path, 500);
+        Model *model = reader.load();
+        auto actual = qobject_cast<EditableDenseThreeDimensionalModel *>(model);
+        QVERIFY(actual);
+        QCOMPARE(actual->getResolution(), 5);
+        QCOMPARE(actual->getWidth(), 4);
+        QCOMPARE(actual->getColumn(3)[1], 31.f);
+        delete model;
+    }
+
+    void laterOutputsSkipped() {
+        // Only the first output is loaded, with the data records of
+        // the second ignored even where they come first
+        QString path = tempDir.filePath("two.svfb");
+        {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            OutputHeader second = makeHeader(0);
+            second.index = 1;
+            second.outputId = "second";
+            Rows secondRows = makeRows(0, 0, 3);
+            secondRows.outputIndex = 1;
+            file.write(BinaryFeatureFormat::encodeFileHeader());
+            file.write(BinaryFeatureFormat::encodeOutputRecord(makeHeader(1)));
+            file.write(BinaryFeatureFormat::encodeOutputRecord(second));
+            file.write(BinaryFeatureFormat::encodeDataRecord(secondRows));
+            file.write(BinaryFeatureFormat::encodeDataRecord
+                       (makeRows(1, 0, 2)));
+        }
+        QCOMPARE(BinaryFeatureFormat::countOutputs(path), 2);
+
+        BinaryFeatureFileReader reader(path, 1000);
+        Model *model = reader.load();
+        auto actual = qobject_cast<SparseTimeValueModel *>(model);
+        QVERIFY(actual);
+        QCOMPARE(int(actual->getAllEvents().size()), 2);
+        delete model;
+    }
+
+    void sparseWithLabels() {
+        Rows r = makeRows(1, 0, 3);
+        r.labels = { "a", "", "c" };
+        QString path = writeFile("sparse.svfb", makeHeader(1), { r });
+
+        BinaryFeatureFileReader reader(path, 1000);
+        QVERIFY(reader.isOK());
+        Model *model = reader.load();
+        auto actual = qobject_cast<SparseTimeValueModel *>(model);
+        QVERIFY(actual);
+        QCOMPARE(actual->getScaleUnits(), QString("dB"));
+        auto events = actual->getAllEvents();
+        QCOMPARE(int(events.size()), 3);
+        QCOMPARE(events[0].getFrame(), sv_frame_t(0));
+        QCOMPARE(events[2].getFrame(), sv_frame_t(20));
+        QCOMPARE(events[2].getValue(), 20.f);
+        QCOMPARE(events[0].getLabel(), QString("a"));
+        QCOMPARE(events[1].getLabel(), QString());
+        QCOMPARE(events[2].getLabel(), QString("c"));
+        delete model;
+    }
+
+    void regions() {
+        Rows r = makeRows(1, 0, 2);
+        r.durationsNs = { 5000000, 15000000 };
+        QString path = writeFile("regions.svfb", makeHeader(1), { r });
+
+        BinaryFeatureFileReader reader(path, 1000);
+        Model *model = reader.load();
+        auto actual = qobject_cast<RegionModel *>(model);
+        QVERIFY(actual);
+        auto events = actual->getAllEvents();
+        QCOMPARE(int(events.size()), 2);
+        QCOMPARE(events[0].getDuration(), sv_frame_t(5));
+        QCOMPARE(events[1].getFrame(), sv_frame_t(10));
+        QCOMPARE(events[1].getDuration(), sv_frame_t(15));
+        delete model;
+    }
+
+    void instants() {
+        QString path = writeFile("instants.svfb", makeHeader(0),
+                                 { makeRows(0, 0, 4) });
+
+        BinaryFeatureFileReader reader(path, 1000);
+        Model *model = reader.load();
+        auto actual = qobject_cast<SparseOneDimensionalModel *>(model);
+        QVERIFY(actual);
+        QCOMPARE(int(actual->getAllEvents().size()), 4);
+        delete model;
+    }
+
+    void overflowingDataCounts() {
+        // Row and bin counts whose product overflows, in a record
+        // much too short to hold them
+        QByteArray record = BinaryFeatureFormat::encodeDataRecord
+            (makeRows(2, 0, 4));
+        QByteArray payload = record.mid(16);
+        for (int i = 4; i < 12; ++i) payload[i] = char(0xff);
+        BinaryFeatureFormat::RowsView v;
+        QVERIFY(!BinaryFeatureFormat::decodeDataRecord
+                (reinterpret_cast<const unsigned char *>(payload.data()),
+                 payload.size(), v));
+
+        // Row count alone, for the bin count given
+        payload = record.mid(16);
+        payload[4] = char(5);
+        QVERIFY(!BinaryFeatureFormat::decodeDataRecord
+                (reinterpret_cast<const unsigned char *>(payload.data()),
+                 payload.size(), v));
+
+        // Unchanged
+        payload = record.mid(16);
+        QVERIFY(BinaryFeatureFormat::decodeDataRecord
+                (reinterpret_cast<const unsigned char *>(payload.data()),
+                 payload.size(), v));
+        QCOMPARE(v.rowCount, 4);
+        QCOMPARE(v.binCount, 2);
+    }
+
+    void oversizedBinCount() {
+        // An output claiming more bins than the file could hold
+        OutputHeader h = makeHeader(3);
+        h.binNames.clear();
+        QString path = writeFile("oversized.svfb", h, { makeRows(3, 0, 4) });
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.seek(16 + 16 + 4));
+        QVERIFY(file.write("\xff\xff\xff\x7f", 4) == 4);
+        file.close();
+
+        BinaryFeatureFileReader reader(path, 1000);
+        QVERIFY(reader.isOK());
+        QVERIFY(!reader.load());
+    }
+};
+
+#endif
@@ -0,0 +1,273 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_BINARY_FEATURE_WRITER_H
+#define TEST_BINARY_FEATURE_WRITER_H
+
+#include "../BinaryFeatureFormat.h"
+
+#include "transform/BinaryFeatureWriter.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+
+#include <cmath>
+
+class BinaryFeatureWriterTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    typedef Vamp::Plugin::OutputDescriptor OutputDescriptor;
+    typedef Vamp::Plugin::Feature Feature;
+    typedef Vamp::Plugin::FeatureList FeatureList;
+
+    QTemporaryDir m_tempDir;
+    QString m_path;
+
+    // The file contents, which the views below refer to
+    QByteArray m_data;
+    std::vector<BinaryFeatureFormat::OutputHeader> m_outputs;
+    std::vector<BinaryFeatureFormat::RowsView> m_runs;
+
+    Transform makeTransform() {
+        Transform t;
+        t.setPluginIdentifier("vamp:test-plugins:spectrum");
+        t.setOutput("spectrum");
+        t.setSampleRate(1000);
+        t.setStepSize(10);
+        t.setBlockSize(20);
+        return t;
+    }
+
+    OutputDescriptor makeDescriptor(int binCount) {
+        OutputDescriptor d;
+        d.identifier = "spectrum";
+        d.name = "Spectrum";
+        d.unit = "dB";
+        d.hasFixedBinCount = true;
+        d.binCount = binCount;
+        for (int b = 0; b < binCount; ++b) {
+            d.binNames.push_back("bin " + std::to_string(b));
+        }
+        d.sampleType = OutputDescriptor::OneSamplePerStep;
+        d.hasDuration = false;
+        return d;
+    }
+
+    // Features at every 10ms from the given one, with value i * 10 + bin
+    FeatureList makeFeatures(int binCount, int from, int count) {
+        FeatureList features;
+        for (int i = from; i < from + count; ++i) {
+            Feature f;
+            f.hasTimestamp = true;
+            f.timestamp = Vamp::RealTime::fromMilliseconds(i * 10);
+            for (int b = 0; b < binCount; ++b) {
+                f.values.push_back(float(i * 10 + b));
+            }
+            features.push_back(f);
+        }
+        return features;
+    }
+
+    void setParameters(BinaryFeatureWriter &writer, bool append) {
+        std::map<std::string, std::string> params;
+        params["one-file"] = m_path.toStdString();
+        if (append) params["append"] = "";
+        else params["force"] = "";
+        writer.setParameters(params);
+    }
+
+    bool readFile() {
+        m_outputs.clear();
+        m_runs.clear();
+        QFile file(m_path);
+        if (!file.open(QIODevice::ReadOnly)) return false;
+        m_data = file.readAll();
+
+        auto data = reinterpret_cast<const unsigned char *>(m_data.constData());
+        int64_t size = m_data.size();
+        if (!BinaryFeatureFormat::isFeatureFile(data, size)) return false;
+
+        int64_t offset = BinaryFeatureFormat::getFileHeaderSize();
+        int type = 0;
+        int64_t payloadOffset = 0, payloadLength = 0;
+        while (BinaryFeatureFormat::readRecord(data, size, offset, type,
+                                               payloadOffset, payloadLength)) {
+            const unsigned char *payload = data + payloadOffset;
+            offset = payloadOffset + payloadLength;
+            if (type == BinaryFeatureFormat::OutputRecord) {
+                BinaryFeatureFormat::OutputHeader h;
+                if (!BinaryFeatureFormat::decodeOutputRecord
+                    (payload, payloadLength, h)) return false;
+                m_outputs.push_back(h);
+            } else if (type == BinaryFeatureFormat::DataRecord) {
+                BinaryFeatureFormat::RowsView v;
+                if (!BinaryFeatureFormat::decodeDataRecord
+                    (payload, payloadLength, v)) return false;
+                m_runs.push_back(v);
+            }
+        }
+        return offset == size;
+    }
+
+private slots:
+    void init() {
+        QVERIFY(m_tempDir.isValid());
+        m_path = m_tempDir.filePath("features.svfb");
+        QFile::remove(m_path);
+    }
+
+    void dense() {
+        {
+            BinaryFeatureWriter writer;
+            setParameters(writer, false);
+            writer.write("track.wav", makeTransform(), makeDescriptor(3),
+                         makeFeatures(3, 0, 4));
+            writer.write("track.wav", makeTransform(), makeDescriptor(3),
+                         makeFeatures(3, 4, 2));
+            writer.finish();
+        }
+
+        QVERIFY(readFile());
+        QCOMPARE(int(m_outputs.size()), 1);
+
+        const auto &h = m_outputs[0];
+        QCOMPARE(h.index, 0);
+        QCOMPARE(h.trackId, QString("track.wav"));
+        QCOMPARE(h.transformId, makeTransform().getIdentifier());
+        QCOMPARE(h.outputId, QString("spectrum"));
+        QCOMPARE(h.unit, QString("dB"));
+        QCOMPARE(h.stepSize, 10);
+        QCOMPARE(h.blockSize, 20);
+        QCOMPARE(h.binCount, 3);
+        QCOMPARE(int(h.binNames.size()), 3);
+        QCOMPARE(h.binNames[2], QString("bin 2"));
+
+        // Pending rows are written together, when finished
+        QCOMPARE(int(m_runs.size()), 1);
+        const auto &v = m_runs[0];
+        QCOMPARE(v.outputIndex, 0);
+        QCOMPARE(v.rowCount, 6);
+        QCOMPARE(v.binCount, 3);
+        QVERIFY(!v.hasLabels());
+        for (int i = 0; i < 6; ++i) {
+            QCOMPARE(v.getTimeNs(i), int64_t(i) * 10000000);
+            QCOMPARE(v.getDurationNs(i), int64_t(-1));
+            for (int b = 0; b < 3; ++b) {
+                QCOMPARE(v.getValue(i, b), float(i * 10 + b));
+            }
+        }
+    }
+
+    void variableBinCount() {
+        // Without a fixed bin count, the stride is taken from the
+        // first feature and other rows are truncated or padded
+        OutputDescriptor d = makeDescriptor(0);
+        d.hasFixedBinCount = false;
+
+        FeatureList features = makeFeatures(2, 0, 3);
+        features[1].values.pop_back();
+        features[2].values.push_back(99.f);
+        {
+            BinaryFeatureWriter writer;
+            setParameters(writer, false);
+            writer.write("track.wav", makeTransform(), d, features);
+        }
+
+        QVERIFY(readFile());
+        QCOMPARE(int(m_outputs.size()), 1);
+        QCOMPARE(m_outputs[0].binCount, 2);
+        QCOMPARE(int(m_runs.size()), 1);
+        const auto &v = m_runs[0];
+        QCOMPARE(v.rowCount, 3);
+        QCOMPARE(v.getValue(1, 0), 10.f);
+        QVERIFY(std::isnan(v.getValue(1, 1)));
+        QCOMPARE(v.getValue(2, 1), 21.f);
+    }
+
+    void labelsAndDurations() {
+        OutputDescriptor d = makeDescriptor(1);
+        d.hasDuration = true;
+
+        FeatureList features = makeFeatures(1, 0, 3);
+        features[0].hasDuration = true;
+        features[0].duration = Vamp::RealTime::fromMilliseconds(5);
+        features[2].label = "third";
+        {
+            BinaryFeatureWriter writer;
+            setParameters(writer, false);
+            writer.write("track.wav", makeTransform(), d, features);
+        }
+
+        QVERIFY(readFile());
+        QCOMPARE(int(m_runs.size()), 1);
+        const auto &v = m_runs[0];
+        QVERIFY(v.hasLabels());
+        QCOMPARE(v.getDurationNs(0), int64_t(5000000));
+        QCOMPARE(v.getDurationNs(1), int64_t(-1));
+        QCOMPARE(v.getLabel(0), QString());
+        QCOMPARE(v.getLabel(2), QString("third"));
+    }
+
+    void manyRows() {
+        // More rows than are held pending, so written in several
+        // data records
+        {
+            BinaryFeatureWriter writer;
+            setParameters(writer, false);
+            writer.write("track.wav", makeTransform(), makeDescriptor(1),
+                         makeFeatures(1, 0, 10000));
+        }
+
+        QVERIFY(readFile());
+        QVERIFY(m_runs.size() > 1);
+        int row = 0;
+        for (const auto &v: m_runs) {
+            for (int i = 0; i < v.rowCount; ++i, ++row) {
+                QCOMPARE(v.getValue(i, 0), float(row * 10));
+            }
+        }
+        QCOMPARE(row, 10000);
+    }
+
+    void append() {
+        {
+            BinaryFeatureWriter writer;
+            setParameters(writer, false);
+            writer.write("track.wav", makeTransform(), makeDescriptor(2),
+                         makeFeatures(2, 0, 2));
+        }
+        {
+            BinaryFeatureWriter writer;
+            setParameters(writer, true);
+            writer.write("other.wav", makeTransform(), makeDescriptor(2),
+                         makeFeatures(2, 2, 3));
+        }
+
+        QCOMPARE(BinaryFeatureFormat::countOutputs(m_path), 2);
+        QVERIFY(readFile());
+        QCOMPARE(int(m_outputs.size()), 2);
+        QCOMPARE(m_outputs[1].index, 1);
+        QCOMPARE(m_outputs[1].trackId, QString("other.wav"));
+        QCOMPARE(int(m_runs.size()), 2);
+        QCOMPARE(m_runs[1].outputIndex, 1);
+        QCOMPARE(m_runs[1].rowCount, 3);
+        QCOMPARE(m_runs[1].getValue(0, 0), 20.f);
+    }
+};
+
+#endif
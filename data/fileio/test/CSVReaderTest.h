@@ -29,6 +29,9 @@
 #include <QObject>
 #include <QtTest>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
 
 #include <iostream>
 
@@ -365,6 +368,81 @@ private slots:
         QCOMPARE(int(actual->getAllEvents().size()), 5);
         delete model;
     }
+
+    void startAtTimeZero() {
+        // An event at frame 0 is a valid time, not a failed one
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QString path = tempDir.filePath("zero.csv");
+        {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write("0,1.5\n100,2.5\n200,3.5\n");
+        }
+        Model *model = nullptr;
+        CSVFormat f;
+        QVERIFY(f.guessFormatFor(path));
+        CSVFileReader reader(path, f, mainRate);
+        model = reader.load();
+        auto actual = qobject_cast<SparseTimeValueModel *>(model);
+        QVERIFY(actual);
+        QCOMPARE(int(actual->getAllEvents().size()), 3);
+        QCOMPARE(actual->getAllEvents()[0].getFrame(), sv_frame_t(0));
+        delete model;
+    }
+
+    void largeFileCRLineEnds() {
+        // Large enough to be read in several blocks, each parsed in
+        // several slices; with old-style Mac line endings, which the
+        // format guesser must cope with without reading the whole
+        // file as a single line
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+        QString path = tempDir.filePath("large.csv");
+        const int rows = 40000, cols = 40;
+        auto text = [](int i, int j) {
+            // not monotonic in any column, so that none is taken
+            // to be a timing column
+            return QByteArray::number(double((i * 37) % 1000) / 1000.0 + j);
+        };
+        {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            QByteArray row;
+            for (int i = 0; i < rows; ++i) {
+                row.clear();
+                for (int j = 0; j < cols; ++j) {
+                    if (j > 0) row += ',';
+                    row += text(i, j);
+                }
+                row += '\r';
+                file.write(row);
+            }
+        }
+        QVERIFY(QFileInfo(path).size() > 8 * 1024 * 1024);
+
+        CSVFormat f;
+        QVERIFY(f.guessFormatFor(path));
+        QCOMPARE(f.getColumnCount(), cols);
+        QCOMPARE(f.getModelType(), CSVFormat::ThreeDimensionalModel);
+        QCOMPARE(f.getTimingType(), CSVFormat::ImplicitTiming);
+        
+        CSVFileReader reader(path, f, mainRate);
+        Model *model = reader.load();
+        auto actual = qobject_cast<EditableDenseThreeDimensionalModel *>(model);
+        QVERIFY(actual);
+        QCOMPARE(actual->getWidth(), rows);
+        QCOMPARE(actual->getHeight(), cols);
+        for (int i: { 0, 1, 999, 12345, rows - 1 }) {
+            auto column = actual->getColumn(i);
+            QCOMPARE(int(column.size()), cols);
+            QCOMPARE(column[0], text(i, 0).toFloat());
+            QCOMPARE(column[cols-1], text(i, cols-1).toFloat());
+        }
+        QCOMPARE(actual->getMinimumLevel(), 0.f);
+        QCOMPARE(actual->getMaximumLevel(), QByteArray("39.999").toFloat());
+        delete model;
+    }
 };
 
 #endif
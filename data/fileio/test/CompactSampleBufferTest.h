@@ -0,0 +1,155 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_COMPACT_SAMPLE_BUFFER_H
+#define TEST_COMPACT_SAMPLE_BUFFER_H
+
+#include "../CompactSampleBuffer.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <random>
+#include <cmath>
+
+using namespace std;
+
+class CompactSampleBufferTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    // Append the samples in chunks of varying size, then check that
+    // reads from all over the buffer return exactly what went in
+    void checkRoundTrip(CompactSampleBuffer &buffer,
+                        const floatvec_t &samples) {
+
+        int channels = buffer.getChannelCount();
+        sv_frame_t frames = sv_frame_t(samples.size()) / channels;
+
+        mt19937 rng(0);
+        sv_frame_t appended = 0;
+        while (appended < frames) {
+            sv_frame_t n = min(sv_frame_t(rng() % 10000), frames - appended);
+            buffer.append(samples.data() + appended * channels, n);
+            appended += n;
+        }
+        QCOMPARE(buffer.getFrameCount(), frames);
+
+        for (int i = 0; i < 200; ++i) {
+            sv_frame_t start = rng() % (frames + 10);
+            sv_frame_t count = rng() % 20000;
+            floatvec_t out(count * channels);
+            sv_frame_t got = buffer.getInterleavedFrames
+                (start, count, out.data());
+            sv_frame_t expected =
+                (start >= frames ? 0 : min(count, frames - start));
+            QCOMPARE(got, expected);
+            for (sv_frame_t j = 0; j < got * channels; ++j) {
+                QVERIFY(out[j] == samples[start * channels + j]);
+            }
+        }
+    }
+
+private slots:
+    void sixteenBit() {
+        mt19937 rng(1);
+        floatvec_t samples(100000 * 2);
+        for (auto &s: samples) {
+            s = float(int(rng() % 65536) - 32768) / 32768.f;
+        }
+        CompactSampleBuffer buffer(2);
+        checkRoundTrip(buffer, samples);
+        // Every complete block of 4096 frames is packed, including
+        // those reaching -1.0; the incomplete final block is held
+        // as floats
+        size_t blocks = 100000 / 4096;
+        QCOMPARE(buffer.getSizeInBytes(),
+                 blocks * 4096 * 2 * sizeof(int16_t) +
+                 (100000 - blocks * 4096) * 2 * sizeof(float));
+    }
+
+    void fullScaleSixteenBit() {
+        // A single block of 16-bit audio at both extremes
+        floatvec_t samples(4096, 0.f);
+        samples[0] = -1.f;
+        samples[1] = 32767.f / 32768.f;
+        samples[2] = 1.f / 32768.f;
+        CompactSampleBuffer buffer(1);
+        buffer.append(samples.data(), 4096);
+        QCOMPARE(buffer.getSizeInBytes(), 4096 * sizeof(int16_t));
+        floatvec_t out(4096);
+        QCOMPARE(buffer.getInterleavedFrames(0, 4096, out.data()),
+                 sv_frame_t(4096));
+        QVERIFY(out == samples);
+    }
+
+    void quietTwentyFourBit() {
+        // 24-bit values below -48dB fit into 16 bits with a gain
+        mt19937 rng(2);
+        floatvec_t samples(100000);
+        for (auto &s: samples) {
+            s = float(int(rng() % 65536) - 32768) / 8388608.f;
+        }
+        CompactSampleBuffer buffer(1);
+        checkRoundTrip(buffer, samples);
+        QVERIFY(buffer.getSizeInBytes() <
+                buffer.getUncompactedSizeInBytes() * 6 / 10);
+    }
+
+    void arbitraryFloat() {
+        mt19937 rng(3);
+        uniform_real_distribution<float> dist(-1.f, 1.f);
+        floatvec_t samples(100000 * 3);
+        for (auto &s: samples) {
+            s = dist(rng);
+        }
+        CompactSampleBuffer buffer(3);
+        checkRoundTrip(buffer, samples);
+        QCOMPARE(buffer.getSizeInBytes(), buffer.getUncompactedSizeInBytes());
+    }
+
+    void mixed() {
+        // Silence, 8-bit, float and non-finite values in different
+        // blocks, each of which must come back unchanged
+        mt19937 rng(4);
+        uniform_real_distribution<float> dist(-1.f, 1.f);
+        floatvec_t samples(60000);
+        for (size_t i = 0; i < samples.size(); ++i) {
+            switch ((i / 5000) % 4) {
+            case 0: samples[i] = 0.f; break;
+            case 1: samples[i] = float(int(rng() % 256) - 128) / 128.f; break;
+            case 2: samples[i] = dist(rng); break;
+            case 3: samples[i] = (i % 1000 == 0 ? INFINITY : 0.25f); break;
+            }
+        }
+        CompactSampleBuffer buffer(1);
+        checkRoundTrip(buffer, samples);
+        QVERIFY(buffer.getSizeInBytes() < buffer.getUncompactedSizeInBytes());
+    }
+
+    void clear() {
+        floatvec_t samples(10000, 0.5f);
+        CompactSampleBuffer buffer(1);
+        buffer.append(samples.data(), 10000);
+        QCOMPARE(buffer.getFrameCount(), sv_frame_t(10000));
+        buffer.clear();
+        QCOMPARE(buffer.getFrameCount(), sv_frame_t(0));
+        QCOMPARE(buffer.getSizeInBytes(), size_t(0));
+        float f = 0.f;
+        QCOMPARE(buffer.getInterleavedFrames(0, 1, &f), sv_frame_t(0));
+    }
+};
+
+#endif
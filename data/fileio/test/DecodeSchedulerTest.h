@@ -0,0 +1,207 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_DECODE_SCHEDULER_H
+#define TEST_DECODE_SCHEDULER_H
+
+#include "../DecodeScheduler.h"
+
+#include "base/Thread.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+class DecodeSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    // Waits for a slot, notes that it got one, and (unless told to
+    // hold it) releases it again at once
+    class DecodeThread : public Thread
+    {
+    public:
+        DecodeThread(int id, int priority, bool hold,
+                     QMutex &orderMutex, vector<int> &order) :
+            m_id(id), m_priority(priority), m_cancelled(false),
+            m_hold(hold), m_acquired(false),
+            m_orderMutex(orderMutex), m_order(order) { }
+
+        void run() override {
+            auto scheduler = DecodeScheduler::getInstance();
+            if (!scheduler->acquire(&m_priority, 0, &m_cancelled)) {
+                return;
+            }
+            m_acquired = true;
+            {
+                QMutexLocker locker(&m_orderMutex);
+                m_order.push_back(m_id);
+            }
+            if (!m_hold) {
+                scheduler->release();
+            }
+        }
+
+        void setPriority(int priority) {
+            m_priority = priority;
+            DecodeScheduler::getInstance()->priorityChanged();
+        }
+
+        void cancel() { m_cancelled = true; }
+        bool hasAcquired() const { return m_acquired; }
+
+    private:
+        int m_id;
+        std::atomic<int> m_priority;
+        std::atomic<bool> m_cancelled;
+        bool m_hold;
+        std::atomic<bool> m_acquired;
+        QMutex &m_orderMutex;
+        vector<int> &m_order;
+    };
+
+    bool waitForWaiting(int n) {
+        auto scheduler = DecodeScheduler::getInstance();
+        for (int i = 0; i < 2000; ++i) {
+            if (scheduler->getWaitingDecodeCount() == n) return true;
+            QThread::msleep(1);
+        }
+        return false;
+    }
+
+private slots:
+    void init() {
+        QCOMPARE(DecodeScheduler::getInstance()->getRunningDecodeCount(), 0);
+    }
+
+    void cleanup() {
+        DecodeScheduler::getInstance()->setMaxConcurrentDecodes(0);
+    }
+
+    void ordering() {
+        // Waiting decodes start highest priority first, then in order
+        // of arrival, with a priority change while waiting respected
+        auto scheduler = DecodeScheduler::getInstance();
+        scheduler->setMaxConcurrentDecodes(1);
+        QVERIFY(scheduler->acquire(nullptr, 0, nullptr));
+
+        QMutex orderMutex;
+        vector<int> order;
+        DecodeThread t1(1, 0, false, orderMutex, order);
+        DecodeThread t2(2, 5, false, orderMutex, order);
+        DecodeThread t3(3, 0, false, orderMutex, order);
+        DecodeThread t4(4, 0, false, orderMutex, order);
+        t1.start();
+        QVERIFY(waitForWaiting(1));
+        t2.start();
+        QVERIFY(waitForWaiting(2));
+        t3.start();
+        QVERIFY(waitForWaiting(3));
+        t4.start();
+        QVERIFY(waitForWaiting(4));
+
+        t3.setPriority(10);
+        scheduler->release();
+
+        t1.wait();
+        t2.wait();
+        t3.wait();
+        t4.wait();
+
+        QCOMPARE(order, vector<int>({ 3, 2, 1, 4 }));
+        QCOMPARE(scheduler->getRunningDecodeCount(), 0);
+        QCOMPARE(scheduler->getWaitingDecodeCount(), 0);
+    }
+
+    void cancellation() {
+        auto scheduler = DecodeScheduler::getInstance();
+        scheduler->setMaxConcurrentDecodes(1);
+        QVERIFY(scheduler->acquire(nullptr, 0, nullptr));
+
+        QMutex orderMutex;
+        vector<int> order;
+        DecodeThread t1(1, 0, false, orderMutex, order);
+        DecodeThread t2(2, 0, false, orderMutex, order);
+        t1.start();
+        QVERIFY(waitForWaiting(1));
+        t2.start();
+        QVERIFY(waitForWaiting(2));
+
+        // The first in line gives up, without ever taking a slot,
+        // leaving the second to go when the slot is released
+        t1.cancel();
+        QVERIFY(t1.wait(5000));
+        QVERIFY(!t1.hasAcquired());
+        QCOMPARE(scheduler->getWaitingDecodeCount(), 1);
+        QCOMPARE(scheduler->getRunningDecodeCount(), 1);
+
+        scheduler->release();
+        QVERIFY(t2.wait(5000));
+        QVERIFY(t2.hasAcquired());
+        QCOMPARE(order, vector<int>({ 2 }));
+        QCOMPARE(scheduler->getRunningDecodeCount(), 0);
+    }
+
+    void limit() {
+        auto scheduler = DecodeScheduler::getInstance();
+        scheduler->setMaxConcurrentDecodes(2);
+        QCOMPARE(scheduler->getMaxConcurrentDecodes(), 2);
+
+        QMutex orderMutex;
+        vector<int> order;
+        DecodeThread t1(1, 0, true, orderMutex, order);
+        DecodeThread t2(2, 0, true, orderMutex, order);
+        DecodeThread t3(3, 0, true, orderMutex, order);
+        t1.start();
+        t2.start();
+        QVERIFY(t1.wait(5000));
+        QVERIFY(t2.wait(5000));
+        QCOMPARE(scheduler->getRunningDecodeCount(), 2);
+
+        // No more than the limit at once
+        t3.start();
+        QVERIFY(waitForWaiting(1));
+        QThread::msleep(100);
+        QVERIFY(!t3.hasAcquired());
+        QCOMPARE(scheduler->getRunningDecodeCount(), 2);
+
+        scheduler->release();
+        QVERIFY(t3.wait(5000));
+        QVERIFY(t3.hasAcquired());
+        QCOMPARE(scheduler->getRunningDecodeCount(), 2);
+        QCOMPARE(scheduler->getWaitingDecodeCount(), 0);
+
+        // Raising the limit lets a waiting decode start at once
+        DecodeThread t4(4, 0, true, orderMutex, order);
+        t4.start();
+        QVERIFY(waitForWaiting(1));
+        scheduler->setMaxConcurrentDecodes(3);
+        QVERIFY(t4.wait(5000));
+        QCOMPARE(scheduler->getRunningDecodeCount(), 3);
+
+        scheduler->release();
+        scheduler->release();
+        scheduler->release();
+        QCOMPARE(scheduler->getRunningDecodeCount(), 0);
+    }
+};
+
+#endif
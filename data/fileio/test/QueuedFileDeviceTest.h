@@ -0,0 +1,115 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_QUEUED_FILE_DEVICE_H
+#define TEST_QUEUED_FILE_DEVICE_H
+
+#include "../QueuedFileDevice.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QFile>
+
+class QueuedFileDeviceTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir tempDir;
+
+    QByteArray readAll(QString path) {
+        QFile f(path);
+        if (!f.open(QIODevice::ReadOnly)) return {};
+        return f.readAll();
+    }
+
+private slots:
+    void init() {
+        QVERIFY(tempDir.isValid());
+    }
+
+    void manyBuffers() {
+        // Small buffers and a short queue, so that the writer
+        // blocks on the writer thread often
+        QString path = tempDir.filePath("many");
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QByteArray expected;
+        {
+            QueuedFileDevice device(&file, 100, 2);
+            for (int i = 0; i < 10000; ++i) {
+                QByteArray line = QString("line %1\n").arg(i).toUtf8();
+                QCOMPARE(device.write(line), qint64(line.size()));
+                expected.append(line);
+            }
+            device.close();
+            QVERIFY(device.isOK());
+        }
+        file.close();
+        QCOMPARE(readAll(path), expected);
+    }
+
+    void flushWritesEverything() {
+        QString path = tempDir.filePath("flush");
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QueuedFileDevice device(&file, 1024 * 1024, 4);
+        QByteArray data(5000, 'x');
+        device.write(data);
+        QVERIFY(device.flush());
+        QCOMPARE(readAll(path), data);
+        device.write(data);
+        QVERIFY(device.flush());
+        QCOMPARE(readAll(path).size(), 10000);
+    }
+
+    void throughTextStream() {
+        QString path = tempDir.filePath("text");
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        {
+            QueuedFileDevice device(&file, 64, 1);
+            QTextStream stream(&device);
+            for (int i = 0; i < 1000; ++i) {
+                stream << i << ",";
+            }
+            stream << "\n";
+            stream.flush();
+        }
+        QByteArray contents = readAll(path);
+        QVERIFY(contents.startsWith("0,1,2,"));
+        QVERIFY(contents.endsWith("998,999,\n"));
+    }
+
+    void writeFailure() {
+        // A file opened only for reading can't be written to; the
+        // failure is found on the writer thread and reported back
+        QString path = tempDir.filePath("readonly");
+        {
+            QFile f(path);
+            QVERIFY(f.open(QIODevice::WriteOnly));
+        }
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QueuedFileDevice device(&file, 16, 1);
+        device.write(QByteArray(100, 'x'));
+        QVERIFY(!device.flush());
+        QVERIFY(!device.isOK());
+        QCOMPARE(device.write(QByteArray(100, 'x')), qint64(-1));
+    }
+};
+
+#endif
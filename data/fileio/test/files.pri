@@ -10,7 +10,13 @@ TEST_HEADERS += \
 	MIDIFileReaderTest.h \
 	CSVFormatTest.h \
 	CSVReaderTest.h \
-	CSVStreamWriterTest.h
+	CSVStreamWriterTest.h \
+	CompactSampleBufferTest.h \
+	AudioReadSchedulerTest.h \
+	DecodeSchedulerTest.h \
+	BinaryFeatureFileReaderTest.h \
+	BinaryFeatureWriterTest.h \
+	QueuedFileDeviceTest.h
      
 TEST_SOURCES += \
 	../../model/test/MockWaveModel.cpp \
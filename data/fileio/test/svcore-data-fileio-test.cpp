@@ -20,6 +20,12 @@
 #include "CSVFormatTest.h"
 #include "CSVReaderTest.h"
 #include "CSVStreamWriterTest.h"
+#include "CompactSampleBufferTest.h"
+#include "AudioReadSchedulerTest.h"
+#include "DecodeSchedulerTest.h"
+#include "BinaryFeatureFileReaderTest.h"
+#include "BinaryFeatureWriterTest.h"
+#include "QueuedFileDeviceTest.h"
 
 #include "system/Init.h"
 
@@ -102,6 +108,42 @@ int main(int argc, char *argv[])
         else ++bad;
     }
 
+    {
+        CompactSampleBufferTest t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    {
+        AudioReadSchedulerTest t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    {
+        DecodeSchedulerTest t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    {
+        BinaryFeatureFileReaderTest t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    {
+        BinaryFeatureWriterTest t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    {
+        QueuedFileDeviceTest t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
     if (bad > 0) {
         SVCERR << "\n********* " << bad << " test suite(s) failed!\n" << endl;
         return 1;
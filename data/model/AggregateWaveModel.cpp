@@ -16,6 +16,7 @@
 #include "AggregateWaveModel.h"
 
 #include <iostream>
+#include <algorithm>
 
 #include <QTextStream>
 
@@ -143,20 +144,50 @@ AggregateWaveModel::getSampleRate() const
     return model->getSampleRate();
 }
 
+// Number of samples to read from each component at a time when
+// mixing several of them together
+static const int mixReadSize = 16384;
+
 floatvec_t
 AggregateWaveModel::getData(int channel, sv_frame_t start, sv_frame_t count) const
 {
-    if (m_components.empty()) return {};
+    if (count <= 0) return {};
+
+    floatvec_t result(count, 0.f);
+    sv_frame_t obtained = getData(channel, start, count, result.data());
+    result.resize(obtained);
+    return result;
+}
+
+sv_frame_t
+AggregateWaveModel::getData(int channel, sv_frame_t start, sv_frame_t count,
+                            float *buffer) const
+{
+    if (m_components.empty() || count <= 0) return 0;
 
     int ch0 = channel, ch1 = channel;
     if (channel == -1) {
         ch0 = 0;
         ch1 = getChannelCount()-1;
     } else if (!in_range_for(m_components, channel)) {
-        return {};
+        return 0;
     }
 
-    floatvec_t result(count, 0.f);
+    if (ch0 == ch1) {
+        auto model = ModelById::getAs<RangeSummarisableTimeValueModel>
+            (m_components[ch0].model);
+        if (!model) return 0;
+        return model->getData(m_components[ch0].channel, start, count, buffer);
+    }
+    
+    for (sv_frame_t i = 0; i < count; ++i) {
+        buffer[i] = 0.f;
+    }
+
+    // Not a thread_local scratch buffer as in ReadOnlyWaveFileModel,
+    // because a component may itself be an aggregate model, which
+    // would reuse the buffer while we are still reading into it
+    floatvec_t here(std::min(sv_frame_t(mixReadSize), count));
     sv_frame_t longest = 0;
     
     for (int c = ch0; c <= ch1; ++c) {
@@ -165,17 +196,25 @@ AggregateWaveModel::getData(int channel, sv_frame_t start, sv_frame_t count) con
             (m_components[c].model);
         if (!model) continue;
 
-        auto here = model->getData(m_components[c].channel, start, count);
-        if (sv_frame_t(here.size()) > longest) {
-            longest = sv_frame_t(here.size());
+        sv_frame_t obtained = 0;
+        while (obtained < count) {
+            sv_frame_t n = std::min(sv_frame_t(mixReadSize), count - obtained);
+            sv_frame_t got = model->getData(m_components[c].channel,
+                                            start + obtained, n, here.data());
+            float *out = buffer + obtained;
+            for (sv_frame_t i = 0; i < got; ++i) {
+                out[i] += here[i];
+            }
+            obtained += got;
+            if (got < n) break;
         }
-        for (sv_frame_t i = 0; in_range_for(here, i); ++i) {
-            result[i] += here[i];
+        
+        if (obtained > longest) {
+            longest = obtained;
         }
     }
 
-    result.resize(longest);
-    return result;
+    return longest;
 }
 
 vector<floatvec_t>
@@ -201,6 +240,24 @@ AggregateWaveModel::getMultiChannelData(int fromchannel, int tochannel,
     return result;
 }
 
+sv_frame_t
+AggregateWaveModel::getMultiChannelData(int fromchannel, int tochannel,
+                                        sv_frame_t start, sv_frame_t count,
+                                        float *const *buffers) const
+{
+    sv_frame_t min = count;
+
+    for (int c = fromchannel; c <= tochannel; ++c) {
+        sv_frame_t obtained = getData(c, start, count,
+                                      buffers[c - fromchannel]);
+        if (obtained < min) {
+            min = obtained;
+        }
+    }
+
+    return min;
+}
+
 int
 AggregateWaveModel::getSummaryBlockSize(int desired) const
 {
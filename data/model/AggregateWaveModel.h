@@ -68,8 +68,13 @@ public:
     sv_frame_t getTrueEndFrame() const override { return getFrameCount(); }
 
     floatvec_t getData(int channel, sv_frame_t start, sv_frame_t count) const override;
+    sv_frame_t getData(int channel, sv_frame_t start, sv_frame_t count,
+                       float *buffer) const override;
 
     std::vector<floatvec_t> getMultiChannelData(int fromchannel, int tochannel, sv_frame_t start, sv_frame_t count) const override;
+    sv_frame_t getMultiChannelData(int fromchannel, int tochannel,
+                                   sv_frame_t start, sv_frame_t count,
+                                   float *const *buffers) const override;
 
     int getSummaryBlockSize(int desired) const override;
 
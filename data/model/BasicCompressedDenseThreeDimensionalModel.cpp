@@ -16,6 +16,7 @@
 #include "BasicCompressedDenseThreeDimensionalModel.h"
 
 #include "base/LogRange.h"
+#include "base/NumberFormat.h"
 
 #include <QTextStream>
 #include <QStringList>
@@ -537,8 +538,9 @@ BasicCompressedDenseThreeDimensionalModel::toStringExportRows(DataExportOptions,
         sv_frame_t fr = m_startFrame + i * m_resolution;
         if (fr >= startFrame && fr < startFrame + duration) {
             QVector<QString> row;
+            row.reserve(c.size());
             for (int j = 0; in_range_for(c, j); ++j) {
-                row << QString("%1").arg(c.at(j));
+                row << NumberFormat::fromFloat(c.at(j));
             }
             rows.push_back(row);
         }
@@ -19,6 +19,7 @@
 #include "TabularModel.h"
 #include "Model.h"
 #include "DeferredNotifier.h"
+#include "SparseModelEdits.h"
 
 #include "base/RealTime.h"
 #include "base/EventSeries.h"
@@ -205,6 +206,41 @@ public:
                                 e.getFrame(),
                                 e.getFrame() + e.getDuration() + m_resolution);
     }
+
+    void addEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        bool allChange = false;
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_events.addEvents(ee);
+
+            for (const auto &e: ee) {
+                float f0 = e.getValue();
+                float f1 = f0 + fabsf(e.getLevel());
+                if (SparseModelEdits::extendValueExtents
+                    (f0, f1, m_haveExtents, m_valueMinimum, m_valueMaximum)) {
+                    allChange = true;
+                }
+            }
+        }
+        
+        SparseModelEdits::notifyEventsAdded
+            (this, m_notifier, ee, m_resolution, allChange);
+    }
+
+    void removeEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        {
+            QMutexLocker locker(&m_mutex);
+            m_events.removeEvents(ee);
+        }
+        SparseModelEdits::notifyEventsRemoved(this, ee, m_resolution);
+    }
     
     /**
      * TabularModel methods.  
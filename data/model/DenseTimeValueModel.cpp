@@ -15,10 +15,42 @@
 
 #include "DenseTimeValueModel.h"
 
+#include "base/NumberFormat.h"
+
 #include <QStringList>
 
+#include <algorithm>
+
 using namespace std;
 
+sv_frame_t
+DenseTimeValueModel::getData(int channel, sv_frame_t start, sv_frame_t count,
+                             float *buffer) const
+{
+    floatvec_t data = getData(channel, start, count);
+    sv_frame_t n = min(sv_frame_t(data.size()), count);
+    copy(data.begin(), data.begin() + n, buffer);
+    return n;
+}
+
+sv_frame_t
+DenseTimeValueModel::getMultiChannelData(int fromchannel, int tochannel,
+                                         sv_frame_t start, sv_frame_t count,
+                                         float *const *buffers) const
+{
+    auto data = getMultiChannelData(fromchannel, tochannel, start, count);
+    if (data.empty()) return 0;
+
+    sv_frame_t n = count;
+    for (const auto &d: data) {
+        n = min(n, sv_frame_t(d.size()));
+    }
+    for (int c = 0; in_range_for(data, c); ++c) {
+        copy(data[c].begin(), data[c].begin() + n, buffers[c]);
+    }
+    return n;
+}
+
 QVector<QString>
 DenseTimeValueModel::getStringExportHeaders(DataExportOptions) const
 {
@@ -47,9 +79,10 @@ DenseTimeValueModel::toStringExportRows(DataExportOptions,
 
     for (sv_frame_t i = 0; in_range_for(data[0], i); ++i) {
         QVector<QString> row;
-        row.push_back(QString("%1").arg(startFrame + i));
+        row.reserve(ch + 1);
+        row.push_back(NumberFormat::fromInteger(startFrame + i));
         for (int c = 0; in_range_for(data, c); ++c) {
-            row.push_back(QString("%1").arg(data[c][i]));
+            row.push_back(NumberFormat::fromFloat(data[c][i]));
         }
         rows.push_back(row);
     }
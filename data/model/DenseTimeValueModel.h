@@ -85,6 +85,44 @@ public:
                                                         sv_frame_t count)
         const = 0;
 
+    /**
+     * Get the specified set of samples from the given channel (or a
+     * mix of all channels, if channel is -1) as for getData above,
+     * but write them into the given buffer, which must have room for
+     * count samples. Return the number of samples written, which may
+     * be fewer than requested if the end of file was reached.
+     *
+     * The default implementation calls the vector-returning getData
+     * and copies. Subclasses should override it if they can avoid
+     * allocating, as this is the version to use when reading block
+     * by block.
+     */
+    virtual sv_frame_t getData(int channel, sv_frame_t start, sv_frame_t count,
+                               float *buffer) const;
+
+    /**
+     * Get the specified set of samples from the given contiguous
+     * range of channels as for getMultiChannelData above, but write
+     * them into the given buffers, of which there must be
+     * (tochannel - fromchannel + 1) each with room for count
+     * samples. Return the number of samples written to each buffer.
+     *
+     * The default implementation calls the vector-returning
+     * getMultiChannelData and copies.
+     */
+    virtual sv_frame_t getMultiChannelData(int fromchannel, int tochannel,
+                                           sv_frame_t start, sv_frame_t count,
+                                           float *const *buffers) const;
+
+    /**
+     * Hint that the given range of samples is likely to be asked for
+     * soon, so that a model reading from slow storage can start to
+     * fetch it in the background. The default implementation does
+     * nothing.
+     */
+    virtual void prefetchData(sv_frame_t /* start */,
+                              sv_frame_t /* count */) const { }
+
     bool canPlay() const override { return true; }
     QString getDefaultPlayClipId() const override { return ""; }
 
@@ -16,6 +16,7 @@
 #include "EditableDenseThreeDimensionalModel.h"
 
 #include "base/LogRange.h"
+#include "base/NumberFormat.h"
 
 #include <QTextStream>
 #include <QStringList>
@@ -25,15 +26,31 @@
 
 #include <cmath>
 #include <cassert>
+#include <algorithm>
 
 using std::vector;
 
 #include "system/System.h"
 
+// Approximate number of values in each slab of column storage. The
+// number of columns per slab is the largest power of two for which
+// the slab is no bigger than this (or one column, for tall models),
+// up to a limit so that short models don't start out too big. It is
+// chosen from the height when the first column is stored
+static const int slabValues = 65536;
+static const int maxSlabColumns = 4096;
+
+// Number of slabs the first slab index has room for
+static const int initialIndexCapacity = 16;
+
 EditableDenseThreeDimensionalModel::EditableDenseThreeDimensionalModel(sv_samplerate_t sampleRate,
                                                                        int resolution,
                                                                        int yBinCount,
                                                                        bool notifyOnAdd) :
+    m_index(nullptr),
+    m_width(0),
+    m_slabShift(0),
+    m_slabColumns(1),
     m_startFrame(0),
     m_sampleRate(sampleRate),
     m_resolution(resolution),
@@ -46,8 +63,14 @@ EditableDenseThreeDimensionalModel::EditableDenseThreeDimensionalModel(sv_sample
     m_sinceLastNotifyMax(-1),
     m_completion(100)
 {
+    m_index = new SlabIndex(initialIndexCapacity);
 }    
 
+EditableDenseThreeDimensionalModel::~EditableDenseThreeDimensionalModel()
+{
+    delete m_index.load();
+}
+
 bool
 EditableDenseThreeDimensionalModel::isOK() const
 {
@@ -82,7 +105,8 @@ EditableDenseThreeDimensionalModel::setStartFrame(sv_frame_t f)
 sv_frame_t
 EditableDenseThreeDimensionalModel::getTrueEndFrame() const
 {
-    return m_resolution * m_data.size() + (m_resolution - 1);
+    int resolution = m_resolution;
+    return resolution * sv_frame_t(getWidth()) + (resolution - 1);
 }
 
 int
@@ -100,7 +124,7 @@ EditableDenseThreeDimensionalModel::setResolution(int sz)
 int
 EditableDenseThreeDimensionalModel::getWidth() const
 {
-    return int(m_data.size());
+    return m_width.load(std::memory_order_acquire);
 }
 
 int
@@ -112,6 +136,7 @@ EditableDenseThreeDimensionalModel::getHeight() const
 void
 EditableDenseThreeDimensionalModel::setHeight(int sz)
 {
+    QMutexLocker locker(&m_mutex);
     m_yBinCount = sz;
 }
 
@@ -139,35 +164,49 @@ EditableDenseThreeDimensionalModel::setMaximumLevel(float level)
     m_maximum = level;
 }
 
+EditableDenseThreeDimensionalModel::ColumnView
+EditableDenseThreeDimensionalModel::getColumnView(int index) const
+{
+    // Read the width before the index: the writer publishes the
+    // index first, so this one has slabs for every column within it.
+    // Enter the read scope before loading the index, so that neither
+    // it nor its slabs can be freed while the view exists
+
+    if (index < 0 || index >= m_width.load(std::memory_order_acquire)) {
+        return {};
+    }
+    EpochReadScope scope(m_reclaimer);
+    const SlabIndex *slabIndex = m_index.load(std::memory_order_acquire);
+    const Slab *slab = slabIndex->slabs[index >> m_slabShift];
+    int offset = index & (m_slabColumns - 1);
+    return { slab->values.data() + size_t(offset) * slab->stride,
+             slab->lengths[offset],
+             std::move(scope) };
+}
+
 EditableDenseThreeDimensionalModel::Column
 EditableDenseThreeDimensionalModel::getColumn(int index) const
 {
-    QMutexLocker locker(&m_mutex);
-    if (!in_range_for(m_data, index)) {
+    if (index < 0 || index >= getWidth()) {
         return {};
     }
-    Column c = m_data.at(index);
-    if (int(c.size()) == m_yBinCount) {
-        return c;
-    } else {
-        Column cc(c);
-        cc.resize(m_yBinCount, 0.0);
-        return cc;
-    }
+    int height = m_yBinCount;
+    ColumnView view = getColumnView(index);
+    int n = std::min(view.size(), height);
+    Column c(view.begin(), view.begin() + n);
+    c.resize(height, 0.0);
+    return c;
 }
 
 float
 EditableDenseThreeDimensionalModel::getValueAt(int index, int n) const
 {
-    QMutexLocker locker(&m_mutex);
-    if (!in_range_for(m_data, index)) {
-        return m_minimum;
-    }
-    const Column &c = m_data.at(index);
-    if (!in_range_for(c, n)) {
+    ColumnView view = getColumnView(index);
+    if (n < 0 || n >= view.size()) {
+        QMutexLocker locker(&m_mutex);
         return m_minimum;
     }
-    return c.at(n);
+    return view[n];
 }
 
 QString
@@ -187,33 +226,73 @@ EditableDenseThreeDimensionalModel::setColumn(int index,
                                               const Column &values)
 {
     bool allChange = false;
+    int resolution = getResolution();
     sv_frame_t windowStart = index;
-    windowStart *= m_resolution;
+    windowStart *= resolution;
 
     {
         QMutexLocker locker(&m_mutex);
 
-        while (index >= int(m_data.size())) {
-            m_data.push_back(Column());
+        storeColumn(index, values, allChange);
+
+        if (index >= m_width.load(std::memory_order_relaxed)) {
+            m_width.store(index + 1, std::memory_order_release);
         }
 
-        for (int i = 0; in_range_for(values, i); ++i) {
-            float value = values[i];
-            if (ISNAN(value) || ISINF(value)) {
-                continue;
-            }
-            if (!m_haveExtents || value < m_minimum) {
-                m_minimum = value;
-                allChange = true;
+        if (allChange) {
+            m_sinceLastNotifyMin = -1;
+            m_sinceLastNotifyMax = -1;
+        } else {
+            if (m_sinceLastNotifyMin == -1 ||
+                windowStart < m_sinceLastNotifyMin) {
+                m_sinceLastNotifyMin = windowStart;
             }
-            if (!m_haveExtents || value > m_maximum) {
-                m_maximum = value;
-                allChange = true;
+            if (m_sinceLastNotifyMax == -1 ||
+                windowStart > m_sinceLastNotifyMax) {
+                m_sinceLastNotifyMax = windowStart;
             }
-            m_haveExtents = true;
+        }
+    }
+
+    if (m_notifyOnAdd) {
+        if (allChange) {
+            emit modelChanged(getId());
+        } else {
+            emit modelChangedWithin(getId(),
+                                    windowStart, windowStart + resolution);
+        }
+    } else {
+        if (allChange) {
+            emit modelChanged(getId());
+        }
+    }
+}
+
+void
+EditableDenseThreeDimensionalModel::setColumns(int x,
+                                               const std::vector<Column> &columns)
+{
+    if (columns.empty()) return;
+    
+    bool allChange = false;
+    int resolution = getResolution();
+    sv_frame_t windowStart = x;
+    windowStart *= resolution;
+    sv_frame_t windowEnd = x + int(columns.size());
+    windowEnd *= resolution;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        for (int c = 0; in_range_for(columns, c); ++c) {
+            storeColumn(x + c, columns[c], allChange);
         }
 
-        m_data[index] = values;
+        // Publish the whole run at once
+        int end = x + int(columns.size());
+        if (end > m_width.load(std::memory_order_relaxed)) {
+            m_width.store(end, std::memory_order_release);
+        }
 
         if (allChange) {
             m_sinceLastNotifyMin = -1;
@@ -224,8 +303,8 @@ EditableDenseThreeDimensionalModel::setColumn(int index,
                 m_sinceLastNotifyMin = windowStart;
             }
             if (m_sinceLastNotifyMax == -1 ||
-                windowStart > m_sinceLastNotifyMax) {
-                m_sinceLastNotifyMax = windowStart;
+                windowEnd - resolution > m_sinceLastNotifyMax) {
+                m_sinceLastNotifyMax = windowEnd - resolution;
             }
         }
     }
@@ -234,8 +313,7 @@ EditableDenseThreeDimensionalModel::setColumn(int index,
         if (allChange) {
             emit modelChanged(getId());
         } else {
-            emit modelChangedWithin(getId(),
-                                    windowStart, windowStart + m_resolution);
+            emit modelChangedWithin(getId(), windowStart, windowEnd);
         }
     } else {
         if (allChange) {
@@ -244,6 +322,107 @@ EditableDenseThreeDimensionalModel::setColumn(int index,
     }
 }
 
+void
+EditableDenseThreeDimensionalModel::storeColumn(int index,
+                                                const Column &values,
+                                                bool &allChange)
+{
+    if (index < 0) return;
+
+    int n = int(values.size());
+    int stride = std::max(m_yBinCount.load(), n);
+    
+    if (m_slabs.empty()) {
+        // No reader looks at the slab size until a column has been
+        // published, so it can still be chosen here
+        while (m_slabColumns < maxSlabColumns &&
+               m_slabColumns * 2 * std::max(stride, 1) <= slabValues) {
+            m_slabColumns *= 2;
+            ++m_slabShift;
+        }
+    }
+    
+    int slabNo = index >> m_slabShift;
+    SlabIndex *current = m_index.load(std::memory_order_relaxed);
+    SlabIndex *slabIndex = current;
+
+    if (slabNo >= int(slabIndex->slabs.size())) {
+        // Readers may still be using the current index, so make a
+        // larger copy rather than changing it
+        int capacity = int(slabIndex->slabs.size());
+        while (slabNo >= capacity) capacity *= 2;
+        SlabIndex *larger = new SlabIndex(capacity);
+        std::copy(slabIndex->slabs.begin(), slabIndex->slabs.end(),
+                  larger->slabs.begin());
+        slabIndex = larger;
+    }
+
+    // Slots beyond the published width are not read, so new slabs
+    // can be added to an index already in use
+    while (int(m_slabs.size()) <= slabNo) {
+        m_slabs.emplace_back(new Slab(m_slabColumns, stride));
+        slabIndex->slabs[m_slabs.size() - 1] = m_slabs.back().get();
+    }
+
+    Slab *narrow = nullptr;
+    
+    if (m_slabs[slabNo]->stride < n) {
+        // The column is longer than its slab has room for (the height
+        // has grown since the slab was made, or the column is longer
+        // than the height). Readers may be using the slab and the
+        // index, so make a wider copy of the slab and a new index
+        // that refers to it
+        narrow = m_slabs[slabNo].release();
+        Slab *wide = new Slab(m_slabColumns, stride);
+        for (int c = 0; c < m_slabColumns; ++c) {
+            std::copy(narrow->values.begin() + size_t(c) * narrow->stride,
+                      narrow->values.begin() + size_t(c) * narrow->stride
+                      + narrow->lengths[c],
+                      wide->values.begin() + size_t(c) * stride);
+        }
+        wide->lengths = narrow->lengths;
+        m_slabs[slabNo].reset(wide);
+        if (slabIndex == current) {
+            slabIndex = new SlabIndex(int(current->slabs.size()));
+            slabIndex->slabs = current->slabs;
+        }
+        slabIndex->slabs[slabNo] = wide;
+    }
+
+    if (slabIndex != current) {
+        // Once the replacement is published no new reader can find
+        // the old index or the narrow slab, so they can be retired
+        m_index.store(slabIndex, std::memory_order_release);
+        m_reclaimer.retire(current);
+        if (narrow) m_reclaimer.retire(narrow);
+    } else if (m_reclaimer.getRetiredCount() > 0) {
+        m_reclaimer.reclaim();
+    }
+    
+    for (int i = 0; in_range_for(values, i); ++i) {
+        float value = values[i];
+        if (ISNAN(value) || ISINF(value)) {
+            continue;
+        }
+        if (!m_haveExtents || value < m_minimum) {
+            m_minimum = value;
+            allChange = true;
+        }
+        if (!m_haveExtents || value > m_maximum) {
+            m_maximum = value;
+            allChange = true;
+        }
+        m_haveExtents = true;
+    }
+
+    Slab *slab = m_slabs[slabNo].get();
+    int offset = index & (m_slabColumns - 1);
+    float *target = slab->values.data() + size_t(offset) * slab->stride;
+    std::copy(values.begin(), values.end(), target);
+    std::fill(target + n, target + slab->stride, 0.f);
+    slab->lengths[offset] = n;
+}
+
 QString
 EditableDenseThreeDimensionalModel::getBinName(int n) const
 {
@@ -300,21 +479,19 @@ EditableDenseThreeDimensionalModel::setBinValueUnit(QString unit)
 bool
 EditableDenseThreeDimensionalModel::shouldUseLogValueScale() const
 {
-    QMutexLocker locker(&m_mutex);
-
     vector<double> sample;
     vector<int> n;
     
     for (int i = 0; i < 10; ++i) {
         int index = i * 10;
-        if (in_range_for(m_data, index)) {
-            const Column &c = m_data.at(index);
-            while (c.size() > sample.size()) {
+        if (index < getWidth()) {
+            ColumnView c = getColumnView(index);
+            while (c.size() > int(sample.size())) {
                 sample.push_back(0.0);
                 n.push_back(0);
             }
-            for (int j = 0; in_range_for(c, j); ++j) {
-                sample[j] += c.at(j);
+            for (int j = 0; j < c.size(); ++j) {
+                sample[j] += c[j];
                 ++n[j];
             }
         }
@@ -347,7 +524,7 @@ EditableDenseThreeDimensionalModel::setCompletion(int completion, bool update)
                 m_sinceLastNotifyMax >= 0) {
                 emit modelChangedWithin(getId(),
                                         m_sinceLastNotifyMin,
-                                        m_sinceLastNotifyMax + m_resolution);
+                                        m_sinceLastNotifyMax + getResolution());
                 m_sinceLastNotifyMin = m_sinceLastNotifyMax = -1;
             } else {
                 emit completionChanged(getId());
@@ -369,7 +546,8 @@ EditableDenseThreeDimensionalModel::getStringExportHeaders(DataExportOptions)
     const
 {
     QVector<QString> sv;
-    for (int i = 0; i < m_yBinCount; ++i) {
+    int height = getHeight();
+    for (int i = 0; i < height; ++i) {
         sv.push_back(QString("Bin%1").arg(i+1));
     }
     return sv;
@@ -381,16 +559,19 @@ EditableDenseThreeDimensionalModel::toStringExportRows(DataExportOptions,
                                                        sv_frame_t duration)
     const
 {
-    QMutexLocker locker(&m_mutex);
-
     QVector<QVector<QString>> rows;
 
-    for (int i = 0; in_range_for(m_data, i); ++i) {
-        sv_frame_t fr = m_startFrame + i * m_resolution;
+    int width = getWidth();
+    sv_frame_t start = getStartFrame();
+    int resolution = getResolution();
+    for (int i = 0; i < width; ++i) {
+        sv_frame_t fr = start + i * resolution;
         if (fr >= startFrame && fr < startFrame + duration) {
+            ColumnView column = getColumnView(i);
             QVector<QString> row;
-            for (int j = 0; in_range_for(m_data.at(i), j); ++j) {
-                row.push_back(QString("%1").arg(m_data.at(i).at(j)));
+            row.reserve(column.size());
+            for (float value: column) {
+                row.push_back(NumberFormat::fromFloat(value));
             }
             rows.push_back(row);
         }
@@ -416,12 +597,12 @@ EditableDenseThreeDimensionalModel::toXml(QTextStream &out,
     Model::toXml
         (out, indent,
          QString("type=\"dense\" dimensions=\"3\" windowSize=\"%1\" yBinCount=\"%2\" minimum=\"%3\" maximum=\"%4\" dataset=\"%5\" startFrame=\"%6\" %7")
-         .arg(m_resolution)
-         .arg(m_yBinCount)
+         .arg(getResolution())
+         .arg(getHeight())
          .arg(m_minimum)
          .arg(m_maximum)
          .arg(getExportId())
-         .arg(m_startFrame)
+         .arg(getStartFrame())
          .arg(extraAttributes));
 
     out << indent;
@@ -436,16 +617,25 @@ EditableDenseThreeDimensionalModel::toXml(QTextStream &out,
         }
     }
 
-    for (int i = 0; in_range_for(m_data, i); ++i) {
+    // Each row is formatted into a single string before being
+    // written. The stream flushes itself as its buffer fills, so
+    // there is no need to flush it per row
+    QString line;
+    int width = getWidth();
+    for (int i = 0; i < width; ++i) {
         Column c = getColumn(i);
-        out << indent + "  ";
-        out << QString("<row n=\"%1\">").arg(i);
+        line.clear();
+        line.reserve(indent.size() + 32 + c.size() * 12);
+        line += indent;
+        line += QLatin1String("  <row n=\"");
+        NumberFormat::appendInteger(line, i);
+        line += QLatin1String("\">");
         for (int j = 0; in_range_for(c, j); ++j) {
-            if (j > 0) out << " ";
-            out << c.at(j);
+            if (j > 0) line += ' ';
+            NumberFormat::appendFloat(line, c.at(j));
         }
-        out << QString("</row>\n");
-        out.flush();
+        line += QLatin1String("</row>\n");
+        out << line;
     }
 
     out << indent + "</dataset>\n";
@@ -18,10 +18,35 @@
 
 #include "DenseThreeDimensionalModel.h"
 
+#include "base/EpochReclaimer.h"
+
 #include <QMutex>
 
 #include <vector>
-
+#include <atomic>
+#include <memory>
+
+/**
+ * A dense 3-D model whose columns are set explicitly, e.g. when
+ * loading from a file.
+ *
+ * Column values are stored contiguously, in slabs of a fixed number
+ * of columns each. Within a slab each column takes the same space,
+ * enough for the model's height when the slab was made or for the
+ * longest column stored in it, whichever is greater. Slabs are added
+ * as the model grows, and a slab is replaced by a wider copy when a
+ * column too long for it is stored. Columns can be read without
+ * copying (see getColumnView) and without taking the mutex that
+ * serialises writers. A writer stores a column first and then
+ * publishes the new width; a reader reads the width and then reads
+ * only columns within it. A slab or slab index that has been
+ * replaced is not freed until no reader can still be using it (see
+ * EpochReclaimer).
+ *
+ * Columns may also be rewritten after they have been published. A
+ * reader racing with such a rewrite may see a mixture of old and new
+ * values in the column, or the old column entire.
+ */
 class EditableDenseThreeDimensionalModel : public DenseThreeDimensionalModel
 {
     Q_OBJECT
@@ -31,6 +56,7 @@ public:
                                        int resolution,
                                        int height,
                                        bool notifyOnAdd = true);
+    virtual ~EditableDenseThreeDimensionalModel();
 
     bool isOK() const override;
     bool isReady(int *completion = 0) const override;
@@ -75,6 +101,10 @@ public:
      * never called) on retrieval. That is, the model owner determines
      * the height of the model at a single stroke; the columns
      * themselves don't have any effect on the height of the model.
+     *
+     * All of the values set for a column are stored, whatever the
+     * height, so increasing the height later exposes any values
+     * beyond the old height that were set before.
      */
     virtual void setHeight(int sz);
 
@@ -108,6 +138,40 @@ public:
      */
     float getValueAt(int x, int n) const override;
 
+    /**
+     * A read-only view of the values stored for a column, without
+     * the padding or truncation to the model's height that getColumn
+     * applies. The view remains valid for as long as it exists, and
+     * for that long it keeps any storage that is replaced meanwhile
+     * from being freed, so it should not be kept longer than needed.
+     */
+    class ColumnView
+    {
+    public:
+        ColumnView() : m_values(nullptr), m_size(0) { }
+        ColumnView(const float *values, int size, EpochReadScope &&scope) :
+            m_values(values), m_size(size), m_scope(std::move(scope)) { }
+        ColumnView(ColumnView &&) =default;
+
+        int size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        const float *data() const { return m_values; }
+        float operator[](int n) const { return m_values[n]; }
+        const float *begin() const { return m_values; }
+        const float *end() const { return m_values + m_size; }
+        
+    private:
+        const float *m_values;
+        int m_size;
+        EpochReadScope m_scope;
+    };
+
+    /**
+     * Get a view of the values stored for the given column. The view
+     * is empty if the column is out of range or has not been set.
+     */
+    ColumnView getColumnView(int x) const;
+
     /**
      * Obtain the name of the unit of the values returned from
      * getValueAt(), if any.
@@ -125,6 +189,14 @@ public:
      */
     virtual void setColumn(int x, const Column &values);
 
+    /**
+     * Set the entire set of bin values at each of a run of columns,
+     * starting at column x. This has the same effect as calling
+     * setColumn for each in turn, but takes the lock and notifies
+     * once for the whole run, for use when loading in bulk.
+     */
+    virtual void setColumns(int x, const std::vector<Column> &columns);
+
     /**
      * Return the name of bin n. This is a single label per bin that
      * does not vary from one column to the next.
@@ -197,18 +269,56 @@ public:
                        QString extraAttributes = "") const override;
 
 protected:
-    typedef std::vector<Column> ValueMatrix;
-    ValueMatrix m_data;
+    // Base for the storage that is retired to m_reclaimer when
+    // replaced, so that slabs and slab indexes can share it
+    struct Storage {
+        virtual ~Storage() { }
+    };
+    
+    struct Slab : Storage {
+        Slab(int columns, int stride_) :
+            stride(stride_),
+            values(size_t(columns) * stride_, 0.f),
+            lengths(columns, 0) { }
+        int stride; // space for values per column
+        std::vector<float> values;
+        std::vector<int> lengths; // number of values stored per column
+    };
+
+    // The slabs in order. This has a fixed capacity once created, so
+    // a reader can use it while the writer adds slabs beyond those
+    // it can see; when it fills, it is replaced by a larger one
+    struct SlabIndex : Storage {
+        SlabIndex(int capacity) : slabs(capacity, nullptr) { }
+        std::vector<Slab *> slabs;
+    };
+
+    // Owners of the slabs in the current index, in order. The current
+    // index itself is owned through m_index. A slab or index that is
+    // replaced is retired to m_reclaimer, as a reader may still be
+    // using it
+    std::vector<std::unique_ptr<Slab>> m_slabs;
+    EpochReclaimer<Storage> m_reclaimer;
+
+    std::atomic<SlabIndex *> m_index;
+    std::atomic<int> m_width;
+
+    int m_slabShift;
+    int m_slabColumns; // chosen when the first column is stored
+
+    // Writer side, called with m_mutex held
+    void storeColumn(int x, const Column &values, bool &allChange);
+
     QString m_unit;
 
     std::vector<QString> m_binNames;
     std::vector<float> m_binValues;
     QString m_binValueUnit;
 
-    sv_frame_t m_startFrame;
+    std::atomic<sv_frame_t> m_startFrame;
     sv_samplerate_t m_sampleRate;
-    int m_resolution;
-    int m_yBinCount;
+    std::atomic<int> m_resolution;
+    std::atomic<int> m_yBinCount;
     float m_minimum;
     float m_maximum;
     bool m_haveExtents;
@@ -29,6 +29,18 @@ public:
     virtual ~EventEditable() { }
     virtual void add(Event e) = 0;
     virtual void remove(Event e) = 0;
+
+    /**
+     * Add or remove many events at once. The default implementations
+     * simply call add or remove for each event in turn; classes that
+     * can do better in bulk should override them.
+     */
+    virtual void addEvents(const EventVector &ee) {
+        for (const auto &e: ee) add(e);
+    }
+    virtual void removeEvents(const EventVector &ee) {
+        for (const auto &e: ee) remove(e);
+    }
 };
 
 class WithEditable
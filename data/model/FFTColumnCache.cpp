@@ -0,0 +1,316 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "FFTColumnCache.h"
+
+#include "base/StorageAdviser.h"
+#include "base/TempDirectory.h"
+#include "base/Exceptions.h"
+#include "base/Debug.h"
+
+#include <QDir>
+#include <QMutexLocker>
+
+#include <map>
+#include <new>
+#include <cstdint>
+#include <cmath>
+
+//#define DEBUG_FFT_COLUMN_CACHE 1
+
+using namespace std;
+
+static QMutex instanceMutex;
+static map<FFTColumnCache::Key, weak_ptr<FFTColumnCache>> instances;
+
+shared_ptr<FFTColumnCache>
+FFTColumnCache::getInstance(const Key &key, int width)
+{
+    if (width <= 0 || key.fftSize <= 0) return {};
+
+    QMutexLocker locker(&instanceMutex);
+
+    auto itr = instances.find(key);
+    if (itr != instances.end()) {
+        if (auto existing = itr->second.lock()) {
+            return existing;
+        }
+        instances.erase(itr);
+    }
+
+    // The constructor does not allocate; we go via the
+    // StorageAdviser first to decide where the data should live
+
+    shared_ptr<FFTColumnCache> cache
+        (new FFTColumnCache(key, width, key.fftSize / 2 + 1));
+
+    size_t kb = cache->getSizeKB();
+
+    StorageAdviser::Recommendation rec;
+    try {
+        rec = StorageAdviser::recommend
+            (StorageAdviser::Criteria(StorageAdviser::SpeedCritical |
+                                      StorageAdviser::FrequentLookupLikely),
+             kb, kb);
+    } catch (const InsufficientDiscSpace &) {
+        SVDEBUG << "FFTColumnCache::getInstance: insufficient space for "
+                << kb << "K cache, not caching" << endl;
+        return {};
+    }
+
+    bool allocated = false;
+    if ((rec & StorageAdviser::UseMemory) ||
+        (rec & StorageAdviser::PreferMemory)) {
+        allocated = cache->allocateInMemory();
+        if (!allocated && !(rec & StorageAdviser::UseMemory)) {
+            allocated = cache->allocateOnDisc();
+        }
+    } else {
+        allocated = cache->allocateOnDisc();
+        if (!allocated && !(rec & StorageAdviser::UseDisc)) {
+            allocated = cache->allocateInMemory();
+        }
+    }
+
+    if (!allocated) {
+        SVDEBUG << "FFTColumnCache::getInstance: failed to allocate "
+                << kb << "K cache, not caching" << endl;
+        return {};
+    }
+
+#ifdef DEBUG_FFT_COLUMN_CACHE
+    SVCERR << "FFTColumnCache::getInstance: created cache for model "
+           << key.model << " (" << width << " columns, " << kb << "K, "
+           << (cache->isOnDisc() ? "on disc" : "in memory") << ")" << endl;
+#endif
+
+    instances[key] = cache;
+    return cache;
+}
+
+FFTColumnCache::FFTColumnCache(const Key &key, int width, int height) :
+    m_key(key),
+    m_width(width),
+    m_height(height),
+    m_data(nullptr),
+    m_file(nullptr),
+    m_sequence(new std::atomic<uint32_t>[width])
+{
+    for (int i = 0; i < m_width; ++i) {
+        m_sequence[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+FFTColumnCache::~FFTColumnCache()
+{
+    if (m_file) {
+        if (m_data) {
+            m_file->unmap(reinterpret_cast<uchar *>(m_data));
+        }
+        QString name = m_file->fileName();
+        m_file->close();
+        if (!m_file->remove()) {
+            SVDEBUG << "WARNING: FFTColumnCache::~FFTColumnCache: Failed to delete cache file \"" << name << "\"" << endl;
+        }
+        delete m_file;
+        StorageAdviser::notifyDoneAllocation
+            (StorageAdviser::DiscAllocation, getSizeKB());
+    } else if (m_data) {
+        delete[] m_data;
+        StorageAdviser::notifyDoneAllocation
+            (StorageAdviser::MemoryAllocation, getSizeKB());
+    }
+
+    delete[] m_sequence;
+}
+
+size_t
+FFTColumnCache::getSizeKB() const
+{
+    return (size_t(m_width) * size_t(m_height) * 2 * sizeof(float)) / 1024;
+}
+
+bool
+FFTColumnCache::allocateInMemory()
+{
+    try {
+        m_data = new float[size_t(m_width) * size_t(m_height) * 2];
+    } catch (const std::bad_alloc &) {
+        SVDEBUG << "FFTColumnCache::allocateInMemory: Caught bad_alloc"
+                << endl;
+        m_data = nullptr;
+        return false;
+    }
+    StorageAdviser::notifyPlannedAllocation
+        (StorageAdviser::MemoryAllocation, getSizeKB());
+    return true;
+}
+
+bool
+FFTColumnCache::allocateOnDisc()
+{
+    QString fileName;
+    try {
+        QDir dir(TempDirectory::getInstance()->getSubDirectoryPath("fft"));
+        fileName = dir.filePath(QString("fft_%1.dat").arg((intptr_t)this));
+    } catch (const DirectoryCreationFailed &) {
+        SVDEBUG << "FFTColumnCache::allocateOnDisc: failed to create temporary directory" << endl;
+        return false;
+    }
+
+    qint64 bytes = qint64(m_width) * m_height * 2 * qint64(sizeof(float));
+
+    QFile *file = new QFile(fileName);
+    if (!file->open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+        !file->resize(bytes)) {
+        SVDEBUG << "FFTColumnCache::allocateOnDisc: failed to create cache file \"" << fileName << "\" of " << bytes << " bytes: " << file->errorString() << endl;
+        file->close();
+        file->remove();
+        delete file;
+        return false;
+    }
+
+    uchar *mapped = file->map(0, bytes);
+    if (!mapped) {
+        SVDEBUG << "FFTColumnCache::allocateOnDisc: failed to map cache file \"" << fileName << "\": " << file->errorString() << endl;
+        file->close();
+        file->remove();
+        delete file;
+        return false;
+    }
+
+    m_file = file;
+    m_data = reinterpret_cast<float *>(mapped);
+    StorageAdviser::notifyPlannedAllocation
+        (StorageAdviser::DiscAllocation, getSizeKB());
+    return true;
+}
+
+uint32_t
+FFTColumnCache::beginRead(int x) const
+{
+    if (x < 0 || x >= m_width) return 0;
+    uint32_t sequence = m_sequence[x].load(std::memory_order_acquire);
+    return (sequence & 1) ? sequence : 0;
+}
+
+bool
+FFTColumnCache::endRead(int x, uint32_t sequence) const
+{
+    // Order the reads of the column before the second read of its
+    // sequence number. If the column was invalidated, and perhaps
+    // rewritten, while we were reading it, the number will differ
+    atomic_thread_fence(std::memory_order_acquire);
+    return m_sequence[x].load(std::memory_order_relaxed) == sequence;
+}
+
+bool
+FFTColumnCache::getMagnitudesAt(int x, float *values,
+                                int minbin, int count) const
+{
+    if (minbin < 0 || count < 0 || count > m_height - minbin) return false;
+    uint32_t sequence = beginRead(x);
+    if (!sequence) return false;
+    const float *data = getColumnData(x) + minbin * 2;
+    for (int i = 0; i < count; ++i) {
+        double re = data[i * 2], im = data[i * 2 + 1];
+        values[i] = float(sqrt(re * re + im * im));
+    }
+    return endRead(x, sequence);
+}
+
+bool
+FFTColumnCache::getPhasesAt(int x, float *values,
+                            int minbin, int count) const
+{
+    if (minbin < 0 || count < 0 || count > m_height - minbin) return false;
+    uint32_t sequence = beginRead(x);
+    if (!sequence) return false;
+    const float *data = getColumnData(x) + minbin * 2;
+    for (int i = 0; i < count; ++i) {
+        values[i] = float(atan2(double(data[i * 2 + 1]), double(data[i * 2])));
+    }
+    return endRead(x, sequence);
+}
+
+bool
+FFTColumnCache::getValuesAt(int x, complex<double> *values, int count) const
+{
+    if (count < 0 || count > m_height) return false;
+    uint32_t sequence = beginRead(x);
+    if (!sequence) return false;
+    const float *data = getColumnData(x);
+    for (int i = 0; i < count; ++i) {
+        values[i] = complex<double>(data[i * 2], data[i * 2 + 1]);
+    }
+    return endRead(x, sequence);
+}
+
+void
+FFTColumnCache::setColumnAt(int x, const complex<double> *values,
+                            uint32_t sequence)
+{
+    if (x < 0 || x >= m_width) return;
+
+    QMutexLocker locker(&m_writeMutex);
+
+    if (sequence & 1) {
+        // it was already present when our caller started
+        return;
+    }
+    
+    if (m_sequence[x].load(std::memory_order_relaxed) != sequence) {
+        // another FFTModel got here first, or the column has been
+        // invalidated since our caller started calculating it, from
+        // source data that may already have changed
+        return;
+    }
+
+    // The sequence number was changed when the column was
+    // invalidated. Keep our writes to the column after that change,
+    // so that a reader that sees any of them also sees the change
+    atomic_thread_fence(std::memory_order_release);
+
+    float *data = getColumnData(x);
+    for (int i = 0; i < m_height; ++i) {
+        data[i * 2] = float(values[i].real());
+        data[i * 2 + 1] = float(values[i].imag());
+    }
+
+    m_sequence[x].store(sequence + 1, std::memory_order_release);
+}
+
+void
+FFTColumnCache::invalidate()
+{
+    invalidate(0, m_width - 1);
+}
+
+void
+FFTColumnCache::invalidate(int x0, int x1)
+{
+    if (x0 < 0) x0 = 0;
+    if (x1 >= m_width) x1 = m_width - 1;
+    
+    QMutexLocker locker(&m_writeMutex);
+
+    for (int i = x0; i <= x1; ++i) {
+        // A valid column becomes invalid; an invalid one stays so,
+        // but with a new number, so that any calculation of it
+        // already under way is not stored
+        uint32_t sequence = m_sequence[i].load(std::memory_order_relaxed);
+        m_sequence[i].store(sequence + ((sequence & 1) ? 1 : 2),
+                            std::memory_order_release);
+    }
+}
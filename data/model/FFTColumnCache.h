@@ -0,0 +1,188 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_FFT_COLUMN_CACHE_H
+#define SV_FFT_COLUMN_CACHE_H
+
+#include "Model.h"
+
+#include "base/Window.h"
+
+#include <QMutex>
+#include <QFile>
+
+#include <atomic>
+#include <complex>
+#include <memory>
+#include <cstdint>
+
+/**
+ * A large, optional cache of complex FFT columns for FFTModel,
+ * holding one slot for every column of the model. Values are stored
+ * as single-precision real and imaginary parts, so a column read
+ * back has the same values, to float precision, as one calculated
+ * afresh; magnitudes and phases are calculated from them on reading. The
+ * storage is either a block of memory or a memory-mapped temporary
+ * file in the TempDirectory, as advised by the StorageAdviser.
+ *
+ * Caches are shared: all FFTModels constructed with the same source
+ * model, channel, window type, window size, window increment and FFT
+ * size obtain the same cache from getInstance(), so that a column
+ * requested by several layers or transforms is calculated only
+ * once. The cache is released when the last FFTModel using it goes
+ * away.
+ *
+ * Reading from the cache does not lock. Each column has a sequence
+ * number, which is odd while the column is valid and changes
+ * whenever it is written or invalidated. A writer obtains the number
+ * with getSequence before calculating the column, and passes it to
+ * setColumnAt, which drops the column if it has changed since, so a
+ * column calculated from source data that has since been replaced is
+ * never stored. Writing a column takes a mutex and publishes the
+ * column only once its values are complete.
+ * A reader checks the sequence number again after copying a column,
+ * and reports the column as absent if it has changed in the
+ * meantime, so a reader never sees a column that has been
+ * invalidated and partly rewritten under it.
+ */
+class FFTColumnCache
+{
+public:
+    struct Key {
+        ModelId model;
+        int channel;
+        WindowType windowType;
+        int windowSize;
+        int windowIncrement;
+        int fftSize;
+
+        bool operator<(const Key &k) const {
+            if (model != k.model) return model < k.model;
+            if (channel != k.channel) return channel < k.channel;
+            if (windowType != k.windowType) return windowType < k.windowType;
+            if (windowSize != k.windowSize) return windowSize < k.windowSize;
+            if (windowIncrement != k.windowIncrement) {
+                return windowIncrement < k.windowIncrement;
+            }
+            return fftSize < k.fftSize;
+        }
+    };
+
+    /**
+     * Return the shared cache for the given key, creating it with
+     * room for the given number of columns if it does not already
+     * exist. Return a null pointer if the StorageAdviser reports that
+     * there is nowhere to put a cache of this size, or if the
+     * storage could not be allocated.
+     */
+    static std::shared_ptr<FFTColumnCache> getInstance(const Key &key,
+                                                       int width);
+
+    ~FFTColumnCache();
+
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+
+    bool isOnDisc() const { return m_file != nullptr; }
+
+    bool haveColumn(int x) const {
+        if (x < 0 || x >= m_width) return false;
+        return (m_sequence[x].load(std::memory_order_acquire) & 1) != 0;
+    }
+
+    /**
+     * Retrieve magnitudes for count bins of the given column,
+     * starting at minbin. Return false if the column is not in the
+     * cache or the bins are not all within its height.
+     */
+    bool getMagnitudesAt(int x, float *values, int minbin, int count) const;
+
+    /**
+     * Retrieve phases for count bins of the given column, starting
+     * at minbin. Return false if the column is not in the cache or
+     * the bins are not all within its height.
+     */
+    bool getPhasesAt(int x, float *values, int minbin, int count) const;
+
+    /**
+     * Retrieve the first count complex bin values for the given
+     * column. Return false if the column is not in the cache or count
+     * is negative or greater than its height.
+     */
+    bool getValuesAt(int x, std::complex<double> *values, int count) const;
+
+    /**
+     * Return the sequence number of the given column, to be passed
+     * to setColumnAt with the column calculated after this call.
+     */
+    uint32_t getSequence(int x) const {
+        if (x < 0 || x >= m_width) return 0;
+        return m_sequence[x].load(std::memory_order_acquire);
+    }
+
+    /**
+     * Store a column of complex bin values. The values array must
+     * contain getHeight() elements. The column is not stored if it is
+     * outside the cache's width, if it is already present, or if it
+     * has been invalidated (or written) since getSequence returned
+     * the given sequence number.
+     */
+    void setColumnAt(int x, const std::complex<double> *values,
+                     uint32_t sequence);
+
+    /**
+     * Mark all columns as absent, for example because the source
+     * model has changed.
+     */
+    void invalidate();
+
+    /**
+     * Mark the columns from x0 to x1 inclusive as absent.
+     */
+    void invalidate(int x0, int x1);
+
+private:
+    FFTColumnCache(const Key &key, int width, int height);
+    FFTColumnCache(const FFTColumnCache &) =delete;
+    FFTColumnCache &operator=(const FFTColumnCache &) =delete;
+
+    bool allocateInMemory();
+    bool allocateOnDisc();
+
+    size_t getSizeKB() const;
+
+    // Return the column's sequence number if it is valid, or 0
+    uint32_t beginRead(int x) const;
+
+    // Return true if the column has not changed since beginRead
+    // returned the given sequence number
+    bool endRead(int x, uint32_t sequence) const;
+
+    const float *getColumnData(int x) const {
+        return m_data + size_t(x) * m_height * 2;
+    }
+    float *getColumnData(int x) {
+        return m_data + size_t(x) * m_height * 2;
+    }
+
+    Key m_key;
+    int m_width;
+    int m_height;
+    float *m_data; // width * height * [real, imaginary]
+    QFile *m_file;
+    std::atomic<uint32_t> *m_sequence; // odd if column is valid
+    QMutex m_writeMutex;
+};
+
+#endif
@@ -31,6 +31,11 @@ using namespace std;
 
 static HitCount inSmallCache("FFTModel: Small FFT cache");
 static HitCount inSourceCache("FFTModel: Source data cache");
+static HitCount inColumnCache("FFTModel: Shared column cache");
+
+// Minimum extent of source data to ask the model to read ahead of
+// the columns being calculated
+static const sv_frame_t sourcePrefetchFrames = 65536;
 
 FFTModel::FFTModel(ModelId modelId,
                    int channel,
@@ -49,7 +54,9 @@ FFTModel::FFTModel(ModelId modelId,
     m_fft(fftSize),
     m_maximumFrequency(0.0),
     m_cacheWriteIndex(0),
-    m_cacheSize(3)
+    m_cacheSize(3),
+    m_columnCacheEnabled(false),
+    m_columnCacheFailed(false)
 {
     clearCaches();
     
@@ -70,6 +77,11 @@ FFTModel::FFTModel(ModelId modelId,
                 this, SIGNAL(modelChanged(ModelId)));
         connect(model.get(), SIGNAL(modelChangedWithin(ModelId, sv_frame_t, sv_frame_t)),
                 this, SIGNAL(modelChangedWithin(ModelId, sv_frame_t, sv_frame_t)));
+
+        connect(model.get(), SIGNAL(modelChanged(ModelId)),
+                this, SLOT(sourceModelChanged()));
+        connect(model.get(), SIGNAL(modelChangedWithin(ModelId, sv_frame_t, sv_frame_t)),
+                this, SLOT(sourceModelChangedWithin(ModelId, sv_frame_t, sv_frame_t)));
     } else {
         m_error = QString("Model #%1 is not available").arg(m_model.untyped);
     }
@@ -123,6 +135,79 @@ FFTModel::setMaximumFrequency(double freq)
     clearCaches();
 }
 
+void
+FFTModel::setColumnCacheEnabled(bool enabled)
+{
+    m_columnCacheEnabled = enabled;
+    if (!enabled) {
+        m_columnCache.reset();
+    }
+    m_columnCacheFailed = false;
+}
+
+void
+FFTModel::sourceModelChanged()
+{
+    // Columns calculated before the change may now be wrong, both
+    // for us and for anyone else sharing the column cache
+    if (m_columnCache) {
+        m_columnCache->invalidate();
+    }
+    clearCaches();
+}
+
+void
+FFTModel::sourceModelChangedWithin(ModelId, sv_frame_t start, sv_frame_t end)
+{
+    // Only the columns whose windows overlap the change need to go
+    if (m_columnCache) {
+        sv_frame_t half = m_windowSize / 2;
+        sv_frame_t x0 = (start - half) / m_windowIncrement - 1;
+        sv_frame_t x1 = (end + half) / m_windowIncrement + 1;
+        if (x0 < m_columnCache->getWidth() && x1 >= 0) {
+            m_columnCache->invalidate
+                (int(max(x0, sv_frame_t(0))),
+                 int(min(x1, sv_frame_t(m_columnCache->getWidth()))));
+        }
+    }
+    clearCaches();
+}
+
+bool
+FFTModel::sharesColumnCacheWith(const FFTModel &other) const
+{
+    FFTColumnCache *cache = getColumnCache();
+    return cache && cache == other.getColumnCache();
+}
+
+FFTColumnCache *
+FFTModel::getColumnCache() const
+{
+    if (m_columnCache) return m_columnCache.get();
+    if (!m_columnCacheEnabled || m_columnCacheFailed) return nullptr;
+    
+    auto model = ModelById::getAs<DenseTimeValueModel>(m_model);
+    if (!model || !model->isReady()) {
+        // Don't cache columns calculated from a source that is still
+        // being loaded; we'll try again next time
+        return nullptr;
+    }
+
+    int width = int((model->getEndFrame() - model->getStartFrame())
+                    / m_windowIncrement) + 1;
+    
+    m_columnCache = FFTColumnCache::getInstance
+        ({ m_model, m_channel, m_windowType,
+           m_windowSize, m_windowIncrement, m_fftSize },
+         width);
+
+    if (!m_columnCache) {
+        m_columnCacheFailed = true;
+    }
+    
+    return m_columnCache.get();
+}
+
 int
 FFTModel::getWidth() const
 {
@@ -160,6 +245,15 @@ FFTModel::getBinValue(int n) const
 FFTModel::Column
 FFTModel::getColumn(int x) const
 {
+    FFTColumnCache *columnCache = getColumnCache();
+    if (columnCache && columnCache->haveColumn(x)) {
+        Column col(getHeight());
+        if (columnCache->getMagnitudesAt(x, col.data(), 0, int(col.size()))) {
+            inColumnCache.hit();
+            return col;
+        }
+    }
+    
     auto cplx = getFFTColumn(x);
     Column col;
     col.reserve(cplx.size());
@@ -170,6 +264,15 @@ FFTModel::getColumn(int x) const
 FFTModel::Column
 FFTModel::getPhases(int x) const
 {
+    FFTColumnCache *columnCache = getColumnCache();
+    if (columnCache && columnCache->haveColumn(x)) {
+        Column col(getHeight());
+        if (columnCache->getPhasesAt(x, col.data(), 0, int(col.size()))) {
+            inColumnCache.hit();
+            return col;
+        }
+    }
+    
     auto cplx = getFFTColumn(x);
     Column col;
     col.reserve(cplx.size());
@@ -227,6 +330,14 @@ FFTModel::getMagnitudesAt(int x, float *values, int minbin, int count) const
     if (count == 0) {
         count = getHeight() - minbin;
     }
+    if (minbin < 0 || count < 0 || count > getHeight() - minbin) {
+        return false;
+    }
+    FFTColumnCache *columnCache = getColumnCache();
+    if (columnCache && columnCache->getMagnitudesAt(x, values, minbin, count)) {
+        inColumnCache.hit();
+        return true;
+    }
     auto col = getFFTColumn(x);
     for (int i = 0; i < count; ++i) {
         values[i] = abs(col[minbin + i]);
@@ -237,7 +348,17 @@ FFTModel::getMagnitudesAt(int x, float *values, int minbin, int count) const
 bool
 FFTModel::getPhasesAt(int x, float *values, int minbin, int count) const
 {
-    if (count == 0) count = getHeight();
+    if (count == 0) {
+        count = getHeight() - minbin;
+    }
+    if (minbin < 0 || count < 0 || count > getHeight() - minbin) {
+        return false;
+    }
+    FFTColumnCache *columnCache = getColumnCache();
+    if (columnCache && columnCache->getPhasesAt(x, values, minbin, count)) {
+        inColumnCache.hit();
+        return true;
+    }
     auto col = getFFTColumn(x);
     for (int i = 0; i < count; ++i) {
         values[i] = arg(col[minbin + i]);
@@ -248,7 +369,12 @@ FFTModel::getPhasesAt(int x, float *values, int minbin, int count) const
 bool
 FFTModel::getValuesAt(int x, float *reals, float *imags, int minbin, int count) const
 {
-    if (count == 0) count = getHeight();
+    if (count == 0) {
+        count = getHeight() - minbin;
+    }
+    if (minbin < 0 || count < 0 || count > getHeight() - minbin) {
+        return false;
+    }
     auto col = getFFTColumn(x);
     for (int i = 0; i < count; ++i) {
         reals[i] = col[minbin + i].real();
@@ -259,6 +385,21 @@ FFTModel::getValuesAt(int x, float *reals, float *imags, int minbin, int count)
     return true;
 }
 
+bool
+FFTModel::getInterleavedValuesAt(int x, float *values) const
+{
+    if (x < 0 || x >= getWidth()) {
+        return false;
+    }
+    const auto &col = getFFTColumn(x);
+    int count = getHeight();
+    for (int i = 0; i < count; ++i) {
+        values[i*2] = float(col[i].real());
+        values[i*2+1] = float(col[i].imag());
+    }
+    return true;
+}
+
 floatvec_t
 FFTModel::getSourceSamples(int column) const
 {
@@ -317,6 +458,8 @@ FFTModel::getSourceData(pair<sv_frame_t, sv_frame_t> range) const
             ({ m_savedData.range.second, range.second });
 
         data.insert(data.end(), rest.begin(), rest.end());
+
+        prefetchSourceData(range, true);
         
         m_savedData = { range, data };
         return data;
@@ -326,11 +469,32 @@ FFTModel::getSourceData(pair<sv_frame_t, sv_frame_t> range) const
         inSourceCache.miss();
         
         auto data = getSourceDataUncached(range);
+        prefetchSourceData(range, range.first >= m_savedData.range.first);
         m_savedData = { range, data };
         return data;
     }
 }
 
+void
+FFTModel::prefetchSourceData(pair<sv_frame_t, sv_frame_t> range,
+                             bool forward) const
+{
+    // Columns are usually calculated in order, in one direction or
+    // the other, so let the model start reading what the next ones
+    // will need in case it has to come from slow storage
+
+    auto model = ModelById::getAs<DenseTimeValueModel>(m_model);
+    if (!model) return;
+
+    sv_frame_t extent = std::max(sv_frame_t(m_windowSize) * 8,
+                                 sourcePrefetchFrames);
+    if (forward) {
+        model->prefetchData(range.second, extent);
+    } else {
+        model->prefetchData(range.first - extent, extent);
+    }
+}
+
 floatvec_t
 FFTModel::getSourceDataUncached(pair<sv_frame_t, sv_frame_t> range) const
 {
@@ -345,24 +509,16 @@ FFTModel::getSourceDataUncached(pair<sv_frame_t, sv_frame_t> range) const
         range = { 0, range.second };
     }
 
-    auto data = model->getData(m_channel,
-                               range.first,
-                               range.second - range.first);
-/*
-    if (data.empty()) {
-        SVDEBUG << "NOTE: empty source data for range (" << range.first << ","
-                << range.second << ") (model end frame "
-                << model->getEndFrame() << ")" << endl;
-    }
-*/
+    // Anything not filled in by the model (the prefix before the
+    // start of the model, or beyond its end) is left as zeros, so
+    // that we never return a partial frame
     
-    // don't return a partial frame
-    data.resize(range.second - range.first, 0.f);
-
-    if (pfx > 0) {
-        vector<float> pad(pfx, 0.f);
-        data.insert(data.begin(), pad.begin(), pad.end());
-    }
+    floatvec_t data(pfx + range.second - range.first, 0.f);
+    
+    model->getData(m_channel,
+                   range.first,
+                   range.second - range.first,
+                   data.data() + pfx);
     
     if (m_channel == -1) {
         int channels = model->getChannelCount();
@@ -396,27 +552,54 @@ FFTModel::getFFTColumn(int n) const
     }
     inSmallCache.miss();
 
-    Profiler profiler("FFTModel::getFFTColumn (cache miss)");
-    
-    auto fsamples = getSourceSamples(n);
+    doublecomplexvec_t &col = m_cached[m_cacheWriteIndex].col;
+
+    // expand to large enough for fft destination, if truncated previously
+    col.resize(m_fftSize / 2 + 1);
+
+    // The shared column cache (if we have one) is the large one,
+    // with room for every column, shared with other FFTModels
+    // having the same source and parameters
+    FFTColumnCache *columnCache = getColumnCache();
 
-    // Ensure that windowing and FFT happen in double precision
-    vector<double> samples;
-    samples.reserve(fsamples.size());
-    for (int i = 0; in_range_for(fsamples, i); ++i) {
-        samples.push_back(fsamples[i]);
+    // Taken before we read any source data, so that if the column is
+    // invalidated while we calculate it, what we calculate is not
+    // stored
+    uint32_t sequence = 0;
+    if (columnCache) {
+        sequence = columnCache->getSequence(n);
     }
     
-    m_windower.cut(samples.data() + (m_fftSize - m_windowSize) / 2);
-    breakfastquay::v_fftshift(samples.data(), m_fftSize);
+    if (columnCache &&
+        columnCache->getValuesAt(n, col.data(), int(col.size()))) {
 
-    doublecomplexvec_t &col = m_cached[m_cacheWriteIndex].col;
+        inColumnCache.hit();
 
-    // expand to large enough for fft destination, if truncated previously
-    col.resize(m_fftSize / 2 + 1);
+    } else {
+
+        if (columnCache) inColumnCache.miss();
+        
+        Profiler profiler("FFTModel::getFFTColumn (cache miss)");
+    
+        auto fsamples = getSourceSamples(n);
 
-    m_fft.forwardInterleaved(samples.data(),
-                             reinterpret_cast<double *>(col.data()));
+        // Ensure that windowing and FFT happen in double precision
+        vector<double> samples;
+        samples.reserve(fsamples.size());
+        for (int i = 0; in_range_for(fsamples, i); ++i) {
+            samples.push_back(fsamples[i]);
+        }
+    
+        m_windower.cut(samples.data() + (m_fftSize - m_windowSize) / 2);
+        breakfastquay::v_fftshift(samples.data(), m_fftSize);
+
+        m_fft.forwardInterleaved(samples.data(),
+                                 reinterpret_cast<double *>(col.data()));
+
+        if (columnCache) {
+            columnCache->setColumnAt(n, col.data(), sequence);
+        }
+    }
 
     // keep only the number of elements we need - so that we can
     // return a const ref without having to resize on a cache hit
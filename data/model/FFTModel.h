@@ -18,6 +18,7 @@
 
 #include "DenseThreeDimensionalModel.h"
 #include "DenseTimeValueModel.h"
+#include "FFTColumnCache.h"
 
 #include "base/Window.h"
 
@@ -125,6 +126,27 @@ public:
     void setMaximumFrequency(double freq);
     double getMaximumFrequency() const { return m_maximumFrequency; }
 
+    /**
+     * Specify whether to use a large cache of magnitude and phase
+     * columns, shared with any other FFTModel that has the same
+     * source model and FFT parameters (see FFTColumnCache). The
+     * cache is not used by default, as it has room for every column
+     * of the model: enable it only for models whose columns will be
+     * read repeatedly or by more than one user, such as those behind
+     * a spectrogram view. FeatureExtractionModelTransformer enables
+     * it for the models it creates. It is only created once the
+     * source model is ready, and only if the StorageAdviser finds
+     * room for it.
+     */
+    void setColumnCacheEnabled(bool enabled);
+    bool isColumnCacheEnabled() const { return m_columnCacheEnabled; }
+
+    /**
+     * Return true if this model and the other are both using a
+     * column cache and it is the same one.
+     */
+    bool sharesColumnCacheWith(const FFTModel &other) const;
+
 //!!! review which of these are ever actually called
     
     float getMagnitudeAt(int x, int y) const;
@@ -136,6 +158,14 @@ public:
     bool getPhasesAt(int x, float *values, int minbin = 0, int count = 0) const;
     bool getValuesAt(int x, float *reals, float *imaginaries, int minbin = 0, int count = 0) const;
 
+    /**
+     * Retrieve the complete column x as interleaved real and
+     * imaginary values, i.e. in the layout expected by the input of a
+     * frequency-domain Vamp plugin. The values array must have room
+     * for getHeight() * 2 floats. Return false if x is out of range.
+     */
+    bool getInterleavedValuesAt(int x, float *values) const;
+
     /**
      * Calculate an estimated frequency for a stable signal in this
      * bin, using phase unwrapping.  This will be completely wrong if
@@ -168,6 +198,10 @@ public:
 
     QString getTypeName() const override { return tr("FFT"); }
 
+private slots:
+    void sourceModelChanged();
+    void sourceModelChangedWithin(ModelId, sv_frame_t, sv_frame_t);
+
 private:
     FFTModel(const FFTModel &) =delete;
     FFTModel &operator=(const FFTModel &) =delete;
@@ -201,6 +235,7 @@ private:
     floatvec_t getSourceSamples(int column) const;
     floatvec_t getSourceData(std::pair<sv_frame_t, sv_frame_t>) const;
     floatvec_t getSourceDataUncached(std::pair<sv_frame_t, sv_frame_t>) const;
+    void prefetchSourceData(std::pair<sv_frame_t, sv_frame_t>, bool forward) const;
 
     struct SavedSourceData {
         std::pair<sv_frame_t, sv_frame_t> range;
@@ -216,6 +251,11 @@ private:
     mutable size_t m_cacheWriteIndex;
     size_t m_cacheSize;
 
+    bool m_columnCacheEnabled;
+    mutable bool m_columnCacheFailed;
+    mutable std::shared_ptr<FFTColumnCache> m_columnCache;
+    FFTColumnCache *getColumnCache() const;
+
     void clearCaches();
 };
 
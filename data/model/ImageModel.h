@@ -20,6 +20,7 @@
 #include "TabularModel.h"
 #include "Model.h"
 #include "DeferredNotifier.h"
+#include "SparseModelEdits.h"
 
 #include "base/EventSeries.h"
 #include "base/XmlExportable.h"
@@ -150,6 +151,29 @@ public:
                                 e.getFrame(), e.getFrame() + m_resolution);
     }
 
+    void addEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        EventVector stripped;
+        stripped.reserve(ee.size());
+        for (const auto &e: ee) {
+            stripped.push_back(e.withoutDuration().withoutValue().withoutLevel());
+        }
+        m_events.addEvents(stripped);
+
+        SparseModelEdits::notifyEventsAdded
+            (this, m_notifier, stripped, m_resolution, false);
+    }
+
+    void removeEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        m_events.removeEvents(ee);
+        SparseModelEdits::notifyEventsRemoved(this, ee, m_resolution);
+    }
+
     /**
      * TabularModel methods.  
      */
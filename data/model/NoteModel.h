@@ -19,6 +19,7 @@
 #include "TabularModel.h"
 #include "EventCommands.h"
 #include "DeferredNotifier.h"
+#include "SparseModelEdits.h"
 #include "base/UnitDatabase.h"
 #include "base/EventSeries.h"
 #include "base/NoteData.h"
@@ -235,6 +236,27 @@ public:
                                 e.getFrame() + e.getDuration() + m_resolution);
     }
 
+    void addEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        m_events.addEvents(ee);
+
+        bool allChange = SparseModelEdits::extendValueExtents
+            (ee, m_haveExtents, m_valueMinimum, m_valueMaximum);
+        
+        SparseModelEdits::notifyEventsAdded
+            (this, m_notifier, ee, m_resolution, allChange);
+    }
+
+    void removeEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        m_events.removeEvents(ee);
+        SparseModelEdits::notifyEventsRemoved(this, ee, m_resolution);
+    }
+
     /**
      * TabularModel methods.  
      */
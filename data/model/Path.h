@@ -18,6 +18,7 @@
 #include "base/XmlExportable.h"
 #include "base/RealTime.h"
 #include "base/BaseTypes.h"
+#include "base/NumberFormat.h"
 
 #include <QStringList>
 #include <set>
@@ -47,7 +48,7 @@ struct PathPoint
                                   sv_samplerate_t sampleRate) const {
         QStringList list;
         list << RealTime::frame2RealTime(frame, sampleRate).toString().c_str();
-        list << QString("%1").arg(mapframe);
+        list << NumberFormat::fromInteger(mapframe);
         return list.join(delimiter);
     }
 
@@ -150,10 +151,10 @@ public:
         for (PathPoint p: m_points) {
             if (p.frame < startFrame) continue;
             if (p.frame >= startFrame + duration) break;
-            s += QString("%1%2%3\n")
-                .arg(p.frame)
-                .arg(delimiter)
-                .arg(p.mapframe);
+            NumberFormat::appendInteger(s, p.frame);
+            s += delimiter;
+            NumberFormat::appendInteger(s, p.mapframe);
+            s += '\n';
         }
 
         return s;
@@ -0,0 +1,308 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "RangeSummaryFile.h"
+
+#include "base/TempDirectory.h"
+#include "base/TempWriteFile.h"
+#include "base/Exceptions.h"
+#include "base/Profiler.h"
+#include "base/Debug.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QCryptographicHash>
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+//#define DEBUG_RANGE_SUMMARY_FILE 1
+
+using namespace std;
+
+static const char summaryMagic[8] = { 'S', 'V', 'R', 'S', 'U', 'M', 'M', '\0' };
+
+// Bump this whenever the layout changes or the way in which the
+// summaries are calculated changes
+static const uint32_t summaryVersion = 1;
+
+struct RangeSummaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    int32_t channels;
+    int32_t blockSize[2];
+    int32_t reserved;
+    int64_t frameCount;
+    int64_t count[2];
+};
+
+static_assert(sizeof(RangeSummaryHeader) == 56,
+              "RangeSummaryHeader should have no unexpected padding");
+
+// Total size of summary files to keep
+static const qint64 maxSummaryDirectorySize = 512LL * 1024 * 1024;
+
+QString
+RangeSummaryFile::getSummaryDirectory()
+{
+    QDir dir = TempDirectory::getInstance()->getContainingPath();
+
+    QString summaryDirName("summaries");
+
+    QFileInfo fi(dir.filePath(summaryDirName));
+
+    if ((fi.exists() && !fi.isDir()) ||
+        (!fi.exists() && !dir.mkdir(summaryDirName))) {
+
+        throw DirectoryCreationFailed(fi.filePath());
+    }
+
+    return fi.filePath();
+}
+
+void
+RangeSummaryFile::cleanupSummaryDirectory(qint64 maxBytes)
+{
+    QString dirPath;
+    try {
+        dirPath = getSummaryDirectory();
+    } catch (const DirectoryCreationFailed &) {
+        return;
+    }
+
+    // Most recently modified first. A summary file's modification
+    // time is updated whenever it is loaded, where possible
+    QDir dir(dirPath);
+    QFileInfoList files = dir.entryInfoList
+        (QStringList() << "*.summary", QDir::Files, QDir::Time);
+
+    qint64 total = 0;
+    for (const auto &fi: files) {
+        total += fi.size();
+        if (total <= maxBytes) continue;
+        // This may fail if the file is in use elsewhere, in which
+        // case it will be tried again next time
+        QFile::remove(fi.filePath());
+    }
+}
+
+RangeSummaryFile::RangeSummaryFile(QString audioFilePath,
+                                   sv_samplerate_t targetRate,
+                                   QString readerOptions) :
+    m_audioPath(audioFilePath)
+{
+    QFileInfo fi(audioFilePath);
+    if (audioFilePath == "" || !fi.exists() || !fi.isFile()) {
+        return;
+    }
+
+    QString key = QString("%1|%2|%3|%4|%5")
+        .arg(fi.canonicalFilePath())
+        .arg(fi.size())
+        .arg(fi.lastModified().toMSecsSinceEpoch())
+        .arg(targetRate)
+        .arg(readerOptions);
+
+    QString hash = QString::fromLocal8Bit
+        (QCryptographicHash::hash(key.toUtf8(),
+                                  QCryptographicHash::Sha1).toHex());
+
+    try {
+        QDir dir(getSummaryDirectory());
+        m_summaryPath = dir.filePath(hash + ".summary");
+    } catch (const DirectoryCreationFailed &f) {
+        SVDEBUG << "RangeSummaryFile: failed to create summary directory: "
+                << f.what() << endl;
+    }
+
+#ifdef DEBUG_RANGE_SUMMARY_FILE
+    SVCERR << "RangeSummaryFile: key \"" << key << "\" -> \""
+           << m_summaryPath << "\"" << endl;
+#endif
+}
+
+bool
+RangeSummaryFile::load(int channels,
+                       const sv_frame_t blockSizes[2],
+                       RangeBlock caches[2],
+                       sv_frame_t &frameCount) const
+{
+    if (!isValid()) return false;
+
+    Profiler profiler("RangeSummaryFile::load");
+
+    QFile file(m_summaryPath);
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    qint64 size = file.size();
+    if (size < qint64(sizeof(RangeSummaryHeader))) {
+        SVDEBUG << "RangeSummaryFile::load: file \"" << m_summaryPath
+                << "\" is too short" << endl;
+        return false;
+    }
+
+    uchar *mapped = file.map(0, size);
+    if (!mapped) {
+        SVDEBUG << "RangeSummaryFile::load: failed to map \""
+                << m_summaryPath << "\": " << file.errorString() << endl;
+        return false;
+    }
+
+    RangeSummaryHeader header;
+    memcpy(&header, mapped, sizeof(header));
+
+    bool ok = true;
+
+    if (memcmp(header.magic, summaryMagic, sizeof(summaryMagic)) ||
+        header.version != summaryVersion ||
+        header.headerSize != sizeof(RangeSummaryHeader)) {
+        SVDEBUG << "RangeSummaryFile::load: file \"" << m_summaryPath
+                << "\" has wrong magic, version or byte order" << endl;
+        ok = false;
+    } else if ((channels != 0 && header.channels != channels) ||
+               header.channels <= 0 ||
+               header.blockSize[0] != blockSizes[0] ||
+               header.blockSize[1] != blockSizes[1] ||
+               header.count[0] < 0 ||
+               header.count[1] < 0) {
+        SVDEBUG << "RangeSummaryFile::load: file \"" << m_summaryPath
+                << "\" does not match this model's summary layout" << endl;
+        ok = false;
+    } else if (qint64(sizeof(RangeSummaryHeader)) +
+               (header.count[0] + header.count[1]) * 3 * qint64(sizeof(float))
+               != size) {
+        SVDEBUG << "RangeSummaryFile::load: file \"" << m_summaryPath
+                << "\" is truncated" << endl;
+        ok = false;
+    }
+
+    if (ok) {
+        const float *data =
+            reinterpret_cast<const float *>(mapped + sizeof(RangeSummaryHeader));
+        for (int cacheType = 0; cacheType < 2; ++cacheType) {
+            RangeBlock &cache = caches[cacheType];
+            cache.clear();
+            cache.reserve(header.count[cacheType]);
+            for (int64_t i = 0; i < header.count[cacheType]; ++i) {
+                cache.push_back(Range(data[0], data[1], data[2]));
+                data += 3;
+            }
+        }
+        frameCount = header.frameCount;
+    }
+
+    file.unmap(mapped);
+
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+    if (ok) {
+        // Mark as recently used, so as to be the last to go when the
+        // directory is cleaned up. Failure doesn't matter
+        file.setFileTime(QDateTime::currentDateTimeUtc(),
+                         QFileDevice::FileModificationTime);
+    }
+#endif
+
+#ifdef DEBUG_RANGE_SUMMARY_FILE
+    SVCERR << "RangeSummaryFile::load: " << (ok ? "loaded" : "rejected")
+           << " \"" << m_summaryPath << "\"" << endl;
+#endif
+
+    return ok;
+}
+
+bool
+RangeSummaryFile::save(int channels,
+                       const sv_frame_t blockSizes[2],
+                       const RangeBlock caches[2],
+                       sv_frame_t frameCount) const
+{
+    if (!isValid()) return false;
+
+    Profiler profiler("RangeSummaryFile::save");
+
+    RangeSummaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, summaryMagic, sizeof(summaryMagic));
+    header.version = summaryVersion;
+    header.headerSize = sizeof(RangeSummaryHeader);
+    header.channels = channels;
+    header.blockSize[0] = int32_t(blockSizes[0]);
+    header.blockSize[1] = int32_t(blockSizes[1]);
+    header.frameCount = frameCount;
+    header.count[0] = int64_t(caches[0].size());
+    header.count[1] = int64_t(caches[1].size());
+
+    try {
+
+        TempWriteFile temp(m_summaryPath);
+
+        QFile file(temp.getTemporaryFilename());
+        if (!file.open(QIODevice::WriteOnly)) {
+            SVDEBUG << "RangeSummaryFile::save: failed to open \""
+                    << file.fileName() << "\" for writing" << endl;
+            return false;
+        }
+
+        bool ok = (file.write(reinterpret_cast<const char *>(&header),
+                              sizeof(header)) == qint64(sizeof(header)));
+
+        const int chunk = 65536;
+        vector<float> buffer;
+        buffer.reserve(chunk * 3);
+
+        for (int cacheType = 0; cacheType < 2 && ok; ++cacheType) {
+            const RangeBlock &cache = caches[cacheType];
+            size_t i = 0;
+            while (i < cache.size() && ok) {
+                buffer.clear();
+                for (int j = 0; j < chunk && i < cache.size(); ++j, ++i) {
+                    buffer.push_back(cache[i].min());
+                    buffer.push_back(cache[i].max());
+                    buffer.push_back(cache[i].absmean());
+                }
+                qint64 bytes = qint64(buffer.size() * sizeof(float));
+                ok = (file.write(reinterpret_cast<const char *>(buffer.data()),
+                                 bytes) == bytes);
+            }
+        }
+
+        file.close();
+
+        if (!ok) {
+            SVDEBUG << "RangeSummaryFile::save: failed to write \""
+                    << m_summaryPath << "\"" << endl;
+            return false;
+        }
+
+        temp.moveToTarget();
+
+    } catch (const FileOperationFailed &f) {
+        SVDEBUG << "RangeSummaryFile::save: " << f.what() << endl;
+        return false;
+    }
+
+    cleanupSummaryDirectory(maxSummaryDirectorySize);
+
+#ifdef DEBUG_RANGE_SUMMARY_FILE
+    SVCERR << "RangeSummaryFile::save: saved \"" << m_summaryPath << "\"" << endl;
+#endif
+
+    return true;
+}
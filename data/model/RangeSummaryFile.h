@@ -0,0 +1,110 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_RANGE_SUMMARY_FILE_H
+#define SV_RANGE_SUMMARY_FILE_H
+
+#include "RangeSummarisableTimeValueModel.h"
+
+#include <QString>
+
+/**
+ * A persistent file, kept in a subdirectory of the application's
+ * cache directory, containing the range summary caches calculated by
+ * ReadOnlyWaveFileModel for an audio file. When the same audio file
+ * is opened again, the summaries can be loaded from here instead of
+ * being calculated from the decoded audio.
+ *
+ * A summary file is identified by the path, size and modification
+ * time of the audio file, the target sample rate, and a string
+ * describing any other reader options that affect the decoded
+ * samples. If any of these change, the summary file will simply not
+ * be found.
+ *
+ * The file consists of a fixed-size header followed by the two
+ * caches, each stored as a flat array of min, max and absmean floats
+ * in native byte order, so that it can be memory-mapped and copied
+ * straight into place. A file written with a different format
+ * version or byte order is ignored.
+ *
+ * The summary directory is limited in size. Whenever a summary file
+ * is saved, the least recently used files are deleted until the rest
+ * fit within the limit.
+ */
+class RangeSummaryFile
+{
+public:
+    typedef RangeSummarisableTimeValueModel::Range Range;
+    typedef RangeSummarisableTimeValueModel::RangeBlock RangeBlock;
+
+    /**
+     * Identify the summary file for the given local audio file,
+     * target rate and reader options. The summary file need not
+     * exist.
+     */
+    RangeSummaryFile(QString audioFilePath,
+                     sv_samplerate_t targetRate,
+                     QString readerOptions);
+
+    /**
+     * Return true if the audio file could be found, so that a
+     * summary file can be loaded or saved for it.
+     */
+    bool isValid() const { return m_summaryPath != ""; }
+
+    /**
+     * Return the path of the summary file, whether or not it exists,
+     * or an empty string if the object is not valid.
+     */
+    QString getSummaryPath() const { return m_summaryPath; }
+
+    /**
+     * Load the summary caches. The block sizes must match those the
+     * file was saved with. If channels is non-zero, the channel
+     * count must also match. Return false if there is no usable
+     * summary file, leaving the caches untouched.
+     */
+    bool load(int channels,
+              const sv_frame_t blockSizes[2],
+              RangeBlock caches[2],
+              sv_frame_t &frameCount) const;
+
+    /**
+     * Save the summary caches, replacing any existing summary file
+     * for the same audio. Return false on failure.
+     */
+    bool save(int channels,
+              const sv_frame_t blockSizes[2],
+              const RangeBlock caches[2],
+              sv_frame_t frameCount) const;
+
+    /**
+     * Return the directory in which summary files are kept, creating
+     * it if necessary. Throw DirectoryCreationFailed if it cannot be
+     * created.
+     */
+    static QString getSummaryDirectory();
+
+    /**
+     * Delete the least recently loaded or saved summary files until
+     * those remaining total no more than maxBytes.
+     */
+    static void cleanupSummaryDirectory(qint64 maxBytes);
+
+private:
+    QString m_audioPath;
+    QString m_summaryPath;
+};
+
+#endif
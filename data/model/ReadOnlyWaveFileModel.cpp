@@ -14,9 +14,11 @@
 */
 
 #include "ReadOnlyWaveFileModel.h"
+#include "RangeSummaryFile.h"
 
 #include "fileio/AudioFileReader.h"
 #include "fileio/AudioFileReaderFactory.h"
+#include "fileio/AudioReadScheduler.h"
 
 #include "system/System.h"
 
@@ -45,7 +47,9 @@ ReadOnlyWaveFileModel::ReadOnlyWaveFileModel(FileSource source, sv_samplerate_t
     m_path(source.getLocation()),
     m_reader(nullptr),
     m_myReader(true),
+    m_readScheduler(nullptr),
     m_startFrame(0),
+    m_targetRate(targetRate),
     m_fillThread(nullptr),
     m_updateTimer(nullptr),
     m_lastFillExtent(0),
@@ -78,6 +82,12 @@ ReadOnlyWaveFileModel::ReadOnlyWaveFileModel(FileSource source, sv_samplerate_t
         
         params.threadingMode = AudioFileReaderFactory::ThreadingMode::Threaded;
 
+        // Anything other than the file itself and the target rate
+        // that affects the decoded samples must be reflected here
+        m_summaryOptions = QString("normalise=%1;gapless=%2")
+            .arg(prefs->getNormaliseAudio())
+            .arg(prefs->getUseGaplessMode());
+
         m_reader = AudioFileReaderFactory::createReader(m_source, params);
         if (m_reader) {
             SVDEBUG << "ReadOnlyWaveFileModel::ReadOnlyWaveFileModel: reader rate: "
@@ -87,6 +97,9 @@ ReadOnlyWaveFileModel::ReadOnlyWaveFileModel(FileSource source, sv_samplerate_t
 
     if (m_reader) setObjectName(m_reader->getTitle());
     if (objectName() == "") setObjectName(QFileInfo(m_path).fileName());
+    if (m_reader && m_reader->isReadAheadUseful()) {
+        m_readScheduler = new AudioReadScheduler(m_reader);
+    }
     if (isOK()) fillCache();
     
     PlayParameterRepository::getInstance()->addPlayable
@@ -98,7 +111,9 @@ ReadOnlyWaveFileModel::ReadOnlyWaveFileModel(FileSource source, AudioFileReader
     m_path(source.getLocation()),
     m_reader(nullptr),
     m_myReader(false),
+    m_readScheduler(nullptr),
     m_startFrame(0),
+    m_targetRate(0),
     m_fillThread(nullptr),
     m_updateTimer(nullptr),
     m_lastFillExtent(0),
@@ -113,6 +128,9 @@ ReadOnlyWaveFileModel::ReadOnlyWaveFileModel(FileSource source, AudioFileReader
     m_reader = reader;
     if (m_reader) setObjectName(m_reader->getTitle());
     if (objectName() == "") setObjectName(QFileInfo(m_path).fileName());
+    if (m_reader && m_reader->isReadAheadUseful()) {
+        m_readScheduler = new AudioReadScheduler(m_reader);
+    }
     fillCache();
     
     PlayParameterRepository::getInstance()->addPlayable
@@ -128,6 +146,7 @@ ReadOnlyWaveFileModel::~ReadOnlyWaveFileModel()
     
     m_exiting = true;
     if (m_fillThread) m_fillThread->wait();
+    delete m_readScheduler;
     if (m_myReader) delete m_reader;
     m_reader = nullptr;
 
@@ -245,11 +264,72 @@ ReadOnlyWaveFileModel::getLocalFilename() const
     return "";
 }
     
+// Number of samples to read from the file at a time, when reading
+// more than one channel via an interleaved buffer
+static const int interleavedReadSize = 16384;
+
+// Frames per block for an interleaved read of count frames
+static sv_frame_t
+interleavedBlockSize(int channels, sv_frame_t count)
+{
+    sv_frame_t blockSize = interleavedReadSize / channels;
+    if (blockSize < 1) blockSize = 1;
+    if (blockSize > count) blockSize = count;
+    return blockSize;
+}
+
+// Buffer for interleaved reads, kept for reuse by each thread rather
+// than allocated on every call. Reads are done in blocks no larger
+// than interleavedReadSize samples (or one frame, if that is more),
+// so it stays small
+static float *
+interleavedScratch(sv_frame_t samples)
+{
+    static thread_local floatvec_t scratch;
+    if (sv_frame_t(scratch.size()) < samples) {
+        scratch.resize(samples);
+    }
+    return scratch.data();
+}
+
+sv_frame_t
+ReadOnlyWaveFileModel::readInterleaved(sv_frame_t start, sv_frame_t count,
+                                       float *buffer) const
+{
+    if (m_readScheduler && m_reader->isReadAheadUseful()) {
+        return m_readScheduler->getInterleavedFrames(start, count, buffer);
+    } else {
+        return m_reader->getInterleavedFrames(start, count, buffer);
+    }
+}
+
 floatvec_t
 ReadOnlyWaveFileModel::getData(int channel,
                                sv_frame_t start,
                                sv_frame_t count)
     const
+{
+    // Nothing can be read beyond the end of the file, but a read
+    // starting before m_startFrame may still need all of count
+    if (count > getTrueEndFrame() - start) {
+        count = getTrueEndFrame() - start;
+    }
+    if (count <= 0) {
+        return {};
+    }
+    
+    floatvec_t result(count, 0.f);
+    sv_frame_t obtained = getData(channel, start, count, result.data());
+    result.resize(obtained);
+    return result;
+}
+
+sv_frame_t
+ReadOnlyWaveFileModel::getData(int channel,
+                               sv_frame_t start,
+                               sv_frame_t count,
+                               float *buffer)
+    const
 {
     // Read a single channel (if channel >= 0) or a mixdown of all
     // channels (if channel == -1) directly from the file.  This is
@@ -267,51 +347,104 @@ ReadOnlyWaveFileModel::getData(int channel,
         SVCERR << "ERROR: WaveFileModel::getData: channel ("
              << channel << ") >= channel count (" << channels << ")"
              << endl;
-        return {};
+        return 0;
     }
 
-    if (!m_reader || !m_reader->isOK() || count == 0) {
-        return {};
+    if (!m_reader || !m_reader->isOK() || count <= 0) {
+        return 0;
     }
 
     if (start >= m_startFrame) {
         start -= m_startFrame;
     } else {
         if (count <= m_startFrame - start) {
-            return {};
+            return 0;
         } else {
             count -= (m_startFrame - start);
             start = 0;
         }
     }
 
-    floatvec_t interleaved = m_reader->getInterleavedFrames(start, count);
-    if (channels == 1) return interleaved;
+    if (channels == 1) {
+        return readInterleaved(start, count, buffer);
+    }
 
-    sv_frame_t obtained = interleaved.size() / channels;
-    
-    floatvec_t result(obtained, 0.f);
-    
-    if (channel != -1) {
-        // get a single channel
-        for (int i = 0; i < obtained; ++i) {
-            result[i] = interleaved[i * channels + channel];
-        }
-    } else {
-        // channel == -1, mix down all channels
-        for (int i = 0; i < obtained; ++i) {
-            for (int c = 0; c < channels; ++c) {
-                result[i] += interleaved[i * channels + c];
+    sv_frame_t blockSize = interleavedBlockSize(channels, count);
+    float *interleaved = interleavedScratch(blockSize * channels);
+
+    sv_frame_t obtained = 0;
+
+    while (obtained < count) {
+
+        sv_frame_t n = std::min(blockSize, count - obtained);
+        sv_frame_t got = readInterleaved
+            (start + obtained, n, interleaved);
+
+        float *out = buffer + obtained;
+        
+        if (channel != -1) {
+            // get a single channel
+            for (sv_frame_t i = 0; i < got; ++i) {
+                out[i] = interleaved[i * channels + channel];
+            }
+        } else {
+            // channel == -1, mix down all channels
+            for (sv_frame_t i = 0; i < got; ++i) {
+                float sum = 0.f;
+                for (int c = 0; c < channels; ++c) {
+                    sum += interleaved[i * channels + c];
+                }
+                out[i] = sum;
             }
         }
+
+        obtained += got;
+        if (got < n) break;
     }
 
-    return result;
+    return obtained;
 }
 
 vector<floatvec_t>
 ReadOnlyWaveFileModel::getMultiChannelData(int fromchannel, int tochannel,
                                            sv_frame_t start, sv_frame_t count) const
+{
+    // Nothing can be read beyond the end of the file, but a read
+    // starting before m_startFrame may still need all of count
+    if (count > getTrueEndFrame() - start) {
+        count = getTrueEndFrame() - start;
+    }
+    if (count <= 0 || fromchannel > tochannel ||
+        tochannel >= getChannelCount() ||
+        !m_reader || !m_reader->isOK()) {
+        return {};
+    }
+    if (start < m_startFrame && count <= m_startFrame - start) {
+        return {};
+    }
+
+    int reqchannels = (tochannel - fromchannel) + 1;
+
+    vector<floatvec_t> result(reqchannels, floatvec_t(count, 0.f));
+    vector<float *> buffers;
+    for (auto &r: result) {
+        buffers.push_back(r.data());
+    }
+
+    sv_frame_t obtained = getMultiChannelData
+        (fromchannel, tochannel, start, count, buffers.data());
+
+    // One vector per requested channel, empty if nothing was read
+    for (auto &r: result) {
+        r.resize(obtained);
+    }
+    return result;
+}
+
+sv_frame_t
+ReadOnlyWaveFileModel::getMultiChannelData(int fromchannel, int tochannel,
+                                           sv_frame_t start, sv_frame_t count,
+                                           float *const *buffers) const
 {
     // Read a set of channels directly from the file.  This is used
     // for e.g. audio playback or input to transforms.
@@ -329,7 +462,7 @@ ReadOnlyWaveFileModel::getMultiChannelData(int fromchannel, int tochannel,
                << "fromchannel (" << fromchannel
                << ") > tochannel (" << tochannel << ")"
                << endl;
-        return {};
+        return 0;
     }
 
     if (tochannel >= channels) {
@@ -337,40 +470,69 @@ ReadOnlyWaveFileModel::getMultiChannelData(int fromchannel, int tochannel,
                << "tochannel (" << tochannel
                << ") >= channel count (" << channels << ")"
                << endl;
-        return {};
+        return 0;
     }
 
-    if (!m_reader || !m_reader->isOK() || count == 0) {
-        return {};
+    if (!m_reader || !m_reader->isOK() || count <= 0) {
+        return 0;
     }
 
-    int reqchannels = (tochannel - fromchannel) + 1;
-
     if (start >= m_startFrame) {
         start -= m_startFrame;
     } else {
         if (count <= m_startFrame - start) {
-            return {};
+            return 0;
         } else {
             count -= (m_startFrame - start);
             start = 0;
         }
     }
 
-    floatvec_t interleaved = m_reader->getInterleavedFrames(start, count);
-    if (channels == 1) return { interleaved };
+    if (channels == 1) {
+        return readInterleaved(start, count, buffers[0]);
+    }
+
+    sv_frame_t blockSize = interleavedBlockSize(channels, count);
+    float *interleaved = interleavedScratch(blockSize * channels);
+
+    sv_frame_t obtained = 0;
+
+    while (obtained < count) {
 
-    sv_frame_t obtained = interleaved.size() / channels;
-    vector<floatvec_t> result(reqchannels, floatvec_t(obtained, 0.f));
+        sv_frame_t n = std::min(blockSize, count - obtained);
+        sv_frame_t got = readInterleaved
+            (start + obtained, n, interleaved);
 
-    for (int c = fromchannel; c <= tochannel; ++c) {
-        int destc = c - fromchannel;
-        for (int i = 0; i < obtained; ++i) {
-            result[destc][i] = interleaved[i * channels + c];
+        for (int c = fromchannel; c <= tochannel; ++c) {
+            float *out = buffers[c - fromchannel] + obtained;
+            for (sv_frame_t i = 0; i < got; ++i) {
+                out[i] = interleaved[i * channels + c];
+            }
         }
+
+        obtained += got;
+        if (got < n) break;
     }
     
-    return result;
+    return obtained;
+}
+
+void
+ReadOnlyWaveFileModel::prefetchData(sv_frame_t start, sv_frame_t count) const
+{
+    if (!m_readScheduler || !m_reader->isReadAheadUseful()) {
+        return;
+    }
+
+    m_readScheduler->prefetch(start - m_startFrame, count);
+}
+
+void
+ReadOnlyWaveFileModel::setDecodePriority(int priority)
+{
+    if (m_reader) {
+        m_reader->setDecodePriority(priority);
+    }
 }
 
 int
@@ -480,6 +642,23 @@ ReadOnlyWaveFileModel::getSummaries(int channel, sv_frame_t start, sv_frame_t co
         }
         div = blockSize / cacheBlock;
 
+        // While the fill thread is running, only the part of the
+        // cache below its fill extent is known to be complete (the
+        // parallel fill preallocates the whole cache up front). Round
+        // the extent up, so that the final partial block is included
+        // as soon as it has been filled rather than only once the
+        // fill thread has gone. This includes no incomplete block:
+        // the parallel fill's extent is always on a cache block
+        // boundary or at the end of the file, and the serial fill
+        // appends each block to the cache only once it is complete
+        sv_frame_t validBlocks =
+            (channels > 0 ? sv_frame_t(cache.size()) / channels : 0);
+        if (m_fillThread) {
+            sv_frame_t extent = m_fillThread->getFillExtent();
+            validBlocks = std::min(validBlocks,
+                                   (extent + cacheBlock - 1) / cacheBlock);
+        }
+        
         sv_frame_t startIndex = start / cacheBlock;
         sv_frame_t endIndex = (start + count) / cacheBlock;
 
@@ -492,6 +671,7 @@ ReadOnlyWaveFileModel::getSummaries(int channel, sv_frame_t start, sv_frame_t co
 
         for (i = 0; i <= endIndex - startIndex; ) {
         
+            if (i + startIndex >= validBlocks) break;
             sv_frame_t index = (i + startIndex) * channels + channel;
             if (!in_range_for(cache, index)) break;
             
@@ -593,10 +773,61 @@ ReadOnlyWaveFileModel::fillCache()
 #endif
 }   
 
+bool
+ReadOnlyWaveFileModel::loadSummaries(const sv_frame_t blockSizes[2],
+                                     sv_frame_t &frameCount)
+{
+    if (m_summaryOptions == "") return false;
+    
+    RangeSummaryFile file(m_source.getLocalFilename(),
+                          m_targetRate, m_summaryOptions);
+
+    RangeBlock caches[2];
+    if (!file.load(getChannelCount(), blockSizes, caches, frameCount)) {
+        return false;
+    }
+
+    SVDEBUG << "ReadOnlyWaveFileModel: Loaded summaries for " << m_path
+            << " from summary file" << endl;
+    
+    QMutexLocker locker(&m_mutex);
+    m_cache[0].swap(caches[0]);
+    m_cache[1].swap(caches[1]);
+    return true;
+}
+
+void
+ReadOnlyWaveFileModel::saveSummaries(const sv_frame_t blockSizes[2],
+                                     sv_frame_t frameCount) const
+{
+    // Short files are quick enough to summarise that it isn't worth
+    // cluttering the cache directory with them
+    const sv_frame_t minimumFrames = 1 << 20;
+    
+    if (m_summaryOptions == "" || frameCount < minimumFrames) return;
+
+    RangeSummaryFile file(m_source.getLocalFilename(),
+                          m_targetRate, m_summaryOptions);
+
+    // The caches are no longer being written to once the fill is
+    // complete, so we can save them without holding the mutex
+    if (!file.save(getChannelCount(), blockSizes, m_cache, frameCount)) {
+        SVDEBUG << "ReadOnlyWaveFileModel: Failed to save summary file for "
+                << m_path << endl;
+    }
+}
+
 void
 ReadOnlyWaveFileModel::fillTimerTimedOut()
 {
     if (m_fillThread) {
+        if (m_fillThread->takeRestarted()) {
+            // Summaries from a summary file have been found not to
+            // match the audio, and are being calculated again from
+            // the start
+            m_lastFillExtent = 0;
+            emit modelChanged(getId());
+        }
         sv_frame_t fillExtent = m_fillThread->getFillExtent();
 #ifdef DEBUG_WAVE_FILE_MODEL
         SVCERR << "ReadOnlyWaveFileModel(" << objectName() << ")::fillTimerTimedOut: extent = " << fillExtent << endl;
@@ -634,21 +865,93 @@ ReadOnlyWaveFileModel::cacheFilled()
     emit ready(getId());
 }
 
+// Number of read blocks in each region handed to a parallel fill
+// worker
+static const sv_frame_t regionReadBlocks = 10;
+
+// Read block size for the parallel fill: a multiple of both cache
+// block sizes (so that no cache block straddles two reads) of around
+// 32K frames
+static sv_frame_t
+readBlockSizeFor(const sv_frame_t cacheBlockSize[2])
+{
+    sv_frame_t unit = cacheBlockSize[0] * cacheBlockSize[1];
+    sv_frame_t n = 32768 / unit;
+    if (n < 1) n = 1;
+    return n * unit;
+}
+
+// Calculate min, max and mean absolute value of a contiguous run of
+// samples. The work is spread across a fixed number of independent
+// lanes, so that the compiler is free to vectorise the loop without
+// having to reorder any single floating-point accumulation.
+static void
+summariseSamples(const float *samples, int n,
+                 float &min, float &max, float &absmean)
+{
+    const int lanes = 8;
+
+    if (n <= 0) {
+        min = max = absmean = 0.f;
+        return;
+    }
+    
+    float lmin[lanes], lmax[lanes], lsum[lanes];
+    for (int j = 0; j < lanes; ++j) {
+        lmin[j] = samples[0];
+        lmax[j] = samples[0];
+        lsum[j] = 0.f;
+    }
+
+    int i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        for (int j = 0; j < lanes; ++j) {
+            float s = samples[i + j];
+            lmin[j] = (s < lmin[j] ? s : lmin[j]);
+            lmax[j] = (s > lmax[j] ? s : lmax[j]);
+            lsum[j] += fabsf(s);
+        }
+    }
+    for (; i < n; ++i) {
+        float s = samples[i];
+        lmin[0] = (s < lmin[0] ? s : lmin[0]);
+        lmax[0] = (s > lmax[0] ? s : lmax[0]);
+        lsum[0] += fabsf(s);
+    }
+
+    min = lmin[0];
+    max = lmax[0];
+    float sum = lsum[0];
+    for (int j = 1; j < lanes; ++j) {
+        if (lmin[j] < min) min = lmin[j];
+        if (lmax[j] > max) max = lmax[j];
+        sum += lsum[j];
+    }
+
+    absmean = sum / float(n);
+}
+
 void
 ReadOnlyWaveFileModel::RangeCacheFillThread::run()
 {
-    int cacheBlockSize[2];
-    cacheBlockSize[0] = (1 << m_model.m_zoomConstraint.getMinCachePower());
-    cacheBlockSize[1] = (int((1 << m_model.m_zoomConstraint.getMinCachePower()) *
+    m_cacheBlockSize[0] = (1 << m_model.m_zoomConstraint.getMinCachePower());
+    m_cacheBlockSize[1] = (int((1 << m_model.m_zoomConstraint.getMinCachePower()) *
                                         sqrt(2.) + 0.01));
     
-    sv_frame_t frame = 0;
-    const sv_frame_t readBlockSize = 32768;
-    floatvec_t block;
-
     if (!m_model.isOK()) return;
-    
+
     int channels = m_model.getChannelCount();
+
+    sv_frame_t summaryFrameCount = 0;
+    if (m_model.loadSummaries(m_cacheBlockSize, summaryFrameCount)) {
+        if (waitForPreloadedSummaries(summaryFrameCount, channels)) {
+            return;
+        }
+        if (m_model.m_exiting) {
+            return;
+        }
+    }
+    
     bool updating = m_model.m_reader->isUpdating();
 
     if (updating) {
@@ -664,6 +967,83 @@ ReadOnlyWaveFileModel::RangeCacheFillThread::run()
         }
     }
 
+    if (!updating) {
+        m_frameCount = m_model.getFrameCount();
+    }
+    
+    if (updating || channels == 0 || QThread::idealThreadCount() < 2 ||
+        m_frameCount < 2 * regionReadBlocks * readBlockSizeFor(m_cacheBlockSize)) {
+        fillSerially(channels, updating);
+    } else {
+        fillInParallel(channels);
+    }
+
+    m_fillExtent = m_frameCount;
+
+#ifdef DEBUG_WAVE_FILE_MODEL        
+    for (int cacheType = 0; cacheType < 2; ++cacheType) {
+        SVCERR << "ReadOnlyWaveFileModel(" << m_model.objectName() << "): Cache type " << cacheType << " now contains " << m_model.m_cache[cacheType].size() << " ranges" << endl;
+    }
+#endif
+
+    if (!m_model.m_exiting) {
+        m_model.saveSummaries(m_cacheBlockSize, m_frameCount);
+    }
+}
+
+bool
+ReadOnlyWaveFileModel::RangeCacheFillThread::waitForPreloadedSummaries
+(sv_frame_t summaryFrameCount, int &channels)
+{
+    // The summaries are usable straight away, even if the reader is
+    // still decoding
+    m_fillExtent = summaryFrameCount;
+    
+    while (m_model.m_reader->isUpdating() && !m_model.m_exiting) {
+        usleep(100000);
+    }
+    if (m_model.m_exiting) {
+        return false;
+    }
+
+    m_frameCount = m_model.getFrameCount();
+    channels = m_model.getChannelCount();
+
+    QMutexLocker locker(&m_model.m_mutex);
+
+    bool consistent = (m_frameCount == summaryFrameCount && channels > 0);
+    for (int cacheType = 0; cacheType < 2 && consistent; ++cacheType) {
+        sv_frame_t blocks = (m_frameCount + m_cacheBlockSize[cacheType] - 1)
+            / m_cacheBlockSize[cacheType];
+        if (sv_frame_t(m_model.m_cache[cacheType].size()) != blocks * channels) {
+            consistent = false;
+        }
+    }
+
+    if (consistent) {
+        m_fillExtent = m_frameCount;
+        return true;
+    }
+
+    SVDEBUG << "ReadOnlyWaveFileModel: Summary file for " << m_model.m_path
+            << " does not match decoded audio (" << summaryFrameCount
+            << " vs " << m_frameCount << " frames), recalculating" << endl;
+    
+    m_model.m_cache[0].clear();
+    m_model.m_cache[1].clear();
+    m_fillExtent = 0;
+    m_restarted = true;
+    return false;
+}
+
+void
+ReadOnlyWaveFileModel::RangeCacheFillThread::fillSerially(int channels,
+                                                          bool updating)
+{
+    sv_frame_t frame = 0;
+    const sv_frame_t readBlockSize = 32768;
+    floatvec_t block;
+
     Range *range = new Range[2 * channels];
     float *means = new float[2 * channels];
     int count[2];
@@ -716,7 +1096,7 @@ ReadOnlyWaveFileModel::RangeCacheFillThread::run()
 
                 for (int cacheType = 0; cacheType < 2; ++cacheType) {
 
-                    if (++count[cacheType] == cacheBlockSize[cacheType]) {
+                    if (++count[cacheType] == m_cacheBlockSize[cacheType]) {
                         
                         for (int ch = 0; ch < int(channels); ++ch) {
                             int rangeIndex = ch * 2 + cacheType;
@@ -775,14 +1155,158 @@ ReadOnlyWaveFileModel::RangeCacheFillThread::run()
     
     delete[] means;
     delete[] range;
+}
 
-    m_fillExtent = m_frameCount;
-
-#ifdef DEBUG_WAVE_FILE_MODEL        
-    for (int cacheType = 0; cacheType < 2; ++cacheType) {
-        SVCERR << "ReadOnlyWaveFileModel(" << m_model.objectName() << "): Cache type " << cacheType << " now contains " << m_model.m_cache[cacheType].size() << " ranges" << endl;
+void
+ReadOnlyWaveFileModel::RangeCacheFillThread::fillInParallel(int channels)
+{
+    Profiler profiler("ReadOnlyWaveFileModel::RangeCacheFillThread::fillInParallel");
+
+    m_channels = channels;
+    m_regionSize = regionReadBlocks * readBlockSizeFor(m_cacheBlockSize);
+    m_regionCount = int((m_frameCount + m_regionSize - 1) / m_regionSize);
+    m_regionDone = vector<bool>(m_regionCount, false);
+    m_contiguousRegions = 0;
+    m_nextRegion = 0;
+
+    {
+        // Preallocate the whole of both caches, so that the workers
+        // can write into their own slices without reallocation and
+        // without taking the model mutex
+        QMutexLocker locker(&m_model.m_mutex);
+        for (int cacheType = 0; cacheType < 2; ++cacheType) {
+            sv_frame_t blocks = (m_frameCount + m_cacheBlockSize[cacheType] - 1)
+                / m_cacheBlockSize[cacheType];
+            m_model.m_cache[cacheType].clear();
+            m_model.m_cache[cacheType].resize(blocks * channels);
+        }
     }
+
+    int threadCount = std::min(QThread::idealThreadCount(), m_regionCount);
+
+#ifdef DEBUG_WAVE_FILE_MODEL
+    SVCERR << "ReadOnlyWaveFileModel(" << m_model.objectName() << "): filling "
+           << m_regionCount << " regions of " << m_regionSize
+           << " frames using " << threadCount << " threads" << endl;
 #endif
+    
+    vector<Worker *> workers;
+    for (int i = 1; i < threadCount; ++i) {
+        Worker *worker = new Worker(*this);
+        worker->start();
+        workers.push_back(worker);
+    }
+
+    // This thread works too
+    fillRegions();
+
+    for (auto worker: workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    if (!m_model.m_exiting) {
+        QMutexLocker locker(&m_model.m_mutex);
+        for (int cacheType = 0; cacheType < 2; ++cacheType) {
+            if (m_model.m_cache[cacheType].empty()) continue;
+            const Range &rr = *m_model.m_cache[cacheType].begin();
+            MUNLOCK(&rr, m_model.m_cache[cacheType].capacity() * sizeof(Range));
+        }
+    }
+}
+
+void
+ReadOnlyWaveFileModel::RangeCacheFillThread::fillRegions()
+{
+    const sv_frame_t readBlockSize = readBlockSizeFor(m_cacheBlockSize);
+    floatvec_t block(readBlockSize * m_channels);
+    floatvec_t buffer;
+    
+    while (!m_model.m_exiting) {
+
+        int region = m_nextRegion++;
+        if (region >= m_regionCount) break;
+
+        sv_frame_t regionStart = region * m_regionSize;
+        sv_frame_t regionEnd = std::min(regionStart + m_regionSize, m_frameCount);
+
+        for (sv_frame_t frame = regionStart; frame < regionEnd;
+             frame += readBlockSize) {
+
+            if (m_model.m_exiting) return;
+            
+            sv_frame_t toRead = std::min(readBlockSize, regionEnd - frame);
+            sv_frame_t got = m_model.m_reader->getInterleavedFrames
+                (frame, toRead, block.data());
+            if (got <= 0) break;
+
+            summariseBlock(block.data(), got, frame, buffer);
+        }
+
+        markRegionDone(region);
+    }
+}
+
+void
+ReadOnlyWaveFileModel::RangeCacheFillThread::summariseBlock(const float *interleaved,
+                                                            sv_frame_t frames,
+                                                            sv_frame_t startFrame,
+                                                            floatvec_t &buffer)
+{
+    // startFrame is always a multiple of both cache block sizes, so
+    // every cache block but the very last in the file lies entirely
+    // within the frames we have been given here
+    
+    if (m_channels > 1 && sv_frame_t(buffer.size()) < frames) {
+        buffer.resize(frames);
+    }
+    
+    for (int ch = 0; ch < m_channels; ++ch) {
+
+        const float *samples = interleaved;
+        
+        if (m_channels > 1) {
+            // De-interleave so that the summary kernel can run over
+            // contiguous samples
+            for (sv_frame_t i = 0; i < frames; ++i) {
+                buffer[i] = interleaved[i * m_channels + ch];
+            }
+            samples = buffer.data();
+        }
+        
+        for (int cacheType = 0; cacheType < 2; ++cacheType) {
+
+            RangeBlock &cache = m_model.m_cache[cacheType];
+            sv_frame_t blockSize = m_cacheBlockSize[cacheType];
+            sv_frame_t index = (startFrame / blockSize) * m_channels + ch;
+
+            for (sv_frame_t offset = 0; offset < frames; offset += blockSize) {
+                if (!in_range_for(cache, index)) break;
+                float min, max, absmean;
+                summariseSamples(samples + offset,
+                                 int(std::min(blockSize, frames - offset)),
+                                 min, max, absmean);
+                cache[index] = Range(min, max, absmean);
+                index += m_channels;
+            }
+        }
+    }
+}
+
+void
+ReadOnlyWaveFileModel::RangeCacheFillThread::markRegionDone(int region)
+{
+    QMutexLocker locker(&m_regionMutex);
+    m_regionDone[region] = true;
+    while (m_contiguousRegions < m_regionCount &&
+           m_regionDone[m_contiguousRegions]) {
+        ++m_contiguousRegions;
+    }
+    // The fill extent is only ever the contiguous filled prefix, so
+    // that getSummaries never returns values from a region that a
+    // worker may still be writing to
+    m_fillExtent = std::min(m_frameCount,
+                            sv_frame_t(m_contiguousRegions) * m_regionSize);
 }
 
 void
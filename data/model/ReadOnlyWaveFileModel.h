@@ -32,6 +32,7 @@
 #include <atomic>
 
 class AudioFileReader;
+class AudioReadScheduler;
 
 class ReadOnlyWaveFileModel : public WaveFileModel
 {
@@ -84,8 +85,23 @@ public:
     void setStartFrame(sv_frame_t startFrame) override { m_startFrame = startFrame; }
 
     floatvec_t getData(int channel, sv_frame_t start, sv_frame_t count) const override;
+    sv_frame_t getData(int channel, sv_frame_t start, sv_frame_t count,
+                       float *buffer) const override;
 
     std::vector<floatvec_t> getMultiChannelData(int fromchannel, int tochannel, sv_frame_t start, sv_frame_t count) const override;
+    sv_frame_t getMultiChannelData(int fromchannel, int tochannel,
+                                   sv_frame_t start, sv_frame_t count,
+                                   float *const *buffers) const override;
+
+    void prefetchData(sv_frame_t start, sv_frame_t count) const override;
+
+    /**
+     * Set the priority with which the file should be decoded, if it
+     * is still waiting for its turn (see
+     * AudioFileReader::setDecodePriority). For example, raise it for
+     * the file the user is looking at.
+     */
+    void setDecodePriority(int priority);
 
     int getSummaryBlockSize(int desired) const override;
 
@@ -112,27 +128,92 @@ protected:
     {
     public:
         RangeCacheFillThread(ReadOnlyWaveFileModel &model) :
-            m_model(model), m_fillExtent(0),
-            m_frameCount(model.getFrameCount()) { }
+            m_model(model), m_fillExtent(0), m_restarted(false),
+            m_frameCount(model.getFrameCount()),
+            m_channels(0), m_regionSize(0), m_regionCount(0),
+            m_nextRegion(0), m_contiguousRegions(0) { }
     
         sv_frame_t getFillExtent() const { return m_fillExtent; }
+
+        // True (once) if the fill extent has gone back to the start
+        // since the last call, because preloaded summaries were
+        // discarded
+        bool takeRestarted() { return m_restarted.exchange(false); }
+        
         void run() override;
 
     protected:
+        /**
+         * Helper thread for the parallel fill. Each worker takes
+         * regions of the file in turn from the fill thread until
+         * there are none left.
+         */
+        class Worker : public Thread
+        {
+        public:
+            Worker(RangeCacheFillThread &fill) : m_fill(fill) { }
+            void run() override { m_fill.fillRegions(); }
+        private:
+            RangeCacheFillThread &m_fill;
+        };
+
+        // Used while the reader is still decoding, so that the total
+        // length is not yet known
+        void fillSerially(int channels, bool updating);
+
+        // Used when the total length is known in advance: the caches
+        // are preallocated and each region of the file is summarised
+        // into its own slice of them by one of a pool of workers
+        void fillInParallel(int channels);
+        void fillRegions();
+        void summariseBlock(const float *interleaved, sv_frame_t frames,
+                            sv_frame_t startFrame, floatvec_t &buffer);
+        void markRegionDone(int region);
+
+        // Used when the summaries have been loaded from a summary
+        // file: wait for the reader to finish decoding and check
+        // that the summaries are consistent with what it produced
+        bool waitForPreloadedSummaries(sv_frame_t summaryFrameCount,
+                                       int &channels);
+        
         ReadOnlyWaveFileModel &m_model;
-        sv_frame_t m_fillExtent;
+        std::atomic<sv_frame_t> m_fillExtent;
+        std::atomic<bool> m_restarted;
         sv_frame_t m_frameCount;
+        sv_frame_t m_cacheBlockSize[2];
+        int m_channels;
+        sv_frame_t m_regionSize;
+        int m_regionCount;
+        std::atomic<int> m_nextRegion;
+        std::vector<bool> m_regionDone;
+        int m_contiguousRegions;
+        QMutex m_regionMutex;
     };
          
     void fillCache();
 
+    bool loadSummaries(const sv_frame_t blockSizes[2],
+                       sv_frame_t &frameCount);
+    void saveSummaries(const sv_frame_t blockSizes[2],
+                       sv_frame_t frameCount) const;
+
+    // Through the read scheduler if we have one, otherwise directly
+    sv_frame_t readInterleaved(sv_frame_t start, sv_frame_t count,
+                               float *buffer) const;
+
     FileSource m_source;
     QString m_path;
     AudioFileReader *m_reader;
     bool m_myReader;
+    AudioReadScheduler *m_readScheduler; // if reading ahead is useful
 
     sv_frame_t m_startFrame;
 
+    // Target rate and reader options identifying our summary file; if
+    // the options are empty, no summary file is used
+    sv_samplerate_t m_targetRate;
+    QString m_summaryOptions;
+
     RangeBlock m_cache[2]; // interleaved at two base resolutions
     mutable QMutex m_mutex;
     RangeCacheFillThread *m_fillThread;
@@ -19,6 +19,7 @@
 #include "TabularModel.h"
 #include "Model.h"
 #include "DeferredNotifier.h"
+#include "SparseModelEdits.h"
 
 #include "base/RealTime.h"
 #include "base/EventSeries.h"
@@ -204,6 +205,33 @@ public:
                                 e.getFrame(),
                                 e.getFrame() + e.getDuration() + m_resolution);
     }
+
+    void addEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        m_events.addEvents(ee);
+
+        for (const auto &e: ee) {
+            if (e.hasValue() && e.getValue() != 0.f) {
+                m_haveDistinctValues = true;
+            }
+        }
+
+        bool allChange = SparseModelEdits::extendValueExtents
+            (ee, m_haveExtents, m_valueMinimum, m_valueMaximum);
+        
+        SparseModelEdits::notifyEventsAdded
+            (this, m_notifier, ee, m_resolution, allChange);
+    }
+
+    void removeEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        m_events.removeEvents(ee);
+        SparseModelEdits::notifyEventsRemoved(this, ee, m_resolution);
+    }
     
     /**
      * TabularModel methods.  
@@ -0,0 +1,106 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+    
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_SPARSE_MODEL_EDITS_H
+#define SV_SPARSE_MODEL_EDITS_H
+
+#include "Model.h"
+#include "DeferredNotifier.h"
+
+#include "base/Event.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Value extent and change notification code shared by the addEvents
+ * and removeEvents implementations of the sparse models.
+ */
+class SparseModelEdits
+{
+public:
+    /**
+     * Widen the value extents min and max to include the range from
+     * lo to hi, or set them to that range if haveExtents is false.
+     * Non-finite values are ignored. Return true if the extents
+     * changed.
+     */
+    static bool extendValueExtents(float lo, float hi, bool &haveExtents,
+                                   float &min, float &max) {
+        if (!std::isfinite(lo) || !std::isfinite(hi)) return false;
+        bool changed = false;
+        if (!haveExtents || lo < min) { min = lo; changed = true; }
+        if (!haveExtents || hi > max) { max = hi; changed = true; }
+        haveExtents = true;
+        return changed;
+    }
+
+    /**
+     * Widen the value extents to include the values of all of the
+     * given events. Return true if the extents changed.
+     */
+    static bool extendValueExtents(const EventVector &ee, bool &haveExtents,
+                                   float &min, float &max) {
+        bool changed = false;
+        for (const auto &e: ee) {
+            float v = e.getValue();
+            if (extendValueExtents(v, v, haveExtents, min, max)) {
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    /**
+     * Report the addition of the given (non-empty) set of events to
+     * a model with the given resolution, through the model's
+     * notifier. If the value extents have changed, report that the
+     * whole model has changed as well.
+     */
+    static void notifyEventsAdded(Model *model, DeferredNotifier &notifier,
+                                  const EventVector &ee, int resolution,
+                                  bool valueExtentsChanged) {
+        sv_frame_t f0, f1;
+        getFrameExtents(ee, f0, f1);
+        notifier.update(f0, f1 - f0 + resolution);
+        if (valueExtentsChanged) {
+            emit model->modelChanged(model->getId());
+        }
+    }
+
+    /**
+     * Report the removal of the given (non-empty) set of events from
+     * a model with the given resolution. This is reported at once,
+     * whatever the mode of the model's notifier.
+     */
+    static void notifyEventsRemoved(Model *model, const EventVector &ee,
+                                    int resolution) {
+        sv_frame_t f0, f1;
+        getFrameExtents(ee, f0, f1);
+        emit model->modelChangedWithin(model->getId(), f0, f1 + resolution);
+    }
+
+private:
+    static void getFrameExtents(const EventVector &ee,
+                                sv_frame_t &f0, sv_frame_t &f1) {
+        f0 = ee[0].getFrame();
+        f1 = f0;
+        for (const auto &e: ee) {
+            f0 = std::min(f0, e.getFrame());
+            f1 = std::max(f1, e.getFrame() + e.getDuration());
+        }
+    }
+};
+
+#endif
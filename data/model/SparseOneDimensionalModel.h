@@ -19,6 +19,7 @@
 #include "TabularModel.h"
 #include "Model.h"
 #include "DeferredNotifier.h"
+#include "SparseModelEdits.h"
 
 #include "base/NoteData.h"
 #include "base/EventSeries.h"
@@ -165,6 +166,32 @@ public:
         emit modelChangedWithin(getId(),
                                 e.getFrame(), e.getFrame() + m_resolution);
     }
+
+    void addEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        EventVector stripped;
+        stripped.reserve(ee.size());
+        for (const auto &e: ee) {
+            if (e.getLabel() != "") {
+                m_haveTextLabels = true;
+            }
+            stripped.push_back(e.withoutValue().withoutDuration());
+        }
+        m_events.addEvents(stripped);
+
+        SparseModelEdits::notifyEventsAdded
+            (this, m_notifier, stripped, m_resolution, false);
+    }
+
+    void removeEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        m_events.removeEvents(ee);
+        SparseModelEdits::notifyEventsRemoved(this, ee, m_resolution);
+    }
     
     /**
      * TabularModel methods.  
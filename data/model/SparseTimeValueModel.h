@@ -19,6 +19,7 @@
 #include "TabularModel.h"
 #include "Model.h"
 #include "DeferredNotifier.h"
+#include "SparseModelEdits.h"
 
 #include "base/RealTime.h"
 #include "base/EventSeries.h"
@@ -219,6 +220,35 @@ public:
         emit modelChangedWithin(getId(),
                                 e.getFrame(), e.getFrame() + m_resolution);
     }
+
+    void addEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        EventVector stripped;
+        stripped.reserve(ee.size());
+        for (const auto &e: ee) {
+            if (e.getLabel() != "") {
+                m_haveTextLabels = true;
+            }
+            stripped.push_back(e.withoutDuration());
+        }
+        m_events.addEvents(stripped);
+
+        bool allChange = SparseModelEdits::extendValueExtents
+            (stripped, m_haveExtents, m_valueMinimum, m_valueMaximum);
+        
+        SparseModelEdits::notifyEventsAdded
+            (this, m_notifier, stripped, m_resolution, allChange);
+    }
+
+    void removeEvents(const EventVector &ee) override {
+
+        if (ee.empty()) return;
+        
+        m_events.removeEvents(ee);
+        SparseModelEdits::notifyEventsRemoved(this, ee, m_resolution);
+    }
     
     /**
      * TabularModel methods.  
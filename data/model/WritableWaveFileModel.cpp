@@ -331,6 +331,24 @@ WritableWaveFileModel::getMultiChannelData(int fromchannel, int tochannel,
     return m_model->getMultiChannelData(fromchannel, tochannel, start, count);
 }    
 
+sv_frame_t
+WritableWaveFileModel::getData(int channel, sv_frame_t start, sv_frame_t count,
+                               float *buffer) const
+{
+    if (!m_model || m_model->getChannelCount() == 0) return 0;
+    return m_model->getData(channel, start, count, buffer);
+}
+
+sv_frame_t
+WritableWaveFileModel::getMultiChannelData(int fromchannel, int tochannel,
+                                           sv_frame_t start, sv_frame_t count,
+                                           float *const *buffers) const
+{
+    if (!m_model || m_model->getChannelCount() == 0) return 0;
+    return m_model->getMultiChannelData(fromchannel, tochannel,
+                                        start, count, buffers);
+}
+
 int
 WritableWaveFileModel::getSummaryBlockSize(int desired) const
 {
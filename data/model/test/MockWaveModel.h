@@ -42,6 +42,9 @@ public:
     float getValueMaximum() const override { return  1.f; }
     int getChannelCount() const override { return int(m_data.size()); }
     
+    using DenseTimeValueModel::getData;
+    using DenseTimeValueModel::getMultiChannelData;
+    
     floatvec_t getData(int channel, sv_frame_t start, sv_frame_t count) const override;
     std::vector<floatvec_t> getMultiChannelData(int fromchannel, int tochannel, sv_frame_t start, sv_frame_t count) const override;
 
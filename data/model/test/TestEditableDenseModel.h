@@ -0,0 +1,226 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_EDITABLE_DENSE_MODEL_H
+#define TEST_EDITABLE_DENSE_MODEL_H
+
+#include "../EditableDenseThreeDimensionalModel.h"
+
+#include "base/Thread.h"
+
+#include <QObject>
+#include <QtTest>
+
+#include <atomic>
+
+class TestEditableDenseModel : public QObject
+{
+    Q_OBJECT
+
+private:
+    typedef EditableDenseThreeDimensionalModel::Column Column;
+
+    static Column makeColumn(int x, int height) {
+        Column c(height);
+        for (int j = 0; j < height; ++j) {
+            c[j] = float(x) + float(j) / 1000.f;
+        }
+        return c;
+    }
+
+    class Reader : public Thread
+    {
+    public:
+        Reader(const EditableDenseThreeDimensionalModel &model,
+               int height, std::atomic<bool> &done) :
+            m_model(model), m_height(height), m_done(done),
+            m_checked(0), m_bad(0) { }
+
+        int getChecked() const { return m_checked; }
+        int getBad() const { return m_bad; }
+
+        void run() override {
+            while (!m_done) {
+                int width = m_model.getWidth();
+                for (int x = (width > 20 ? width - 20 : 0); x < width; ++x) {
+                    auto view = m_model.getColumnView(x);
+                    if (view.size() != m_height ||
+                        view[m_height - 1] != makeColumn(x, m_height).back()) {
+                        ++m_bad;
+                    }
+                    ++m_checked;
+                }
+            }
+        }
+
+    private:
+        const EditableDenseThreeDimensionalModel &m_model;
+        int m_height;
+        std::atomic<bool> &m_done;
+        int m_checked;
+        int m_bad;
+    };
+
+private slots:
+    void empty() {
+        EditableDenseThreeDimensionalModel m(100, 10, 4, false);
+        QCOMPARE(m.getWidth(), 0);
+        QCOMPARE(m.getColumn(0), Column());
+        QVERIFY(m.getColumnView(0).empty());
+        QCOMPARE(m.getValueAt(0, 0), m.getMinimumLevel());
+    }
+
+    void appendAcrossSlabs() {
+        // Tall enough that each slab holds only a few columns
+        int height = 5000;
+        int width = 100;
+        EditableDenseThreeDimensionalModel m(100, 10, height, false);
+        for (int x = 0; x < width; ++x) {
+            m.setColumn(x, makeColumn(x, height));
+        }
+        QCOMPARE(m.getWidth(), width);
+        QCOMPARE(m.getTrueEndFrame(), sv_frame_t(width * 10 + 9));
+        for (int x = 0; x < width; ++x) {
+            QCOMPARE(m.getColumn(x), makeColumn(x, height));
+            auto view = m.getColumnView(x);
+            QCOMPARE(view.size(), height);
+            QCOMPARE(Column(view.begin(), view.end()), makeColumn(x, height));
+        }
+        QCOMPARE(m.getMinimumLevel(), 0.f);
+        QCOMPARE(m.getMaximumLevel(), makeColumn(width - 1, height).back());
+    }
+
+    void shortColumnsAndGaps() {
+        EditableDenseThreeDimensionalModel m(100, 10, 4, false);
+        m.setColumn(0, { 1.f, 2.f });
+        m.setColumn(3, { 1.f, 2.f, 3.f, 4.f, 5.f });
+        QCOMPARE(m.getWidth(), 4);
+
+        // Padded to the height on retrieval, but not in the view
+        QCOMPARE(m.getColumn(0), Column({ 1.f, 2.f, 0.f, 0.f }));
+        QCOMPARE(m.getColumnView(0).size(), 2);
+        QCOMPARE(m.getValueAt(0, 1), 2.f);
+        QCOMPARE(m.getValueAt(0, 2), m.getMinimumLevel());
+
+        // Never set
+        QCOMPARE(m.getColumn(1), Column({ 0.f, 0.f, 0.f, 0.f }));
+        QVERIFY(m.getColumnView(1).empty());
+        QCOMPARE(m.getValueAt(1, 0), m.getMinimumLevel());
+
+        // Values beyond the height are stored, though not retrieved
+        // by getColumn
+        QCOMPARE(m.getColumn(3), Column({ 1.f, 2.f, 3.f, 4.f }));
+        QCOMPARE(m.getColumnView(3).size(), 5);
+        QCOMPARE(m.getValueAt(3, 4), 5.f);
+
+        // Rewriting an existing column
+        m.setColumn(0, { 9.f, 8.f, 7.f });
+        QCOMPARE(m.getColumn(0), Column({ 9.f, 8.f, 7.f, 0.f }));
+        QCOMPARE(m.getWidth(), 4);
+        QCOMPARE(m.getMaximumLevel(), 9.f);
+    }
+
+    void zeroHeight() {
+        EditableDenseThreeDimensionalModel m(100, 10, 0, false);
+        m.setColumn(0, { 1.f, 2.f, 3.f });
+        m.setColumn(1, { 4.f });
+        QCOMPARE(m.getWidth(), 2);
+        QCOMPARE(m.getColumn(0), Column());
+        QCOMPARE(m.getColumnView(0).size(), 3);
+        m.setHeight(3);
+        QCOMPARE(m.getColumn(0), Column({ 1.f, 2.f, 3.f }));
+        QCOMPARE(m.getColumn(1), Column({ 4.f, 0.f, 0.f }));
+    }
+
+    void heightIncrease() {
+        int width = 10000;
+        EditableDenseThreeDimensionalModel m(100, 10, 2, false);
+        for (int x = 0; x < width; ++x) {
+            m.setColumn(x, makeColumn(x, 2));
+        }
+        m.setHeight(6);
+        Column padded = makeColumn(5, 2);
+        padded.resize(6, 0.f);
+        QCOMPARE(m.getColumn(5), padded);
+
+        // Rewriting a column at the new height, in a slab made at the
+        // old one, and appending further columns
+        m.setColumn(5, makeColumn(5, 6));
+        for (int x = width; x < width * 2; ++x) {
+            m.setColumn(x, makeColumn(x, 6));
+        }
+        QCOMPARE(m.getWidth(), width * 2);
+        QCOMPARE(m.getColumn(5), makeColumn(5, 6));
+        for (int x = 0; x < width; x += 97) {
+            if (x == 5) continue;
+            QCOMPARE(m.getColumnView(x).size(), 2);
+            QCOMPARE(m.getValueAt(x, 1), makeColumn(x, 2)[1]);
+        }
+        for (int x = width; x < width * 2; x += 97) {
+            QCOMPARE(m.getColumn(x), makeColumn(x, 6));
+        }
+    }
+
+    void viewHeldAcrossWidening() {
+        EditableDenseThreeDimensionalModel m(100, 10, 2, false);
+        for (int x = 0; x < 100; ++x) {
+            m.setColumn(x, makeColumn(x, 2));
+        }
+        auto view = m.getColumnView(7);
+        m.setHeight(6);
+
+        // The slab the view refers to is replaced, repeatedly, by
+        // wider ones; it must not be freed while the view is held
+        for (int x = 0; x < 100; ++x) {
+            m.setColumn(x, makeColumn(x, 6));
+        }
+        m.setHeight(12);
+        for (int x = 0; x < 100; ++x) {
+            m.setColumn(x, makeColumn(x, 12));
+        }
+        QCOMPARE(Column(view.begin(), view.end()), makeColumn(7, 2));
+        QCOMPARE(m.getColumn(7), makeColumn(7, 12));
+    }
+
+    void setColumns() {
+        EditableDenseThreeDimensionalModel m(100, 10, 3, false);
+        std::vector<Column> columns;
+        for (int x = 0; x < 10000; ++x) {
+            columns.push_back(makeColumn(x, 3));
+        }
+        m.setColumns(0, columns);
+        m.setColumns(10000, columns);
+        QCOMPARE(m.getWidth(), 20000);
+        QCOMPARE(m.getColumn(9999), makeColumn(9999, 3));
+        QCOMPARE(m.getColumn(19999), makeColumn(9999, 3));
+        QCOMPARE(m.getValueAt(12345, 2), makeColumn(2345, 3)[2]);
+    }
+
+    void readWhileAppending() {
+        int height = 64;
+        EditableDenseThreeDimensionalModel m(100, 10, height, false);
+        std::atomic<bool> done(false);
+        Reader reader(m, height, done);
+        reader.start();
+        for (int x = 0; x < 100000; ++x) {
+            m.setColumn(x, makeColumn(x, height));
+        }
+        done = true;
+        reader.wait();
+        QCOMPARE(reader.getBad(), 0);
+        QCOMPARE(m.getWidth(), 100000);
+    }
+};
+
+#endif
@@ -84,6 +84,14 @@ private:
                 }
                 QCOMPARE(reals[hs1], 999.f);
                 QCOMPARE(imags[hs1], 999.f);
+                vector<float> interleaved(hs1 * 2 + 1, 0.f);
+                interleaved[hs1 * 2] = 999.f;
+                fftm.getInterleavedValuesAt(columnNo, &interleaved[0]);
+                for (int i = 0; i < hs1; ++i) {
+                    QCOMPARE(interleaved[i*2], reals[i]);
+                    QCOMPARE(interleaved[i*2+1], imags[i]);
+                }
+                QCOMPARE(interleaved[hs1 * 2], 999.f);
             }
         }
     }
@@ -268,6 +276,161 @@ private slots:
              { { {}, {}, {}, {}, {} } }, 7);
         releaseMock(mwm);
     }
+
+    void column_cache_shared() {
+        // Two FFTModels with the same source and parameters share a
+        // column cache; both, and an uncached model, must agree
+        auto mwm = makeMock({ Sine, Cosine }, 64, 4);
+        for (int ch = 0; ch < 2; ++ch) {
+            FFTModel a(mwm, ch, HanningWindow, 16, 4, 16);
+            FFTModel b(mwm, ch, HanningWindow, 16, 4, 16);
+            FFTModel c(mwm, ch, HanningWindow, 16, 4, 16);
+            a.setColumnCacheEnabled(true);
+            b.setColumnCacheEnabled(true);
+            QVERIFY(a.isColumnCacheEnabled());
+            QVERIFY(!c.isColumnCacheEnabled());
+            QVERIFY(a.sharesColumnCacheWith(b));
+            QVERIFY(b.sharesColumnCacheWith(a));
+            QVERIFY(!a.sharesColumnCacheWith(c));
+            int w = a.getWidth();
+            QCOMPARE(b.getWidth(), w);
+            for (int x = 0; x < w; ++x) {
+                auto acol = a.getColumn(x);
+                auto aph = a.getPhases(x);
+                for (int pass = 0; pass < 2; ++pass) {
+                    FFTModel &other = (pass == 0 ? b : c);
+                    auto ocol = other.getColumn(x);
+                    auto oph = other.getPhases(x);
+                    QCOMPARE(ocol.size(), acol.size());
+                    for (int y = 0; in_range_for(acol, y); ++y) {
+                        COMPARE_FUZZIER_F(ocol[y], acol[y]);
+                        if (acol[y] > 1e-4f) {
+                            COMPARE_FUZZIER_F(oph[y], aph[y]);
+                        }
+                    }
+                }
+            }
+        }
+        releaseMock(mwm);
+    }
+
+    void column_cache_values() {
+        // Values read back from the shared column cache must be the
+        // same as those calculated afresh
+        auto mwm = makeMock({ Sine, Cosine }, 64, 4);
+        for (int ch = 0; ch < 2; ++ch) {
+            FFTModel a(mwm, ch, HanningWindow, 16, 4, 16);
+            FFTModel c(mwm, ch, HanningWindow, 16, 4, 16);
+            a.setColumnCacheEnabled(true);
+            int w = a.getWidth();
+            int h = a.getHeight();
+            vector<float> re(h), im(h), ore(h), oim(h), mag(h), omag(h);
+            for (int x = 0; x < w; ++x) {
+                a.getValuesAt(x, re.data(), im.data());
+            }
+            // A new model has nothing in its own small cache, so
+            // reads through the shared one
+            FFTModel b(mwm, ch, HanningWindow, 16, 4, 16);
+            b.setColumnCacheEnabled(true);
+            QVERIFY(b.sharesColumnCacheWith(a));
+            for (int x = 0; x < w; ++x) {
+                b.getValuesAt(x, re.data(), im.data());
+                c.getValuesAt(x, ore.data(), oim.data());
+                b.getMagnitudesAt(x, mag.data());
+                c.getMagnitudesAt(x, omag.data());
+                for (int y = 0; y < h; ++y) {
+                    QCOMPARE(re[y], ore[y]);
+                    QCOMPARE(im[y], oim[y]);
+                    COMPARE_FUZZIER_F(mag[y], omag[y]);
+                }
+            }
+        }
+        releaseMock(mwm);
+    }
+
+    void column_cache_off_by_default() {
+        auto mwm = makeMock({ Sine }, 64, 4);
+        FFTModel a(mwm, 0, HanningWindow, 16, 4, 16);
+        FFTModel b(mwm, 0, HanningWindow, 16, 4, 16);
+        QVERIFY(!a.isColumnCacheEnabled());
+        QVERIFY(!a.sharesColumnCacheWith(b));
+        a.setColumnCacheEnabled(true);
+        vector<float> values(a.getHeight() * 2);
+        QVERIFY(a.getInterleavedValuesAt(0, values.data()));
+        QVERIFY(!a.getInterleavedValuesAt(-1, values.data()));
+        QVERIFY(!a.getInterleavedValuesAt(a.getWidth(), values.data()));
+        releaseMock(mwm);
+    }
+
+    void column_cache_stale_write() {
+        auto mwm = makeMock({ Sine }, 64, 4);
+        FFTColumnCache::Key key { mwm, 0, HanningWindow, 16, 4, 16 };
+        auto cache = FFTColumnCache::getInstance(key, 10);
+        QVERIFY(cache);
+        int h = cache->getHeight();
+        vector<complex<double>> col(h, complex<double>(1.0, -0.5));
+        vector<complex<double>> out(h);
+
+        // Calculated, but invalidated before it could be stored
+        uint32_t sequence = cache->getSequence(3);
+        cache->invalidate(2, 4);
+        cache->setColumnAt(3, col.data(), sequence);
+        QVERIFY(!cache->haveColumn(3));
+
+        sequence = cache->getSequence(3);
+        cache->setColumnAt(3, col.data(), sequence);
+        QVERIFY(cache->haveColumn(3));
+        QVERIFY(cache->getValuesAt(3, out.data(), h));
+        QCOMPARE(out[h-1].real(), 1.0);
+        QCOMPARE(out[h-1].imag(), -0.5);
+
+        sequence = cache->getSequence(7);
+        cache->setColumnAt(7, col.data(), sequence);
+        QVERIFY(cache->haveColumn(7));
+
+        // Only the range given is invalidated
+        cache->invalidate(0, 4);
+        QVERIFY(!cache->haveColumn(3));
+        QVERIFY(!cache->getValuesAt(3, out.data(), h));
+        QVERIFY(cache->haveColumn(7));
+        
+        cache.reset();
+        releaseMock(mwm);
+    }
+
+    void column_cache_bad_ranges() {
+        auto mwm = makeMock({ Sine }, 64, 4);
+        FFTColumnCache::Key key { mwm, 0, HanningWindow, 16, 4, 16 };
+        auto cache = FFTColumnCache::getInstance(key, 10);
+        QVERIFY(cache);
+        int h = cache->getHeight();
+        vector<complex<double>> col(h, complex<double>(1.0, -0.5));
+        cache->setColumnAt(3, col.data(), cache->getSequence(3));
+        QVERIFY(cache->haveColumn(3));
+
+        vector<complex<double>> out(h + 1);
+        vector<float> values(h + 1);
+        QVERIFY(cache->getValuesAt(3, out.data(), h));
+        QVERIFY(!cache->getValuesAt(3, out.data(), -1));
+        QVERIFY(!cache->getValuesAt(3, out.data(), h + 1));
+        QVERIFY(cache->getMagnitudesAt(3, values.data(), 1, h - 1));
+        QVERIFY(!cache->getMagnitudesAt(3, values.data(), 1, h));
+        QVERIFY(!cache->getMagnitudesAt(3, values.data(), 0, -1));
+        QVERIFY(!cache->getPhasesAt(3, values.data(), -1, 2));
+        QVERIFY(!cache->getPhasesAt(3, values.data(), h, 1));
+
+        // and the same through the model
+        FFTModel fftm(mwm, 0, HanningWindow, 16, 4, 16);
+        fftm.setColumnCacheEnabled(true);
+        vector<float> im(h + 1);
+        QVERIFY(fftm.getMagnitudesAt(3, values.data(), 1));
+        QVERIFY(!fftm.getMagnitudesAt(3, values.data(), 1, h));
+        QVERIFY(!fftm.getPhasesAt(3, values.data(), 0, -1));
+        QVERIFY(!fftm.getValuesAt(3, values.data(), im.data(), h, 1));
+        
+        cache.reset();
+        releaseMock(mwm);
+    }
     
 };
 
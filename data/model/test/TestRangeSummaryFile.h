@@ -0,0 +1,236 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_RANGE_SUMMARY_FILE_H
+#define TEST_RANGE_SUMMARY_FILE_H
+
+#include "../RangeSummaryFile.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+
+using namespace std;
+
+class TestRangeSummaryFile : public QObject
+{
+    Q_OBJECT
+
+private:
+    typedef RangeSummaryFile::Range Range;
+    typedef RangeSummaryFile::RangeBlock RangeBlock;
+
+    QTemporaryDir m_audioDir;
+    sv_frame_t m_blockSizes[2];
+
+    // The summary file only depends on the audio file's path, size
+    // and modification time, so it doesn't need to be real audio
+    QString makeAudioFile(QString name, int bytes) {
+        QString path = m_audioDir.filePath(name);
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) return "";
+        file.write(QByteArray(bytes, 'x'));
+        return path;
+    }
+
+    void makeCaches(int channels, sv_frame_t frames, RangeBlock caches[2]) {
+        for (int cacheType = 0; cacheType < 2; ++cacheType) {
+            sv_frame_t blocks = (frames + m_blockSizes[cacheType] - 1) /
+                m_blockSizes[cacheType];
+            caches[cacheType].clear();
+            for (sv_frame_t i = 0; i < blocks * channels; ++i) {
+                float v = float(i % 1000) / 1000.f;
+                caches[cacheType].push_back(Range(-v, v * 0.5f, v * 0.25f));
+            }
+        }
+    }
+
+    void compareCaches(const RangeBlock a[2], const RangeBlock b[2]) {
+        for (int cacheType = 0; cacheType < 2; ++cacheType) {
+            QCOMPARE(a[cacheType].size(), b[cacheType].size());
+            for (size_t i = 0; i < a[cacheType].size(); ++i) {
+                QCOMPARE(a[cacheType][i].min(), b[cacheType][i].min());
+                QCOMPARE(a[cacheType][i].max(), b[cacheType][i].max());
+                QCOMPARE(a[cacheType][i].absmean(), b[cacheType][i].absmean());
+            }
+        }
+    }
+
+private slots:
+    void initTestCase() {
+        QVERIFY(m_audioDir.isValid());
+        m_blockSizes[0] = 64;
+        m_blockSizes[1] = 90;
+    }
+
+    void init() {
+        // Start each test with an empty summary directory
+        RangeSummaryFile::cleanupSummaryDirectory(0);
+    }
+
+    void cleanupTestCase() {
+        RangeSummaryFile::cleanupSummaryDirectory(0);
+    }
+
+    void missingAudio() {
+        RangeSummaryFile file(m_audioDir.filePath("absent.wav"), 0, "");
+        QVERIFY(!file.isValid());
+        RangeBlock caches[2];
+        sv_frame_t frames = 0;
+        QVERIFY(!file.load(0, m_blockSizes, caches, frames));
+    }
+
+    void roundTrip() {
+        QString audio = makeAudioFile("roundtrip.wav", 1000);
+        RangeSummaryFile file(audio, 0, "normalise=0");
+        QVERIFY(file.isValid());
+
+        RangeBlock saved[2];
+        makeCaches(2, 100001, saved);
+        QVERIFY(file.save(2, m_blockSizes, saved, 100001));
+        QVERIFY(QFileInfo(file.getSummaryPath()).exists());
+
+        // A new object for the same audio file finds the same summary
+        RangeSummaryFile again(audio, 0, "normalise=0");
+        QCOMPARE(again.getSummaryPath(), file.getSummaryPath());
+
+        RangeBlock loaded[2];
+        sv_frame_t frames = 0;
+        QVERIFY(again.load(2, m_blockSizes, loaded, frames));
+        QCOMPARE(frames, sv_frame_t(100001));
+        compareCaches(saved, loaded);
+
+        // A channel count of zero accepts whatever was saved
+        QVERIFY(again.load(0, m_blockSizes, loaded, frames));
+    }
+
+    void truncated() {
+        QString audio = makeAudioFile("truncated.wav", 1000);
+        RangeSummaryFile file(audio, 0, "");
+
+        RangeBlock saved[2];
+        makeCaches(1, 50000, saved);
+        QVERIFY(file.save(1, m_blockSizes, saved, 50000));
+
+        QFile summary(file.getSummaryPath());
+        qint64 size = summary.size();
+        QVERIFY(summary.resize(size - 4));
+
+        RangeBlock loaded[2];
+        loaded[0].push_back(Range(1.f, 2.f, 3.f));
+        sv_frame_t frames = 123;
+        QVERIFY(!file.load(1, m_blockSizes, loaded, frames));
+
+        // Left untouched on failure
+        QCOMPARE(int(loaded[0].size()), 1);
+        QVERIFY(loaded[1].empty());
+        QCOMPARE(frames, sv_frame_t(123));
+
+        // And shorter than the header too
+        QVERIFY(summary.resize(10));
+        QVERIFY(!file.load(1, m_blockSizes, loaded, frames));
+    }
+
+    void wrongLayout() {
+        QString audio = makeAudioFile("layout.wav", 1000);
+        RangeSummaryFile file(audio, 0, "");
+
+        RangeBlock saved[2];
+        makeCaches(2, 50000, saved);
+        QVERIFY(file.save(2, m_blockSizes, saved, 50000));
+
+        RangeBlock loaded[2];
+        sv_frame_t frames = 0;
+
+        sv_frame_t otherBlockSizes[2] = { m_blockSizes[0], m_blockSizes[1] + 1 };
+        QVERIFY(!file.load(2, otherBlockSizes, loaded, frames));
+        otherBlockSizes[0] = m_blockSizes[0] * 2;
+        otherBlockSizes[1] = m_blockSizes[1];
+        QVERIFY(!file.load(2, otherBlockSizes, loaded, frames));
+
+        QVERIFY(!file.load(1, m_blockSizes, loaded, frames));
+        QVERIFY(loaded[0].empty());
+
+        QVERIFY(file.load(2, m_blockSizes, loaded, frames));
+    }
+
+    void changedAudio() {
+        QString audio = makeAudioFile("changed.wav", 1000);
+        RangeSummaryFile file(audio, 0, "");
+
+        RangeBlock saved[2];
+        makeCaches(1, 50000, saved);
+        QVERIFY(file.save(1, m_blockSizes, saved, 50000));
+
+        // Different reader options or target rate give a different
+        // summary for the same file
+        RangeSummaryFile otherOptions(audio, 0, "normalise=1");
+        QVERIFY(otherOptions.getSummaryPath() != file.getSummaryPath());
+        RangeSummaryFile otherRate(audio, 22050, "");
+        QVERIFY(otherRate.getSummaryPath() != file.getSummaryPath());
+
+        // As does a change to the audio file itself
+        QVERIFY(makeAudioFile("changed.wav", 2000) == audio);
+        RangeSummaryFile changed(audio, 0, "");
+        QVERIFY(changed.isValid());
+        QVERIFY(changed.getSummaryPath() != file.getSummaryPath());
+
+        RangeBlock loaded[2];
+        sv_frame_t frames = 0;
+        QVERIFY(!changed.load(1, m_blockSizes, loaded, frames));
+    }
+
+    void directoryLimit() {
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+        // Three summaries of the same size, saved at distinct times
+        QDateTime now = QDateTime::currentDateTimeUtc();
+        vector<RangeSummaryFile> files;
+        for (int i = 0; i < 3; ++i) {
+            QString audio = makeAudioFile(QString("limit%1.wav").arg(i), 1000);
+            files.push_back(RangeSummaryFile(audio, 0, ""));
+            RangeBlock saved[2];
+            makeCaches(1, 50000, saved);
+            QVERIFY(files[i].save(1, m_blockSizes, saved, 50000));
+            QFile summary(files[i].getSummaryPath());
+            QVERIFY(summary.open(QIODevice::ReadWrite));
+            QVERIFY(summary.setFileTime(now.addSecs(-100 + i * 10),
+                                        QFileDevice::FileModificationTime));
+        }
+
+        qint64 size = QFileInfo(files[0].getSummaryPath()).size();
+
+        // Loading the oldest marks it as the most recently used
+        RangeBlock loaded[2];
+        sv_frame_t frames = 0;
+        QVERIFY(files[0].load(1, m_blockSizes, loaded, frames));
+
+        // So it is the second oldest that goes first
+        RangeSummaryFile::cleanupSummaryDirectory(size * 2);
+        QVERIFY(QFileInfo(files[0].getSummaryPath()).exists());
+        QVERIFY(!QFileInfo(files[1].getSummaryPath()).exists());
+        QVERIFY(QFileInfo(files[2].getSummaryPath()).exists());
+
+        RangeSummaryFile::cleanupSummaryDirectory(size);
+        QVERIFY(QFileInfo(files[0].getSummaryPath()).exists());
+        QVERIFY(!QFileInfo(files[2].getSummaryPath()).exists());
+#else
+        QSKIP("Can't set file modification times with this version of Qt");
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,196 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_WAVE_FILE_MODEL_SUMMARIES_H
+#define TEST_WAVE_FILE_MODEL_SUMMARIES_H
+
+#include "../ReadOnlyWaveFileModel.h"
+
+#include "data/fileio/AudioFileReader.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QCoreApplication>
+#include <QThread>
+
+#include <cmath>
+
+using namespace std;
+
+// A reader of synthetic audio, with a different signal in each
+// channel, that can be read from any thread
+class SyntheticAudioFileReader : public AudioFileReader
+{
+public:
+    SyntheticAudioFileReader(sv_frame_t frames, int channels) {
+        m_frameCount = frames;
+        m_channelCount = channels;
+        m_sampleRate = 44100;
+    }
+
+    static float sampleAt(sv_frame_t frame, int channel) {
+        // A tone with a pseudo-random jitter, so that neither the
+        // minimum nor the maximum of a block is at a fixed offset
+        uint32_t h = uint32_t(frame) * 2654435761u + uint32_t(channel) * 40503u;
+        double jitter = double(h >> 8) / double(1 << 24) - 0.5;
+        return float(0.6 * sin(double(frame) * 0.01 * (channel + 1))
+                     + 0.3 * jitter);
+    }
+
+    QString getLocation() const override { return ""; }
+    QString getLocalFilename() const override { return ""; }
+    QString getTitle() const override { return "synthetic"; }
+    QString getMaker() const override { return ""; }
+    bool isQuicklySeekable() const override { return true; }
+
+    floatvec_t getInterleavedFrames(sv_frame_t start,
+                                    sv_frame_t count) const override {
+        floatvec_t data(count * m_channelCount);
+        data.resize(getInterleavedFrames(start, count, data.data())
+                    * m_channelCount);
+        return data;
+    }
+
+    sv_frame_t getInterleavedFrames(sv_frame_t start, sv_frame_t count,
+                                    float *buffer) const override {
+        if (start >= m_frameCount) return 0;
+        count = min(count, m_frameCount - start);
+        for (sv_frame_t i = 0; i < count; ++i) {
+            for (int c = 0; c < m_channelCount; ++c) {
+                buffer[i * m_channelCount + c] = sampleAt(start + i, c);
+            }
+        }
+        return count;
+    }
+};
+
+class TestWaveFileModelSummaries : public QObject
+{
+    Q_OBJECT
+
+private:
+    typedef RangeSummarisableTimeValueModel::Range Range;
+    typedef RangeSummarisableTimeValueModel::RangeBlock RangeBlock;
+
+    // Straightforward serial summary of each block of the given size
+    static RangeBlock reference(sv_frame_t frames, int channel,
+                                int blockSize) {
+        RangeBlock ranges;
+        for (sv_frame_t start = 0; start < frames; start += blockSize) {
+            sv_frame_t n = min(sv_frame_t(blockSize), frames - start);
+            float min = 0.f, max = 0.f;
+            double total = 0.0;
+            for (sv_frame_t i = 0; i < n; ++i) {
+                float s = SyntheticAudioFileReader::sampleAt(start + i, channel);
+                if (i == 0 || s < min) min = s;
+                if (i == 0 || s > max) max = s;
+                total += fabs(s);
+            }
+            ranges.push_back(Range(min, max, float(total / double(n))));
+        }
+        return ranges;
+    }
+
+    static bool waitForReady(const ReadOnlyWaveFileModel &model) {
+        for (int i = 0; i < 3000; ++i) {
+            // The fill thread reports completion through a queued
+            // signal, so we need to process events to see it
+            QCoreApplication::processEvents();
+            if (model.isReady(nullptr)) return true;
+            QThread::msleep(10);
+        }
+        return false;
+    }
+
+private slots:
+    void parallelFill_data() {
+        QTest::addColumn<int>("channels");
+        QTest::addColumn<qlonglong>("frames");
+
+        // Long enough to be filled in parallel, with a tail that is
+        // a whole number of neither cache block size
+        QTest::newRow("mono") << 1 << qlonglong(1000003);
+        QTest::newRow("stereo") << 2 << qlonglong(1000003);
+        QTest::newRow("three channels, short tail") << 3 << qlonglong(1152001);
+    }
+
+    void parallelFill() {
+        QFETCH(int, channels);
+        QFETCH(qlonglong, frames);
+
+        SyntheticAudioFileReader reader(frames, channels);
+        ReadOnlyWaveFileModel model(FileSource("synthetic.wav"), &reader);
+        QVERIFY(model.isOK());
+        QVERIFY(waitForReady(model));
+
+        // The two cache block sizes, as chosen by the zoom constraint
+        for (int cacheBlockSize: { 64, 90 }) {
+            for (int c = 0; c < channels; ++c) {
+
+                RangeBlock expected = reference(frames, c, cacheBlockSize);
+
+                RangeBlock actual;
+                int blockSize = cacheBlockSize;
+                model.getSummaries(c, 0, frames, actual, blockSize);
+                QCOMPARE(blockSize, cacheBlockSize);
+                QCOMPARE(actual.size(), expected.size());
+
+                for (int i = 0; in_range_for(expected, i); ++i) {
+                    if (actual[i].min() != expected[i].min() ||
+                        actual[i].max() != expected[i].max() ||
+                        fabsf(actual[i].absmean() - expected[i].absmean())
+                        > 1e-5f) {
+                        cerr << "Mismatch at block " << i << " of "
+                             << expected.size() << " (block size "
+                             << cacheBlockSize << ", channel " << c
+                             << "): expected " << expected[i].min() << ", "
+                             << expected[i].max() << ", "
+                             << expected[i].absmean() << ", got "
+                             << actual[i].min() << ", " << actual[i].max()
+                             << ", " << actual[i].absmean() << endl;
+                        QFAIL("Summary differs from reference");
+                    }
+                }
+            }
+        }
+    }
+
+    void readFromBeforeStartFrame() {
+        // A read beginning before the model's start frame should
+        // still reach the end of the file, in both the vector and the
+        // multi-channel overloads
+        sv_frame_t frames = 1000, offset = 300;
+        SyntheticAudioFileReader reader(frames, 2);
+        ReadOnlyWaveFileModel model(FileSource("synthetic.wav"), &reader);
+        QVERIFY(model.isOK());
+        QVERIFY(waitForReady(model));
+        model.setStartFrame(offset);
+
+        floatvec_t data = model.getData(1, 0, model.getEndFrame());
+        QCOMPARE(sv_frame_t(data.size()), frames);
+        QCOMPARE(data[0], SyntheticAudioFileReader::sampleAt(0, 1));
+        QCOMPARE(data[frames - 1],
+                 SyntheticAudioFileReader::sampleAt(frames - 1, 1));
+
+        auto multi = model.getMultiChannelData(0, 1, 0, model.getEndFrame());
+        QCOMPARE(int(multi.size()), 2);
+        for (int c = 0; c < 2; ++c) {
+            QCOMPARE(sv_frame_t(multi[c].size()), frames);
+            QCOMPARE(multi[c][frames - 1],
+                     SyntheticAudioFileReader::sampleAt(frames - 1, c));
+        }
+    }
+};
+
+#endif
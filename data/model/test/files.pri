@@ -1,9 +1,12 @@
 TEST_HEADERS += \
 	Compares.h \
 	MockWaveModel.h \
+	TestEditableDenseModel.h \
 	TestFFTModel.h \
+	TestRangeSummaryFile.h \
         TestSparseModels.h \
         TestWaveformOversampler.h \
+        TestWaveFileModelSummaries.h \
         TestZoomConstraints.h
 	
 TEST_SOURCES += \
@@ -15,6 +15,9 @@
 #include "TestZoomConstraints.h"
 #include "TestWaveformOversampler.h"
 #include "TestSparseModels.h"
+#include "TestEditableDenseModel.h"
+#include "TestWaveFileModelSummaries.h"
+#include "TestRangeSummaryFile.h"
 
 #include "system/Init.h"
 
@@ -58,6 +61,24 @@ int main(int argc, char *argv[])
         else ++bad;
     }
 
+    {
+        TestEditableDenseModel t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    {
+        TestWaveFileModelSummaries t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+    {
+        TestRangeSummaryFile t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
     if (bad > 0) {
         SVCERR << "\n********* " << bad << " test suite(s) failed!\n" << endl;
         return 1;
@@ -8,6 +8,7 @@ SVCORE_HEADERS = \
            base/ColumnOp.h \
            base/Command.h \
            base/Debug.h \
+           base/EpochReclaimer.h \
            base/Event.h \
            base/EventSeries.h \
            base/Exceptions.h \
@@ -18,6 +19,7 @@ SVCORE_HEADERS = \
            base/MagnitudeRange.h \
            base/NoteData.h \
            base/NoteExportable.h \
+           base/NumberFormat.h \
            base/Pitch.h \
            base/Playable.h \
            base/PlayParameterRepository.h \
@@ -43,6 +45,7 @@ SVCORE_HEADERS = \
            base/TempDirectory.h \
            base/TempWriteFile.h \
            base/TextMatcher.h \
+           base/TextMatcherIndex.h \
            base/Thread.h \
            base/UnitDatabase.h \
            base/ViewManagerBase.h \
@@ -53,16 +56,21 @@ SVCORE_HEADERS = \
            data/fileio/AudioFileReader.h \
            data/fileio/AudioFileReaderFactory.h \
            data/fileio/AudioFileSizeEstimator.h \
+           data/fileio/AudioReadScheduler.h \
            data/fileio/BQAFileReader.h \
+           data/fileio/BinaryFeatureFileReader.h \
+           data/fileio/BinaryFeatureFormat.h \
            data/fileio/BZipFileDevice.h \
            data/fileio/CachedFile.h \
            data/fileio/CodedAudioFileReader.h \
+           data/fileio/CompactSampleBuffer.h \
            data/fileio/CSVFileReader.h \
            data/fileio/CSVFileWriter.h \
            data/fileio/CSVFormat.h \
            data/fileio/CSVStreamWriter.h \
            data/fileio/DataFileReader.h \
            data/fileio/DataFileReaderFactory.h \
+           data/fileio/DecodeScheduler.h \
            data/fileio/DecodingWavFileReader.h \
            data/fileio/FileFinder.h \
            data/fileio/FileReadThread.h \
@@ -70,7 +78,9 @@ SVCORE_HEADERS = \
            data/fileio/MIDIFileReader.h \
            data/fileio/MIDIFileWriter.h \
            data/fileio/MP3FileReader.h \
+           data/fileio/MappedAudioFile.h \
            data/fileio/PlaylistFileReader.h \
+           data/fileio/QueuedFileDevice.h \
            data/fileio/TextTest.h \
            data/fileio/WavFileReader.h \
            data/fileio/WavFileWriter.h \
@@ -86,6 +96,7 @@ SVCORE_HEADERS = \
            data/model/DeferredNotifier.h \
            data/model/EditableDenseThreeDimensionalModel.h \
            data/model/EventCommands.h \
+           data/model/FFTColumnCache.h \
            data/model/FFTModel.h \
            data/model/ImageModel.h \
            data/model/Labeller.h \
@@ -96,8 +107,10 @@ SVCORE_HEADERS = \
            data/model/PowerOfSqrtTwoZoomConstraint.h \
            data/model/PowerOfTwoZoomConstraint.h \
            data/model/RangeSummarisableTimeValueModel.h \
+           data/model/RangeSummaryFile.h \
            data/model/RegionModel.h \
            data/model/RelativelyFineZoomConstraint.h \
+           data/model/SparseModelEdits.h \
            data/model/SparseOneDimensionalModel.h \
            data/model/SparseTimeValueModel.h \
            data/model/TabularModel.h \
@@ -116,6 +129,7 @@ SVCORE_HEADERS = \
            plugin/LADSPAPluginFactory.h \
            plugin/LADSPAPluginInstance.h \
            plugin/NativeVampPluginFactory.h \
+           plugin/PiperServerPool.h \
            plugin/PiperVampPluginFactory.h \
            plugin/PluginIdentifier.h \
            plugin/PluginPathSetter.h \
@@ -141,10 +155,12 @@ SVCORE_HEADERS = \
            rdf/RDFTransformFactory.h \
 	   system/Init.h \
            system/System.h \
+           transform/BinaryFeatureWriter.h \
 	   transform/CSVFeatureWriter.h \
            transform/FeatureExtractionModelTransformer.h \
            transform/FeatureWriter.h \
            transform/FileFeatureWriter.h \
+           transform/InstalledTransformCache.h \
            transform/RealTimeEffectModelTransformer.h \
            transform/Transform.h \
            transform/TransformDescription.h \
@@ -163,6 +179,7 @@ SVCORE_SOURCES = \
            base/Exceptions.cpp \
            base/HelperExecPath.cpp \
            base/LogRange.cpp \
+           base/NumberFormat.cpp \
            base/Pitch.cpp \
            base/PlayParameterRepository.cpp \
            base/PlayParameters.cpp \
@@ -184,6 +201,7 @@ SVCORE_SOURCES = \
            base/TempDirectory.cpp \
            base/TempWriteFile.cpp \
            base/TextMatcher.cpp \
+           base/TextMatcherIndex.cpp \
            base/Thread.cpp \
            base/UnitDatabase.cpp \
            base/ViewManagerBase.cpp \
@@ -192,21 +210,28 @@ SVCORE_SOURCES = \
            data/fileio/AudioFileReader.cpp \
            data/fileio/AudioFileReaderFactory.cpp \
            data/fileio/AudioFileSizeEstimator.cpp \
+           data/fileio/AudioReadScheduler.cpp \
            data/fileio/BQAFileReader.cpp \
+           data/fileio/BinaryFeatureFileReader.cpp \
+           data/fileio/BinaryFeatureFormat.cpp \
            data/fileio/BZipFileDevice.cpp \
            data/fileio/CachedFile.cpp \
            data/fileio/CodedAudioFileReader.cpp \
+           data/fileio/CompactSampleBuffer.cpp \
            data/fileio/CSVFileReader.cpp \
            data/fileio/CSVFileWriter.cpp \
            data/fileio/CSVFormat.cpp \
            data/fileio/DataFileReaderFactory.cpp \
+           data/fileio/DecodeScheduler.cpp \
            data/fileio/DecodingWavFileReader.cpp \
            data/fileio/FileReadThread.cpp \
            data/fileio/FileSource.cpp \
            data/fileio/MIDIFileReader.cpp \
            data/fileio/MIDIFileWriter.cpp \
            data/fileio/MP3FileReader.cpp \
+           data/fileio/MappedAudioFile.cpp \
            data/fileio/PlaylistFileReader.cpp \
+           data/fileio/QueuedFileDevice.cpp \
            data/fileio/TextTest.cpp \
            data/fileio/WavFileReader.cpp \
            data/fileio/WavFileWriter.cpp \
@@ -218,12 +243,14 @@ SVCORE_SOURCES = \
            data/model/Dense3DModelPeakCache.cpp \
            data/model/DenseTimeValueModel.cpp \
            data/model/EditableDenseThreeDimensionalModel.cpp \
+           data/model/FFTColumnCache.cpp \
            data/model/FFTModel.cpp \
            data/model/Model.cpp \
            data/model/ModelDataTableModel.cpp \
            data/model/PowerOfSqrtTwoZoomConstraint.cpp \
            data/model/PowerOfTwoZoomConstraint.cpp \
            data/model/RangeSummarisableTimeValueModel.cpp \
+           data/model/RangeSummaryFile.cpp \
            data/model/RelativelyFineZoomConstraint.cpp \
            data/model/WaveformOversampler.cpp \
            data/model/WaveFileModel.cpp \
@@ -238,6 +265,7 @@ SVCORE_SOURCES = \
            plugin/LADSPAPluginFactory.cpp \
            plugin/LADSPAPluginInstance.cpp \
            plugin/NativeVampPluginFactory.cpp \
+           plugin/PiperServerPool.cpp \
            plugin/PiperVampPluginFactory.cpp \
            plugin/PluginIdentifier.cpp \
            plugin/PluginPathSetter.cpp \
@@ -254,9 +282,11 @@ SVCORE_SOURCES = \
 	   system/Init.cpp \
            system/System.cpp \
            system/os-other.cpp \
+           transform/BinaryFeatureWriter.cpp \
 	   transform/CSVFeatureWriter.cpp \
            transform/FeatureExtractionModelTransformer.cpp \
            transform/FileFeatureWriter.cpp \
+           transform/InstalledTransformCache.cpp \
            transform/RealTimeEffectModelTransformer.cpp \
            transform/Transform.cpp \
            transform/TransformFactory.cpp \
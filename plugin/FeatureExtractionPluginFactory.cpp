@@ -22,29 +22,36 @@
 #include "base/Preferences.h"
 #include "base/Debug.h"
 
+static QMutex instanceMutex;
+static FeatureExtractionPluginFactory *theInstance = nullptr;
+
 FeatureExtractionPluginFactory *
 FeatureExtractionPluginFactory::instance()
 {
-    static QMutex mutex;
-    static FeatureExtractionPluginFactory *instance = nullptr;
-
-    QMutexLocker locker(&mutex);
+    QMutexLocker locker(&instanceMutex);
     
-    if (!instance) {
+    if (!theInstance) {
 
 #ifdef HAVE_PIPER
         if (Preferences::getInstance()->getRunPluginsInProcess()) {
             SVDEBUG << "FeatureExtractionPluginFactory: in-process preference set, using native factory" << endl;
-            instance = new NativeVampPluginFactory();
+            theInstance = new NativeVampPluginFactory();
         } else {
             SVDEBUG << "FeatureExtractionPluginFactory: in-process preference not set, using Piper factory" << endl;
-            instance = new PiperVampPluginFactory();
+            theInstance = new PiperVampPluginFactory();
         }
 #else
         SVDEBUG << "FeatureExtractionPluginFactory: no Piper support compiled in, using native factory" << endl;
-        instance = new NativeVampPluginFactory();
+        theInstance = new NativeVampPluginFactory();
 #endif
     }
 
-    return instance;
+    return theInstance;
+}
+
+void
+FeatureExtractionPluginFactory::setInstance(FeatureExtractionPluginFactory *f)
+{
+    QMutexLocker locker(&instanceMutex);
+    theInstance = f;
 }
@@ -30,6 +30,14 @@ class FeatureExtractionPluginFactory
 {
 public:
     static FeatureExtractionPluginFactory *instance();
+
+    /**
+     * Replace the factory returned by instance(), for example with
+     * one that wraps the original in order to instrument the plugins
+     * it makes. The factory is not owned here, and must outlive any
+     * use of it. The factory it replaces is not deleted.
+     */
+    static void setInstance(FeatureExtractionPluginFactory *factory);
     
     virtual ~FeatureExtractionPluginFactory() { }
 
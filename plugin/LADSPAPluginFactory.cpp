@@ -631,6 +631,11 @@ LADSPAPluginFactory::discoverPlugins()
 
     generateFallbackCategories();
 
+    // The scan is usually done already, by TransformFactory, unless
+    // it populated its transforms from its cache instead. (PluginScan
+    // serialises this, and does nothing if it has already been done)
+    PluginScan::getInstance()->scan();
+    
     auto candidates =
         PluginScan::getInstance()->getCandidateLibrariesFor(getPluginType());
 
@@ -0,0 +1,352 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifdef HAVE_PIPER
+
+#include "PiperServerPool.h"
+
+#ifdef _WIN32
+#undef VOID
+#undef ERROR
+#define CAPNP_LITE 1
+#endif
+
+#include "vamp-client/qt/ProcessQtTransport.h"
+#include "vamp-client/CapnpRRClient.h"
+
+#include "base/Debug.h"
+#include "base/Profiler.h"
+
+#include <QMutexLocker>
+#include <QSettings>
+#include <QThread>
+
+#include <algorithm>
+
+using namespace std;
+
+//#define DEBUG_PIPER_SERVER_POOL 1
+
+// How long to wait for a server to be released, when the limit has
+// been reached, before starting one anyway
+static const unsigned long overflowWaitMs = 5000;
+
+PiperServerPool::PiperServerPool(std::shared_ptr<piper_vamp::client::LogCallback> logger) :
+    m_logger(logger),
+    m_maxServers(0)
+{
+    QSettings settings;
+    settings.beginGroup("PiperServerPool");
+    m_maxServers = settings.value("max-servers", 0).toInt();
+    settings.endGroup();
+
+    if (m_maxServers < 0) {
+        m_maxServers = 0;
+    }
+}
+
+PiperServerPool::~PiperServerPool()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (auto &t: m_servers) {
+        for (auto s: t.second) {
+            if (s->inUse) {
+                // Something loaded through it may still refer to its
+                // client, so we can only leave it be
+                SVCERR << "WARNING: PiperServerPool: server " << s->executable
+                       << " still in use on pool destruction" << endl;
+                continue;
+            }
+            // Whichever thread started it, there is no later chance
+            stop(s);
+        }
+    }
+}
+
+PiperServerPool::Server *
+PiperServerPool::acquire(const HelperExecPath::HelperExec &helper)
+{
+    Profiler profiler("PiperServerPool::acquire");
+    
+    QString tag = helper.tag;
+    QThread *current = QThread::currentThread();
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        bool overflow = false;
+        
+        while (true) {
+
+            auto &servers = m_servers[tag];
+
+            // Discard any idle server that has died or been retired
+            // since it was last used, then take the first idle one
+            // remaining that was started on this thread
+            
+            reap(servers);
+
+            for (auto s: servers) {
+                if (!s->inUse && !s->retired && s->thread == current &&
+                    s->executable == helper.executable) {
+#ifdef DEBUG_PIPER_SERVER_POOL
+                    SVDEBUG << "PiperServerPool: reusing server "
+                            << s->executable << endl;
+#endif
+                    s->inUse = true;
+                    return s;
+                }
+            }
+
+            if (overflow ||
+                countActive(servers) + m_starting[tag] < getLimit()) {
+                break;
+            }
+
+            // An idle server belonging to another thread is no use to
+            // us, so rather than wait, take its place; its own thread
+            // will stop it
+            
+            auto idle = find_if(servers.begin(), servers.end(),
+                                [](const Server *s) {
+                                    return !s->inUse && !s->retired;
+                                });
+            if (idle != servers.end()) {
+#ifdef DEBUG_PIPER_SERVER_POOL
+                SVDEBUG << "PiperServerPool: retiring idle server "
+                        << (*idle)->executable << " from another thread"
+                        << endl;
+#endif
+                (*idle)->retired = true;
+                reap(servers);
+                break;
+            }
+
+            if (!m_condition.wait(&m_mutex, overflowWaitMs)) {
+                SVDEBUG << "PiperServerPool: no server with tag \"" << tag
+                        << "\" released within " << overflowWaitMs
+                        << "ms, starting another beyond the limit of "
+                        << getLimit() << endl;
+                overflow = true; // but look once more for an idle one
+            }
+        }
+
+        ++m_starting[tag];
+    }
+
+    // Starting the process can take a while, so we do it without
+    // the lock; m_starting keeps our place against the limit
+    
+    Server *server = start(helper);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        --m_starting[tag];
+        if (server) {
+            server->thread = current;
+            server->inUse = true;
+            m_servers[tag].push_back(server);
+        }
+    }
+
+    if (!server) {
+        m_condition.wakeAll();
+    }
+    
+    return server;
+}
+
+void
+PiperServerPool::release(Server *server)
+{
+    if (!server) return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        server->inUse = false;
+
+        auto &servers = m_servers[server->tag];
+        bool running = isRunning(server);
+
+        if (!running || server->retired) {
+            SVDEBUG << "PiperServerPool: server " << server->executable
+                    << " has stopped running or failed; it will be "
+                    << "replaced" << endl;
+            server->retired = true;
+        } else if (countActive(servers) > getLimit()) {
+            server->retired = true;
+        }
+
+        reap(servers);
+    }
+
+    m_condition.wakeAll();
+}
+
+void
+PiperServerPool::retire(Server *server)
+{
+    if (!server) return;
+
+    QMutexLocker locker(&m_mutex);
+    server->retired = true;
+}
+
+void
+PiperServerPool::setMaxServers(int n)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+
+        m_maxServers = max(n, 0);
+
+        // Retire idle servers that are now over the limit
+        for (auto &t: m_servers) {
+            auto &servers = t.second;
+            for (auto s: servers) {
+                if (countActive(servers) <= getLimit()) break;
+                if (!s->inUse && !s->retired) {
+                    s->retired = true;
+                }
+            }
+            reap(servers);
+        }
+    }
+
+    m_condition.wakeAll();
+}
+
+int
+PiperServerPool::getMaxServers() const
+{
+    QMutexLocker locker(&m_mutex);
+    return getLimit();
+}
+
+int
+PiperServerPool::getLimit() const
+{
+    // called with m_mutex held
+    
+    if (m_maxServers > 0) {
+        return m_maxServers;
+    }
+    return max(1, QThread::idealThreadCount());
+}
+
+int
+PiperServerPool::countActive(const vector<Server *> &servers) const
+{
+    // called with m_mutex held; retired servers are on their way out
+    // and don't count against the limit
+    
+    return int(count_if(servers.begin(), servers.end(),
+                        [](const Server *s) { return !s->retired; }));
+}
+
+bool
+PiperServerPool::canStop(const Server *server) const
+{
+    // A server's process may be stopped only on the thread that
+    // started it, or once that thread has gone
+    
+    const QThread *thread = server->thread;
+    return (!thread ||
+            thread == QThread::currentThread() ||
+            thread->isFinished());
+}
+
+void
+PiperServerPool::reap(vector<Server *> &servers)
+{
+    // called with m_mutex held
+    
+    for (auto i = servers.begin(); i != servers.end(); ) {
+
+        Server *s = *i;
+        const QThread *thread = s->thread;
+        bool orphaned = (!thread || thread->isFinished());
+        
+        if (s->inUse || !canStop(s)) {
+            ++i;
+            continue;
+        }
+
+        if (!s->retired && !orphaned && isRunning(s)) {
+            ++i;
+            continue;
+        }
+
+        if (!s->retired && !isRunning(s)) {
+            SVDEBUG << "PiperServerPool: discarding idle server "
+                    << s->executable << " as it is no longer running"
+                    << endl;
+        }
+        
+        stop(s);
+        i = servers.erase(i);
+    }
+}
+
+PiperServerPool::Server *
+PiperServerPool::start(const HelperExecPath::HelperExec &helper)
+{
+    Profiler profiler("PiperServerPool::start");
+
+    SVDEBUG << "PiperServerPool: starting server " << helper.executable
+            << " (tag \"" << helper.tag << "\")" << endl;
+    
+    auto transport = new piper_vamp::client::ProcessQtTransport
+        (helper.executable.toStdString(), "capnp", m_logger.get());
+
+    if (!transport->isOK()) {
+        SVDEBUG << "PiperServerPool: Failed to start Piper process transport"
+                << endl;
+        delete transport;
+        return nullptr;
+    }
+
+    Server *server = new Server;
+    server->executable = helper.executable;
+    server->tag = helper.tag;
+    server->transport = transport;
+    server->client = new piper_vamp::client::CapnpRRClient(transport, m_logger.get());
+    server->inUse = false;
+    server->retired = false;
+    return server;
+}
+
+void
+PiperServerPool::stop(Server *server)
+{
+#ifdef DEBUG_PIPER_SERVER_POOL
+    SVDEBUG << "PiperServerPool: stopping server " << server->executable
+            << endl;
+#endif
+
+    // Deleting the transport ends the process, if it is still running
+    delete server->client;
+    delete server->transport;
+    delete server;
+}
+
+bool
+PiperServerPool::isRunning(const Server *server) const
+{
+    return server->transport->isOK();
+}
+
+#endif
@@ -0,0 +1,149 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_PIPER_SERVER_POOL_H
+#define SV_PIPER_SERVER_POOL_H
+
+#ifdef HAVE_PIPER
+
+#include "base/HelperExecPath.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QPointer>
+#include <QThread>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace piper_vamp {
+namespace client {
+class LogCallback;
+class ProcessQtTransport;
+class CapnpRRClient;
+}
+}
+
+/**
+ * A pool of running Piper server processes, kept for reuse so that
+ * a plugin can sometimes be loaded without waiting for a new server
+ * to start and load its libraries.
+ *
+ * Servers are pooled separately for each helper tag (i.e. each
+ * server executable). A caller acquires a server, which it then has
+ * to itself, loads a plugin into it or lists plugins through it, and
+ * releases it when the plugin has been deleted. A released server
+ * stays running for the next caller, unless it has crashed, in which
+ * case it is killed and a fresh one is started when next needed.
+ *
+ * A server's process is owned by the thread that started it, and
+ * may not be used or stopped from any other. So an idle server is
+ * only handed to a caller on the same thread, and one released on
+ * another thread, or found to be unwanted there, is stopped the next
+ * time its own thread calls into the pool, or once that thread has
+ * finished. No servers are started in advance.
+ *
+ * This limits what the pool can do. Reuse happens only for a thread
+ * that loads plugins repeatedly, such as the GUI thread when it
+ * queries plugin descriptors or parameters. A transform runs on a
+ * thread of its own, as does each worker of a segmented extraction,
+ * so these always start a fresh server; the pool only bounds how
+ * many are running at once.
+ *
+ * The number of servers per tag is limited, to the number of
+ * processor cores unless set otherwise (with setMaxServers or the
+ * "max-servers" value in the "PiperServerPool" settings group). A
+ * caller who finds the limit reached takes the place of an idle
+ * server belonging to another thread, if there is one, or else
+ * waits for a server to be released. If none is released within a
+ * few seconds, a server is started anyway, so that a caller who
+ * already holds every server for a tag cannot deadlock itself.
+ */
+class PiperServerPool
+{
+public:
+    struct Server {
+        QString executable;
+        QString tag;
+        piper_vamp::client::ProcessQtTransport *transport;
+        piper_vamp::client::CapnpRRClient *client;
+        QPointer<QThread> thread; // that started it, and owns its process
+        bool inUse;
+        bool retired;
+    };
+
+    /**
+     * Construct a pool whose servers log through the given logger.
+     * The pool shares ownership of it, as servers may still be
+     * running (and logging) after whoever made the pool has gone.
+     */
+    PiperServerPool(std::shared_ptr<piper_vamp::client::LogCallback> logger);
+    virtual ~PiperServerPool();
+
+    /**
+     * Return a running server for the given helper, starting one if
+     * none is idle. Return nullptr if a server could not be started.
+     */
+    Server *acquire(const HelperExecPath::HelperExec &helper);
+
+    /**
+     * Return a server obtained from acquire, once nothing loaded
+     * through it remains. A server that is still running is kept
+     * for reuse.
+     */
+    void release(Server *server);
+
+    /**
+     * Mark a server obtained from acquire as unfit for reuse, for
+     * example because it has crashed. It is stopped when released
+     * rather than being kept.
+     */
+    void retire(Server *server);
+
+    void setMaxServers(int n);
+    int getMaxServers() const;
+
+    PiperServerPool(const PiperServerPool &) =delete;
+    PiperServerPool &operator=(const PiperServerPool &) =delete;
+
+protected:
+    // These start, stop, and check on the server process, and may be
+    // overridden in tests to do without one. stop() and isRunning()
+    // are called with m_mutex held. The destructor stops servers
+    // with PiperServerPool::stop, which frees the Server and its
+    // transport and client if present.
+    virtual Server *start(const HelperExecPath::HelperExec &helper);
+    virtual void stop(Server *server);
+    virtual bool isRunning(const Server *server) const;
+
+private:
+    // These are called with m_mutex held
+    int getLimit() const;
+    int countActive(const std::vector<Server *> &servers) const;
+    bool canStop(const Server *server) const;
+    void reap(std::vector<Server *> &servers);
+    
+    std::shared_ptr<piper_vamp::client::LogCallback> m_logger;
+    mutable QMutex m_mutex;
+    QWaitCondition m_condition;
+    std::map<QString, std::vector<Server *>> m_servers; // tag -> servers
+    std::map<QString, int> m_starting; // tag -> count being started
+    int m_maxServers;
+};
+
+#endif
+
+#endif
@@ -16,6 +16,7 @@
 #ifdef HAVE_PIPER
 
 #include "PiperVampPluginFactory.h"
+#include "PiperServerPool.h"
 #include "PluginIdentifier.h"
 
 #include "system/System.h"
@@ -28,10 +29,10 @@
 #define CAPNP_LITE 1
 #endif
 
-#include "vamp-client/qt/PiperAutoPlugin.h"
-#include "vamp-client/qt/ProcessQtTransport.h"
 #include "vamp-client/CapnpRRClient.h"
 
+#include <vamp-hostsdk/PluginWrapper.h>
+
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
@@ -54,9 +55,200 @@ protected:
     }
 };
 
+/**
+ * Wraps a plugin loaded into a pooled server, handing the server back
+ * to the pool when the plugin is deleted.
+ *
+ * As PiperAutoPlugin did, calls that go to the server are guarded
+ * against its having crashed: the crash is logged, the call returns
+ * an empty or failure result, and every later call does the same
+ * without going near the server again. The server is retired, so
+ * that the pool replaces it rather than reusing it.
+ */
+class PiperPooledPluginAdapter : public Vamp::HostExt::PluginWrapper {
+public:
+    PiperPooledPluginAdapter(Vamp::Plugin *plugin,
+                             std::shared_ptr<PiperServerPool> pool,
+                             PiperServerPool::Server *server) :
+        PluginWrapper(plugin), m_pool(pool), m_server(server),
+        m_crashed(false) { }
+    ~PiperPooledPluginAdapter() override;
+
+    bool initialise(size_t inputChannels,
+                    size_t stepSize,
+                    size_t blockSize) override;
+    void reset() override;
+
+    ParameterList getParameterDescriptors() const override;
+    float getParameter(std::string) const override;
+    void setParameter(std::string, float) override;
+    std::string getCurrentProgram() const override;
+    void selectProgram(std::string) override;
+
+    OutputList getOutputDescriptors() const override;
+
+    FeatureSet process(const float *const *inputBuffers,
+                       Vamp::RealTime timestamp) override;
+    FeatureSet getRemainingFeatures() override;
+
+protected:
+    std::shared_ptr<PiperServerPool> m_pool;
+    PiperServerPool::Server *m_server;
+    mutable bool m_crashed;
+
+    void serverCrashed(std::string call, std::string message) const;
+};
+
+PiperPooledPluginAdapter::~PiperPooledPluginAdapter()
+{
+    // The plugin asks the server to unload it when it is deleted, and
+    // refers to the server's client until then, so it must go before
+    // the server is handed back for reuse
+    try {
+        delete m_plugin;
+    } catch (const std::exception &e) {
+        SVCERR << "PiperPooledPluginAdapter: caught exception while "
+               << "deleting plugin: " << e.what() << endl;
+        m_pool->retire(m_server);
+    }
+    m_plugin = nullptr;
+    m_pool->release(m_server);
+}
+
+void
+PiperPooledPluginAdapter::serverCrashed(std::string call,
+                                        std::string message) const
+{
+    SVCERR << "PiperPooledPluginAdapter: Piper server crashed or failed "
+           << "during " << call << ": " << message << endl;
+    m_crashed = true;
+    m_pool->retire(m_server);
+}
+
+bool
+PiperPooledPluginAdapter::initialise(size_t inputChannels,
+                                     size_t stepSize,
+                                     size_t blockSize)
+{
+    if (m_crashed) return false;
+    try {
+        return m_plugin->initialise(inputChannels, stepSize, blockSize);
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("initialise", c.what());
+        return false;
+    }
+}
+
+void
+PiperPooledPluginAdapter::reset()
+{
+    if (m_crashed) return;
+    try {
+        m_plugin->reset();
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("reset", c.what());
+    }
+}
+
+PiperPooledPluginAdapter::ParameterList
+PiperPooledPluginAdapter::getParameterDescriptors() const
+{
+    if (m_crashed) return {};
+    try {
+        return m_plugin->getParameterDescriptors();
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("getParameterDescriptors", c.what());
+        return {};
+    }
+}
+
+float
+PiperPooledPluginAdapter::getParameter(std::string name) const
+{
+    if (m_crashed) return 0.f;
+    try {
+        return m_plugin->getParameter(name);
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("getParameter", c.what());
+        return 0.f;
+    }
+}
+
+void
+PiperPooledPluginAdapter::setParameter(std::string name, float value)
+{
+    if (m_crashed) return;
+    try {
+        m_plugin->setParameter(name, value);
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("setParameter", c.what());
+    }
+}
+
+std::string
+PiperPooledPluginAdapter::getCurrentProgram() const
+{
+    if (m_crashed) return {};
+    try {
+        return m_plugin->getCurrentProgram();
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("getCurrentProgram", c.what());
+        return {};
+    }
+}
+
+void
+PiperPooledPluginAdapter::selectProgram(std::string program)
+{
+    if (m_crashed) return;
+    try {
+        m_plugin->selectProgram(program);
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("selectProgram", c.what());
+    }
+}
+
+PiperPooledPluginAdapter::OutputList
+PiperPooledPluginAdapter::getOutputDescriptors() const
+{
+    if (m_crashed) return {};
+    try {
+        return m_plugin->getOutputDescriptors();
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("getOutputDescriptors", c.what());
+        return {};
+    }
+}
+
+PiperPooledPluginAdapter::FeatureSet
+PiperPooledPluginAdapter::process(const float *const *inputBuffers,
+                                  Vamp::RealTime timestamp)
+{
+    if (m_crashed) return {};
+    try {
+        return m_plugin->process(inputBuffers, timestamp);
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("process", c.what());
+        return {};
+    }
+}
+
+PiperPooledPluginAdapter::FeatureSet
+PiperPooledPluginAdapter::getRemainingFeatures()
+{
+    if (m_crashed) return {};
+    try {
+        return m_plugin->getRemainingFeatures();
+    } catch (const piper_vamp::client::ServerCrashed &c) {
+        serverCrashed("getRemainingFeatures", c.what());
+        return {};
+    }
+}
+
 PiperVampPluginFactory::PiperVampPluginFactory() :
-    m_logger(new Logger)
+    m_pool(std::make_shared<PiperServerPool>(std::make_shared<Logger>()))
 {
+
     QString serverName = "piper-vamp-simple-server";
     float minimumVersion = 2.0;
 
@@ -89,7 +281,8 @@ PiperVampPluginFactory::PiperVampPluginFactory() :
 
 PiperVampPluginFactory::~PiperVampPluginFactory()
 {
-    delete m_logger;
+    // The pool, and the logger it owns, lasts as long as any plugin
+    // adapter holding it
 }
 
 bool
@@ -172,6 +365,11 @@ PiperVampPluginFactory::instantiatePlugin(QString identifier,
 {
     Profiler profiler("PiperVampPluginFactory::instantiatePlugin");
 
+    {
+        QMutexLocker locker(&m_mutex);
+        ensurePopulated();
+    }
+
     if (m_origins.find(identifier) == m_origins.end()) {
         SVCERR << "ERROR: No known server for identifier " << identifier << endl;
         return nullptr;
@@ -182,27 +380,74 @@ PiperVampPluginFactory::instantiatePlugin(QString identifier,
         return nullptr;
     }
 
-    SVDEBUG << "PiperVampPluginFactory: Creating PiperAutoPlugin for server "
+    const HelperExecPath::HelperExec *helper = nullptr;
+    for (const auto &server: m_servers) {
+        if (server.executable == m_origins[identifier]) {
+            helper = &server;
+            break;
+        }
+    }
+    if (!helper) {
+        SVCERR << "ERROR: No known helper for server "
+               << m_origins[identifier] << endl;
+        return nullptr;
+    }
+
+    SVDEBUG << "PiperVampPluginFactory: Loading plugin into server "
         << m_origins[identifier] << ", identifier " << identifier << endl;
+
+    // Each process() call on the resulting plugin is a separate
+    // synchronous request to the server, with its input serialised
+    // into the message, so for plugins with small step sizes the
+    // round-trip can cost more than the processing. Passing input
+    // through shared memory, or batching process calls whose
+    // features are not needed at once, would need support in the
+    // Piper protocol and in the server and transport implementations
+    // in piper-cpp; nothing in the plugin interface used here allows
+    // it. Until then, the way to avoid this cost is the in-process
+    // preference checked in FeatureExtractionPluginFactory.
+
+    PiperServerPool::Server *server = m_pool->acquire(*helper);
+    if (!server) {
+        SVCERR << "ERROR: Failed to start server " << m_origins[identifier]
+               << " for identifier " << identifier << endl;
+        return nullptr;
+    }
+
+    piper_vamp::LoadRequest req;
+    req.pluginKey = psd.pluginKey;
+    req.inputSampleRate = float(inputSampleRate);
+    req.adapterFlags = 0;
+
+    Vamp::Plugin *plugin = nullptr;
     
-    auto ap = new piper_vamp::client::PiperAutoPlugin
-        (m_origins[identifier].toStdString(),
-         psd.pluginKey,
-         float(inputSampleRate),
-         0,
-         m_logger);
-    
-    if (!ap->isOK()) {
-        delete ap;
+    try {
+        piper_vamp::LoadResponse resp = server->client->load(req);
+        plugin = resp.plugin;
+    } catch (const piper_vamp::client::ServerCrashed &) {
+        SVDEBUG << "PiperVampPluginFactory: Piper server crashed while loading "
+                << identifier << endl;
+        m_pool->retire(server);
+    } catch (const std::exception &e) {
+        SVDEBUG << "PiperVampPluginFactory: Exception caught while loading "
+                << identifier << ": " << e.what() << endl;
+    }
+
+    if (!plugin) {
+        m_pool->release(server);
         return nullptr;
     }
 
-    return std::shared_ptr<Vamp::Plugin>(ap);
+    return std::shared_ptr<Vamp::Plugin>
+        (new PiperPooledPluginAdapter(plugin, m_pool, server));
 }
 
 piper_vamp::PluginStaticData
 PiperVampPluginFactory::getPluginStaticData(QString identifier)
 {
+    QMutexLocker locker(&m_mutex);
+    ensurePopulated();
+    
     if (m_pluginData.find(identifier) != m_pluginData.end()) {
         return m_pluginData[identifier];
     } else {
@@ -213,6 +458,9 @@ PiperVampPluginFactory::getPluginStaticData(QString identifier)
 QString
 PiperVampPluginFactory::getPluginCategory(QString identifier)
 {
+    QMutexLocker locker(&m_mutex);
+    ensurePopulated();
+    
     if (m_taxonomy.find(identifier) != m_taxonomy.end()) {
         return m_taxonomy[identifier];
     } else {
@@ -230,6 +478,9 @@ PiperVampPluginFactory::getPluginLibraryPath(QString identifier)
     // what the SDK thinks the likely location would be (in case our
     // search order turns out to have been different)
 
+    QMutexLocker locker(&m_mutex);
+    ensurePopulated();
+    
     QStringList bits = identifier.split(':');
     if (bits.size() > 1) {
         QString soname = bits[bits.size() - 2];
@@ -241,9 +492,25 @@ PiperVampPluginFactory::getPluginLibraryPath(QString identifier)
     return QString();
 }
 
+void
+PiperVampPluginFactory::ensurePopulated()
+{
+    // Called with m_mutex held. We may be asked about a plugin before
+    // anyone has listed them all, if TransformFactory populated its
+    // transforms from its cache
+    
+    if (m_pluginData.empty() && !m_servers.empty()) {
+        QString errorMessage;
+        populate(errorMessage);
+    }
+}
+
 void
 PiperVampPluginFactory::populate(QString &errorMessage)
 {
+    // Normally done already by TransformFactory; see instantiatePlugin
+    PluginScan::getInstance()->scan();
+    
     QString someError;
 
     for (auto s: m_servers) {
@@ -298,34 +565,39 @@ PiperVampPluginFactory::populateFrom(const HelperExecPath::HelperExec &server,
         }
     }
     
-    piper_vamp::client::ProcessQtTransport transport(executable, "capnp", m_logger);
-    if (!transport.isOK()) {
+    // The server used for listing goes back into the pool afterwards,
+    // ready for the first plugin to be loaded from it on this thread
+    PiperServerPool::Server *ps = m_pool->acquire(server);
+    if (!ps) {
         SVDEBUG << "PiperVampPluginFactory: Failed to start Piper process transport" << endl;
         errorMessage = QObject::tr("Could not start external plugin host");
         return;
     }
 
-    piper_vamp::client::CapnpRRClient client(&transport, m_logger);
-
     piper_vamp::ListRequest req;
     req.from = from;
     
     piper_vamp::ListResponse resp;
 
     try {
-        resp = client.list(req);
+        resp = ps->client->list(req);
     } catch (const piper_vamp::client::ServerCrashed &) {
         SVDEBUG << "PiperVampPluginFactory: Piper server crashed" << endl;
         errorMessage = QObject::tr
             ("External plugin host exited unexpectedly while listing plugins");
+        m_pool->retire(ps);
+        m_pool->release(ps);
         return;
     } catch (const std::exception &e) {
         SVDEBUG << "PiperVampPluginFactory: Exception caught: " << e.what() << endl;
         errorMessage = QObject::tr("External plugin host invocation failed: %1")
             .arg(e.what());
+        m_pool->release(ps);
         return;
     }
 
+    m_pool->release(ps);
+
     SVDEBUG << "PiperVampPluginFactory: server \"" << executable << "\" lists "
             << resp.available.size() << " plugin(s)" << endl;
 
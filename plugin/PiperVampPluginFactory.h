@@ -23,13 +23,18 @@
 #include <QMutex>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include "base/Debug.h"
 #include "base/HelperExecPath.h"
 
+class PiperServerPool;
+
 /**
  * FeatureExtractionPluginFactory type for Vamp plugins hosted in a
- * separate process using Piper protocol.
+ * separate process using Piper protocol. Server processes are taken
+ * from a PiperServerPool and returned to it when the plugin loaded
+ * into them is deleted.
  */
 class PiperVampPluginFactory : public FeatureExtractionPluginFactory
 {
@@ -58,14 +63,15 @@ protected:
     std::map<QString, QString> m_libraries; // soname -> full file path
     std::map<QString, piper_vamp::PluginStaticData> m_pluginData; // identifier -> data
     std::map<QString, QString> m_taxonomy; // identifier -> category string
+    std::shared_ptr<PiperServerPool> m_pool; // shared with live plugins
 
     bool serverMeetsMinimumVersion(const HelperExecPath::HelperExec &server,
                                    float minimumVersion);
+    void ensurePopulated();
     void populate(QString &errorMessage);
     void populateFrom(const HelperExecPath::HelperExec &, QString &errorMessage);
 
     class Logger;
-    Logger *m_logger;
 };
 
 #endif
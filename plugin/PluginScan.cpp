@@ -113,10 +113,19 @@ PluginScan::scan()
         }
     }
 
+    m_scanned = true;
+
     SVDEBUG << "PluginScan::scan complete" << endl;
 #endif
 }
 
+void
+PluginScan::setCachedStartupFailureReport(QString report)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cachedReport = report;
+}
+
 bool
 PluginScan::scanSucceeded() const
 {
@@ -289,6 +298,12 @@ PluginScan::getStartupFailureReport() const
     
     QMutexLocker locker(&m_mutex);
 
+    if (!m_scanned) {
+        // TransformFactory skipped the scan at startup, and gave us
+        // the report from the last one
+        return m_cachedReport;
+    }
+    
     if (!m_succeeded) {
         return QObject::tr("<b>Failed to scan for plugins</b>"
                            "<p>Failed to scan for plugins at startup. Possibly "
@@ -73,6 +73,13 @@ public:
 
     QString getStartupFailureReport() const;
 
+    /**
+     * Provide a failure report, saved from the scan made during an
+     * earlier run, to be returned by getStartupFailureReport() for
+     * as long as no scan has been made during this one.
+     */
+    void setCachedStartupFailureReport(QString report);
+
 private:
     PluginScan();
     ~PluginScan();
@@ -91,6 +98,7 @@ private:
 
     bool m_scanned;
     bool m_succeeded;
+    QString m_cachedReport;
 
     class Logger;
     Logger *m_logger;
@@ -28,6 +28,9 @@
 #include "system/System.h"
 #include "base/Profiler.h"
 
+#include <QMutex>
+#include <QMutexLocker>
+
 #include <iostream>
 
 sv_samplerate_t RealTimePluginFactory::m_sampleRate = 48000;
@@ -42,6 +45,12 @@ RealTimePluginFactory::~RealTimePluginFactory()
 RealTimePluginFactory *
 RealTimePluginFactory::instance(QString pluginType)
 {
+    // The factories are not safe to use while they are discovering
+    // their plugins, so a caller arriving meanwhile (perhaps from the
+    // thread populating TransformFactory) waits for that to finish
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+
     if (pluginType == "ladspa") {
         if (!_ladspaInstance) {
 //            SVDEBUG << "RealTimePluginFactory::instance(" << pluginType//                      << "): creating new LADSPAPluginFactory" << endl;
@@ -73,6 +73,9 @@ protected:
 
     std::map<ModelId, std::map<QString, float> > m_labelValueMap;
 
+    // Events waiting to be added to each sparse model in one batch
+    std::map<ModelId, EventVector> m_pendingEvents;
+
     void getDataModelsAudio(std::vector<ModelId> &, ProgressReporter *);
     void getDataModelsSparse(std::vector<ModelId> &, ProgressReporter *);
     void getDataModelsDense(std::vector<ModelId> &, ProgressReporter *);
@@ -85,6 +88,9 @@ protected:
 
     void fillModel(ModelId, sv_frame_t, sv_frame_t,
                    bool, std::vector<float> &, QString);
+
+    void flushEvents(ModelId);
+    void flushAllEvents();
 };
 
 QString
@@ -348,11 +354,13 @@ RDFImporterImpl::getDataModelsDense(std::vector<ModelId> &models,
             auto m = std::make_shared<SparseTimeValueModel>
                 (sampleRate, hopSize, false);
 
+            EventVector ee;
+            ee.reserve(values.size());
             for (int j = 0; j < values.size(); ++j) {
                 float f = values[j].toFloat();
-                Event e(j * hopSize, f, "");
-                m->add(e);
+                ee.push_back(Event(j * hopSize, f, ""));
             }
+            m->addEvents(ee);
 
             m->setObjectName(getDenseModelTitle(feature, type));
             m->setRDFTypeURI(type);
@@ -695,6 +703,8 @@ RDFImporterImpl::getDataModelsSparse(std::vector<ModelId> &models,
             }
         }
     }
+
+    flushAllEvents();
 }
 
 void
@@ -709,7 +719,7 @@ RDFImporterImpl::fillModel(ModelId modelId,
 
     if (auto sodm = ModelById::getAs<SparseOneDimensionalModel>(modelId)) {
         Event point(ftime, label);
-        sodm->add(point);
+        m_pendingEvents[modelId].push_back(point);
         return;
     }
 
@@ -718,13 +728,13 @@ RDFImporterImpl::fillModel(ModelId modelId,
             (ftime,
              values.empty() ? 0.5f : values[0] < 0.f ? 0.f : values[0] > 1.f ? 1.f : values[0], // I was young and feckless once too
              label);
-        tm->add(e);
+        m_pendingEvents[modelId].push_back(e);
         return;
     }
 
     if (auto stvm = ModelById::getAs<SparseTimeValueModel>(modelId)) {
         Event e(ftime, values.empty() ? 0.f : values[0], label);
-        stvm->add(e);
+        m_pendingEvents[modelId].push_back(e);
         return;
     }
 
@@ -738,7 +748,7 @@ RDFImporterImpl::fillModel(ModelId modelId,
                 }
             }
             Event e(ftime, value, fduration, level, label);
-            nm->add(e);
+            m_pendingEvents[modelId].push_back(e);
         } else {
             float value = 0.f, duration = 1.f, level = 1.f;
             if (!values.empty()) {
@@ -752,7 +762,7 @@ RDFImporterImpl::fillModel(ModelId modelId,
             }
             Event e(ftime, value, sv_frame_t(lrintf(duration)),
                         level, label);
-            nm->add(e);
+            m_pendingEvents[modelId].push_back(e);
         }
         return;
     }
@@ -762,6 +772,9 @@ RDFImporterImpl::fillModel(ModelId modelId,
         if (values.empty()) {
             // no values? map each unique label to a distinct value
             if (m_labelValueMap[modelId].find(label) == m_labelValueMap[modelId].end()) {
+                // the model's value range must include everything
+                // added so far
+                flushEvents(modelId);
                 m_labelValueMap[modelId][label] = rm->getValueMaximum() + 1.f;
             }
             value = m_labelValueMap[modelId][label];
@@ -770,7 +783,7 @@ RDFImporterImpl::fillModel(ModelId modelId,
         }
         if (haveDuration) {
             Event e(ftime, value, fduration, label);
-            rm->add(e);
+            m_pendingEvents[modelId].push_back(e);
         } else {
             // This won't actually happen -- we only create region models
             // if we do have duration -- but just for completeness
@@ -782,7 +795,7 @@ RDFImporterImpl::fillModel(ModelId modelId,
                 }
             }
             Event e(ftime, value, sv_frame_t(lrintf(duration)), label);
-            rm->add(e);
+            m_pendingEvents[modelId].push_back(e);
         }
         return;
     }
@@ -791,6 +804,27 @@ RDFImporterImpl::fillModel(ModelId modelId,
     return;
 }
 
+void
+RDFImporterImpl::flushEvents(ModelId modelId)
+{
+    auto itr = m_pendingEvents.find(modelId);
+    if (itr == m_pendingEvents.end()) return;
+
+    if (auto editable = ModelById::getAs<EventEditable>(modelId)) {
+        editable->addEvents(itr->second);
+    }
+    
+    m_pendingEvents.erase(itr);
+}
+
+void
+RDFImporterImpl::flushAllEvents()
+{
+    while (!m_pendingEvents.empty()) {
+        flushEvents(m_pendingEvents.begin()->first);
+    }
+}
+
 RDFImporter::RDFDocumentType
 RDFImporter::identifyDocumentType(QUrl url)
 {
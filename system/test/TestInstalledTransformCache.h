@@ -0,0 +1,246 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_INSTALLED_TRANSFORM_CACHE_H
+#define TEST_INSTALLED_TRANSFORM_CACHE_H
+
+#include "../../transform/InstalledTransformCache.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QFile>
+
+class TestInstalledTransformCache : public QObject
+{
+    Q_OBJECT
+
+private:
+    typedef InstalledTransformCache::TransformDescriptionMap
+    TransformDescriptionMap;
+    typedef InstalledTransformCache::LibraryMap LibraryMap;
+    typedef InstalledTransformCache::FailureReports FailureReports;
+
+    QTemporaryDir m_tempDir;
+    QString m_pluginDir;
+    QString m_library;
+    QString m_cachePath;
+
+    TransformDescriptionMap makeTransforms() {
+        TransformDescriptionMap transforms;
+        TransformId a = "vamp:test-plugins:onsets:onsets";
+        TransformId b = "vamp:test-plugins:pitch:f0";
+        transforms[a] = TransformDescription
+            (TransformDescription::Analysis, "Time > Onsets", a,
+             "Onsets", "Onsets", "Detect onsets",
+             "Detect onsets using Onsets by Someone", "Someone", "", true);
+        transforms[b] = TransformDescription
+            (TransformDescription::Analysis, "Pitch", b,
+             "Pitch: F0", "F0", "Estimate pitch",
+             QString::fromUtf8("Estimate pitch \xc3\xa0 la mode"),
+             "Someone Else", "Hz", false);
+        return transforms;
+    }
+
+    LibraryMap makeLibraries(const TransformDescriptionMap &transforms) {
+        LibraryMap libraries;
+        for (const auto &t: transforms) {
+            libraries[t.first] = m_library;
+        }
+        return libraries;
+    }
+
+    InstalledTransformCache makeCache(QString context = "en_GB;in-process") {
+        return InstalledTransformCache(context, { m_pluginDir }, m_cachePath);
+    }
+
+    void writeLibrary(QByteArray contents) {
+        QFile f(m_library);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(contents);
+    }
+
+private slots:
+    void init() {
+        QVERIFY(m_tempDir.isValid());
+        QDir dir(m_tempDir.path());
+        dir.removeRecursively();
+        QVERIFY(dir.mkpath("plugins"));
+        m_pluginDir = dir.filePath("plugins");
+        m_library = QDir(m_pluginDir).filePath("test-plugins.so");
+        m_cachePath = dir.filePath("installed-transforms.cache");
+        writeLibrary("not really a library");
+    }
+
+    void noCache() {
+        TransformDescriptionMap loaded;
+        FailureReports reports;
+        QVERIFY(!makeCache().load(loaded, reports));
+        QVERIFY(loaded.empty());
+    }
+
+    void roundTrip() {
+        TransformDescriptionMap transforms = makeTransforms();
+        QVERIFY(makeCache().save(transforms, makeLibraries(transforms),
+                                 FailureReports()));
+
+        TransformDescriptionMap loaded;
+        FailureReports reports;
+        QVERIFY(makeCache().load(loaded, reports));
+        QVERIFY(InstalledTransformCache::sameDescriptions(loaded, transforms));
+
+        const TransformDescription &d =
+            loaded["vamp:test-plugins:pitch:f0"];
+        QCOMPARE(d.type, TransformDescription::Analysis);
+        QCOMPARE(d.longDescription,
+                 QString::fromUtf8("Estimate pitch \xc3\xa0 la mode"));
+        QCOMPARE(d.units, QString("Hz"));
+        QCOMPARE(d.configurable, false);
+    }
+
+    void staleLibrary() {
+        TransformDescriptionMap transforms = makeTransforms();
+        QVERIFY(makeCache().save(transforms, makeLibraries(transforms),
+                                 FailureReports()));
+        QVERIFY(makeCache().librariesUnchanged());
+
+        // A library of a different size has been updated in place,
+        // which the directory does not show, so the cache still loads
+        // but the library check fails
+        writeLibrary("a rather longer replacement library");
+
+        TransformDescriptionMap loaded;
+        FailureReports reports;
+        QVERIFY(makeCache().load(loaded, reports));
+        QVERIFY(!makeCache().librariesUnchanged());
+    }
+
+    void removedLibrary() {
+        TransformDescriptionMap transforms = makeTransforms();
+        QVERIFY(makeCache().save(transforms, makeLibraries(transforms),
+                                 FailureReports()));
+        QVERIFY(QFile::remove(m_library));
+        QVERIFY(!makeCache().librariesUnchanged());
+    }
+
+    void changedLibraries() {
+        TransformDescriptionMap transforms = makeTransforms();
+        LibraryMap libraries = makeLibraries(transforms);
+        QString other = QDir(m_pluginDir).filePath("other-plugins.so");
+        {
+            QFile f(other);
+            QVERIFY(f.open(QIODevice::WriteOnly));
+            f.write("another library");
+        }
+        libraries["vamp:test-plugins:pitch:f0"] = other;
+        QVERIFY(makeCache().save(transforms, libraries, FailureReports()));
+
+        TransformDescriptionMap loaded;
+        LibraryMap loadedLibraries;
+        FailureReports reports;
+        QVERIFY(makeCache().load(loaded, loadedLibraries, reports));
+        QVERIFY(loadedLibraries == libraries);
+
+        std::set<QString> changed;
+        QVERIFY(makeCache().findChangedLibraries(changed));
+        QVERIFY(changed.empty());
+
+        writeLibrary("a rather longer replacement library");
+        QVERIFY(makeCache().findChangedLibraries(changed));
+        QCOMPARE(int(changed.size()), 1);
+        QCOMPARE(*changed.begin(), m_library);
+    }
+
+    void failureReports() {
+        TransformDescriptionMap transforms = makeTransforms();
+        FailureReports saved;
+        saved.pluginScan = "<p>Failed to load one or more plugin libraries</p>";
+        saved.transforms = "Failed to list Vamp plugins: oops";
+        QVERIFY(makeCache().save(transforms, makeLibraries(transforms), saved));
+
+        TransformDescriptionMap loaded;
+        FailureReports reports;
+        QVERIFY(makeCache().load(loaded, reports));
+        QCOMPARE(reports.pluginScan, saved.pluginScan);
+        QCOMPARE(reports.transforms, saved.transforms);
+    }
+
+    void removedDirectory() {
+        TransformDescriptionMap transforms = makeTransforms();
+        QVERIFY(makeCache().save(transforms, LibraryMap(), FailureReports()));
+        QVERIFY(QDir(m_pluginDir).removeRecursively());
+        TransformDescriptionMap loaded;
+        FailureReports reports;
+        QVERIFY(!makeCache().load(loaded, reports));
+    }
+
+    void changedContext() {
+        TransformDescriptionMap transforms = makeTransforms();
+        QVERIFY(makeCache().save(transforms, makeLibraries(transforms),
+                                 FailureReports()));
+        TransformDescriptionMap loaded;
+        FailureReports reports;
+        QVERIFY(!makeCache("fr_FR;in-process").load(loaded, reports));
+        QVERIFY(makeCache().load(loaded, reports));
+    }
+
+    void truncated() {
+        TransformDescriptionMap transforms = makeTransforms();
+        QVERIFY(makeCache().save(transforms, makeLibraries(transforms),
+                                 FailureReports()));
+        QFile f(m_cachePath);
+        QVERIFY(f.open(QIODevice::ReadWrite));
+        QVERIFY(f.resize(f.size() - 10));
+        f.close();
+        TransformDescriptionMap loaded;
+        FailureReports reports;
+        QVERIFY(!makeCache().load(loaded, reports));
+        QVERIFY(loaded.empty());
+    }
+
+    void sameDescriptions() {
+        TransformDescriptionMap a = makeTransforms(), b = makeTransforms();
+        QVERIFY(InstalledTransformCache::sameDescriptions(a, b));
+
+        b["vamp:test-plugins:onsets:onsets"].maker = "Someone New";
+        QVERIFY(!InstalledTransformCache::sameDescriptions(a, b));
+
+        b = makeTransforms();
+        b.erase("vamp:test-plugins:pitch:f0");
+        QVERIFY(!InstalledTransformCache::sameDescriptions(a, b));
+        QVERIFY(!InstalledTransformCache::sameDescriptions(b, a));
+
+        QVERIFY(InstalledTransformCache::sameDescriptions
+                (TransformDescriptionMap(), TransformDescriptionMap()));
+    }
+
+    void providerNotRecorded() {
+        TransformDescriptionMap transforms = makeTransforms();
+        TransformId a = "vamp:test-plugins:onsets:onsets";
+        transforms[a].provider.infoUrl = "https://example.com/plugins";
+        QVERIFY(makeCache().save(transforms, makeLibraries(transforms),
+                                 FailureReports()));
+
+        TransformDescriptionMap loaded;
+        FailureReports reports;
+        QVERIFY(makeCache().load(loaded, reports));
+        QCOMPARE(loaded[a].provider.infoUrl, QString());
+
+        // and so it makes no difference to the comparison
+        QVERIFY(InstalledTransformCache::sameDescriptions(loaded, transforms));
+    }
+};
+
+#endif
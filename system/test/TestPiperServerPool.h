@@ -0,0 +1,206 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_PIPER_SERVER_POOL_H
+#define TEST_PIPER_SERVER_POOL_H
+
+#ifdef HAVE_PIPER
+
+#include "../../plugin/PiperServerPool.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <atomic>
+#include <set>
+
+// A pool whose servers are records only, with no process behind
+// them, which can be made to appear to have crashed
+class MockPiperServerPool : public PiperServerPool
+{
+public:
+    MockPiperServerPool() :
+        PiperServerPool(nullptr), m_started(0), m_stopped(0) { }
+
+    int getStartedCount() const { return m_started; }
+    int getStoppedCount() const { return m_stopped; }
+
+    void crash(Server *server) {
+        QMutexLocker locker(&m_crashMutex);
+        m_crashed.insert(server);
+    }
+
+protected:
+    Server *start(const HelperExecPath::HelperExec &helper) override {
+        Server *server = new Server;
+        server->executable = helper.executable;
+        server->tag = helper.tag;
+        server->transport = nullptr;
+        server->client = nullptr;
+        server->inUse = false;
+        server->retired = false;
+        ++m_started;
+        return server;
+    }
+
+    void stop(Server *server) override {
+        ++m_stopped;
+        {
+            QMutexLocker locker(&m_crashMutex);
+            m_crashed.erase(server);
+        }
+        PiperServerPool::stop(server);
+    }
+
+    bool isRunning(const Server *server) const override {
+        QMutexLocker locker(&m_crashMutex);
+        return m_crashed.find(server) == m_crashed.end();
+    }
+
+private:
+    std::atomic<int> m_started;
+    std::atomic<int> m_stopped;
+    mutable QMutex m_crashMutex;
+    std::set<const Server *> m_crashed;
+};
+
+class TestPiperServerPool : public QObject
+{
+    Q_OBJECT
+
+private:
+    class AcquireThread : public QThread
+    {
+    public:
+        AcquireThread(PiperServerPool &pool, bool releaseAfter) :
+            m_pool(pool), m_releaseAfter(releaseAfter), m_server(nullptr) { }
+
+        void run() override {
+            m_server = m_pool.acquire(helper());
+            if (m_releaseAfter) {
+                m_pool.release(m_server);
+            }
+        }
+
+        PiperServerPool::Server *getServer() const { return m_server; }
+
+    private:
+        PiperServerPool &m_pool;
+        bool m_releaseAfter;
+        PiperServerPool::Server *m_server;
+    };
+
+    static HelperExecPath::HelperExec helper() {
+        return { "mock-piper-server", "mock" };
+    }
+
+private slots:
+    void reuse() {
+        MockPiperServerPool pool;
+        pool.setMaxServers(2);
+        auto a = pool.acquire(helper());
+        QVERIFY(a);
+        QVERIFY(a->inUse);
+        pool.release(a);
+        QVERIFY(!a->inUse);
+        auto b = pool.acquire(helper());
+        QCOMPARE(b, a);
+        QCOMPARE(pool.getStartedCount(), 1);
+        pool.release(b);
+        QCOMPARE(pool.getStoppedCount(), 0);
+    }
+
+    void retire() {
+        MockPiperServerPool pool;
+        pool.setMaxServers(2);
+        auto a = pool.acquire(helper());
+        pool.retire(a);
+        QCOMPARE(pool.getStoppedCount(), 0);
+        pool.release(a);
+        QCOMPARE(pool.getStoppedCount(), 1);
+        auto b = pool.acquire(helper());
+        QVERIFY(b);
+        QCOMPARE(pool.getStartedCount(), 2);
+        pool.release(b);
+    }
+
+    void crashedWhileIdle() {
+        MockPiperServerPool pool;
+        pool.setMaxServers(2);
+        auto a = pool.acquire(helper());
+        pool.release(a);
+        pool.crash(a);
+        auto b = pool.acquire(helper());
+        QVERIFY(b);
+        QCOMPARE(pool.getStartedCount(), 2);
+        QCOMPARE(pool.getStoppedCount(), 1);
+        pool.release(b);
+    }
+
+    void finishedThread() {
+        // A server released by a thread that has since finished can't
+        // be used from here, and is stopped rather than kept
+        MockPiperServerPool pool;
+        pool.setMaxServers(2);
+        AcquireThread t(pool, true);
+        t.start();
+        t.wait();
+        QVERIFY(t.getServer());
+        auto b = pool.acquire(helper());
+        QVERIFY(b);
+        QCOMPARE(pool.getStartedCount(), 2);
+        QCOMPARE(pool.getStoppedCount(), 1);
+        QCOMPARE(b->thread.data(), QThread::currentThread());
+        pool.release(b);
+    }
+
+    void limit() {
+        MockPiperServerPool pool;
+        pool.setMaxServers(1);
+        QCOMPARE(pool.getMaxServers(), 1);
+
+        auto a = pool.acquire(helper());
+        QVERIFY(a);
+
+        // At the limit, so this waits for a release
+        AcquireThread t(pool, false);
+        t.start();
+        QThread::msleep(200);
+        QVERIFY(!t.isFinished());
+        QCOMPARE(pool.getStartedCount(), 1);
+
+        // Our server, released on this thread, is not one the other
+        // thread can use: it is retired in favour of a new one, but
+        // not stopped from there
+        pool.release(a);
+        QVERIFY(t.wait(2000));
+        auto b = t.getServer();
+        QVERIFY(b);
+        QVERIFY(b != a);
+        QCOMPARE(pool.getStartedCount(), 2);
+        QCOMPARE(pool.getStoppedCount(), 0);
+
+        // Now we can stop ours, and the other thread's too, as that
+        // thread has finished
+        pool.release(b);
+        QCOMPARE(pool.getStoppedCount(), 2);
+    }
+};
+
+#endif
+
+#endif
@@ -1,5 +1,7 @@
 TEST_HEADERS = \
-	     TestEnv.h
+	     TestEnv.h \
+	     TestInstalledTransformCache.h \
+	     TestPiperServerPool.h
 	     
 TEST_SOURCES += \
 	     svcore-system-test.cpp
@@ -12,6 +12,8 @@
 */
 
 #include "TestEnv.h"
+#include "TestInstalledTransformCache.h"
+#include "TestPiperServerPool.h"
 
 #include <QtTest>
 
@@ -31,6 +33,20 @@ int main(int argc, char *argv[])
         else ++bad;
     }
 
+    {
+        TestInstalledTransformCache t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+
+#ifdef HAVE_PIPER
+    {
+        TestPiperServerPool t;
+        if (QTest::qExec(&t, argc, argv) == 0) ++good;
+        else ++bad;
+    }
+#endif
+
     if (bad > 0) {
         SVCERR << "\n********* " << bad << " test suite(s) failed!\n" << endl;
         return 1;
@@ -0,0 +1,256 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "BinaryFeatureWriter.h"
+
+#include "base/Exceptions.h"
+#include "base/Debug.h"
+
+#include "data/fileio/QueuedFileDevice.h"
+
+#include <QFile>
+
+#include <cmath>
+
+using namespace std;
+using namespace Vamp;
+
+// Rows are written out when either limit is reached
+static const int maxPendingRows = 4096;
+static const size_t maxPendingValues = 65536;
+
+static int64_t
+toNanoseconds(const Vamp::RealTime &rt)
+{
+    return int64_t(rt.sec) * 1000000000 + rt.nsec;
+}
+
+BinaryFeatureWriter::BinaryFeatureWriter() :
+    FileFeatureWriter(SupportOneFilePerTrackTransform |
+                      SupportOneFilePerTrack |
+                      SupportOneFileTotal,
+                      "svfb")
+{
+}
+
+BinaryFeatureWriter::~BinaryFeatureWriter()
+{
+    try {
+        writeAllPending();
+    } catch (const std::exception &e) {
+        SVCERR << "BinaryFeatureWriter::~BinaryFeatureWriter: ERROR: "
+               << "Failed to write pending features: " << e.what() << endl;
+    }
+}
+
+string
+BinaryFeatureWriter::getDescription() const
+{
+    return "Write features in a compact binary format, with the values of each output stored as 32-bit floating-point columns. Much faster to write and smaller than CSV for outputs with many bins, such as spectra or chromagrams. The files can be loaded into Sonic Visualiser.";
+}
+
+void
+BinaryFeatureWriter::reviewFileForAppending(QString filename)
+{
+    // Called by FileFeatureWriter::getOutputFile when in append
+    // mode. Our output indices have to follow on from those already
+    // in the file
+
+    m_appendCounts[filename] = BinaryFeatureFormat::countOutputs(filename);
+}
+
+void
+BinaryFeatureWriter::writeRecord(QFile *file, QueuedFileDevice *device,
+                                 const QByteArray &record)
+{
+    if (device->write(record) != record.size()) {
+        SVCERR << "BinaryFeatureWriter: ERROR: Failed to write to \""
+               << file->fileName() << "\": " << device->errorString() << endl;
+        throw FileOperationFailed(file->fileName(), "write");
+    }
+}
+
+BinaryFeatureWriter::PendingOutput &
+BinaryFeatureWriter::getOutput(QString trackId,
+                               const Transform &transform,
+                               const Plugin::OutputDescriptor &output,
+                               const Plugin::FeatureList &features,
+                               std::string summaryType)
+{
+    TransformId transformId = transform.getIdentifier();
+    OutputKey key(TrackTransformPair(trackId, transformId), summaryType);
+
+    auto i = m_outputs.find(key);
+    if (i != m_outputs.end()) {
+        return i->second;
+    }
+
+    QFile *file = getOutputFile(trackId, transformId);
+    QueuedFileDevice *device = getOutputDevice(trackId, transformId);
+    if (!file || !device) {
+        throw FailedToOpenOutputStream(trackId, transformId);
+    }
+
+    if (m_nextIndex.find(file) == m_nextIndex.end()) {
+        // Nothing has been written to this file through the device
+        // yet, so its size is that of any existing content
+        if (file->size() == 0) {
+            writeRecord(file, device,
+                        BinaryFeatureFormat::encodeFileHeader());
+            m_nextIndex[file] = 0;
+        } else {
+            // appending to an existing file
+            int count = -1;
+            if (m_appendCounts.find(file->fileName()) != m_appendCounts.end()) {
+                count = m_appendCounts[file->fileName()];
+            }
+            if (count < 0) {
+                SVCERR << "BinaryFeatureWriter: ERROR: Existing file \""
+                       << file->fileName() << "\" is not a feature file, "
+                       << "cannot append to it" << endl;
+                throw FailedToOpenOutputStream(trackId, transformId);
+            }
+            m_nextIndex[file] = count;
+        }
+    }
+
+    BinaryFeatureFormat::OutputHeader h;
+    h.index = m_nextIndex[file]++;
+    h.trackId = trackId;
+    h.transformId = transformId;
+    h.outputId = output.identifier.c_str();
+    h.name = output.name.c_str();
+    h.unit = output.unit.c_str();
+    h.summaryType = summaryType.c_str();
+    h.sampleRate = transform.getSampleRate();
+    h.stepSize = transform.getStepSize();
+    h.blockSize = transform.getBlockSize();
+    h.sampleType = int(output.sampleType);
+    h.outputSampleRate = output.sampleRate;
+    h.hasDuration = output.hasDuration;
+
+    // The stride is fixed for the output: rows that differ from it
+    // are truncated or padded with NaN when written
+    if (output.hasFixedBinCount) {
+        h.binCount = int(output.binCount);
+    } else {
+        h.binCount = int(features[0].values.size());
+    }
+
+    for (int b = 0; b < h.binCount && b < int(output.binNames.size()); ++b) {
+        h.binNames.push_back(output.binNames[b].c_str());
+    }
+
+    writeRecord(file, device, BinaryFeatureFormat::encodeOutputRecord(h));
+
+    PendingOutput &p = m_outputs[key];
+    p.file = file;
+    p.device = device;
+    p.rows.outputIndex = h.index;
+    p.rows.binCount = h.binCount;
+    return p;
+}
+
+void
+BinaryFeatureWriter::write(QString trackId,
+                           const Transform &transform,
+                           const Plugin::OutputDescriptor &output,
+                           const Plugin::FeatureList &features,
+                           std::string summaryType)
+{
+    if (features.empty()) return;
+
+    PendingOutput &p = getOutput(trackId, transform, output,
+                                 features, summaryType);
+
+    BinaryFeatureFormat::Rows &rows = p.rows;
+    size_t stride = size_t(rows.binCount);
+
+    for (const auto &f: features) {
+
+        int row = rows.getRowCount();
+
+        rows.timesNs.push_back(toNanoseconds(f.timestamp));
+        rows.durationsNs.push_back(f.hasDuration ?
+                                   toNanoseconds(f.duration) : -1);
+
+        size_t n = min(stride, f.values.size());
+        rows.values.insert(rows.values.end(),
+                           f.values.begin(), f.values.begin() + n);
+        rows.values.resize(rows.values.size() + (stride - n), NAN);
+
+        if (f.label != "") {
+            if (rows.labels.empty()) {
+                rows.labels.resize(row);
+            }
+            rows.labels.push_back(f.label.c_str());
+        } else if (!rows.labels.empty()) {
+            rows.labels.push_back({});
+        }
+
+        if (rows.getRowCount() >= maxPendingRows ||
+            rows.values.size() >= maxPendingValues) {
+            writePending(p);
+        }
+    }
+}
+
+void
+BinaryFeatureWriter::writePending(PendingOutput &p)
+{
+    if (p.rows.getRowCount() == 0) return;
+
+    writeRecord(p.file, p.device,
+                BinaryFeatureFormat::encodeDataRecord(p.rows));
+
+    p.rows.timesNs.clear();
+    p.rows.durationsNs.clear();
+    p.rows.values.clear();
+    p.rows.labels.clear();
+}
+
+void
+BinaryFeatureWriter::writeAllPending()
+{
+    for (auto &i: m_outputs) {
+        writePending(i.second);
+    }
+}
+
+void
+BinaryFeatureWriter::flush()
+{
+    writeAllPending();
+
+    for (auto &i: m_devices) {
+        if (!i.second->flush()) {
+            throw FileOperationFailed(i.first->fileName(), "write");
+        }
+    }
+}
+
+void
+BinaryFeatureWriter::finish()
+{
+    writeAllPending();
+
+    if (m_singleFileName == "") {
+        // FileFeatureWriter::finish closes all the files, so any
+        // further features go to new files with outputs of their own
+        m_outputs.clear();
+        m_nextIndex.clear();
+    }
+
+    FileFeatureWriter::finish();
+}
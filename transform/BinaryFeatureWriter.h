@@ -0,0 +1,95 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_BINARY_FEATURE_WRITER_H
+#define SV_BINARY_FEATURE_WRITER_H
+
+#include "FileFeatureWriter.h"
+
+#include "data/fileio/BinaryFeatureFormat.h"
+
+#include <QString>
+
+#include <map>
+#include <string>
+
+class QFile;
+
+/**
+ * Feature writer for the binary feature format described in
+ * BinaryFeatureFormat. Values are written as raw float32 columns
+ * with a fixed stride per output rather than formatted as text,
+ * which makes this much faster and smaller than CSV for outputs with
+ * many bins. The files can be loaded back through
+ * DataFileReaderFactory.
+ *
+ * Features are buffered per output and written in runs of a few
+ * thousand rows, each run as a data record. As with the text
+ * writers, the records are passed on to the file from a separate
+ * thread (see FileFeatureWriter::getOutputDevice).
+ */
+class BinaryFeatureWriter : public FileFeatureWriter
+{
+public:
+    BinaryFeatureWriter();
+    virtual ~BinaryFeatureWriter();
+
+    string getDescription() const override;
+
+    void write(QString trackid,
+               const Transform &transform,
+               const Vamp::Plugin::OutputDescriptor &output,
+               const Vamp::Plugin::FeatureList &features,
+               std::string summaryType = "") override;
+
+    void flush() override;
+    void finish() override;
+
+    QString getWriterTag() const override { return "binary"; }
+
+protected:
+    void reviewFileForAppending(QString) override;
+
+private:
+    typedef pair<TrackTransformPair, std::string> OutputKey;
+
+    struct PendingOutput {
+        PendingOutput() : file(nullptr), device(nullptr) { }
+        QFile *file;
+        QueuedFileDevice *device;
+        BinaryFeatureFormat::Rows rows;
+    };
+
+    typedef map<OutputKey, PendingOutput> OutputMap;
+    OutputMap m_outputs;
+
+    // next output index for each open file
+    map<QFile *, int> m_nextIndex;
+
+    // output counts found by reviewFileForAppending, by file name
+    map<QString, int> m_appendCounts;
+
+    PendingOutput &getOutput(QString trackId,
+                             const Transform &transform,
+                             const Vamp::Plugin::OutputDescriptor &output,
+                             const Vamp::Plugin::FeatureList &features,
+                             std::string summaryType);
+
+    void writeRecord(QFile *file, QueuedFileDevice *device,
+                     const QByteArray &record);
+    void writePending(PendingOutput &);
+    void writeAllPending();
+};
+
+#endif
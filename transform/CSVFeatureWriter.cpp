@@ -19,15 +19,27 @@
 
 #include "CSVFeatureWriter.h"
 
+#include "base/NumberFormat.h"
+
 #include <iostream>
 
-#include <QRegExp>
 #include <QTextStream>
 #include <QTextCodec>
 
 using namespace std;
 using namespace Vamp;
 
+static void
+appendTime(QString &line, const ::RealTime &rt)
+{
+    // RealTime::toString may pad with a leading space, which we don't
+    // want
+    std::string s = rt.toString();
+    size_t i = s.find_first_not_of(' ');
+    if (i == std::string::npos) return;
+    line += QLatin1String(s.c_str() + i, int(s.size() - i));
+}
+
 CSVFeatureWriter::CSVFeatureWriter() :
     FileFeatureWriter(SupportOneFilePerTrackTransform |
                       SupportOneFileTotal |
@@ -213,13 +225,22 @@ CSVFeatureWriter::writeFeature(DataId tt,
     QString trackId = tt.first;
     Transform transform = tt.second;
 
+    // The feature is formatted into a single line and written to the
+    // stream in one go
+    QString line;
+    line.reserve(64 + int(f.values.size()) * (m_digits + 8) +
+                 int(f.label.size()));
+
     if (!m_omitFilename) {
         if (m_stdout || m_singleFileName != "") {
             if (trackId != m_prevPrintedTrackId) {
-                stream << "\"" << trackId << "\"" << m_separator;
+                line += '"';
+                line += trackId;
+                line += '"';
+                line += m_separator;
                 m_prevPrintedTrackId = trackId;
             } else {
-                stream << m_separator;
+                line += m_separator;
             }
         }
     }
@@ -239,64 +260,56 @@ CSVFeatureWriter::writeFeature(DataId tt,
 
         sv_samplerate_t rate = transform.getSampleRate();
 
-        stream << ::RealTime::realTime2Frame(f.timestamp, rate);
+        NumberFormat::appendInteger
+            (line, ::RealTime::realTime2Frame(f.timestamp, rate));
 
         if (haveDuration) {
-            stream << m_separator;
+            line += m_separator;
             if (m_endTimes) {
-                stream << ::RealTime::realTime2Frame
-                    (::RealTime(f.timestamp) + duration, rate);
+                NumberFormat::appendInteger
+                    (line, ::RealTime::realTime2Frame
+                     (::RealTime(f.timestamp) + duration, rate));
             } else {
-                stream << ::RealTime::realTime2Frame(duration, rate);
+                NumberFormat::appendInteger
+                    (line, ::RealTime::realTime2Frame(duration, rate));
             }
         }
 
     } else {
 
-        QString timestamp = f.timestamp.toString().c_str();
-        timestamp.replace(QRegExp("^ +"), "");
-        stream << timestamp;
+        appendTime(line, ::RealTime(f.timestamp));
 
         if (haveDuration) {
+            line += m_separator;
             if (m_endTimes) {
-                QString endtime =
-                    (::RealTime(f.timestamp) + duration).toString().c_str();
-                endtime.replace(QRegExp("^ +"), "");
-                stream << m_separator << endtime;
+                appendTime(line, ::RealTime(f.timestamp) + duration);
             } else {
-                QString d = ::RealTime(duration).toString().c_str();
-                d.replace(QRegExp("^ +"), "");
-                stream << m_separator << d;
+                appendTime(line, duration);
             }
         }            
     }
 
     if (summaryType != "") {
-        stream << m_separator << summaryType.c_str();
+        line += m_separator;
+        line += QLatin1String(summaryType.c_str());
     }
     
     for (unsigned int j = 0; j < f.values.size(); ++j) {
-
-        QString number = QString("%1").arg(f.values[j], 0, 'g', m_digits);
-
-        // Qt pre-5.6 zero pads single-digit exponents to two digits;
-        // Qt 5.7+ doesn't by default. But we want both to produce the
-        // same output. Getting the new behaviour from standard APIs
-        // in Qt 5.6 isn't possible I think; getting the old behaviour
-        // from Qt 5.7 is possible but fiddly, involving setting up an
-        // appropriate locale and using the %L specifier. We could
-        // doubtless do it with sprintf but Qt is a known quantity at
-        // this point. Let's just convert the old format to the new.
-        number.replace("e-0", "e-");
-        
-        stream << m_separator << number;
+        // NumberFormat writes exponents without zero padding, as Qt
+        // 5.7+ does by default, whatever the Qt version
+        line += m_separator;
+        NumberFormat::appendFloat(line, f.values[j], m_digits);
     }
     
     if (f.label != "") {
-        stream << m_separator << "\"" << f.label.c_str() << "\"";
+        line += m_separator;
+        line += '"';
+        line += QLatin1String(f.label.c_str());
+        line += '"';
     }
     
-    stream << "\n";
-}
+    line += '\n';
 
+    stream << line;
+}
 
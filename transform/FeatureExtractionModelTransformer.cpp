@@ -36,16 +36,33 @@
 #include "TransformFactory.h"
 
 #include <iostream>
+#include <algorithm>
 
 #include <QSettings>
+#include <QThread>
 
 //#define DEBUG_FEATURE_EXTRACTION_TRANSFORMER_RUN 1
 
+// Segmented processing: number of steps each segment's plugin is run
+// for before and after the range whose features it supplies, and the
+// minimum number of steps that a segment should own
+static const int segmentOverlapSteps = 32;
+static const int minSegmentSteps = 2048;
+
+// Minimum number of frames per channel read from the input model at
+// once for time-domain plugins
+static const sv_frame_t readAheadFrames = 65536;
+
 FeatureExtractionModelTransformer::FeatureExtractionModelTransformer(Input in,
                                                                      const Transform &transform) :
     ModelTransformer(in, transform),
     m_plugin(nullptr),
-    m_haveOutputs(false)
+    m_haveOutputs(false),
+    m_nextSegment(0),
+    m_segmentChannelCount(0),
+    m_segmentSampleRate(0),
+    m_segmentStartFrame(0),
+    m_segmentFrequencyDomain(false)
 {
     SVDEBUG << "FeatureExtractionModelTransformer::FeatureExtractionModelTransformer: plugin " << m_transforms.begin()->getPluginIdentifier() << ", outputName " << m_transforms.begin()->getOutput() << endl;
 }
@@ -54,7 +71,12 @@ FeatureExtractionModelTransformer::FeatureExtractionModelTransformer(Input in,
                                                                      const Transforms &transforms) :
     ModelTransformer(in, transforms),
     m_plugin(nullptr),
-    m_haveOutputs(false)
+    m_haveOutputs(false),
+    m_nextSegment(0),
+    m_segmentChannelCount(0),
+    m_segmentSampleRate(0),
+    m_segmentStartFrame(0),
+    m_segmentFrequencyDomain(false)
 {
     if (m_transforms.empty()) {
         SVDEBUG << "FeatureExtractionModelTransformer::FeatureExtractionModelTransformer: " << transforms.size() << " transform(s)" << endl;
@@ -747,9 +769,24 @@ FeatureExtractionModelTransformer::run()
         endFrame = input->getEndFrame();
     }
 
-    float **buffers = new float*[channelCount];
-    for (int ch = 0; ch < channelCount; ++ch) {
-        buffers[ch] = new float[primaryTransform.getBlockSize() + 2];
+    RealTime contextStartRT = primaryTransform.getStartTime();
+    RealTime contextDurationRT = primaryTransform.getDuration();
+
+    sv_frame_t contextStart =
+        RealTime::realTime2Frame(contextStartRT, sampleRate);
+
+    sv_frame_t contextDuration =
+        RealTime::realTime2Frame(contextDurationRT, sampleRate);
+
+    if (contextStart == 0 || contextStart < startFrame) {
+        contextStart = startFrame;
+    }
+
+    if (contextDuration == 0) {
+        contextDuration = endFrame - contextStart;
+    }
+    if (contextStart + contextDuration > endFrame) {
+        contextDuration = endFrame - contextStart;
     }
 
     int stepSize = primaryTransform.getStepSize();
@@ -758,61 +795,49 @@ FeatureExtractionModelTransformer::run()
     bool frequencyDomain = (m_plugin->getInputDomain() ==
                             Vamp::Plugin::FrequencyDomain);
 
+    if (canProcessInSegments(contextDuration, stepSize)) {
+        m_segmentFrequencyDomain = frequencyDomain;
+        runSegmented(channelCount, sampleRate, startFrame,
+                     contextStart, contextDuration);
+        deinitialise();
+        return;
+    }
+
+    // In the time domain, the buffers point into the input window
+    // and are not owned here
+    float **buffers = new float*[channelCount];
+    if (frequencyDomain) {
+        for (int ch = 0; ch < channelCount; ++ch) {
+            buffers[ch] = new float[blockSize + 2];
+        }
+    }
+
+    InputWindow window;
     std::vector<FFTModel *> fftModels;
 
     if (frequencyDomain) {
 #ifdef DEBUG_FEATURE_EXTRACTION_TRANSFORMER_RUN
         SVDEBUG << "FeatureExtractionModelTransformer::run: Input is frequency-domain" << endl;
 #endif
-        for (int ch = 0; ch < channelCount; ++ch) {
-            FFTModel *model = new FFTModel
-                (inputId,
-                 channelCount == 1 ? m_input.getChannel() : ch,
-                 primaryTransform.getWindowType(),
-                 blockSize,
-                 stepSize,
-                 blockSize);
-            if (!model->isOK() || model->getError() != "") {
-                QString err = model->getError();
-                delete model;
-                for (int j = 0; in_range_for(m_outputNos, j); ++j) {
-                    setCompletion(j, 100);
-                }
-                SVDEBUG << "FeatureExtractionModelTransformer::run: Failed to create FFT model for input model " << inputId << ": " << err << endl;
-                m_message = "Failed to create the FFT model for this feature extraction model transformer: error is: " + err;
-                for (int cch = 0; cch < ch; ++cch) {
-                    delete fftModels[cch];
-                }
-                abandon();
-                return;
+        QString err;
+        if (!createFFTModels(channelCount, fftModels, err)) {
+            for (int j = 0; in_range_for(m_outputNos, j); ++j) {
+                setCompletion(j, 100);
             }
-            fftModels.push_back(model);
+            SVDEBUG << "FeatureExtractionModelTransformer::run: Failed to create FFT model for input model " << inputId << ": " << err << endl;
+            m_message = "Failed to create the FFT model for this feature extraction model transformer: error is: " + err;
+            for (int ch = 0; ch < channelCount; ++ch) {
+                delete[] buffers[ch];
+            }
+            delete[] buffers;
+            abandon();
+            return;
         }
 #ifdef DEBUG_FEATURE_EXTRACTION_TRANSFORMER_RUN
         SVDEBUG << "FeatureExtractionModelTransformer::run: Created FFT model(s) for frequency-domain input" << endl;
 #endif
     }
 
-    RealTime contextStartRT = primaryTransform.getStartTime();
-    RealTime contextDurationRT = primaryTransform.getDuration();
-
-    sv_frame_t contextStart =
-        RealTime::realTime2Frame(contextStartRT, sampleRate);
-
-    sv_frame_t contextDuration =
-        RealTime::realTime2Frame(contextDurationRT, sampleRate);
-
-    if (contextStart == 0 || contextStart < startFrame) {
-        contextStart = startFrame;
-    }
-
-    if (contextDuration == 0) {
-        contextDuration = endFrame - contextStart;
-    }
-    if (contextStart + contextDuration > endFrame) {
-        contextDuration = endFrame - contextStart;
-    }
-
     sv_frame_t blockFrame = contextStart;
 
     long prevCompletion = 0;
@@ -821,13 +846,6 @@ FeatureExtractionModelTransformer::run()
         setCompletion(j, 0);
     }
 
-    float *reals = nullptr;
-    float *imaginaries = nullptr;
-    if (frequencyDomain) {
-        reals = new float[blockSize/2 + 1];
-        imaginaries = new float[blockSize/2 + 1];
-    }
-
     QString error = "";
 
     try {
@@ -890,30 +908,16 @@ FeatureExtractionModelTransformer::run()
             // channelCount is either input->channelCount or 1
 
             if (frequencyDomain) {
-                for (int ch = 0; ch < channelCount; ++ch) {
-                    int column = int((blockFrame - startFrame) / stepSize);
-                    if (fftModels[ch]->getValuesAt(column, reals, imaginaries)) {
-                        for (int i = 0; i <= blockSize/2; ++i) {
-                            buffers[ch][i*2] = reals[i];
-                            buffers[ch][i*2+1] = imaginaries[i];
-                        }
-                    } else {
-                        for (int i = 0; i <= blockSize/2; ++i) {
-                            buffers[ch][i*2] = 0.f;
-                            buffers[ch][i*2+1] = 0.f;
-                        }
-                    }
-                        
-                    error = fftModels[ch]->getError();
-                    if (error != "") {
-                        SVCERR << "FeatureExtractionModelTransformer::run: Abandoning, error is " << error << endl;
-                        m_abandoned = true;
-                        m_message = error;
-                        break;
-                    }
+                int column = int((blockFrame - startFrame) / stepSize);
+                if (!getFrequencyDomainFrames(fftModels, column, buffers,
+                                              error)) {
+                    SVCERR << "FeatureExtractionModelTransformer::run: Abandoning, error is " << error << endl;
+                    m_abandoned = true;
+                    m_message = error;
                 }
             } else {
-                getFrames(channelCount, blockFrame, blockSize, buffers);
+                getFrames(channelCount, blockFrame, blockSize,
+                          window, buffers);
             }
 
             if (m_abandoned) break;
@@ -970,13 +974,8 @@ FeatureExtractionModelTransformer::run()
     if (frequencyDomain) {
         for (int ch = 0; ch < channelCount; ++ch) {
             delete fftModels[ch];
+            delete[] buffers[ch];
         }
-        delete[] reals;
-        delete[] imaginaries;
-    }
-
-    for (int ch = 0; ch < channelCount; ++ch) {
-        delete[] buffers[ch];
     }
     delete[] buffers;
 
@@ -987,60 +986,556 @@ void
 FeatureExtractionModelTransformer::getFrames(int channelCount,
                                              sv_frame_t startFrame,
                                              sv_frame_t size,
+                                             InputWindow &window,
                                              float **buffers)
 {
-    sv_frame_t offset = 0;
+    if (int(window.data.size()) != channelCount ||
+        startFrame < window.start ||
+        startFrame + size > window.start + window.count) {
+        fillWindow(channelCount, startFrame, size, window);
+    }
+
+    sv_frame_t offset = startFrame - window.start;
+    
+    for (int c = 0; c < channelCount; ++c) {
+        buffers[c] = window.data[c].data() + offset;
+    }
+}
+
+void
+FeatureExtractionModelTransformer::fillWindow(int channelCount,
+                                              sv_frame_t startFrame,
+                                              sv_frame_t size,
+                                              InputWindow &window)
+{
+    sv_frame_t capacity = std::max(readAheadFrames, size * 4);
+
+    // Retain any part of the old window that the new one overlaps,
+    // so as to read only the frames we don't already have
+    
+    sv_frame_t keep = 0;
+    
+    if (int(window.data.size()) == channelCount &&
+        startFrame >= window.start &&
+        startFrame < window.start + window.count) {
+        keep = window.start + window.count - startFrame;
+    } else {
+        window.data = std::vector<floatvec_t>(channelCount);
+    }
 
-    if (startFrame < 0) {
+    for (int c = 0; c < channelCount; ++c) {
+        floatvec_t &data = window.data[c];
+        if (keep > 0 && startFrame > window.start) {
+            // The retained frames move towards the start, so a
+            // forward copy never overwrites one before reading it. If
+            // the window starts where it did, they are already in
+            // place (and std::copy does not permit a range to be
+            // copied onto itself)
+            auto from = data.begin() + (startFrame - window.start);
+            std::copy(from, from + keep, data.begin());
+        }
+        if (sv_frame_t(data.size()) < capacity) {
+            data.resize(capacity, 0.f);
+        }
+    }
+
+    window.start = startFrame;
+    window.count = capacity;
+    
+    sv_frame_t readStart = startFrame + keep;
+    sv_frame_t readCount = capacity - keep;
+    sv_frame_t offset = keep;
+
+    if (readStart < 0) {
+        sv_frame_t pad = std::min(-readStart, readCount);
         for (int c = 0; c < channelCount; ++c) {
-            for (sv_frame_t i = 0; i < size && startFrame + i < 0; ++i) {
-                buffers[c][i] = 0.0f;
+            std::fill(window.data[c].begin() + offset,
+                      window.data[c].begin() + offset + pad, 0.f);
+        }
+        offset += pad;
+        readCount -= pad;
+        readStart += pad;
+    }
+
+    sv_frame_t got = 0;
+
+    auto input = ModelById::getAs<DenseTimeValueModel>(getInputModel());
+    
+    if (input && readCount > 0) {
+
+        if (channelCount == 1) {
+
+            float *target = window.data[0].data() + offset;
+            got = input->getData(m_input.getChannel(),
+                                 readStart, readCount, target);
+            
+            if (m_input.getChannel() == -1 && input->getChannelCount() > 1) {
+                // use mean instead of sum, as plugin input
+                float cc = float(input->getChannelCount());
+                for (sv_frame_t i = 0; i < got; ++i) {
+                    target[i] /= cc;
+                }
+            }
+
+        } else {
+
+            std::vector<float *> targets(channelCount);
+            for (int c = 0; c < channelCount; ++c) {
+                targets[c] = window.data[c].data() + offset;
+            }
+            got = input->getMultiChannelData
+                (0, channelCount-1, readStart, readCount, targets.data());
+        }
+    }
+
+    for (int c = 0; c < channelCount; ++c) {
+        std::fill(window.data[c].begin() + offset + got,
+                  window.data[c].begin() + offset + readCount, 0.f);
+    }
+}
+
+bool
+FeatureExtractionModelTransformer::createFFTModels(int channelCount,
+                                                   std::vector<FFTModel *> &fftModels,
+                                                   QString &error)
+{
+    const Transform &transform = m_transforms[0];
+    int stepSize = transform.getStepSize();
+    int blockSize = transform.getBlockSize();
+    
+    for (int ch = 0; ch < channelCount; ++ch) {
+        FFTModel *model = new FFTModel
+            (getInputModel(),
+             channelCount == 1 ? m_input.getChannel() : ch,
+             transform.getWindowType(),
+             blockSize,
+             stepSize,
+             blockSize);
+        if (!model->isOK() || model->getError() != "") {
+            error = model->getError();
+            delete model;
+            for (auto m: fftModels) {
+                delete m;
+            }
+            fftModels.clear();
+            return false;
+        }
+        // Share columns with any other transform, or view, of the
+        // same input with the same FFT parameters; also with the
+        // other segments' models when processing in segments, as
+        // their overlaps are calculated twice otherwise
+        model->setColumnCacheEnabled(true);
+        fftModels.push_back(model);
+    }
+
+    return true;
+}
+
+bool
+FeatureExtractionModelTransformer::getFrequencyDomainFrames(const std::vector<FFTModel *> &fftModels,
+                                                            int column,
+                                                            float **buffers,
+                                                            QString &error)
+{
+    for (int ch = 0; in_range_for(fftModels, ch); ++ch) {
+        
+        if (!fftModels[ch]->getInterleavedValuesAt(column, buffers[ch])) {
+            int height = fftModels[ch]->getHeight();
+            for (int i = 0; i < height * 2; ++i) {
+                buffers[ch][i] = 0.f;
+            }
+        }
+        
+        error = fftModels[ch]->getError();
+        if (error != "") {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+FeatureExtractionModelTransformer::canProcessInSegments(sv_frame_t contextDuration,
+                                                        int stepSize)
+{
+    if (stepSize <= 0) {
+        return false;
+    }
+
+    // A plugin that carries state across the whole of its input
+    // would give different results if run in segments, and we can't
+    // tell from the outside whether it does, so this is only done
+    // for plugins that have been listed as safe for it
+    
+    QSettings settings;
+    settings.beginGroup("Transformer");
+    QStringList plugins =
+        settings.value("segmented-extraction-plugins").toStringList();
+    settings.endGroup();
+
+    QString pluginId = m_transforms[0].getPluginIdentifier();
+    if (!plugins.contains(pluginId)) {
+        return false;
+    }
+
+    if (QThread::idealThreadCount() < 2) {
+        return false;
+    }
+    
+    if (contextDuration / stepSize < 2 * minSegmentSteps) {
+        SVDEBUG << "FeatureExtractionModelTransformer: Context too short for segmented processing" << endl;
+        return false;
+    }
+
+    for (const auto &d: m_descriptors) {
+        if (d.sampleType == Vamp::Plugin::OutputDescriptor::FixedSampleRate) {
+            SVDEBUG << "FeatureExtractionModelTransformer: Output \""
+                    << d.identifier << "\" has fixed sample rate, can't use "
+                    << "segmented processing" << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+FeatureExtractionModelTransformer::runSegmented(int channelCount,
+                                                sv_samplerate_t sampleRate,
+                                                sv_frame_t startFrame,
+                                                sv_frame_t contextStart,
+                                                sv_frame_t contextDuration)
+{
+    int stepSize = m_transforms[0].getStepSize();
+    sv_frame_t contextEnd = contextStart + contextDuration;
+
+    int totalSteps = int(contextDuration / stepSize) + 1;
+    int threadCount = QThread::idealThreadCount();
+    int segmentSteps = (totalSteps + threadCount * 4 - 1) / (threadCount * 4);
+    if (segmentSteps < minSegmentSteps) {
+        segmentSteps = minSegmentSteps;
+    }
+    int segmentCount = (totalSteps + segmentSteps - 1) / segmentSteps;
+    if (threadCount > segmentCount) {
+        threadCount = segmentCount;
+    }
+
+    SVDEBUG << "FeatureExtractionModelTransformer::runSegmented: "
+            << totalSteps << " steps in " << segmentCount << " segments of "
+            << segmentSteps << " steps, using " << threadCount
+            << " threads" << endl;
+
+    m_segmentChannelCount = channelCount;
+    m_segmentSampleRate = sampleRate;
+    m_segmentStartFrame = startFrame;
+    m_segmentError = "";
+    m_segments = std::vector<Segment>(segmentCount);
+
+    sv_frame_t overlap = sv_frame_t(segmentOverlapSteps) * stepSize;
+    int processSteps = 0;
+    
+    for (int i = 0; i < segmentCount; ++i) {
+        Segment &s = m_segments[i];
+        s.first = (i == 0);
+        s.last = (i + 1 == segmentCount);
+        s.start = contextStart + sv_frame_t(i) * segmentSteps * stepSize;
+        if (s.last) {
+            s.end = contextEnd;
+        } else {
+            s.end = s.start + sv_frame_t(segmentSteps) * stepSize;
+        }
+        s.processStart = (s.first ? contextStart : s.start - overlap);
+        s.processEnd = (s.last ? contextEnd : std::min(s.end + overlap,
+                                                       contextEnd));
+        s.steps = int((s.processEnd - s.processStart) / stepSize) + 1;
+        processSteps += s.steps;
+    }
+
+    // The first segment is processed here, with the plugin that
+    // initialise() created to find out the outputs and step size, so
+    // that it is not wasted; the workers take the rest
+    m_nextSegment = 1;
+    
+    std::vector<SegmentWorker *> workers;
+    for (int i = 1; i < threadCount; ++i) {
+        SegmentWorker *worker = new SegmentWorker(*this);
+        worker->start();
+        workers.push_back(worker);
+    }
+
+    processSegment(m_segments[0], m_plugin);
+    {
+        QMutexLocker locker(&m_segmentMutex);
+        m_segments[0].done = true;
+    }
+
+    int stitched = 0;
+    int prevCompletion = 0;
+
+    while (stitched < segmentCount && !m_abandoned) {
+
+        bool ready = false;
+        {
+            QMutexLocker locker(&m_segmentMutex);
+            ready = m_segments[stitched].done;
+            if (!ready) {
+                m_segmentCondition.wait(&m_segmentMutex, 200);
+                ready = m_segments[stitched].done;
             }
         }
-        offset = -startFrame;
-        size -= offset;
-        if (size <= 0) return;
-        startFrame = 0;
+
+        for (auto mid: m_outputs) {
+            if (!ModelById::get(mid)) {
+                abandon();
+            }
+        }
+        if (m_abandoned) break;
+        
+        if (ready) {
+            Segment &s = m_segments[stitched];
+            for (const auto &pf: s.features) {
+                addFeature(pf.n, pf.blockFrame, pf.feature);
+                if (m_abandoned) break;
+            }
+            std::vector<PendingFeature>().swap(s.features);
+            ++stitched;
+        }
+
+        int stepsDone = 0;
+        for (const auto &s: m_segments) {
+            stepsDone += s.stepsDone;
+        }
+        int completion = int((sv_frame_t(stepsDone) * 99) / (processSteps + 1));
+        if (completion > prevCompletion) {
+            for (int j = 0; in_range_for(m_outputNos, j); ++j) {
+                setCompletion(j, completion);
+            }
+            prevCompletion = completion;
+        }
+    }
+
+    for (auto worker: workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    if (m_segmentError != "") {
+        SVCERR << "FeatureExtractionModelTransformer::runSegmented: "
+               << m_segmentError << endl;
+        m_message = m_segmentError;
     }
+    
+    m_segments.clear();
 
+    for (int j = 0; in_range_for(m_outputNos, j); ++j) {
+        setCompletion(j, 100);
+    }
+}
+
+void
+FeatureExtractionModelTransformer::processSegments()
+{
+    while (!m_abandoned) {
+        
+        int i = m_nextSegment++;
+        if (!in_range_for(m_segments, i)) {
+            break;
+        }
+        
+        processSegment(m_segments[i], {});
+
+        QMutexLocker locker(&m_segmentMutex);
+        m_segments[i].done = true;
+        m_segmentCondition.wakeAll();
+    }
+}
+
+std::shared_ptr<Vamp::Plugin>
+FeatureExtractionModelTransformer::instantiateSegmentPlugin()
+{
+    // Called from a segment worker thread, which constructs,
+    // initialises, uses, and destroys the plugin
+    
+    Transform transform = m_transforms[0];
+    
     auto input = ModelById::getAs<DenseTimeValueModel>(getInputModel());
     if (!input) {
+        return {};
+    }
+    
+    std::shared_ptr<Vamp::Plugin> plugin =
+        FeatureExtractionPluginFactory::instance()->instantiatePlugin
+        (transform.getPluginIdentifier(), input->getSampleRate());
+    if (!plugin) {
+        return {};
+    }
+
+    TransformFactory::getInstance()->makeContextConsistentWithPlugin
+        (transform, plugin);
+    
+    TransformFactory::getInstance()->setPluginParameters
+        (transform, plugin);
+
+    // m_transforms[0] has the step and block size that the primary
+    // plugin accepted, and that the process loop uses
+    if (!plugin->initialise(m_segmentChannelCount,
+                            m_transforms[0].getStepSize(),
+                            m_transforms[0].getBlockSize())) {
+        return {};
+    }
+
+    return plugin;
+}
+
+bool
+FeatureExtractionModelTransformer::isInSegment(const Segment &segment,
+                                               int n,
+                                               sv_frame_t blockFrame,
+                                               const Vamp::Plugin::Feature &feature) const
+{
+    sv_frame_t frame = blockFrame;
+
+    if (m_descriptors[n].sampleType ==
+        Vamp::Plugin::OutputDescriptor::VariableSampleRate &&
+        feature.hasTimestamp) {
+        frame = RealTime::realTime2Frame(feature.timestamp,
+                                         m_segmentSampleRate);
+    }
+
+    if (!segment.first && frame < segment.start) return false;
+    if (!segment.last && frame >= segment.end) return false;
+    return true;
+}
+
+void
+FeatureExtractionModelTransformer::processSegment(Segment &segment,
+                                                  std::shared_ptr<Vamp::Plugin> plugin)
+{
+    QString error;
+    
+    try {
+        if (!plugin) {
+            plugin = instantiateSegmentPlugin();
+        }
+        if (!plugin) {
+            error = tr("Failed to instantiate or initialise plugin \"%1\" for segmented processing").arg(m_transforms[0].getPluginIdentifier());
+        }
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+
+    if (error != "") {
+        QMutexLocker locker(&m_segmentMutex);
+        if (m_segmentError == "") m_segmentError = error;
+        abandon();
         return;
     }
+
+    int channelCount = m_segmentChannelCount;
+    int stepSize = m_transforms[0].getStepSize();
+    int blockSize = m_transforms[0].getBlockSize();
+    bool frequencyDomain = m_segmentFrequencyDomain;
     
-    sv_frame_t got = 0;
+    // As in run(), the time-domain buffers point into the window
+    float **buffers = new float*[channelCount];
+    if (frequencyDomain) {
+        for (int ch = 0; ch < channelCount; ++ch) {
+            buffers[ch] = new float[blockSize + 2];
+        }
+    }
 
-    if (channelCount == 1) {
+    InputWindow window;
+    std::vector<FFTModel *> fftModels;
 
-        auto data = input->getData(m_input.getChannel(), startFrame, size);
-        got = data.size();
+    if (frequencyDomain) {
+        if (!createFFTModels(channelCount, fftModels, error)) {
+            error = "Failed to create the FFT model for this feature extraction model transformer: error is: " + error;
+        }
+    }
 
-        copy(data.begin(), data.end(), buffers[0] + offset);
+    sv_frame_t blockFrame = segment.processStart;
 
-        if (m_input.getChannel() == -1 && input->getChannelCount() > 1) {
-            // use mean instead of sum, as plugin input
-            float cc = float(input->getChannelCount());
-            for (sv_frame_t i = 0; i < got; ++i) {
-                buffers[0][i + offset] /= cc;
+    auto keepFeatures = [&](Vamp::Plugin::FeatureSet &features) {
+        for (int j = 0; in_range_for(m_outputNos, j); ++j) {
+            for (const auto &feature: features[m_outputNos[j]]) {
+                if (isInSegment(segment, j, blockFrame, feature)) {
+                    segment.features.push_back({ j, blockFrame, feature });
+                }
             }
         }
+    };
 
-    } else {
+    try {
+        while (!m_abandoned && error == "") {
 
-        auto data = input->getMultiChannelData(0, channelCount-1, startFrame, size);
-        if (!data.empty()) {
-            got = data[0].size();
-            for (int c = 0; in_range_for(data, c); ++c) {
-                copy(data[c].begin(), data[c].end(), buffers[c] + offset);
+            if (frequencyDomain) {
+                if (blockFrame - int(blockSize)/2 > segment.processEnd) {
+                    break;
+                }
+            } else {
+                if (blockFrame >= segment.processEnd) {
+                    break;
+                }
+            }
+
+            if (!ModelById::get(getInputModel())) {
+                abandon();
+                break;
             }
+
+            if (frequencyDomain) {
+                int column = int((blockFrame - m_segmentStartFrame) / stepSize);
+                if (!getFrequencyDomainFrames(fftModels, column, buffers,
+                                              error)) {
+                    break;
+                }
+            } else {
+                getFrames(channelCount, blockFrame, blockSize,
+                          window, buffers);
+            }
+
+            auto features = plugin->process
+                (buffers,
+                 RealTime::frame2RealTime(blockFrame, m_segmentSampleRate)
+                 .toVampRealTime());
+
+            keepFeatures(features);
+            
+            ++segment.stepsDone;
+            blockFrame += stepSize;
         }
+
+        if (!m_abandoned && error == "") {
+            auto features = plugin->getRemainingFeatures();
+            keepFeatures(features);
+        }
+        
+    } catch (const std::exception &e) {
+        error = e.what();
     }
 
-    while (got < size) {
-        for (int c = 0; c < channelCount; ++c) {
-            buffers[c][got + offset] = 0.0;
+    try {
+        plugin = {};
+    } catch (const std::exception &e) {
+        SVCERR << "FeatureExtractionModelTransformer: caught exception while deleting plugin: " << e.what() << endl;
+    }
+
+    for (auto m: fftModels) {
+        delete m;
+    }
+
+    if (frequencyDomain) {
+        for (int ch = 0; ch < channelCount; ++ch) {
+            delete[] buffers[ch];
         }
-        ++got;
+    }
+    delete[] buffers;
+
+    if (error != "") {
+        QMutexLocker locker(&m_segmentMutex);
+        if (m_segmentError == "") m_segmentError = error;
+        abandon();
     }
 }
 
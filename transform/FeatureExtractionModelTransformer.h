@@ -24,11 +24,15 @@
 
 #include <vamp-hostsdk/Plugin.h>
 
+#include "base/Thread.h"
+
 #include <iostream>
 #include <map>
+#include <atomic>
 
 class DenseTimeValueModel;
 class SparseTimeValueModel;
+class FFTModel;
 
 class FeatureExtractionModelTransformer : public ModelTransformer // + is a Thread
 {
@@ -87,8 +91,114 @@ protected:
 
     void setCompletion(int, int);
 
+    /**
+     * A read-ahead window of time-domain input, from which
+     * successive process blocks are served in place. Each thread
+     * running a process loop has its own.
+     */
+    struct InputWindow {
+        InputWindow() : start(0), count(0) { }
+        sv_frame_t start;              // first frame held
+        sv_frame_t count;              // number of frames held
+        std::vector<floatvec_t> data;  // one per channel
+    };
+
+    /**
+     * Point buffers at the input for the given block, within the
+     * given window, refilling the window first if it does not cover
+     * the whole block. The pointers remain valid until the next call
+     * with the same window.
+     */
     void getFrames(int channelCount, sv_frame_t startFrame, sv_frame_t size,
-                   float **buffer);
+                   InputWindow &window, float **buffers);
+
+    void fillWindow(int channelCount, sv_frame_t startFrame, sv_frame_t size,
+                    InputWindow &window);
+
+    bool createFFTModels(int channelCount,
+                         std::vector<FFTModel *> &fftModels,
+                         QString &error);
+
+    bool getFrequencyDomainFrames(const std::vector<FFTModel *> &fftModels,
+                                  int column, float **buffers,
+                                  QString &error);
+
+    /**
+     * Segmented processing. This is used instead of the serial
+     * process loop if the plugin's identifier appears in the
+     * "segmented-extraction-plugins" list in the "Transformer"
+     * settings group, the context is long enough to be worth
+     * splitting, and no output relies on counting features across
+     * the whole run (FixedSampleRate outputs without timestamps do
+     * that). Only plugins whose results do not depend on input from
+     * far outside a segment should be listed.
+     *
+     * The context is split into segments on the step grid. Each
+     * segment is processed by its own plugin instance, on one of a
+     * pool of worker threads, starting a few steps early and running
+     * a few steps late so that the plugin has some input to warm up
+     * and settle on. Only the features that fall within the segment
+     * proper are kept. The run thread adds the features from each
+     * segment to the output models, in segment order, as soon as all
+     * earlier segments are also complete.
+     *
+     * Whether to segment can only be decided once a plugin has been
+     * initialised, as it depends on the plugin's outputs and on the
+     * step size it accepts. So the run thread processes the first
+     * segment itself, with the plugin that initialise() created,
+     * rather than leaving that plugin unused.
+     */
+    struct PendingFeature {
+        int n;
+        sv_frame_t blockFrame;
+        Vamp::Plugin::Feature feature;
+    };
+
+    struct Segment {
+        Segment() : start(0), end(0), processStart(0), processEnd(0),
+                    first(false), last(false), steps(0),
+                    stepsDone(0), done(false) { }
+        sv_frame_t start;        // first frame owned by this segment
+        sv_frame_t end;          // first frame owned by the next segment
+        sv_frame_t processStart; // first block frame processed
+        sv_frame_t processEnd;   // block frame at which processing stops
+        bool first;
+        bool last;
+        int steps;
+        std::atomic<int> stepsDone;
+        bool done;
+        std::vector<PendingFeature> features;
+    };
+
+    class SegmentWorker : public Thread
+    {
+    public:
+        SegmentWorker(FeatureExtractionModelTransformer &t) : m_t(t) { }
+        void run() override { m_t.processSegments(); }
+    private:
+        FeatureExtractionModelTransformer &m_t;
+    };
+
+    bool canProcessInSegments(sv_frame_t contextDuration, int stepSize);
+    void runSegmented(int channelCount, sv_samplerate_t sampleRate,
+                      sv_frame_t startFrame, sv_frame_t contextStart,
+                      sv_frame_t contextDuration);
+    void processSegments();
+    void processSegment(Segment &segment,
+                        std::shared_ptr<Vamp::Plugin> plugin);
+    std::shared_ptr<Vamp::Plugin> instantiateSegmentPlugin();
+    bool isInSegment(const Segment &segment, int n, sv_frame_t blockFrame,
+                     const Vamp::Plugin::Feature &feature) const;
+
+    std::vector<Segment> m_segments;
+    std::atomic<int> m_nextSegment;
+    int m_segmentChannelCount;
+    sv_samplerate_t m_segmentSampleRate;
+    sv_frame_t m_segmentStartFrame;
+    bool m_segmentFrequencyDomain;
+    QString m_segmentError;
+    QMutex m_segmentMutex;
+    QWaitCondition m_segmentCondition;
 
     bool m_haveOutputs;
     QMutex m_outputMutex;
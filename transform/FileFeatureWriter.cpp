@@ -21,6 +21,8 @@
 
 #include "base/Exceptions.h"
 
+#include "data/fileio/QueuedFileDevice.h"
+
 #include <QTextStream>
 #include <QFile>
 #include <QFileInfo>
@@ -53,19 +55,7 @@ FileFeatureWriter::FileFeatureWriter(int support,
 
 FileFeatureWriter::~FileFeatureWriter()
 {
-    while (!m_streams.empty()) {
-        m_streams.begin()->second->flush();
-        delete m_streams.begin()->second;
-        m_streams.erase(m_streams.begin());
-    }
-    while (!m_files.empty()) {
-        if (m_files.begin()->second) {
-            SVDEBUG << "FileFeatureWriter::~FileFeatureWriter: NOTE: Closing feature file \""
-                 << m_files.begin()->second->fileName() << "\"" << endl;
-            delete m_files.begin()->second;
-        }
-        m_files.erase(m_files.begin());
-    }
+    closeOutputFiles(false);
 }
 
 FileFeatureWriter::ParameterList
@@ -314,6 +304,22 @@ FileFeatureWriter::getOutputFile(QString trackId,
 }
 
 
+QueuedFileDevice *
+FileFeatureWriter::getOutputDevice(QString trackId,
+                                   TransformId transformId)
+{
+    QFile *file = getOutputFile(trackId, transformId);
+    if (!file) {
+        return nullptr;
+    }
+
+    if (m_devices.find(file) == m_devices.end()) {
+        m_devices[file] = new QueuedFileDevice(file);
+    }
+
+    return m_devices[file];
+}
+
 QTextStream *FileFeatureWriter::getOutputStream(QString trackId,
                                                 TransformId transformId,
                                                 QTextCodec *codec)
@@ -327,7 +333,8 @@ QTextStream *FileFeatureWriter::getOutputStream(QString trackId,
         if (m_stdout) {
             m_streams[file] = new QTextStream(stdout);
         } else {
-            m_streams[file] = new QTextStream(file);
+            m_streams[file] = new QTextStream
+                (getOutputDevice(trackId, transformId));
         }
         m_streams[file]->setCodec(codec);
     }
@@ -348,6 +355,12 @@ FileFeatureWriter::flush()
 {
     if (m_prevstream) {
         m_prevstream->flush();
+        QueuedFileDevice *device =
+            qobject_cast<QueuedFileDevice *>(m_prevstream->device());
+        if (device && !device->flush()) {
+            SVCERR << "FileFeatureWriter::flush: ERROR: Failed to write feature file: "
+                   << device->errorString() << endl;
+        }
     }
 }
 
@@ -359,19 +372,49 @@ FileFeatureWriter::finish()
 
     if (m_singleFileName != "" || m_stdout) return;
 
+    closeOutputFiles(true);
+}
+
+void
+FileFeatureWriter::closeOutputFiles(bool throwOnFailure)
+{
+    QString failed;
+
+    // Each stream writes through a device to a file, so they are
+    // closed in that order
+
     while (!m_streams.empty()) {
         m_streams.begin()->second->flush();
         delete m_streams.begin()->second;
         m_streams.erase(m_streams.begin());
     }
+    m_prevstream = nullptr;
+
+    while (!m_devices.empty()) {
+        QueuedFileDevice *device = m_devices.begin()->second;
+        device->close();
+        if (!device->isOK() && failed == "") {
+            failed = m_devices.begin()->first->fileName();
+        }
+        delete device;
+        m_devices.erase(m_devices.begin());
+    }
+
     while (!m_files.empty()) {
         if (m_files.begin()->second) {
-            SVDEBUG << "FileFeatureWriter::finish: NOTE: Closing feature file \""
+            SVDEBUG << "FileFeatureWriter: NOTE: Closing feature file \""
                  << m_files.begin()->second->fileName() << "\"" << endl;
             delete m_files.begin()->second;
         }
         m_files.erase(m_files.begin());
     }
-    m_prevstream = nullptr;
+
+    if (failed != "") {
+        SVCERR << "FileFeatureWriter: ERROR: Failed to write feature file \""
+               << failed << "\"" << endl;
+        if (throwOnFailure) {
+            throw FileOperationFailed(failed, "write");
+        }
+    }
 }
 
@@ -34,6 +34,7 @@ using std::pair;
 class QTextStream;
 class QTextCodec;
 class QFile;
+class QueuedFileDevice;
 
 class FileFeatureWriter : public FeatureWriter
 {
@@ -61,9 +62,11 @@ protected:
     typedef pair<QString, TransformId> TrackTransformPair;
     typedef map<TrackTransformPair, QString> FileNameMap;
     typedef map<TrackTransformPair, QFile *> FileMap;
+    typedef map<QFile *, QueuedFileDevice *> FileDeviceMap;
     typedef map<QFile *, QTextStream *> FileStreamMap;
     FileMap m_files;
     FileNameMap m_filenames;
+    FileDeviceMap m_devices;
     FileStreamMap m_streams;
     QTextStream *m_prevstream;
 
@@ -80,6 +83,18 @@ protected:
     // Look up and return the output file handle for the given track
     // ID - transform ID combo. Return 0 if it could not be opened.
     QFile *getOutputFile(QString, TransformId);
+
+    // Look up and return the device through which to write to the
+    // output file for the given track ID - transform ID combo. Data
+    // written to the device is passed on to the file from a separate
+    // thread, so that extraction is not held up by the file
+    // system. Return 0 if the file could not be opened.
+    QueuedFileDevice *getOutputDevice(QString, TransformId);
+
+    // Close the streams, devices and files that are open, throwing
+    // FileOperationFailed if anything could not be written (unless
+    // throwOnFailure is false, in which case it is only logged).
+    void closeOutputFiles(bool throwOnFailure);
     
     // subclass can implement this to be called before file is opened for append
     virtual void reviewFileForAppending(QString) { }
@@ -0,0 +1,366 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "InstalledTransformCache.h"
+
+#include "base/TempDirectory.h"
+#include "base/TempWriteFile.h"
+#include "base/Exceptions.h"
+#include "base/Profiler.h"
+#include "base/Debug.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+
+#include <set>
+
+//#define DEBUG_INSTALLED_TRANSFORM_CACHE 1
+
+using namespace std;
+
+static const quint32 cacheMagic = 0x53565443; // "SVTC"
+static const quint32 cacheVersion = 3;
+
+static qint64
+getModificationTime(const QFileInfo &fi)
+{
+    return fi.exists() ? fi.lastModified().toMSecsSinceEpoch() : 0;
+}
+
+InstalledTransformCache::InstalledTransformCache(QString context,
+                                                 QStringList pluginDirs,
+                                                 QString cachePath) :
+    m_context(context),
+    m_pluginDirs(pluginDirs),
+    m_cachePath(cachePath)
+{
+}
+
+QString
+InstalledTransformCache::getCachePath() const
+{
+    if (m_cachePath != "") {
+        return m_cachePath;
+    }
+    QDir dir = TempDirectory::getInstance()->getContainingPath();
+    return dir.filePath("installed-transforms.cache");
+}
+
+bool
+InstalledTransformCache::openAndCheck(QFile &file, QDataStream &stream) const
+{
+    // Open the cache file and read as far as the list of libraries,
+    // checking the context and plugin directories on the way
+    
+    QString path;
+    try {
+        path = getCachePath();
+    } catch (const DirectoryCreationFailed &f) {
+        SVDEBUG << "InstalledTransformCache: " << f.what() << endl;
+        return false;
+    }
+    
+    file.setFileName(path);
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    stream.setDevice(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (magic != cacheMagic || version != cacheVersion) {
+        SVDEBUG << "InstalledTransformCache: cache file \"" << path
+                << "\" has wrong magic number or version, ignoring it" << endl;
+        return false;
+    }
+
+    QString context;
+    stream >> context;
+    if (context != m_context) {
+        SVDEBUG << "InstalledTransformCache: context has changed, "
+                << "ignoring cache" << endl;
+        return false;
+    }
+
+    // A library being added to or removed from a directory changes
+    // the directory's modification time
+
+    quint32 ndirs = 0;
+    stream >> ndirs;
+    if (stream.status() != QDataStream::Ok ||
+        int(ndirs) != m_pluginDirs.size()) {
+        return false;
+    }
+    for (quint32 i = 0; i < ndirs; ++i) {
+        QString dir;
+        qint64 mtime = 0;
+        stream >> dir >> mtime;
+        if (dir != m_pluginDirs[int(i)] ||
+            mtime != getModificationTime(QFileInfo(dir))) {
+            SVDEBUG << "InstalledTransformCache: plugin directory \""
+                    << dir << "\" has changed, ignoring cache" << endl;
+            return false;
+        }
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool
+InstalledTransformCache::librariesUnchanged() const
+{
+    set<QString> changed;
+    return findChangedLibraries(changed) && changed.empty();
+}
+
+bool
+InstalledTransformCache::findChangedLibraries(set<QString> &changed) const
+{
+    Profiler profiler("InstalledTransformCache::findChangedLibraries");
+
+    QFile file;
+    QDataStream stream;
+    if (!openAndCheck(file, stream)) {
+        return false;
+    }
+    
+    quint32 nlibs = 0;
+    stream >> nlibs;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+    for (quint32 i = 0; i < nlibs; ++i) {
+        QString library;
+        qint64 size = 0, mtime = 0;
+        stream >> library >> size >> mtime;
+        if (stream.status() != QDataStream::Ok) {
+            return false;
+        }
+        QFileInfo fi(library);
+        if (!fi.exists() || fi.size() != size ||
+            getModificationTime(fi) != mtime) {
+            SVDEBUG << "InstalledTransformCache::findChangedLibraries: "
+                    << "plugin library \"" << library << "\" has changed"
+                    << endl;
+            changed.insert(library);
+        }
+    }
+
+    return true;
+}
+
+bool
+InstalledTransformCache::load(TransformDescriptionMap &transforms,
+                              FailureReports &reports) const
+{
+    LibraryMap libraries;
+    return load(transforms, libraries, reports);
+}
+
+bool
+InstalledTransformCache::load(TransformDescriptionMap &transforms,
+                              LibraryMap &libraries,
+                              FailureReports &reports) const
+{
+    Profiler profiler("InstalledTransformCache::load");
+
+    QFile file;
+    QDataStream stream;
+    if (!openAndCheck(file, stream)) {
+        return false;
+    }
+
+    // Skip the libraries, which librariesUnchanged checks
+    
+    quint32 nlibs = 0;
+    stream >> nlibs;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+    for (quint32 i = 0; i < nlibs; ++i) {
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+        QString library;
+        qint64 size = 0, mtime = 0;
+        stream >> library >> size >> mtime;
+    }
+
+    FailureReports loadedReports;
+    stream >> loadedReports.pluginScan >> loadedReports.transforms;
+    
+    quint32 ntransforms = 0;
+    stream >> ntransforms;
+
+    TransformDescriptionMap loaded;
+    LibraryMap loadedLibraries;
+    
+    for (quint32 i = 0; i < ntransforms; ++i) {
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+        TransformDescription desc;
+        QString library;
+        qint32 type = 0;
+        stream >> type
+               >> desc.category
+               >> desc.identifier
+               >> desc.name
+               >> desc.friendlyName
+               >> desc.description
+               >> desc.longDescription
+               >> desc.maker
+               >> desc.units
+               >> desc.configurable
+               >> library;
+        desc.type = TransformDescription::Type(type);
+        loaded[desc.identifier] = desc;
+        if (library != "") {
+            loadedLibraries[desc.identifier] = library;
+        }
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        SVDEBUG << "InstalledTransformCache::load: cache file \""
+                << file.fileName() << "\" is truncated or corrupt, "
+                << "ignoring it" << endl;
+        return false;
+    }
+
+#ifdef DEBUG_INSTALLED_TRANSFORM_CACHE
+    SVCERR << "InstalledTransformCache::load: loaded " << loaded.size()
+           << " transforms from " << nlibs << " libraries" << endl;
+#endif
+    
+    transforms = loaded;
+    libraries = loadedLibraries;
+    reports = loadedReports;
+    return true;
+}
+
+bool
+InstalledTransformCache::save(const TransformDescriptionMap &transforms,
+                              const LibraryMap &libraries,
+                              const FailureReports &reports) const
+{
+    Profiler profiler("InstalledTransformCache::save");
+
+    set<QString> libraryList;
+    for (const auto &l: libraries) {
+        if (l.second != "") {
+            libraryList.insert(l.second);
+        }
+    }
+    
+    try {
+
+        TempWriteFile temp(getCachePath());
+
+        QFile file(temp.getTemporaryFilename());
+        if (!file.open(QIODevice::WriteOnly)) {
+            SVDEBUG << "InstalledTransformCache::save: failed to open \""
+                    << file.fileName() << "\" for writing" << endl;
+            return false;
+        }
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_0);
+
+        stream << cacheMagic << cacheVersion << m_context;
+
+        stream << quint32(m_pluginDirs.size());
+        for (const auto &dir: m_pluginDirs) {
+            stream << dir << getModificationTime(QFileInfo(dir));
+        }
+
+        stream << quint32(libraryList.size());
+        for (const auto &library: libraryList) {
+            QFileInfo fi(library);
+            stream << library << qint64(fi.size()) << getModificationTime(fi);
+        }
+
+        stream << reports.pluginScan << reports.transforms;
+
+        stream << quint32(transforms.size());
+        // Not the provider, which is not known to the plugins
+        // themselves; see the class comment
+        for (const auto &t: transforms) {
+            const TransformDescription &desc = t.second;
+            auto l = libraries.find(t.first);
+            QString library = (l == libraries.end() ? "" : l->second);
+            stream << qint32(desc.type)
+                   << desc.category
+                   << desc.identifier
+                   << desc.name
+                   << desc.friendlyName
+                   << desc.description
+                   << desc.longDescription
+                   << desc.maker
+                   << desc.units
+                   << desc.configurable
+                   << library;
+        }
+
+        bool ok = (stream.status() == QDataStream::Ok);
+        file.close();
+
+        if (!ok) {
+            SVDEBUG << "InstalledTransformCache::save: failed to write cache"
+                    << endl;
+            return false;
+        }
+
+        temp.moveToTarget();
+
+    } catch (const FileOperationFailed &f) {
+        SVDEBUG << "InstalledTransformCache::save: " << f.what() << endl;
+        return false;
+    } catch (const DirectoryCreationFailed &f) {
+        SVDEBUG << "InstalledTransformCache::save: " << f.what() << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool
+InstalledTransformCache::sameDescriptions(const TransformDescriptionMap &a,
+                                          const TransformDescriptionMap &b)
+{
+    if (a.size() != b.size()) return false;
+    
+    for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j) {
+        const TransformDescription &d = i->second, &e = j->second;
+        if (i->first != j->first ||
+            d.type != e.type ||
+            d.category != e.category ||
+            d.identifier != e.identifier ||
+            d.name != e.name ||
+            d.friendlyName != e.friendlyName ||
+            d.description != e.description ||
+            d.longDescription != e.longDescription ||
+            d.maker != e.maker ||
+            d.units != e.units ||
+            d.configurable != e.configurable) {
+            return false;
+        }
+    }
+
+    return true;
+}
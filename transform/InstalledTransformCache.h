@@ -0,0 +1,137 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef SV_INSTALLED_TRANSFORM_CACHE_H
+#define SV_INSTALLED_TRANSFORM_CACHE_H
+
+#include "TransformDescription.h"
+
+#include <QString>
+#include <QStringList>
+
+class QFile;
+class QDataStream;
+
+#include <map>
+#include <set>
+
+/**
+ * A persistent file, kept in the application's cache directory,
+ * recording the descriptions of the installed transforms found by
+ * TransformFactory, so that they can be used at the next startup
+ * without first scanning and querying every plugin library.
+ *
+ * Alongside the descriptions, the file records the plugin library
+ * each transform came from, with the path, size and modification
+ * time of each library,
+ * the modification time of each directory in the plugin search path,
+ * and the failure reports of the scan that found the transforms, so
+ * that these can still be shown when the scan is skipped.
+ *
+ * The provider field of each description is not recorded. It comes
+ * from the plugin RDF rather than from the plugins, and so is always
+ * derived again by TransformFactory when it finds the uninstalled
+ * transforms, whether the descriptions came from the cache or from a
+ * scan.
+ *
+ * The cache is only loaded if no plugin directory has changed (so
+ * that no library has been added or removed), and if the context
+ * string it was saved with -- which describes anything else that
+ * affects the descriptions, such as the user interface language --
+ * is the same. Checking every library as well takes longer, so that
+ * is done separately, with findChangedLibraries(), which the caller
+ * can run in the background once the cached descriptions are in
+ * use, re-querying only the transforms from any library that has
+ * changed.
+ */
+class InstalledTransformCache
+{
+public:
+    typedef std::map<TransformId, TransformDescription> TransformDescriptionMap;
+    typedef std::map<TransformId, QString> LibraryMap; // id -> library path
+
+    struct FailureReports {
+        QString pluginScan; // from PluginScan::getStartupFailureReport
+        QString transforms; // from TransformFactory::getStartupFailureReport
+    };
+
+    /**
+     * Construct a cache for the given context string and plugin
+     * directories. The cache file is kept in the application's
+     * cache directory, unless another path is given.
+     */
+    InstalledTransformCache(QString context, QStringList pluginDirs,
+                            QString cachePath = "");
+
+    /**
+     * Load the cached descriptions and failure reports. Return false,
+     * leaving transforms and reports untouched, if there is no cache
+     * or its context or plugin directories have changed. The
+     * libraries themselves are not checked here; see
+     * librariesUnchanged().
+     */
+    bool load(TransformDescriptionMap &transforms,
+              FailureReports &reports) const;
+
+    /**
+     * Load the cached descriptions and failure reports as above,
+     * together with the library each transform came from, where
+     * known.
+     */
+    bool load(TransformDescriptionMap &transforms,
+              LibraryMap &libraries,
+              FailureReports &reports) const;
+
+    /**
+     * Check each plugin library recorded in the cache in turn, and
+     * add to changed the path of any that has been updated or
+     * removed since the cache was saved. Return false if the cache
+     * can't be loaded at all.
+     */
+    bool findChangedLibraries(std::set<QString> &changed) const;
+
+    /**
+     * Return true if no plugin library recorded in the cache has been
+     * updated or removed since the cache was saved. Return false if
+     * any has, or if the cache can't be loaded at all.
+     */
+    bool librariesUnchanged() const;
+
+    /**
+     * Save the given descriptions, with the library each came from
+     * (where known) and the failure reports of the scan that found
+     * them. Return false on failure.
+     */
+    bool save(const TransformDescriptionMap &transforms,
+              const LibraryMap &libraries,
+              const FailureReports &reports) const;
+
+    /**
+     * Return true if the two sets of descriptions are the same in
+     * every field that the cache records. The provider field is not
+     * compared, as it is not recorded.
+     */
+    static bool sameDescriptions(const TransformDescriptionMap &a,
+                                 const TransformDescriptionMap &b);
+
+private:
+    QString getCachePath() const;
+    bool openAndCheck(QFile &file, QDataStream &stream) const;
+    
+    QString m_context;
+    QStringList m_pluginDirs;
+    QString m_cachePath;
+};
+
+#endif
@@ -22,6 +22,8 @@
 
 #include "Transform.h"
 
+#include <atomic>
+
 /**
  * A ModelTransformer turns one data model into another.
  *
@@ -126,7 +128,7 @@ protected:
     Transforms m_transforms;
     Input m_input;
     Models m_outputs;
-    bool m_abandoned;
+    std::atomic<bool> m_abandoned;
     QString m_message;
 
 private:
@@ -14,10 +14,13 @@
 */
 
 #include "TransformFactory.h"
+#include "InstalledTransformCache.h"
 
 #include "plugin/FeatureExtractionPluginFactory.h"
 
 #include "plugin/RealTimePluginFactory.h"
+#include "plugin/LADSPAPluginFactory.h"
+#include "plugin/DSSIPluginFactory.h"
 #include "plugin/RealTimePluginInstance.h"
 #include "plugin/PluginXml.h"
 #include "plugin/PluginScan.h"
@@ -30,6 +33,7 @@
 #include "rdf/PluginRDFDescription.h"
 
 #include "base/XmlExportable.h"
+#include "base/Preferences.h"
 
 #include <iostream>
 #include <set>
@@ -37,6 +41,8 @@
 
 #include <QRegExp>
 #include <QTextStream>
+#include <QLocale>
+#include <QMutexLocker>
 
 #include "base/Thread.h"
 
@@ -63,6 +69,7 @@ TransformFactory::TransformFactory() :
     m_installedTransformsPopulated(false),
     m_uninstalledTransformsPopulated(false),
     m_installedThread(nullptr),
+    m_revalidateThread(nullptr),
     m_uninstalledThread(nullptr),
     m_exiting(false),
     m_populatingSlowly(false)
@@ -84,6 +91,17 @@ TransformFactory::~TransformFactory()
 #endif
     }
 
+    if (m_revalidateThread) {
+#ifdef DEBUG_TRANSFORM_FACTORY
+        SVDEBUG << "TransformFactory::~TransformFactory: waiting on installed transform revalidation thread" << endl;
+#endif
+        m_revalidateThread->wait();
+        delete m_revalidateThread;
+#ifdef DEBUG_TRANSFORM_FACTORY
+        SVDEBUG << "TransformFactory::~TransformFactory: waited" << endl;
+#endif
+    }
+
     if (m_uninstalledThread) {
 #ifdef DEBUG_TRANSFORM_FACTORY
         SVDEBUG << "TransformFactory::~TransformFactory: waiting on uninstalled transform thread" << endl;
@@ -134,6 +152,12 @@ TransformFactory::InstalledTransformsPopulateThread::run()
     m_factory->populateInstalledTransforms();
 }
 
+void
+TransformFactory::InstalledTransformsRevalidateThread::run()
+{
+    m_factory->revalidateInstalledTransforms();
+}
+
 void
 TransformFactory::UninstalledTransformsPopulateThread::run()
 {
@@ -375,6 +399,69 @@ TransformFactory::havePopulatedUninstalledTransforms()
     return m_uninstalledTransformsPopulated;
 }
 
+static QStringList
+getInstalledTransformCachePluginDirs()
+{
+    QStringList dirs;
+    for (auto d: Vamp::PluginHostAdapter::getPluginPath()) {
+        QString dir = QString::fromStdString(d);
+        if (!dirs.contains(dir)) dirs.push_back(dir);
+    }
+    for (auto dir: LADSPAPluginFactory::getPluginPath()) {
+        if (!dirs.contains(dir)) dirs.push_back(dir);
+    }
+    for (auto dir: DSSIPluginFactory::getPluginPath()) {
+        if (!dirs.contains(dir)) dirs.push_back(dir);
+    }
+    return dirs;
+}
+
+static InstalledTransformCache
+makeInstalledTransformCache()
+{
+    // The context covers whatever, apart from the plugins themselves,
+    // goes into the descriptions: they are translated, and the set
+    // of plugins found depends on whether they are run in process
+    
+    QString context = QString("%1;%2")
+        .arg(QLocale().name())
+        .arg(Preferences::getInstance()->getRunPluginsInProcess() ?
+             "in-process" : "out-of-process");
+
+    return InstalledTransformCache(context,
+                                   getInstalledTransformCachePluginDirs());
+}
+
+static void
+saveInstalledTransformCache(const InstalledTransformCache::TransformDescriptionMap &transforms,
+                            const InstalledTransformCache::FailureReports &reports)
+{
+    InstalledTransformCache::LibraryMap libraries;
+
+    for (const auto &t: transforms) {
+
+        Transform transform;
+        transform.setIdentifier(t.first);
+        QString pluginId = transform.getPluginIdentifier();
+
+        if (transform.getType() == Transform::FeatureExtraction) {
+            FeatureExtractionPluginFactory *factory =
+                FeatureExtractionPluginFactory::instance();
+            if (factory) {
+                libraries[t.first] = factory->getPluginLibraryPath(pluginId);
+            }
+        } else if (transform.getType() == Transform::RealTimeEffect) {
+            RealTimePluginFactory *factory =
+                RealTimePluginFactory::instanceFor(pluginId);
+            if (factory) {
+                libraries[t.first] = factory->getPluginLibraryPath(pluginId);
+            }
+        }
+    }
+
+    makeInstalledTransformCache().save(transforms, libraries, reports);
+}
+
 void
 TransformFactory::populateInstalledTransforms()
 {
@@ -385,81 +472,274 @@ TransformFactory::populateInstalledTransforms()
             return;
         }
 
-        PluginScan::getInstance()->scan();
-        
         TransformDescriptionMap transforms;
+        InstalledTransformCache::FailureReports reports;
 
-        populateFeatureExtractionPlugins(transforms);
-        if (m_exiting) return;
-        populateRealTimePlugins(transforms);
-        if (m_exiting) return;
+        if (makeInstalledTransformCache().load(transforms, reports)) {
+
+            // No library has been added or removed since the cache
+            // was written, so we can skip the scan for now, and check
+            // for updated libraries in the background. The plugin
+            // factories will discover their plugins for themselves
+            // when first used
+            
+            SVDEBUG << "TransformFactory::populateInstalledTransforms: "
+                    << "using " << transforms.size()
+                    << " cached transform descriptions" << endl;
+            
+            disambiguateTransformNames(transforms, m_transforms);
+
+            {
+                QMutexLocker errorLocker(&m_errorMutex);
+                m_errorString = reports.transforms;
+            }
+            PluginScan::getInstance()->setCachedStartupFailureReport
+                (reports.pluginScan);
+
+            if (!m_revalidateThread) {
+                m_revalidateThread =
+                    new InstalledTransformsRevalidateThread(this);
+                m_revalidateThread->start();
+            }
+            
+        } else {
 
-        // disambiguate plugins with similar names
+            if (!scanInstalledTransforms(transforms)) {
+                return;
+            }
 
-        std::map<QString, int> names;
-        std::map<QString, QString> pluginSources;
-        std::map<QString, QString> pluginMakers;
+            saveInstalledTransformCache
+                (transforms,
+                 { PluginScan::getInstance()->getStartupFailureReport(),
+                   getStartupFailureReport() });
+            
+            disambiguateTransformNames(transforms, m_transforms);
+        }
+
+        mergeTransformProviders(m_transforms);
+        indexTransforms(m_transformIndex, m_transforms);
+        m_installedTransformsPopulated = true;
+    }
+    
+#ifdef DEBUG_TRANSFORM_FACTORY
+    SVCERR << "populateInstalledTransforms exiting" << endl;
+#endif
 
-        for (TransformDescriptionMap::iterator i = transforms.begin();
-             i != transforms.end(); ++i) {
+    emit installedTransformsPopulated();
+}
 
-            TransformDescription desc = i->second;
+bool
+TransformFactory::scanInstalledTransforms(TransformDescriptionMap &out)
+{
+    {
+        QMutexLocker locker(&m_errorMutex);
+        m_errorString = "";
+    }
+    
+    PluginScan::getInstance()->scan();
 
-            QString td = desc.name;
-            QString tn = td.section(": ", 0, 0);
-            QString pn = desc.identifier.section(":", 1, 1);
+    out.clear();
 
-            if (pluginSources.find(tn) != pluginSources.end()) {
-                if (pluginSources[tn] != pn && pluginMakers[tn] != desc.maker) {
-                    ++names[tn];
-                }
-            } else {
+    populateFeatureExtractionPlugins(out, {});
+    if (m_exiting) return false;
+    populateRealTimePlugins(out, {});
+    if (m_exiting) return false;
+
+    return true;
+}
+
+void
+TransformFactory::disambiguateTransformNames(const TransformDescriptionMap &transforms,
+                                             TransformDescriptionMap &out)
+{
+    // disambiguate plugins with similar names
+
+    std::map<QString, int> names;
+    std::map<QString, QString> pluginSources;
+    std::map<QString, QString> pluginMakers;
+
+    for (TransformDescriptionMap::const_iterator i = transforms.begin();
+         i != transforms.end(); ++i) {
+
+        TransformDescription desc = i->second;
+
+        QString td = desc.name;
+        QString tn = td.section(": ", 0, 0);
+        QString pn = desc.identifier.section(":", 1, 1);
+
+        if (pluginSources.find(tn) != pluginSources.end()) {
+            if (pluginSources[tn] != pn && pluginMakers[tn] != desc.maker) {
                 ++names[tn];
-                pluginSources[tn] = pn;
-                pluginMakers[tn] = desc.maker;
             }
+        } else {
+            ++names[tn];
+            pluginSources[tn] = pn;
+            pluginMakers[tn] = desc.maker;
         }
+    }
 
-        std::map<QString, int> counts;
-        m_transforms.clear();
+    std::map<QString, int> counts;
+    out.clear();
 
-        for (TransformDescriptionMap::iterator i = transforms.begin();
-             i != transforms.end(); ++i) {
+    for (TransformDescriptionMap::const_iterator i = transforms.begin();
+         i != transforms.end(); ++i) {
 
-            TransformDescription desc = i->second;
-            QString identifier = desc.identifier;
-            QString maker = desc.maker;
+        TransformDescription desc = i->second;
+        QString identifier = desc.identifier;
+        QString maker = desc.maker;
 
-            QString td = desc.name;
-            QString tn = td.section(": ", 0, 0);
-            QString to = td.section(": ", 1);
+        QString td = desc.name;
+        QString tn = td.section(": ", 0, 0);
+        QString to = td.section(": ", 1);
 
-            if (names[tn] > 1) {
-                maker.replace(QRegExp(tr(" [\\(<].*$")), "");
-                tn = QString("%1 [%2]").arg(tn).arg(maker);
-            }
+        if (names[tn] > 1) {
+            maker.replace(QRegExp(tr(" [\\(<].*$")), "");
+            tn = QString("%1 [%2]").arg(tn).arg(maker);
+        }
+
+        if (to != "") {
+            desc.name = QString("%1: %2").arg(tn).arg(to);
+        } else {
+            desc.name = tn;
+        }
 
-            if (to != "") {
-                desc.name = QString("%1: %2").arg(tn).arg(to);
+        out[identifier] = desc;
+    }
+}
+
+void
+TransformFactory::revalidateInstalledTransforms()
+{
+    InstalledTransformCache cache = makeInstalledTransformCache();
+    
+    TransformDescriptionMap transforms;
+    InstalledTransformCache::LibraryMap libraries;
+    InstalledTransformCache::FailureReports reports;
+    std::set<QString> changed;
+
+    bool haveCache = (cache.load(transforms, libraries, reports) &&
+                      cache.findChangedLibraries(changed));
+    
+    if (haveCache && changed.empty()) {
+
+        // The cached transforms are up to date, but the plugin
+        // factories will still need the PluginScan when first used,
+        // so get that out of the way now
+        
+        SVDEBUG << "TransformFactory::revalidateInstalledTransforms: "
+                << "cached transforms are up to date" << endl;
+        
+        PluginScan::getInstance()->scan();
+        return;
+    }
+
+    if (haveCache) {
+
+        // Query again only the plugins in the libraries that have
+        // changed, keeping the cached descriptions of the rest
+        
+        SVDEBUG << "TransformFactory::revalidateInstalledTransforms: "
+                << changed.size() << " plugin libraries have changed, "
+                << "querying their plugins again" << endl;
+        
+        PluginScan::getInstance()->scan();
+
+        for (auto i = transforms.begin(); i != transforms.end(); ) {
+            auto l = libraries.find(i->first);
+            if (l != libraries.end() && changed.find(l->second) != changed.end()) {
+                i = transforms.erase(i);
             } else {
-                desc.name = tn;
+                ++i;
             }
+        }
 
-            m_transforms[identifier] = desc;
-        }            
+        populateFeatureExtractionPlugins(transforms, changed);
+        if (m_exiting) return;
+        populateRealTimePlugins(transforms, changed);
+        if (m_exiting) return;
+        
+    } else {
 
-        m_installedTransformsPopulated = true;
+        // The cache has gone or changed since we loaded it
+        
+        if (!scanInstalledTransforms(transforms)) {
+            return;
+        }
     }
+
+    saveInstalledTransformCache
+        (transforms,
+         { PluginScan::getInstance()->getStartupFailureReport(),
+           getStartupFailureReport() });
+
+    TransformDescriptionMap named;
+    disambiguateTransformNames(transforms, named);
     
-#ifdef DEBUG_TRANSFORM_FACTORY
-    SVCERR << "populateInstalledTransforms exiting" << endl;
-#endif
+    {
+        MutexLocker locker(&m_installedTransformsMutex,
+                           "TransformFactory::revalidateInstalledTransforms");
+        if (InstalledTransformCache::sameDescriptions(named, m_transforms)) {
+            return;
+        }
+        m_revalidatedTransforms = named;
+    }
+
+    SVDEBUG << "TransformFactory::revalidateInstalledTransforms: "
+            << "installed transforms differ from cached ones, replacing them"
+            << endl;
+
+    // Replace them in the factory's own thread, where the users of
+    // the old descriptions will be looking at them
+    QMetaObject::invokeMethod(this, "installedTransformsRevalidated",
+                              Qt::QueuedConnection);
+}
+
+void
+TransformFactory::installedTransformsRevalidated()
+{
+    {
+        MutexLocker locker(&m_installedTransformsMutex,
+                           "TransformFactory::installedTransformsRevalidated");
+        m_transforms.swap(m_revalidatedTransforms);
+        m_revalidatedTransforms.clear();
+        mergeTransformProviders(m_transforms);
+        indexTransforms(m_transformIndex, m_transforms);
+    }
 
     emit installedTransformsPopulated();
 }
 
 void
-TransformFactory::populateFeatureExtractionPlugins(TransformDescriptionMap &transforms)
+TransformFactory::installedTransformProvidersFound()
+{
+    MutexLocker locker(&m_installedTransformsMutex,
+                       "TransformFactory::installedTransformProvidersFound");
+    mergeTransformProviders(m_transforms);
+}
+
+void
+TransformFactory::mergeTransformProviders(TransformDescriptionMap &transforms)
+{
+    // Called with m_installedTransformsMutex held
+    
+    for (const auto &p: m_installedTransformProviders) {
+        auto i = transforms.find(p.first);
+        if (i != transforms.end() && i->second.provider == Provider()) {
+            i->second.provider = p.second;
+        }
+    }
+}
+
+QString
+TransformFactory::getStartupFailureReport() const
+{
+    QMutexLocker locker(&m_errorMutex);
+    return m_errorString;
+}
+
+void
+TransformFactory::populateFeatureExtractionPlugins(TransformDescriptionMap &transforms,
+                                                   const std::set<QString> &libraries)
 {
     FeatureExtractionPluginFactory *factory =
         FeatureExtractionPluginFactory::instance();
@@ -467,6 +747,7 @@ TransformFactory::populateFeatureExtractionPlugins(TransformDescriptionMap &tran
     QString errorMessage;
     std::vector<QString> plugs = factory->getPluginIdentifiers(errorMessage);
     if (errorMessage != "") {
+        QMutexLocker locker(&m_errorMutex);
         m_errorString = tr("Failed to list Vamp plugins: %1").arg(errorMessage);
     }
     
@@ -476,6 +757,12 @@ TransformFactory::populateFeatureExtractionPlugins(TransformDescriptionMap &tran
 
         QString pluginId = plugs[i];
 
+        if (!libraries.empty() &&
+            libraries.find(factory->getPluginLibraryPath(pluginId)) ==
+            libraries.end()) {
+            continue;
+        }
+
         piper_vamp::PluginStaticData psd = factory->getPluginStaticData(pluginId);
 
         if (psd.pluginKey == "") {
@@ -554,7 +841,8 @@ TransformFactory::populateFeatureExtractionPlugins(TransformDescriptionMap &tran
 }
 
 void
-TransformFactory::populateRealTimePlugins(TransformDescriptionMap &transforms)
+TransformFactory::populateRealTimePlugins(TransformDescriptionMap &transforms,
+                                          const std::set<QString> &libraries)
 {
     std::vector<QString> plugs =
         RealTimePluginFactory::getAllPluginIdentifiers();
@@ -574,6 +862,12 @@ TransformFactory::populateRealTimePlugins(TransformDescriptionMap &transforms)
             continue;
         }
 
+        if (!libraries.empty() &&
+            libraries.find(factory->getPluginLibraryPath(pluginId)) ==
+            libraries.end()) {
+            continue;
+        }
+
         RealTimePluginDescriptor descriptor =
             factory->getPluginDescriptor(pluginId);
 
@@ -709,6 +1003,21 @@ TransformFactory::populateUninstalledTransforms()
         //!!! This will be amazingly slow
 
         QStringList ids = PluginRDFIndexer::getInstance()->getIndexedPluginIds();
+
+        // The installed descriptions may be replaced by the
+        // revalidation thread, so work from a list of their ids, and
+        // merge the providers found for them in the factory's thread
+        // afterwards
+        
+        std::set<TransformId> installed;
+        {
+            MutexLocker locker(&m_installedTransformsMutex,
+                               "TransformFactory::populateUninstalledTransforms");
+            for (const auto &t: m_transforms) {
+                installed.insert(t.first);
+            }
+        }
+        std::map<TransformId, Provider> installedProviders;
     
         for (QStringList::const_iterator i = ids.begin(); i != ids.end(); ++i) {
         
@@ -734,15 +1043,13 @@ TransformFactory::populateUninstalledTransforms()
 
                 TransformId tid = Transform::getIdentifierForPluginOutput(*i, *j);
             
-                if (m_transforms.find(tid) != m_transforms.end()) {
+                if (installed.find(tid) != installed.end()) {
 #ifdef DEBUG_TRANSFORM_FACTORY
                     SVCERR << "TransformFactory::populateUninstalledTransforms: "
                            << tid << " is installed; adding provider if present, skipping rest" << endl;
 #endif
                     if (provider != Provider()) {
-                        if (m_transforms[tid].provider == Provider()) {
-                            m_transforms[tid].provider = provider;
-                        }
+                        installedProviders[tid] = provider;
                     }
                     continue;
                 }
@@ -799,8 +1106,22 @@ TransformFactory::populateUninstalledTransforms()
 
             if (m_exiting) return;
         }
-    
+
+        indexTransforms(m_uninstalledTransformIndex, m_uninstalledTransforms);
         m_uninstalledTransformsPopulated = true;
+
+        {
+            MutexLocker locker(&m_installedTransformsMutex,
+                               "TransformFactory::populateUninstalledTransforms");
+            m_installedTransformProviders = installedProviders;
+        }
+    }
+
+    if (QThread::currentThread() == thread()) {
+        installedTransformProvidersFound();
+    } else {
+        QMetaObject::invokeMethod(this, "installedTransformProvidersFound",
+                                  Qt::QueuedConnection);
     }
 
 #ifdef DEBUG_TRANSFORM_FACTORY
@@ -1214,14 +1535,40 @@ TransformFactory::search(QStringList keywords)
     return results;
 }
 
+void
+TransformFactory::indexTransforms(TextMatcherIndex &index,
+                                  const TransformDescriptionMap &transforms)
+{
+    // Index the same fields as searchUnadjusted tests
+
+    index.clear();
+
+    for (const auto &t: transforms) {
+        const TransformDescription &desc = t.second;
+        index.add(t.first, getTransformTypeName(desc.type));
+        index.add(t.first, desc.category);
+        index.add(t.first, desc.identifier);
+        index.add(t.first, desc.name);
+        index.add(t.first, desc.description);
+        index.add(t.first, desc.maker);
+        index.add(t.first, desc.units);
+    }
+}
+
 TransformFactory::SearchResults
 TransformFactory::searchUnadjusted(QStringList keywords)
 {
     SearchResults results;
     TextMatcher matcher;
 
-    for (TransformDescriptionMap::const_iterator i = m_transforms.begin();
-         i != m_transforms.end(); ++i) {
+    // Only the transforms the index says might match need to be
+    // tested, and they are then scored exactly as if all of them had
+    // been
+
+    for (const auto &id: m_transformIndex.getCandidates(keywords)) {
+
+        auto i = m_transforms.find(id);
+        if (i == m_transforms.end()) continue;
 
         TextMatcher::Match match;
 
@@ -1258,8 +1605,10 @@ TransformFactory::searchUnadjusted(QStringList keywords)
 
     m_uninstalledTransformsMutex.unlock();
 
-    for (TransformDescriptionMap::const_iterator i = m_uninstalledTransforms.begin();
-         i != m_uninstalledTransforms.end(); ++i) {
+    for (const auto &id: m_uninstalledTransformIndex.getCandidates(keywords)) {
+
+        auto i = m_uninstalledTransforms.find(id);
+        if (i == m_uninstalledTransforms.end()) continue;
 
         TextMatcher::Match match;
 
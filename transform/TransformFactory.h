@@ -19,6 +19,7 @@
 #include "TransformDescription.h"
 
 #include "base/TextMatcher.h"
+#include "base/TextMatcherIndex.h"
 
 #include <vamp-hostsdk/Plugin.h>
 
@@ -64,6 +65,23 @@
  * synchronously. The exceptions are the search functions, which do
  * not wait for uninstalled transforms to finish populating - they may
  * just return incomplete data in that case.
+ *
+ * The descriptions of installed transforms are saved to a persistent
+ * cache (see InstalledTransformCache), with the startup failure
+ * reports of the scan that found them. If no plugin directory has
+ * changed since the cache was written, the transforms and reports are
+ * populated from it instead of by scanning the plugins. Each plugin
+ * library is then checked in a further background thread. If any has
+ * changed, that thread queries again the plugins in the changed
+ * libraries only, brings the cache up to date, and, if it finds
+ * different transforms, replaces them (in the factory's own thread)
+ * and emits installedTransformsPopulated again. Either way it runs
+ * the PluginScan, so that the plugin factories, which discover their
+ * own plugins when first used, are not held up by it then.
+ *
+ * The provider information for installed transforms comes from the
+ * plugin RDF, found with the uninstalled transforms, and is merged
+ * into the installed descriptions whenever either is populated.
  */
 class TransformFactory : public QObject
 {
@@ -259,29 +277,47 @@ public:
     void setParametersFromPluginConfigurationXml(Transform &transform,
                                                  QString xml);
     
-    QString getStartupFailureReport() const {
-        return m_errorString;
-    }
+    QString getStartupFailureReport() const;
 
 signals:
     void installedTransformsPopulated();
     void uninstalledTransformsPopulated();
-    
+
+protected slots:
+    void installedTransformsRevalidated();
+    void installedTransformProvidersFound();
+
 protected:
     typedef std::map<TransformId, TransformDescription> TransformDescriptionMap;
 
+    // Read without locking, so changed only in the factory's own
+    // thread once populated, and then with m_installedTransformsMutex
+    // held
     TransformDescriptionMap m_transforms;
+    TextMatcherIndex m_transformIndex;
     std::atomic<bool> m_installedTransformsPopulated;
 
     TransformDescriptionMap m_uninstalledTransforms;
+    TextMatcherIndex m_uninstalledTransformIndex;
     std::atomic<bool> m_uninstalledTransformsPopulated;
 
-    QString m_errorString;
+    QString m_errorString; // written by the populating thread
+    mutable QMutex m_errorMutex;
     
     void populateInstalledTransforms();
     void populateUninstalledTransforms();
-    void populateFeatureExtractionPlugins(TransformDescriptionMap &);
-    void populateRealTimePlugins(TransformDescriptionMap &);
+    bool scanInstalledTransforms(TransformDescriptionMap &);
+    void disambiguateTransformNames(const TransformDescriptionMap &,
+                                    TransformDescriptionMap &);
+    void revalidateInstalledTransforms();
+    void mergeTransformProviders(TransformDescriptionMap &);
+
+    // Add the transforms of the plugins in the given libraries, or
+    // of all plugins if the set is empty
+    void populateFeatureExtractionPlugins(TransformDescriptionMap &,
+                                          const std::set<QString> &);
+    void populateRealTimePlugins(TransformDescriptionMap &,
+                                 const std::set<QString> &);
 
     std::shared_ptr<Vamp::PluginBase> instantiateDefaultPluginFor(TransformId id, sv_samplerate_t rate);
     QMutex m_installedTransformsMutex;
@@ -298,6 +334,22 @@ protected:
     };
     InstalledTransformsPopulateThread *m_installedThread;
 
+    class InstalledTransformsRevalidateThread : public QThread
+    {
+    public:
+        InstalledTransformsRevalidateThread(TransformFactory *factory) :
+            m_factory(factory) {
+        }
+        void run() override;
+        TransformFactory *m_factory;
+    };
+    InstalledTransformsRevalidateThread *m_revalidateThread;
+    TransformDescriptionMap m_revalidatedTransforms;
+
+    // Providers of installed transforms, from the plugin RDF, guarded
+    // by m_installedTransformsMutex
+    std::map<TransformId, Provider> m_installedTransformProviders;
+
     class UninstalledTransformsPopulateThread : public QThread
     {
     public:
@@ -312,6 +364,7 @@ protected:
     std::atomic<bool> m_exiting;
     std::atomic<bool> m_populatingSlowly;
 
+    void indexTransforms(TextMatcherIndex &, const TransformDescriptionMap &);
     SearchResults searchUnadjusted(QStringList keywords);
 
     static TransformFactory *m_instance;
@@ -0,0 +1,272 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef TEST_SEGMENTED_EXTRACTION_H
+#define TEST_SEGMENTED_EXTRACTION_H
+
+#include "../FeatureExtractionModelTransformer.h"
+
+#include "plugin/FeatureExtractionPluginFactory.h"
+
+#include "data/model/SparseTimeValueModel.h"
+#include "data/model/SparseOneDimensionalModel.h"
+#include "data/model/test/MockWaveModel.h"
+
+#include <QObject>
+#include <QtTest>
+#include <QSettings>
+#include <QThread>
+
+#include <atomic>
+#include <deque>
+
+using namespace std;
+
+// A time-domain plugin with two outputs: "recent", one value per
+// step giving the mean energy of the last four blocks, and "marks",
+// an instant every fifth block timestamped half a step before the
+// block. Its state settles within the segment overlap, so running
+// it in segments should give the same features as running it once
+class RecentEnergyPlugin : public Vamp::Plugin
+{
+public:
+    RecentEnergyPlugin(float inputSampleRate) :
+        Plugin(inputSampleRate), m_stepSize(0), m_blockSize(0) { }
+
+    string getIdentifier() const override { return "recentenergy"; }
+    string getName() const override { return "Recent Energy"; }
+    string getDescription() const override { return ""; }
+    string getMaker() const override { return ""; }
+    string getCopyright() const override { return ""; }
+    int getPluginVersion() const override { return 1; }
+    InputDomain getInputDomain() const override { return TimeDomain; }
+
+    bool initialise(size_t channels, size_t stepSize,
+                    size_t blockSize) override {
+        if (channels != 1) return false;
+        m_stepSize = stepSize;
+        m_blockSize = blockSize;
+        return true;
+    }
+
+    void reset() override { m_history.clear(); }
+
+    OutputList getOutputDescriptors() const override {
+        OutputList list;
+        OutputDescriptor d;
+        d.identifier = "recent";
+        d.name = "Recent";
+        d.hasFixedBinCount = true;
+        d.binCount = 1;
+        d.hasKnownExtents = false;
+        d.isQuantized = false;
+        d.sampleType = OutputDescriptor::OneSamplePerStep;
+        d.hasDuration = false;
+        list.push_back(d);
+        d.identifier = "marks";
+        d.name = "Marks";
+        d.binCount = 0;
+        d.sampleType = OutputDescriptor::VariableSampleRate;
+        d.sampleRate = m_inputSampleRate;
+        list.push_back(d);
+        return list;
+    }
+
+    FeatureSet process(const float *const *inputBuffers,
+                       Vamp::RealTime timestamp) override {
+        long frame = Vamp::RealTime::realTime2Frame
+            (timestamp, (unsigned int)m_inputSampleRate);
+        long block = frame / long(m_stepSize);
+
+        double energy = double(block % 7);
+        for (size_t i = 0; i < m_blockSize; ++i) {
+            energy += inputBuffers[0][i] * inputBuffers[0][i];
+        }
+        m_history.push_back(energy);
+        if (m_history.size() > 4) m_history.pop_front();
+
+        double sum = 0.0;
+        for (auto e: m_history) sum += e;
+
+        FeatureSet fs;
+        Feature f;
+        f.hasTimestamp = false;
+        f.values.push_back(float(sum / double(m_history.size())));
+        fs[0].push_back(f);
+
+        if (block % 5 == 0 && frame >= long(m_stepSize)) {
+            Feature m;
+            m.hasTimestamp = true;
+            m.timestamp = Vamp::RealTime::frame2RealTime
+                (frame - long(m_stepSize / 2),
+                 (unsigned int)m_inputSampleRate);
+            fs[1].push_back(m);
+        }
+
+        return fs;
+    }
+
+    FeatureSet getRemainingFeatures() override { return {}; }
+
+private:
+    size_t m_stepSize;
+    size_t m_blockSize;
+    deque<double> m_history;
+};
+
+class RecentEnergyPluginFactory : public FeatureExtractionPluginFactory
+{
+public:
+    RecentEnergyPluginFactory() : m_instances(0) { }
+
+    int getInstanceCount() const { return m_instances; }
+    void resetInstanceCount() { m_instances = 0; }
+
+    vector<QString> getPluginIdentifiers(QString &) override {
+        return { pluginId() };
+    }
+
+    piper_vamp::PluginStaticData getPluginStaticData(QString) override {
+        return {};
+    }
+
+    shared_ptr<Vamp::Plugin> instantiatePlugin(QString identifier,
+                                               sv_samplerate_t rate) override {
+        if (identifier != pluginId()) return {};
+        ++m_instances;
+        return make_shared<RecentEnergyPlugin>(float(rate));
+    }
+
+    QString getPluginCategory(QString) override { return ""; }
+    QString getPluginLibraryPath(QString) override { return ""; }
+
+    static QString pluginId() { return "vamp:svcore-test:recentenergy"; }
+
+private:
+    std::atomic<int> m_instances;
+};
+
+class TestSegmentedExtraction : public QObject
+{
+    Q_OBJECT
+
+private:
+    const int stepSize = 16;
+    const int steps = 20000;
+
+    FeatureExtractionPluginFactory *m_installed;
+    RecentEnergyPluginFactory m_factory;
+    ModelId m_input;
+
+    void setSegmented(bool segmented) {
+        QSettings settings;
+        settings.beginGroup("Transformer");
+        if (segmented) {
+            settings.setValue("segmented-extraction-plugins",
+                              QStringList({ RecentEnergyPluginFactory::pluginId() }));
+        } else {
+            settings.remove("segmented-extraction-plugins");
+        }
+        settings.endGroup();
+    }
+
+    // Runs both outputs of the plugin through a single transformer,
+    // returning the events of each
+    bool extract(EventVector &recent, EventVector &marks) {
+        ModelTransformer::Transforms transforms;
+        for (QString output: { "recent", "marks" }) {
+            Transform t;
+            t.setIdentifier(Transform::getIdentifierForPluginOutput
+                            (RecentEnergyPluginFactory::pluginId(), output));
+            t.setStepSize(stepSize);
+            t.setBlockSize(stepSize * 2);
+            transforms.push_back(t);
+        }
+
+        FeatureExtractionModelTransformer transformer
+            (ModelTransformer::Input(m_input), transforms);
+        transformer.start();
+        transformer.wait();
+
+        auto outputs = transformer.getOutputModels();
+        bool ok = (outputs.size() == 2);
+        if (ok) {
+            auto r = ModelById::getAs<SparseTimeValueModel>(outputs[0]);
+            auto m = ModelById::getAs<SparseOneDimensionalModel>(outputs[1]);
+            ok = (r && m);
+            if (ok) {
+                recent = r->getAllEvents();
+                marks = m->getAllEvents();
+            }
+        }
+        for (auto id: outputs) {
+            ModelById::release(id);
+        }
+        return ok;
+    }
+
+private slots:
+    void initTestCase() {
+        m_installed = FeatureExtractionPluginFactory::instance();
+        FeatureExtractionPluginFactory::setInstance(&m_factory);
+        m_input = ModelById::add
+            (make_shared<MockWaveModel>(vector<Sort>({ Sine }),
+                                        steps * stepSize, 0));
+    }
+
+    void cleanupTestCase() {
+        ModelById::release(m_input);
+        FeatureExtractionPluginFactory::setInstance(m_installed);
+        setSegmented(false);
+    }
+
+    void boundaries() {
+        if (QThread::idealThreadCount() < 2) {
+            QSKIP("Segmented extraction needs more than one thread");
+        }
+
+        EventVector sequentialRecent, sequentialMarks;
+        setSegmented(false);
+        m_factory.resetInstanceCount();
+        QVERIFY(extract(sequentialRecent, sequentialMarks));
+        QCOMPARE(m_factory.getInstanceCount(), 1);
+
+        EventVector segmentedRecent, segmentedMarks;
+        setSegmented(true);
+        m_factory.resetInstanceCount();
+        QVERIFY(extract(segmentedRecent, segmentedMarks));
+        QVERIFY(m_factory.getInstanceCount() > 2);
+
+        // One value per step, and an instant for every fifth, with
+        // none lost or repeated where one segment hands over to the
+        // next, and each the same as when run without segments
+        QCOMPARE(int(sequentialRecent.size()), steps);
+        QCOMPARE(int(sequentialMarks.size()), (steps - 1) / 5);
+        QCOMPARE(segmentedRecent.size(), sequentialRecent.size());
+        QCOMPARE(segmentedMarks.size(), sequentialMarks.size());
+
+        for (int i = 0; in_range_for(sequentialRecent, i); ++i) {
+            QCOMPARE(segmentedRecent[i].getFrame(),
+                     sequentialRecent[i].getFrame());
+            QCOMPARE(segmentedRecent[i].getValue(),
+                     sequentialRecent[i].getValue());
+        }
+        for (int i = 0; in_range_for(sequentialMarks, i); ++i) {
+            QCOMPARE(segmentedMarks[i].getFrame(),
+                     sequentialMarks[i].getFrame());
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,11 @@
+TEST_HEADERS += \
+	     TestSegmentedExtraction.h
+
+TEST_SOURCES += \
+	     ../../data/model/test/MockWaveModel.cpp \
+	     svcore-transform-test.cpp
+
+# Not part of the test suite: a separate benchmark program, with its
+# own main, to be built alongside it from the same libraries
+BENCH_SOURCES += \
+	     svcore-transform-bench.cpp
@@ -0,0 +1,719 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Sonic Visualiser
+    An audio file viewer and annotation editor.
+    Centre for Digital Music, Queen Mary, University of London.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+/*
+   Benchmark for the plugin hosting paths: runs audio through
+   FeatureExtractionModelTransformer (Vamp plugins, loaded natively or
+   through Piper depending on --in-process) and through
+   RealTimeEffectModelTransformer and RealTimePluginInstance::run
+   directly (LADSPA and DSSI plugins), at several block sizes.
+
+   Each case prints one line of JSON to stdout, giving blocks per
+   second, per-block time percentiles and allocations per block. For
+   the Vamp cases the per-block times are those of the plugin's
+   process() call alone, and the time and allocations outside it are
+   reported as host overhead. For the real-time cases, the direct run
+   loop gives the per-block plugin cost, and the transformer case
+   reports its own time per block beyond that as host overhead.
+
+   Run with --help for options. To compare native and Piper hosting
+   of Vamp plugins, run once with and once without --in-process.
+
+   The sources are listed as BENCH_SOURCES in files.pri in this
+   directory, alongside those of the transform test suite, and are
+   built into a program of their own with the same libraries.
+*/
+
+#include "transform/TransformFactory.h"
+#include "transform/FeatureExtractionModelTransformer.h"
+#include "transform/RealTimeEffectModelTransformer.h"
+
+#include "plugin/FeatureExtractionPluginFactory.h"
+#include "plugin/RealTimePluginFactory.h"
+#include "plugin/RealTimePluginInstance.h"
+
+#include "data/model/WritableWaveFileModel.h"
+#include "data/model/ReadOnlyWaveFileModel.h"
+#include "data/fileio/FileSource.h"
+
+#include "base/Preferences.h"
+#include "base/RealTime.h"
+#include "base/Debug.h"
+
+#include "system/Init.h"
+
+#include <vamp-hostsdk/PluginWrapper.h>
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <new>
+#include <iostream>
+
+using namespace std;
+
+// Every allocation in the process is counted, so that allocations
+// per block can be reported. Counts taken while a transformer is
+// running include those of any other threads active at the time
+
+static atomic<long long> allocationCount(0);
+
+void *
+operator new(size_t size)
+{
+    ++allocationCount;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void *
+operator new[](size_t size)
+{
+    ++allocationCount;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void
+operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+static long long
+nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>
+        (chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result
+{
+    Result() : channels(0), blockSize(0), stepSize(0), blocks(0),
+               elapsedNs(0), allocations(0),
+               hostOverheadNs(NAN), hostAllocations(NAN) { }
+
+    QString benchmark;
+    QString host;
+    TransformId transform;
+    int channels;
+    int blockSize;
+    int stepSize;
+    long long blocks;
+    long long elapsedNs;
+    long long allocations;
+    vector<long long> blockNs;   // per block, where measured
+    double hostOverheadNs;       // per block, or NaN if not known
+    double hostAllocations;      // per block, or NaN if not known
+};
+
+static void
+report(Result r)
+{
+    // One JSON object per line
+
+    QStringList fields;
+    fields << QString("\"benchmark\": \"%1\"").arg(r.benchmark);
+    fields << QString("\"host\": \"%1\"").arg(r.host);
+    fields << QString("\"transform\": \"%1\"").arg(r.transform);
+    fields << QString("\"channels\": %1").arg(r.channels);
+    fields << QString("\"blockSize\": %1").arg(r.blockSize);
+    fields << QString("\"stepSize\": %1").arg(r.stepSize);
+    fields << QString("\"blocks\": %1").arg(r.blocks);
+
+    double sec = double(r.elapsedNs) / 1e9;
+    fields << QString("\"seconds\": %1").arg(sec, 0, 'f', 6);
+    fields << QString("\"blocksPerSec\": %1")
+        .arg(sec > 0.0 ? double(r.blocks) / sec : 0.0, 0, 'f', 1);
+
+    double perBlock = (r.blocks > 0 ? 1.0 / double(r.blocks) : 0.0);
+    fields << QString("\"allocsPerBlock\": %1")
+        .arg(double(r.allocations) * perBlock, 0, 'f', 2);
+
+    if (!r.blockNs.empty()) {
+        sort(r.blockNs.begin(), r.blockNs.end());
+        QStringList pcs;
+        for (int p: { 50, 90, 99 }) {
+            size_t ix = min(r.blockNs.size() - 1,
+                            size_t(double(r.blockNs.size()) * p / 100.0));
+            pcs << QString("\"p%1\": %2").arg(p)
+                .arg(double(r.blockNs[ix]) / 1000.0, 0, 'f', 3);
+        }
+        pcs << QString("\"max\": %1")
+            .arg(double(r.blockNs.back()) / 1000.0, 0, 'f', 3);
+        fields << QString("\"blockLatencyUs\": { %1 }").arg(pcs.join(", "));
+    }
+
+    if (!std::isnan(r.hostOverheadNs)) {
+        fields << QString("\"hostOverheadUsPerBlock\": %1")
+            .arg(r.hostOverheadNs / 1000.0, 0, 'f', 3);
+    }
+    if (!std::isnan(r.hostAllocations)) {
+        fields << QString("\"hostAllocsPerBlock\": %1")
+            .arg(r.hostAllocations, 0, 'f', 2);
+    }
+
+    cout << "{ " << fields.join(", ").toStdString() << " }" << endl;
+}
+
+/**
+ * Wraps a plugin, timing and counting the allocations of each
+ * process() call. The wrapped plugin is owned by the shared_ptr it
+ * was given rather than by the PluginWrapper.
+ */
+class TimingPluginWrapper : public Vamp::HostExt::PluginWrapper
+{
+public:
+    TimingPluginWrapper(shared_ptr<Vamp::Plugin> plugin) :
+        PluginWrapper(plugin.get()),
+        m_allocations(0),
+        m_wrapped(plugin) { }
+
+    ~TimingPluginWrapper() override {
+        m_plugin = nullptr;
+    }
+
+    FeatureSet process(const float *const *inputBuffers,
+                       Vamp::RealTime timestamp) override {
+        long long allocations = allocationCount;
+        long long start = nowNs();
+        FeatureSet fs = m_plugin->process(inputBuffers, timestamp);
+        long long end = nowNs();
+        m_allocations += allocationCount - allocations;
+        m_blockNs.push_back(end - start); // reserved, so no allocation
+        return fs;
+    }
+
+    vector<long long> m_blockNs;
+    long long m_allocations;
+
+private:
+    shared_ptr<Vamp::Plugin> m_wrapped;
+};
+
+/**
+ * Wraps the installed feature extraction plugin factory, so that
+ * every plugin the transformers instantiate, including any used for
+ * segmented processing, comes wrapped in a TimingPluginWrapper.
+ */
+class TimingPluginFactory : public FeatureExtractionPluginFactory
+{
+public:
+    TimingPluginFactory(FeatureExtractionPluginFactory *factory) :
+        m_factory(factory),
+        m_expectedBlocks(0) { }
+
+    // Call only while no transformer is running
+    void reset(size_t expectedBlocks) {
+        QMutexLocker locker(&m_mutex);
+        m_expectedBlocks = expectedBlocks;
+        m_timings.clear();
+    }
+
+    // Call only once the transformer has finished. The wrappers
+    // remain valid after the transformer has released its plugins
+    vector<shared_ptr<TimingPluginWrapper>> getTimings() {
+        QMutexLocker locker(&m_mutex);
+        return m_timings;
+    }
+
+    vector<QString> getPluginIdentifiers(QString &errorMsg) override {
+        return m_factory->getPluginIdentifiers(errorMsg);
+    }
+
+    piper_vamp::PluginStaticData getPluginStaticData(QString ident) override {
+        return m_factory->getPluginStaticData(ident);
+    }
+
+    shared_ptr<Vamp::Plugin> instantiatePlugin(QString identifier,
+                                               sv_samplerate_t rate) override {
+        auto plugin = m_factory->instantiatePlugin(identifier, rate);
+        if (!plugin) return plugin;
+        QMutexLocker locker(&m_mutex);
+        auto timing = make_shared<TimingPluginWrapper>(plugin);
+        timing->m_blockNs.reserve(m_expectedBlocks);
+        m_timings.push_back(timing);
+        return timing;
+    }
+
+    QString getPluginCategory(QString identifier) override {
+        return m_factory->getPluginCategory(identifier);
+    }
+
+    QString getPluginLibraryPath(QString identifier) override {
+        return m_factory->getPluginLibraryPath(identifier);
+    }
+
+private:
+    FeatureExtractionPluginFactory *m_factory;
+    QMutex m_mutex;
+    size_t m_expectedBlocks;
+    vector<shared_ptr<TimingPluginWrapper>> m_timings;
+};
+
+static TimingPluginFactory *timingFactory = nullptr;
+
+/**
+ * A FeatureExtractionModelTransformer that exposes the transform it
+ * ended up using.
+ */
+class BenchFeatureExtractionTransformer :
+    public FeatureExtractionModelTransformer
+{
+public:
+    BenchFeatureExtractionTransformer(Input in, const Transform &t) :
+        FeatureExtractionModelTransformer(in, t) { }
+
+    // The transformer may have adjusted the block and step sizes to
+    // suit the plugin
+    Transform getTransform() const { return m_transforms[0]; }
+};
+
+static void
+releaseOutputs(ModelTransformer &transformer)
+{
+    for (auto id: transformer.getOutputModels()) {
+        ModelById::release(id);
+    }
+    for (auto id: transformer.getAdditionalOutputModels()) {
+        ModelById::release(id);
+    }
+}
+
+static QString
+getVampHostName()
+{
+#ifdef HAVE_PIPER
+    if (!Preferences::getInstance()->getRunPluginsInProcess()) {
+        return "piper";
+    }
+#endif
+    return "native";
+}
+
+static void
+benchFeatureExtraction(ModelId input, TransformId id, int blockSize)
+{
+    auto model = ModelById::getAs<DenseTimeValueModel>(input);
+    if (!model) return;
+
+    TransformFactory *tf = TransformFactory::getInstance();
+
+    Transform t = tf->getDefaultTransformFor(id, model->getSampleRate());
+    t.setBlockSize(blockSize);
+    if (tf->getTransformInputDomain(id) == Vamp::Plugin::FrequencyDomain) {
+        t.setStepSize(blockSize / 2);
+    } else {
+        t.setStepSize(blockSize);
+    }
+
+    sv_frame_t frames = model->getEndFrame();
+    size_t expectedBlocks = size_t(frames / t.getStepSize() + 16);
+
+    timingFactory->reset(expectedBlocks);
+
+    BenchFeatureExtractionTransformer transformer
+        (ModelTransformer::Input(input), t);
+
+    long long allocations = allocationCount;
+    long long start = nowNs();
+
+    transformer.start();
+    transformer.wait();
+
+    auto timings = timingFactory->getTimings();
+    if (timings.empty()) {
+        SVCERR << "Failed to set up transformer for " << id << ": "
+               << transformer.getMessage() << endl;
+        releaseOutputs(transformer);
+        return;
+    }
+
+    Result r;
+    r.elapsedNs = nowNs() - start;
+    r.allocations = allocationCount - allocations;
+    r.benchmark = "feature-extraction-transformer";
+    r.host = getVampHostName();
+    r.transform = id;
+    r.channels = model->getChannelCount();
+    r.blockSize = transformer.getTransform().getBlockSize();
+    r.stepSize = transformer.getTransform().getStepSize();
+    long long pluginAllocations = 0;
+    int instancesUsed = 0;
+    for (const auto &timing: timings) {
+        if (!timing->m_blockNs.empty()) ++instancesUsed;
+        r.blockNs.insert(r.blockNs.end(),
+                         timing->m_blockNs.begin(), timing->m_blockNs.end());
+        pluginAllocations += timing->m_allocations;
+    }
+    r.blocks = (long long)r.blockNs.size();
+
+    // Plugin times from several instances running at once, as in
+    // segmented processing, overlap and can't be subtracted from the
+    // elapsed time
+    if (r.blocks > 0 && instancesUsed == 1) {
+        long long pluginNs = 0;
+        for (auto ns: r.blockNs) pluginNs += ns;
+        r.hostOverheadNs = double(r.elapsedNs - pluginNs) / double(r.blocks);
+        r.hostAllocations = double(r.allocations - pluginAllocations) /
+            double(r.blocks);
+    }
+
+    report(r);
+    releaseOutputs(transformer);
+}
+
+static double
+benchRealTimeRun(ModelId input, TransformId id, int blockSize)
+{
+    // Returns the mean time per block in ns, or -1 on failure
+
+    auto model = ModelById::getAs<DenseTimeValueModel>(input);
+    if (!model) return -1.0;
+
+    Transform t;
+    t.setIdentifier(id);
+    QString pluginId = t.getPluginIdentifier();
+    int channels = model->getChannelCount();
+
+    RealTimePluginFactory *factory =
+        RealTimePluginFactory::instanceFor(pluginId);
+    if (!factory) return -1.0;
+
+    auto plugin = factory->instantiatePlugin
+        (pluginId, 0, 0, model->getSampleRate(), blockSize, channels);
+    if (!plugin) {
+        SVCERR << "Failed to instantiate " << pluginId << endl;
+        return -1.0;
+    }
+
+    sv_frame_t frames = model->getEndFrame();
+    auto data = model->getMultiChannelData(0, channels - 1, 0, frames);
+    if (int(data.size()) < channels) return -1.0;
+    frames = min(frames, sv_frame_t(data[0].size()));
+
+    int inputs = plugin->getAudioInputCount();
+    RealTimePluginInstance::sample_t **buffers =
+        plugin->getAudioInputBuffers();
+
+    Result r;
+    r.blockNs.reserve(size_t(frames / blockSize + 1));
+
+    for (sv_frame_t f = 0; f < frames; f += blockSize) {
+
+        sv_frame_t n = min(sv_frame_t(blockSize), frames - f);
+        for (int i = 0; i < inputs; ++i) {
+            const floatvec_t &d = data[i % channels];
+            copy(d.begin() + f, d.begin() + f + n, buffers[i]);
+            fill(buffers[i] + n, buffers[i] + blockSize, 0.f);
+        }
+
+        RealTime rt = RealTime::frame2RealTime(f, model->getSampleRate());
+        long long allocations = allocationCount;
+        long long start = nowNs();
+        plugin->run(rt, blockSize);
+        long long end = nowNs();
+        r.allocations += allocationCount - allocations;
+        r.elapsedNs += end - start;
+        r.blockNs.push_back(end - start);
+    }
+
+    r.benchmark = "real-time-run";
+    r.host = pluginId.section(':', 0, 0);
+    r.transform = id;
+    r.channels = channels;
+    r.blockSize = blockSize;
+    r.stepSize = blockSize;
+    r.blocks = (long long)r.blockNs.size();
+
+    report(r);
+
+    if (r.blocks == 0) return -1.0;
+    return double(r.elapsedNs) / double(r.blocks);
+}
+
+static void
+benchRealTimeTransformer(ModelId input, TransformId id, int blockSize,
+                         double pluginNsPerBlock)
+{
+    auto model = ModelById::getAs<DenseTimeValueModel>(input);
+    if (!model) return;
+
+    Transform t = TransformFactory::getInstance()->getDefaultTransformFor
+        (id, model->getSampleRate());
+    t.setBlockSize(blockSize);
+
+    RealTimeEffectModelTransformer transformer
+        (ModelTransformer::Input(input), t);
+
+    if (transformer.getOutputModels().empty()) {
+        SVCERR << "Failed to set up transformer for " << id << ": "
+               << transformer.getMessage() << endl;
+        return;
+    }
+
+    long long allocations = allocationCount;
+    long long start = nowNs();
+
+    transformer.start();
+    transformer.wait();
+
+    Result r;
+    r.elapsedNs = nowNs() - start;
+    r.allocations = allocationCount - allocations;
+    r.benchmark = "real-time-effect-transformer";
+    r.host = t.getPluginIdentifier().section(':', 0, 0);
+    r.transform = id;
+    r.channels = model->getChannelCount();
+    r.blockSize = blockSize;
+    r.stepSize = blockSize;
+    r.blocks = (model->getEndFrame() + blockSize - 1) / blockSize;
+
+    if (r.blocks > 0 && pluginNsPerBlock >= 0.0) {
+        r.hostOverheadNs = double(r.elapsedNs) / double(r.blocks)
+            - pluginNsPerBlock;
+    }
+
+    report(r);
+    releaseOutputs(transformer);
+}
+
+static ModelId
+makeSyntheticInput(sv_samplerate_t rate, int channels, double seconds)
+{
+    // A tone per channel, with some noise
+
+    auto model = make_shared<WritableWaveFileModel>(rate, channels);
+    if (!model->isOK()) return {};
+
+    sv_frame_t frames = sv_frame_t(round(rate * seconds));
+    const sv_frame_t chunk = 65536;
+
+    vector<floatvec_t> data(channels, floatvec_t(chunk, 0.f));
+    vector<float *> ptrs;
+    for (auto &d: data) ptrs.push_back(d.data());
+
+    mt19937 rng(0);
+    uniform_real_distribution<float> noise(-0.1f, 0.1f);
+
+    for (sv_frame_t f = 0; f < frames; f += chunk) {
+        sv_frame_t n = min(chunk, frames - f);
+        for (int c = 0; c < channels; ++c) {
+            double freq = 220.0 * (c + 1);
+            for (sv_frame_t i = 0; i < n; ++i) {
+                data[c][i] = float(0.5 * sin(2.0 * M_PI * freq *
+                                             double(f + i) / rate))
+                    + noise(rng);
+            }
+        }
+        model->addSamples(ptrs.data(), n);
+    }
+
+    model->writeComplete();
+    return ModelById::add(model);
+}
+
+static ModelId
+makeFileInput(QString path)
+{
+    auto model = make_shared<ReadOnlyWaveFileModel>(FileSource(path));
+    if (!model->isOK()) return {};
+    while (!model->isReady()) {
+        QThread::msleep(100);
+    }
+    return ModelById::add(model);
+}
+
+static QStringList
+getDefaultTransforms()
+{
+    TransformFactory *tf = TransformFactory::getInstance();
+
+    QStringList ids;
+    for (auto id: {
+            "vamp:vamp-example-plugins:zerocrossing:counts",
+            "vamp:vamp-example-plugins:spectralcentroid:logcentroid",
+            "vamp:vamp-example-plugins:percussiononsets:onsets"
+        }) {
+        if (tf->haveTransform(id)) ids << id;
+    }
+
+    // and the first LADSPA and DSSI effects with audio output
+    for (auto type: { "ladspa", "dssi" }) {
+        for (const auto &desc: tf->getInstalledTransformDescriptions()) {
+            if (desc.identifier.startsWith(QString(type) + ":") &&
+                desc.identifier.endsWith(":A")) {
+                ids << desc.identifier;
+                break;
+            }
+        }
+    }
+
+    return ids;
+}
+
+static void
+usage(QString name)
+{
+    cerr << "Usage: " << name.toStdString()
+         << " [options] [transform-id ...]\n\n"
+         << "Options:\n"
+         << "  --in-process        Load Vamp plugins in process rather than through Piper\n"
+         << "  --audio <file>      Process this audio file instead of synthetic audio\n"
+         << "  --seconds <n>       Duration of synthetic audio (default 30)\n"
+         << "  --channels <n>      Channel count of synthetic audio (default 1)\n"
+         << "  --rate <n>          Sample rate of synthetic audio (default 44100)\n"
+         << "  --block-sizes <list> Comma-separated block sizes (default 256,1024,4096)\n\n"
+         << "If no transform ids are given, some Vamp example plugin transforms and\n"
+         << "the first installed LADSPA and DSSI effects are used, where available.\n"
+         << "Results are written to stdout as one JSON object per line." << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    svSystemSpecificInitialisation();
+
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName("sonic-visualiser");
+    app.setApplicationName("svcore-transform-bench");
+
+    QStringList args = app.arguments();
+    QString name = args.takeFirst();
+
+    bool inProcess = false;
+    QString audioPath;
+    double seconds = 30.0;
+    int channels = 1;
+    sv_samplerate_t rate = 44100.0;
+    vector<int> blockSizes { 256, 1024, 4096 };
+    QStringList transforms;
+
+    while (!args.empty()) {
+        QString arg = args.takeFirst();
+        if (arg == "--help" || arg == "-h") {
+            usage(name);
+            return 0;
+        } else if (arg == "--in-process") {
+            inProcess = true;
+        } else if (arg.startsWith("--")) {
+            if (args.empty()) {
+                usage(name);
+                return 2;
+            }
+            QString value = args.takeFirst();
+            if (arg == "--audio") {
+                audioPath = value;
+            } else if (arg == "--seconds") {
+                seconds = value.toDouble();
+            } else if (arg == "--channels") {
+                channels = value.toInt();
+            } else if (arg == "--rate") {
+                rate = value.toDouble();
+            } else if (arg == "--block-sizes") {
+                blockSizes.clear();
+                for (auto s: value.split(",")) blockSizes.push_back(s.toInt());
+            } else {
+                usage(name);
+                return 2;
+            }
+        } else {
+            transforms << arg;
+        }
+    }
+
+    if (seconds <= 0.0 || channels < 1 || rate <= 0.0 ||
+        find_if(blockSizes.begin(), blockSizes.end(),
+                [](int b) { return b < 2; }) != blockSizes.end()) {
+        usage(name);
+        return 2;
+    }
+
+    // Must precede any use of the plugin factories
+    Preferences::getInstance()->setRunPluginsInProcess(inProcess);
+
+    FeatureExtractionPluginFactory *installed =
+        FeatureExtractionPluginFactory::instance();
+    TimingPluginFactory factory(installed);
+    FeatureExtractionPluginFactory::setInstance(&factory);
+    timingFactory = &factory;
+
+    TransformFactory *tf = TransformFactory::getInstance();
+
+    if (transforms.empty()) {
+        transforms = getDefaultTransforms();
+    }
+    if (transforms.empty()) {
+        SVCERR << "No transforms to benchmark (none of the default plugins is installed)" << endl;
+        return 1;
+    }
+
+    ModelId input = (audioPath != "" ?
+                     makeFileInput(audioPath) :
+                     makeSyntheticInput(rate, channels, seconds));
+    if (input.isNone()) {
+        SVCERR << "Failed to create input model" << endl;
+        return 1;
+    }
+
+    int failed = 0;
+
+    for (auto id: transforms) {
+
+        if (!tf->haveTransform(id)) {
+            SVCERR << "Transform " << id << " is not installed" << endl;
+            ++failed;
+            continue;
+        }
+
+        Transform t;
+        t.setIdentifier(id);
+
+        for (int blockSize: blockSizes) {
+            if (t.getType() == Transform::FeatureExtraction) {
+                benchFeatureExtraction(input, id, blockSize);
+            } else if (t.getType() == Transform::RealTimeEffect) {
+                double ns = benchRealTimeRun(input, id, blockSize);
+                benchRealTimeTransformer(input, id, blockSize, ns);
+            } else {
+                SVCERR << "Transform " << id << " is of unknown type" << endl;
+                ++failed;
+                break;
+            }
+        }
+    }
+
+    ModelById::release(input);
+
+    FeatureExtractionPluginFactory::setInstance(installed);
+    timingFactory = nullptr;
+
+    return failed > 0 ? 1 : 0;
+}